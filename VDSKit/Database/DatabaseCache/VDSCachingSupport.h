@@ -22,3 +22,7 @@ FOUNDATION_EXPORT const unsigned char VDSCachingSupportVersionString[];
 #import "VDSMutableDatabaseCacheConfiguration.h"
 #import "VDSExpirableObject.h"
 #import "VDSMergeableObject.h"
+#import "VDSCostableObject.h"
+#import "VDSDatabaseCacheSerializer.h"
+#import "VDSDatabaseCacheDiskTier.h"
+#import "VDSDatabaseCacheMemoryMonitor.h"
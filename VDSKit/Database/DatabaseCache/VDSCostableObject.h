@@ -0,0 +1,34 @@
+//
+//  VDSCostableObject.h
+//  VDSKit
+//
+//  Created by Erikheath Thomas on 6/6/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+
+/// @summary The VDSCostableObject protocol provides a mechanism for objects
+/// stored in a VDSDatabaseCache to report the cost of keeping them in the
+/// cache, typically their size in bytes.
+///
+/// @discussion When an object is added to the cache without an explicit cost,
+/// the cache asks the object for its cost using cacheCost. Objects that do not
+/// conform to the protocol have a cost of 0 unless a cost is passed explicitly.
+///
+/// The cost is requested each time the object is set, and after an update has
+/// been merged into a cached VDSMergeableObject, so the reported cost should
+/// reflect the current contents of the object. The cost must not change while
+/// the object is in the cache unless the object is set again.
+///
+@protocol VDSCostableObject <NSObject>
+
+@required
+
+/// @summary The cost of keeping receiver in a cache, typically its size in bytes.
+///
+- (NSUInteger)cacheCost;
+
+
+@end
@@ -7,6 +7,7 @@
 //
 
 #import <Foundation/Foundation.h>
+#import "../../VDSConstants.h"
 
 
 @class VDSDatabaseCache;
@@ -14,6 +15,22 @@
 @class VDSExpirableObject;
 @protocol VDSDatabaseCacheDelegate;
 @protocol VDSMergableObject;
+@protocol VDSCostableObject;
+@protocol VDSDatabaseCacheSerializer;
+@class VDSDatabaseCacheDiskTier;
+@class VDSOperationQueue;
+
+
+/// @summary The block that receives the result of a load. Pass the loaded object, or nil with an
+/// error if the load failed. Passing nil without an error indicates that no object exists for the key.
+///
+typedef void (^VDSDatabaseCacheLoadCompletion)(id _Nullable object, NSError* _Nullable error);
+
+
+/// @summary A block that loads the object for a key from its source, such as a database or web
+/// service, and passes the result to completion, which must be called exactly once.
+///
+typedef void (^VDSDatabaseCacheLoader)(id _Nonnull key, VDSDatabaseCacheLoadCompletion _Nonnull completion);
 
 
 
@@ -28,9 +45,15 @@
 /// safely subclassed, or may be used as a backing class for a facade that limits direct cache storage
 /// manipulation to facade internals.
 ///
-/// @discussion VDSDatabaseCache supports fast enumeration over the contents contained in its cachedObjects
+/// @discussion VDSDatabaseCache supports fast enumeration over the keys of its cached objects. An enumeration
+/// visits the keys as they were when it started, so the cache may be changed while it is enumerated, including
+/// by eviction cycles, and the enumeration never raises a mutation exception. Starting an enumeration takes a
+/// snapshot of the keys of every shard at the same point in time, without copying them, so it takes time in
+/// proportion to the number of shards rather than the number of keys, and writers never wait for it to finish.
 /// To enumerate only those items that are tracked, use either trackedObjectsAndKeys, trackedKeys, or trackedObjects.
 /// To enumerate over the items that are not tracked, use untrackedObjectsAndKeys, untrackedKeys, or untrackedObjects.
+/// The block based enumerators, such as enumerateTrackedKeysAndObjectsUsingBlock:, visit either partition
+/// without copying it.
 ///
 /// The cache also supports archiving of untracked objects when archivesUntrackedObjects is set to YES. To
 /// archive tracked objects, create a subclass of VDSDatabaseCache and override initWithCoder: and
@@ -42,8 +65,26 @@
 /// make sure to use the setObject:forKey:tracked method to add the objects to the cachedObjects internal
 /// tracking system. Otherwise the formerly tracked objects will become untracked.
 ///
-/// The cache is designed to provide constant time adding and accessing of objects O(1). Removal of a cached object
-/// is accomplished in O(logN). The eviction cycle will take longer due to sorting O(N*logN).
+/// The cache is designed to provide constant time adding, accessing, and removal of objects O(1). Each key is
+/// stored in a single slab allocated entry that is linked directly into the tracking orders, so tracking an
+/// object does not require additional allocations. Expirations are kept in an indexed binary heap, so scheduling
+/// an expiration costs O(logN) and the eviction cycle only visits objects that have expired, O(K*logN) for K
+/// expired objects.
+///
+/// When the configuration specifies a shardCount greater than 1, the keyspace is divided between independent
+/// shards selected by key hash, each with its own storage, tracking orders, and lock. Accessors for a single key
+/// only lock the shard that holds the key, and the eviction cycle processes one shard at a time, so concurrent
+/// readers of other shards are never blocked by an eviction sweep. Tracked objects are ordered by recency within
+/// each shard.
+///
+/// Each object may have a cost, typically its size in bytes, that is either passed when the object is set
+/// or provided by objects that conform to VDSCostableObject. The cache keeps a running total of the costs,
+/// and the eviction cycle evicts tracked objects until both preferredMaxObjectCount and preferredMaxTotalCost
+/// are satisfied, which bounds the memory used by the cache when object sizes vary widely.
+///
+/// For read heavy workloads, setting usesLockFreeReads in the configuration allows objectForKey: to run without
+/// acquiring any lock. Lookups are validated against a per shard sequence counter and retried if they overlap a
+/// write, while removed and replaced objects are kept alive until no reader can observe them.
 ///
 /// @note Archiving tracked objects can become complicated when expiration is determined by an external
 /// source, such as a remote store or web service. In these instances, it is genrally a good idea to rerequest
@@ -67,6 +108,14 @@
 @property(weak, readwrite, nullable) id<VDSDatabaseCacheDelegate> delegate;
 
 
+/// @summary The queue that delivers databaseCache:didEvictObjects:usingKeys:inEvictionCycle: to the
+/// delegate, or nil to deliver it on a global dispatch queue. The message is always delivered after
+/// the cache has released its locks, so a delegate that writes evicted objects elsewhere does not
+/// delay readers of the cache.
+///
+@property(strong, readwrite, nullable) VDSOperationQueue* delegateQueue;
+
+
 
 #pragma mark Cache Configuration
 
@@ -83,6 +132,22 @@
 @property(readwrite, atomic) NSTimeInterval defaultExpirationInterval;
 
 
+/// @summary The block that objectForKey: and objectsForKeys:notFoundMarker: use to refresh a stale
+/// object, or nil to leave stale objects as they are until they expire.
+///
+/// @discussion Only used when the configuration has a refresh interval. A refresh of a key is not
+/// started while a load of the key is in flight, and a refreshed object is stored as a tracked object
+/// with new deadlines. A refresh that fails leaves the stale object in the cache.
+///
+@property(copy, readwrite, nullable) VDSDatabaseCacheLoader refreshLoader;
+
+
+/// @summary The queue that runs refreshes started by objectForKey: and objectsForKeys:notFoundMarker:,
+/// or nil to call the refresh loader on a global dispatch queue.
+///
+@property(strong, readwrite, nullable) VDSOperationQueue* refreshQueue;
+
+
 
 #pragma mark Object Lifecycle
 
@@ -119,12 +184,14 @@
 /// process works. For more information, refer to the class documentation for
 /// VDSEvictionOperation.
 ///
-/// This method is triggered by the evictionLoop timer periodically according to the evictionInterval
-/// property.
+/// The cache no longer uses a timer of its own. Eviction cycles are run by the shared
+/// VDSDatabaseCacheEvictionScheduler when the earliest expiration in the cache passes, and at
+/// least once per evictionInterval. This method remains for callers that trigger a cycle from
+/// a timer of their own.
 ///
-/// @param timer The timer that triggered the execution of the method.
+/// @param timer The timer that triggered the execution of the method, if any.
 ///
-- (void)processEvictions:(NSTimer* _Nonnull)timer;
+- (void)processEvictions:(NSTimer* _Nullable)timer;
 
 
 /// @summary Attempts to evict objects from the cache that meet the eviction criteria
@@ -143,9 +210,215 @@
 /// If the object has not expired but has no users, then the object will be removed if
 /// the cache exceeds the max object count. Otherwise, the object will be left in the cache.
 ///
+/// When the configuration sets an evictionBatchSize or evictionTimeSlice, the cycle releases each
+/// shard's lock whenever it reaches either bound and resumes once it has reacquired it, so accessors
+/// wait for at most a single slice rather than the whole cycle.
+///
+/// The shards of a sharded cache are processed in parallel by up to evictionConcurrency threads, and
+/// the method returns once every shard has been processed.
+///
+/// A delegate that implements databaseCacheShouldBeginEvictionCycle may decline the cycle. When the
+/// delegate implements any of the messages about evicted objects, the objects the cycle selects are
+/// marked as pending eviction but remain in the cache until every lock has been released. Pending
+/// objects can still be read and have their usage counts changed, but are neither tracked nor
+/// untracked, so they are left out of every collection, count, enumeration, and archive of the cache.
+/// The delegate is then consulted about them in a single batch, the objects it approves are removed,
+/// and the rest are tracked again. An object that is stored or removed while it is pending, or whose
+/// usage count rises, is not evicted.
+///
 - (void)processCacheEvictions;
 
 
+/// @summary Sheds tracked objects to relieve memory pressure, in the order determined by the
+/// eviction policy.
+///
+/// @discussion A warning sheds a quarter of the tracked objects in each shard, an urgent level sheds
+/// half, and a critical level sheds every tracked object that is evictable. Objects that are in use
+/// are not shed, and untracked objects are never shed. Shed objects are demoted to the disk tier if
+/// the cache has one, and are counted by the VDSCacheLowMemoryEvictionCountKey metric. The delegate
+/// is notified of the cycle with the VDSLowMemoryCycleKey.
+///
+/// When the configuration sets evictsOnLowMemory, the cache registers with the shared
+/// VDSDatabaseCacheMemoryMonitor, which sends this message as memory pressure rises. It may also be
+/// called directly in response to a memory warning of the application's own.
+///
+/// @param level The memory pressure level. VDSMemoryPressureNormal sheds nothing.
+///
+- (void)evictObjectsForMemoryPressure:(VDSMemoryPressureLevel)level;
+
+
+#pragma mark Metrics
+
+/// @summary Returns a snapshot of the cache's activity since it was created or since resetMetrics
+/// was last called.
+///
+/// @discussion The snapshot holds the number of lookups, hits, hits on stale objects, misses, inserts,
+/// merges, unchanged merges that were skipped, and replacements, the number of evictions broken down by cause, the number and total duration of
+/// eviction cycles along with the duration of the most recent cycle, the total time threads waited
+/// for the cache's locks, and the peak number of objects held. Each value is keyed by a
+/// VDSCacheMetricKey.
+///
+/// The counters are maintained with relaxed atomic operations in each shard, so recording them adds
+/// no locking to any accessor. Values recorded concurrently with the snapshot may or may not be
+/// included. The peak object count is kept for the cache as a whole, so when the cache is sharded it is
+/// the largest number of objects held by all of the shards at one time.
+///
+/// @returns A dictionary of NSNumbers keyed by VDSCacheMetricKey.
+///
+- (NSDictionary<NSString*, NSNumber*>* _Nonnull)metrics;
+
+
+/// @summary Sets every metric to zero.
+///
+- (void)resetMetrics;
+
+
+#pragma mark Snapshot Behaviors
+
+/// @summary Writes the full state of the cache to a file, so that a later instance can start
+/// with the same contents by loading it.
+///
+/// @discussion Unlike encodeWithCoder:, which only archives the configuration and optionally the
+/// untracked objects, a snapshot holds every key and object along with the tracking state of each
+/// tracked entry: its expiration as an absolute date, its usage count, its cost, and its place in
+/// the recency order of the eviction policy.
+///
+/// The snapshot is a compact, versioned binary format written with a single sequential pass
+/// through a buffer. Each shard is locked only long enough to collect its entries, and the entries
+/// are serialized after the lock is released, so accessors are not blocked while the snapshot is
+/// written. Because shards are collected one after another, changes made to the cache while the
+/// snapshot is being written may or may not be included. The snapshot is written to a temporary file
+/// that replaces the destination once it is complete.
+///
+/// @param url The file URL to write the snapshot to.
+///
+/// @param serializer The serializer used to convert keys and objects to data, or nil to use a
+/// VDSDatabaseCacheStandardSerializer. Entries that the serializer can not convert are left out.
+///
+/// @param error On failure, set to an error with the code VDSCacheSnapshotWriteFailed.
+///
+/// @returns YES if the snapshot was written, otherwise NO.
+///
+- (BOOL)writeSnapshotToURL:(NSURL* _Nonnull)url
+                serializer:(id<VDSDatabaseCacheSerializer> _Nullable)serializer
+                     error:(NSError* _Nullable __autoreleasing * _Nullable)error;
+
+
+/// @summary Adds the contents of a snapshot written by writeSnapshotToURL:serializer:error: to the cache.
+///
+/// @discussion Entries are grouped by shard and inserted in bulk, taking each shard's lock once.
+/// Objects in the snapshot replace objects in the cache with the same key. Tracked entries that have
+/// expired by the time the snapshot is loaded are skipped. Expirations, usage counts, costs, and the
+/// recency order are restored as they were written. Entries keep their recency segments when the
+/// snapshot was written by a cache with the same eviction policy, and otherwise are ordered within
+/// the first segment.
+///
+/// If the cache does not expire objects, tracked entries are loaded as untracked objects.
+///
+/// @param url The file URL of the snapshot.
+///
+/// @param serializer The serializer used to convert data back to keys and objects, or nil to use a
+/// VDSDatabaseCacheStandardSerializer. Entries that the serializer can not convert are skipped.
+///
+/// @param error On failure, set to an error with the code VDSCacheSnapshotReadFailed.
+///
+/// @returns YES if the snapshot was loaded. On failure the cache is unchanged.
+///
+- (BOOL)loadSnapshotFromURL:(NSURL* _Nonnull)url
+                 serializer:(id<VDSDatabaseCacheSerializer> _Nullable)serializer
+                      error:(NSError* _Nullable __autoreleasing * _Nullable)error;
+
+
+#pragma mark Disk Tier
+
+/// @summary A secondary tier on local disk that holds the objects the cache evicts, or nil if
+/// evicted objects are discarded. The default value is nil.
+///
+/// @discussion Tracked objects that an eviction cycle, or an inline eviction, removes to meet the
+/// preferred max object count or total cost are demoted to the disk tier along with their expiration
+/// and cost. Objects that are removed because they expired, or that are removed explicitly, are not.
+/// Demoted objects are collected while a shard is locked and written to the disk tier once it has
+/// been unlocked, so the lock is not held while objects are serialized.
+///
+/// When objectForKey: or objectsForKeys:notFoundMarker: misses, the disk tier is probed, and an object found there is deserialized and
+/// promoted back to the cache as a tracked object with the expiration and cost it was demoted with.
+/// Storing or removing an object for a key also removes any object the disk tier holds for it.
+///
+/// A disk tier should only be used by one cache at a time.
+///
+@property(strong, readwrite, nullable) VDSDatabaseCacheDiskTier* diskTier;
+
+
+#pragma mark Loading Behaviors
+
+/// @summary Retrieves an object from the cache, loading it with loader if the cache does not hold it.
+///
+/// @discussion Concurrent requests for a key that is being loaded wait for the load in flight rather
+/// than starting one of their own, so a key that expires while it is in demand is loaded once rather
+/// than once per caller. A loaded object is stored once, as a tracked object with the expiration the
+/// cache determines for it, before any waiting completion is called.
+///
+/// The loader is called on the thread of the request that starts the load. Completions are called on
+/// the thread that the loader calls its completion on, or on the calling thread if the object is
+/// already cached.
+///
+/// When the configuration has a refresh interval, a stale object is passed to the completion at once,
+/// and loader is called on a global dispatch queue to refresh it if no load of the key is in flight.
+/// An object that has reached its expiration is treated as a miss.
+///
+/// @param key A key used to store an object in the cache.
+///
+/// @param loader The block that loads the object if the cache does not hold it. Ignored if a load of
+/// the key is already in flight.
+///
+/// @param completion The block that receives the object, or the error of the load.
+///
+- (void)objectForKey:(id _Nonnull)key
+              loader:(VDSDatabaseCacheLoader _Nonnull)loader
+          completion:(VDSDatabaseCacheLoadCompletion _Nonnull)completion;
+
+
+/// @summary Retrieves an object from the cache, loading it with loader in an operation on queue if
+/// the cache does not hold it.
+///
+/// @discussion Behaves as objectForKey:loader:completion:, except that a load is run by a
+/// VDSBlockOperation added to queue. If the operation is cancelled before the loader completes, every
+/// waiting completion receives an error with the code VDSCacheLoadCancelled.
+///
+/// @param key A key used to store an object in the cache.
+///
+/// @param loader The block that loads the object if the cache does not hold it.
+///
+/// @param queue The queue that runs the load, or nil to call the loader on the calling thread.
+///
+/// @param completion The block that receives the object, or the error of the load.
+///
+- (void)objectForKey:(id _Nonnull)key
+              loader:(VDSDatabaseCacheLoader _Nonnull)loader
+               queue:(VDSOperationQueue* _Nullable)queue
+          completion:(VDSDatabaseCacheLoadCompletion _Nonnull)completion;
+
+
+/// @summary Retrieves an object from the cache, loading it with loader if the cache does not hold
+/// it, and waits for the load to complete.
+///
+/// @discussion Behaves as objectForKey:loader:completion:, blocking the calling thread until the
+/// object is available. The loader must not call its completion on the calling thread's serial queue,
+/// such as the main queue when called from the main thread, or the call will never return.
+///
+/// @param key A key used to store an object in the cache.
+///
+/// @param loader The block that loads the object if the cache does not hold it.
+///
+/// @param error On failure, set to the error of the load.
+///
+/// @returns The object, or nil if the load failed or found no object.
+///
+- (id _Nullable)objectForKey:(id _Nonnull)key
+                      loader:(VDSDatabaseCacheLoader _Nonnull)loader
+                       error:(NSError* _Nullable __autoreleasing * _Nullable)error;
+
+
 #pragma mark Usage Count Behaviors
 
 /// @summary Increments the usage counter for the object associated with the key.
@@ -225,6 +498,63 @@
           expires:(NSDate* _Nullable)expiration;
 
 
+/// @summary Adds an object to the cache with an explicit cost, optionally tracks, and if
+/// necessary evicts an existing object according to the cache configuration.
+///
+/// @discussion The cost is counted toward totalCost and, for tracked objects, toward the
+/// preferredMaxTotalCost of the configuration. When an object is added using any of the other
+/// setters, its cost is provided by the object if it conforms to VDSCostableObject, and is 0
+/// otherwise. If the update is merged into an existing object, cost replaces the cost of the
+/// existing object.
+///
+/// @param object A nonnull object to be tracked by the cache.
+///
+/// @param key A nonnull unique key that should be associated with the object
+/// being tracked. If the key already exists in the cache, the new object is treated as
+/// an update and the values of the new object are either merged with the existing object
+/// or the object is replaced by the new object according to the cache configuration.
+///
+/// @param tracked YES if the object should be tracked, NO otherwise.
+///
+/// @param expiration An optional NSDate indicating when the object should be considered expired and
+/// made available for eviction.
+///
+/// @param cost The cost of keeping the object in the cache, typically its size in bytes.
+///
+- (void)setObject:(id _Nonnull)object
+           forKey:(id _Nonnull)key
+          tracked:(BOOL)tracked
+          expires:(NSDate* _Nullable)expiration
+             cost:(NSUInteger)cost;
+
+
+/// @summary Adds a batch of objects to the cache, optionally tracks them, and if necessary evicts
+/// existing objects according to the cache configuration.
+///
+/// @discussion Each object is stored exactly as if setObject:forKey:tracked:expires: had been called
+/// for it, but the keys are hashed once, each shard is locked once, storage is sized for the batch
+/// up front, and expirations that do not depend on the objects are calculated once. Use this method to
+/// load large result sets.
+///
+/// @param objects The objects to store.
+///
+/// @param keys The keys for the objects. The object at each index of objects is stored using the key
+/// at the same index.
+///
+/// @param tracked YES if the objects should be tracked, NO otherwise.
+///
+/// @param expiration An optional NSDate indicating when the objects should be considered expired and
+/// made available for eviction.
+///
+/// @throws If the NS_BLOCK_ASSERTIONS macro is not defined, will throw
+/// NSInternalInconsistency exception if objects and keys have different counts.
+///
+- (void)setObjects:(NSArray* _Nonnull)objects
+           forKeys:(NSArray* _Nonnull)keys
+           tracked:(BOOL)tracked
+           expires:(NSDate* _Nullable)expiration;
+
+
 /// @summary Removes an object from the cache.
 ///
 /// @note This method removes an object in constant time.
@@ -234,6 +564,14 @@
 - (void)removeObjectForKey:(id _Nonnull)key;
 
 
+/// @summary Removes a batch of objects from the cache, locking each shard once.
+///
+/// @param keys The unique keys associated with the objects in the cache. Keys that are not
+/// in the cache are ignored.
+///
+- (void)removeObjectsForKeys:(NSArray* _Nonnull)keys;
+
+
 /// @summary Clears all objects in the cache.
 ///
 - (void)removeAllObjects;
@@ -243,6 +581,10 @@
 
 /// @summary Retrieves an object from the cache if it exists. Returns nil otherwise.
 ///
+/// @discussion When the configuration has a refresh interval, a stale object is returned and a
+/// refresh of it is started with the refreshLoader, and an object that has reached its expiration is
+/// not returned.
+///
 /// @param key A key used to store an object in the cache.
 ///
 /// @returns An object if found, otherwise nil.
@@ -250,6 +592,26 @@
 - (id _Nullable)objectForKey:(id _Nonnull)key;
 
 
+/// @summary Retrieves a batch of objects from the cache, locking each shard once.
+///
+/// @param keys Keys used to store objects in the cache.
+///
+/// @param marker The object returned for keys that are not in the cache.
+///
+/// @returns An array containing the object for each key, in the same order as keys, with
+/// marker in place of any object that was not found.
+///
+- (NSArray* _Nonnull)objectsForKeys:(NSArray* _Nonnull)keys notFoundMarker:(id _Nonnull)marker;
+
+
+/// @summary The sum of the costs of all cached objects, tracked and untracked.
+///
+/// @discussion Only tracked objects are evicted, so untracked objects count toward the total
+/// cost but not toward the preferredMaxTotalCost of the configuration.
+///
+@property(readonly) NSUInteger totalCost;
+
+
 /// @summary Returns all cached objects.
 ///
 /// @returns A NSArray containing any cached objects. If no cached objects
@@ -318,5 +680,36 @@
 /// exist, the array is empty.
 - (NSDictionary* _Nonnull)untrackedObjectsAndKeys;
 
+
+/// @summary Calls a block with each cached object and its key, without copying them into a collection.
+///
+/// @discussion The cache is locked while the enumeration runs, so the block sees a consistent view of
+/// the cache. Other threads can read and write the cache again once the enumeration completes. The block
+/// must not add, remove, or retrack objects of the cache.
+///
+/// @param block The block to call with each key and object. Set stop to YES to end the enumeration.
+///
+- (void)enumerateKeysAndObjectsUsingBlock:(void (^ _Nonnull)(id _Nonnull key, id _Nonnull object, BOOL* _Nonnull stop))block;
+
+
+/// @summary Calls a block with each tracked object and its key, without copying them into a collection.
+///
+/// @discussion Behaves as enumerateKeysAndObjectsUsingBlock:, visiting only the tracked objects.
+/// Untracked objects are not visited, so the enumeration costs time in proportion to the number of tracked objects.
+///
+/// @param block The block to call with each key and object. Set stop to YES to end the enumeration.
+///
+- (void)enumerateTrackedKeysAndObjectsUsingBlock:(void (^ _Nonnull)(id _Nonnull key, id _Nonnull object, BOOL* _Nonnull stop))block;
+
+
+/// @summary Calls a block with each untracked object and its key, without copying them into a collection.
+///
+/// @discussion Behaves as enumerateKeysAndObjectsUsingBlock:, visiting only the untracked objects.
+/// Tracked objects are not visited, so the enumeration costs time in proportion to the number of untracked objects.
+///
+/// @param block The block to call with each key and object. Set stop to YES to end the enumeration.
+///
+- (void)enumerateUntrackedKeysAndObjectsUsingBlock:(void (^ _Nonnull)(id _Nonnull key, id _Nonnull object, BOOL* _Nonnull stop))block;
+
 @end
 
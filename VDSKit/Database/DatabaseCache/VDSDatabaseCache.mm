@@ -9,12 +9,170 @@
 #import "VDSDatabaseCache.h"
 #import "../../VDSConstants.h"
 #import "../../VDSErrorConstants.h"
-#import "VDSExpirableObject.h"
 #import "VDSDatabaseCacheConfiguration.h"
+#import "VDSDatabaseCacheEntryTable.h"
+#import "VDSDatabaseCacheAdmission.h"
+#import "VDSDatabaseCacheClock.h"
+#import "VDSDatabaseCacheDiskTier.h"
+#import "VDSDatabaseCacheEvictionScheduler.h"
+#import "VDSDatabaseCacheMemoryMonitor.h"
+#import "VDSDatabaseCacheMetrics.h"
+#import "VDSDatabaseCacheDelegate.h"
+#import "VDSDatabaseCacheExpirationEvaluator.h"
+#import "VDSDatabaseCacheSnapshot.h"
 #import "VDSMergeableObject.h"
+#import "VDSCostableObject.h"
+#import "../../ExtendedOperations/VDSBlockOperation.h"
+#import "../../ExtendedOperations/VDSOperationQueue.h"
 #import "objc/runtime.h"
 
-#include <list>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <os/lock.h>
+
+
+
+
+
+#pragma mark - VDSCacheShard -
+
+/// @summary The protocols and optional methods that the classes of stored objects implement,
+/// determined once per class so that storing an object does not query the runtime.
+///
+struct VDSCacheClassTraits {
+
+    enum : uint8_t {
+        Mergeable = 1 << 0,
+        MergesFromObject = 1 << 1,
+        ReportsChangedKeys = 1 << 2,
+        Costable = 1 << 3,
+    };
+
+    /// The traits of each class seen, keyed by class. Classes are never deallocated, so they are
+    /// not retained.
+    std::unordered_map<const void*, uint8_t> classes;
+
+    /// Returns the traits of the class of object.
+    uint8_t of(id object)
+    {
+        Class objectClass = object_getClass(object);
+        auto found = classes.find((__bridge const void*)objectClass);
+        if (found != classes.end()) { return found->second; }
+
+        uint8_t traits = 0;
+        if ([objectClass conformsToProtocol:@protocol(VDSMergeableObject)]) {
+            traits |= Mergeable;
+            if ([objectClass instancesRespondToSelector:@selector(mergeFromObject:)]) { traits |= MergesFromObject; }
+            if ([objectClass instancesRespondToSelector:@selector(changedMergeableKeyMask)]) { traits |= ReportsChangedKeys; }
+        }
+        if ([objectClass conformsToProtocol:@protocol(VDSCostableObject)]) { traits |= Costable; }
+        classes.emplace((__bridge const void*)objectClass, traits);
+        return traits;
+    }
+};
+
+
+
+/// @summary An object evicted from a shard that will be written to the disk tier once the shard is unlocked.
+///
+struct VDSCacheDemotion {
+
+    __strong id key = nil;
+    __strong id object = nil;
+
+    /// The time, on the cache clock, when the object expires.
+    NSTimeInterval expiration = 0;
+
+    NSUInteger cost = 0;
+};
+
+
+/// @summary An object selected for eviction by a cycle whose delegate observes evictions.
+///
+/// @discussion The object's entry is untracked and marked as pending eviction rather than removed, so
+/// the object remains readable, and its usage count can still change, while the delegate is consulted.
+/// The cycle then removes the entries the delegate approves and tracks the rest again with the state
+/// recorded here, keeping their current usage counts.
+///
+struct VDSCacheEviction {
+
+    /// The reason the object was selected, which determines the metric its eviction is counted by.
+    enum Cause : uint8_t { Expired, Count, Cost, LowMemory, CauseCount };
+
+    __strong id key = nil;
+    __strong id object = nil;
+    NSUInteger hash = 0;
+
+    /// The tracking state of the entry when it was selected. An entry whose usage count has risen since
+    /// is in use again, and is restored even if the delegate approves its eviction.
+    NSTimeInterval expiration = 0;
+    NSTimeInterval refreshTime = DBL_MAX;
+    NSUInteger usageCount = 0;
+    uint8_t segment = 0;
+    bool scheduled = false;
+    bool expired = false;
+
+    Cause cause = Count;
+};
+
+
+/// @summary A partition of the cache's keyspace. Each shard owns the entries for the keys that
+/// hash to it, including their recency order and expiration heap, and the lock that guards them.
+///
+struct VDSCacheShard {
+
+    /// The storage and tracking orders for the keys assigned to the shard.
+    VDSCacheEntryTable table;
+
+    /// Guards table. When the cache is not sharded, this is the coordinator lock.
+    __strong NSRecursiveLock* lock = nil;
+
+    /// Estimates the access frequency of the shard's keys when the eviction policy is VDSTinyLFUPolicy.
+    std::unique_ptr<VDSCacheFrequencySketch> sketch;
+
+    /// The hashes of keys recently evicted from the A1in queue when the eviction policy is VDS2QPolicy.
+    VDSCacheGhostList ghosts;
+
+    /// The activity of the shard, reported by the cache's metrics.
+    VDSCacheMetricCounters metrics;
+
+    /// The traits of the classes of objects stored in the shard. Guarded by lock.
+    VDSCacheClassTraits classTraits;
+
+    /// The context used to evaluate the expiration timing map for the shard's keys, reused for
+    /// every insert. Guarded by lock.
+    __strong NSMutableDictionary* expressionContext = nil;
+
+    /// YES if evictions to meet the size preferences are demoted to the disk tier. Guarded by lock.
+    bool demotesEvictions = false;
+
+    /// The objects evicted while the shard was locked that have not yet been written to the disk
+    /// tier. Guarded by lock.
+    std::vector<VDSCacheDemotion> demotions;
+
+    /// YES while an eviction cycle defers its evictions until its delegate has been consulted, in
+    /// which case evictions untrack their entries and record them in evictions. Guarded by lock.
+    bool defersEvictions = false;
+    std::vector<VDSCacheEviction> evictions;
+};
+
+
+/// The recency segments used by the eviction policies. FIFO, LIFO, OAT, and CLOCK keep every tracked
+/// entry in the window segment. W-TinyLFU admits entries to the window and divides the rest of
+/// the cache between the probation and protected segments, while 2Q uses the window segment as
+/// its A1in queue and the protected segment as its Am queue.
+static const NSUInteger VDSCacheWindowSegment = 0;
+static const NSUInteger VDSCacheProbationSegment = 1;
+static const NSUInteger VDSCacheProtectedSegment = 2;
+
+/// The sketch size used for each shard when the cache has no preferred max object count.
+static const NSUInteger VDSCacheDefaultSketchCapacity = 65536;
 
 
 
@@ -23,58 +181,82 @@
 #pragma mark - VDSDatabaseCache Extension -
 
 @interface VDSDatabaseCache () {
-    
-    /// Object Access Time List, used to determine the recency of access of a cached object.
+
+    /// The main storage for the cache. Objects are stored using a unique (for the cache) key
+    /// that is used throughout the cache tracking system to refer to the object. Each key
+    /// is assigned to a shard by its hash and has a single entry in the shard's table that
+    /// holds the object along with its expiration, usage count, and its position in the
+    /// recency and expiration orders.
     ///
-    std::list<id>* _oatList;
-    
-    /// Maintains a list, in temporal order, of expirable objects. An expirable object
-    /// cotains a timestamp representing when an object in the cache should expire and
-    /// the object's associated key. Setting expiresObjects to YES will initialize the
-    /// expireList, otherwise the default value is NULL.
+    /// @discussion It is possible to add cache objects directly without using the tracking system,
+    /// mixing both tracked and untracked objects. This use case is desirable when some objects should be
+    /// tracked for removal, while other objects should effectively be persistent (at least for the life
+    /// of the cache). This design can be more desirable, and simpler than constructing expressions to set
+    /// expiration dates far into the future for a subset of objects in the cache. This also allows you to
+    /// ignore usage rules for certain objects.
     ///
-    std::list<void*>* _expireList;
-    
-}
+    /// Typical uses of untracked objects include permanent or semi-permanent lookup tables (e.g. zip codes,
+    /// state abbreviations, flight numbers, etc.), data loaded from local sources, or reference data for tracked
+    /// objects that should only be evicted when the tracked object is evicted.
+    ///
+    VDSCacheShard* _shards;
 
+    /// The number of shards in _shards. Always at least 1.
+    NSUInteger _shardCount;
 
+    /// YES if objectForKey: reads the shard tables without locking. Cached from the configuration.
+    BOOL _usesLockFreeReads;
 
-#pragma mark Cache Storage
+    /// The eviction policy. Cached from the configuration because accessors consult it on every access.
+    VDSEvictionPolicy _evictionPolicy;
 
+    /// YES if setters evict objects as soon as a shard exceeds its limits. Cached from the configuration.
+    BOOL _evictsOnInsert;
 
-/// The main storage for the cache. Objects are stored using a unique (for the cache) key
-/// that is used throughout the cache tracking system to refer to the object.
-///
-/// @discussion It is possible to add cache objects directly without using the tracking system,
-/// mixing both tracked and untracked objects. This use case is desirable when some objects should be
-/// tracked for removal, while other objects should effectively be persistent (at least for the life
-/// of the cache). This design can be more desirable, and simpler than constructing expressions to set
-/// expiration dates far into the future for a subset of objects in the cache. This also allows you to
-/// ignore usage rules for certain objects.
-///
-/// Typical uses of untracked objects include permanent or semi-permanent lookup tables (e.g. zip codes,
-/// state abbreviations, flight numbers, etc.), data loaded from local sources, or reference data for tracked
-/// objects that should only be evicted when the tracked object is evicted.
-///
-@property(strong, readonly, nonnull) NSMutableDictionary* cacheObjects;
+    /// The time after a tracked object is stored at which it becomes stale, or 0 if objects do not
+    /// become stale. Cached from the configuration, and 0 unless the cache expires objects.
+    NSTimeInterval _refreshInterval;
 
+    /// The time, on the cache clock, of the eviction cycle scheduled with the
+    /// shared eviction scheduler, or DBL_MAX if no cycle is scheduled.
+    std::atomic<NSTimeInterval> _evictionDeadline;
 
+    /// The number of eviction cycles, their total duration, and the duration of the most recent
+    /// cycle, in nanoseconds. Written only by eviction cycles, which are serialized by _evictionCycleLock.
+    std::atomic<uint64_t> _evictionCycleCount;
+    std::atomic<uint64_t> _evictionCycleNanoseconds;
+    std::atomic<uint64_t> _lastEvictionCycleNanoseconds;
 
-#pragma mark Cache Tracking
+    /// The number of objects held by every shard and the largest number held at one time, adjusted
+    /// by the shards' entry tables.
+    VDSCacheObjectCount _objectCount;
 
-/// Maintains a list of keys for objects in the cache and each object's number of uses.
-/// Setting tracksObjectUsage to YES will initialize the usageList, otherwise the default
-/// value is nil.
-///
-@property(strong, readonly, nullable) NSCountedSet* usageList;
+    /// The compiled expiration timing map, or nil if the cache does not have one.
+    VDSCacheExpirationEvaluator* _expirationEvaluator;
 
+    /// The expiration intervals of the configuration, keyed by entity name and by class.
+    VDSCacheIntervalTable _expirationIntervals;
+
+    /// The disk tier that evicted objects are demoted to, or nil. Guarded by _diskTierLock, which is
+    /// only held to read or replace it.
+    VDSDatabaseCacheDiskTier* _diskTier;
+    os_unfair_lock _diskTierLock;
+
+    /// Serializes eviction cycles, including those for memory pressure. It is never held by a
+    /// thread that holds a shard lock.
+    NSRecursiveLock* _evictionCycleLock;
+
+    /// The completions waiting for each load in flight, keyed by the key being loaded. Guarded by
+    /// _loadLock, which is never held while a loader or completion runs.
+    NSMutableDictionary<id, NSMutableArray<VDSDatabaseCacheLoadCompletion>*>* _loads;
+    os_unfair_lock _loadLock;
+
+}
 
-/// Maintains a list of keys and iterators for objects in the _oatList for rapid reference.
-/// Use the key to access the iterator for the _oatList (oldest access time list).
-///
-@property(strong, readonly, nonnull) NSMapTable* evictionPolicyKeyMap;
 
 
+#pragma mark Cache Tracking
+
 /// @summary An expression that must evaluate to one of the keys used in the expirationTimingMap.
 /// The expression is evaluated against an incoming key and with a NSMutableDictionary as
 /// a context object that contains the incoming object associated with VDSEntrySnapshotKey.
@@ -92,30 +274,15 @@
 @property(strong, readonly, nullable) NSDictionary<id, NSExpression*>* expirationTimingMap;
 
 
-/// Maintains a list of keys and iterators of objects in the _expireList O(1) reference.
-/// Use the key to access the iterator.
-///
-@property(strong, readonly, nullable) NSMapTable* expirationMap;
-
-
 /// @summary A recursive lock used to coordinate cache tracking reads and writes. Subclasses should
 /// use the coordinatorLock, synchQueue, barriers, etc. to create facades that ensure reading of
 /// and writing to the cache is thread safe.
 ///
-@property(strong, readonly, nonnull) NSRecursiveLock* coordinatorLock;
-
-
-/// @summary An timer used as a repeating loop to add eviction operations to the evictionQueue.
-/// If the queue is suspended when the timer fires, the eviction loop timer will skip
-/// adding an eviction operation to the queue but will continue to check the queue
-/// at its designated intervals. Once the timer determines the queue has been unsuspended,
-/// it will wait until a subsequent loop to add an eviction operation to the eviction queue.
+/// @discussion When the cache is not sharded, the coordinator lock guards the cache's storage. When
+/// the cache is sharded, each shard is guarded by its own lock. Eviction cycles are serialized by a
+/// lock of their own in either case.
 ///
-@property(strong, readonly, nonnull) NSTimer* evictionLoop;
-
-
-/// Maintains a time marker for the last time value marked for eviction by the cache eviction cycle.
-@property(strong, readwrite, nullable) NSDate* priorEvictionTime;
+@property(strong, readonly, nonnull) NSRecursiveLock* coordinatorLock;
 
 
 @end
@@ -135,21 +302,16 @@
 @synthesize configuration = _configuration;
 @synthesize defaultExpirationInterval = _defaultExpirationInterval;
 
-@synthesize cacheObjects = _cacheObjects;
-@synthesize usageList = _usageList;
-@synthesize evictionPolicyKeyMap = _evictionPolicyKeyMap;
 @synthesize expirationTimingMapKey = _expirationTimingMapKey;
 @synthesize expirationTimingMap = _expirationTimingMap;
-@synthesize expirationMap = _expirationMap;
 @synthesize coordinatorLock = _coordinatorLock;
-@synthesize evictionLoop = _evictionLoop;
-@synthesize priorEvictionTime = _priorEvictionTime;
 
 
 +(BOOL)supportsSecureCoding { return YES; }
 
 
 
+
 #pragma mark Object Lifecycle
 
 - (instancetype _Nonnull)init
@@ -162,56 +324,92 @@
 {
     self = [super init];
     if (self != nil) {
-        _expireList = NULL;
-        _oatList = NULL;
         _configuration = [configuration copy];
-        _cacheObjects = [NSMutableDictionary new];
         _coordinatorLock = [NSRecursiveLock new];
+        _diskTierLock = OS_UNFAIR_LOCK_INIT;
+        _evictionCycleLock = [NSRecursiveLock new];
+        _loads = [NSMutableDictionary new];
+        _loadLock = OS_UNFAIR_LOCK_INIT;
+        _evictionDeadline.store(DBL_MAX, std::memory_order_relaxed);
+        _evictionCycleCount.store(0, std::memory_order_relaxed);
+        _evictionCycleNanoseconds.store(0, std::memory_order_relaxed);
+        _lastEvictionCycleNanoseconds.store(0, std::memory_order_relaxed);
+        [self configureShards];
         if (_configuration.expiresObjects) {
             [self configureExpirationSystem];
             [self configureEvictionSystem];
-            if (_configuration.tracksObjectUsage) { [self configureObjectTrackingSystem]; }
-            [[NSRunLoop mainRunLoop] addTimer:_evictionLoop forMode:NSDefaultRunLoopMode];
+        }
+        if (_configuration.evictsOnLowMemory) {
+            [VDSDatabaseCacheMemoryMonitor.sharedMonitor registerCache:self];
         }
     }
     return self;
 }
 
 
-- (void)configureEvictionSystem
+- (void)configureShards
 {
-    _evictionPolicyKeyMap = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsWeakMemory | NSMapTableObjectPointerPersonality valueOptions:NSPointerFunctionsOpaqueMemory | NSPointerFunctionsStructPersonality];
-    _oatList = new std::list<id>;
-    _evictionLoop = [NSTimer timerWithTimeInterval:_configuration.evictionInterval
-                                            target:self
-                                          selector:@selector(processEvictions:)
-                                          userInfo:nil
-                                           repeats:YES];
-    _priorEvictionTime = [NSDate distantPast];
+    _shardCount = MAX(_configuration.shardCount, (NSUInteger)1);
+    _usesLockFreeReads = _configuration.usesLockFreeReads;
+    _evictionPolicy = _configuration.evictionPolicy;
+    _evictsOnInsert = _configuration.evictsOnInsert && _configuration.expiresObjects;
+    _refreshInterval = _configuration.expiresObjects ? MAX(_configuration.refreshInterval, 0) : 0;
+    _shards = new VDSCacheShard[_shardCount];
+    [self configureAdmissionSystem];
+    for (NSUInteger index = 0; index < _shardCount; index++) {
+        _shards[index].table.shareObjectCount(&_objectCount);
+    }
+    if (_usesLockFreeReads) {
+        for (NSUInteger index = 0; index < _shardCount; index++) {
+            _shards[index].table.enableConcurrentReads();
+        }
+    }
+    if (_shardCount == 1) {
+        _shards[0].lock = _coordinatorLock;
+    } else {
+        for (NSUInteger index = 0; index < _shardCount; index++) {
+            _shards[index].lock = [NSRecursiveLock new];
+        }
+    }
 }
 
 
-- (void)configureObjectTrackingSystem
+- (void)configureEvictionSystem
 {
-    _usageList = _configuration.tracksObjectUsage ? [NSCountedSet new] : nil;
+    /// Eviction cycles are run by the shared scheduler, which holds the cache weakly, so an unused
+    /// cache is deallocated even while cycles are scheduled.
+    if (_configuration.evictionInterval > 0) {
+        [self scheduleEvictionCycleBy:VDSCacheClockNow() + _configuration.evictionInterval];
+    }
 }
 
 
 - (void)configureExpirationSystem
 {
-    _expirationMap = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsWeakMemory | NSMapTableObjectPointerPersonality valueOptions:NSPointerFunctionsOpaqueMemory | NSPointerFunctionsStructPersonality];
-    _expireList = new std::list<void*>;
     _expirationTimingMap = [_configuration.expirationTimingMap copy];
     _expirationTimingMapKey = [_configuration.expirationTimingMapKey copy];
+
+    /// Intervals by entity and class resolve with a hash probe, and take precedence over the timing map.
+    _expirationIntervals.configure(_configuration.expirationIntervals);
+
+    /// The timing map is compiled once, so inserts do not interpret its expressions.
+    if (_expirationTimingMapKey != nil && _expirationTimingMap != nil) {
+        _expirationEvaluator = [[VDSCacheExpirationEvaluator alloc] initWithTimingMapKey:_expirationTimingMapKey
+                                                                               timingMap:_expirationTimingMap];
+        for (NSUInteger index = 0; index < _shardCount; index++) {
+            _shards[index].expressionContext = [NSMutableDictionary new];
+        }
+    }
 }
 
 
 - (void)dealloc {
-    /// Removing all objects cleans up all ARC transfers.
-    [self removeAllObjects];
-    
-    delete _oatList;
-    delete _expireList;
+    /// The memory monitor holds the cache weakly and drops it once it is deallocated, so the cache
+    /// does not unregister. A cache may be deallocated on the monitor's queue, as the last reference
+    /// to it can be released while the monitor notifies it.
+
+    /// Deleting the shards releases all keys and objects.
+    delete[] _shards;
 }
 
 
@@ -225,7 +423,9 @@
     NSDictionary* untrackedObjectsAndKeys = [coder decodeObjectOfClass:[NSDictionary class]
                                                                 forKey:NSStringFromSelector(@selector(untrackedObjectsAndKeys))];
     if (untrackedObjectsAndKeys) {
-        [_cacheObjects addEntriesFromDictionary:untrackedObjectsAndKeys];
+        [untrackedObjectsAndKeys enumerateKeysAndObjectsUsingBlock:^(id key, id object, BOOL* stop) {
+            [self setObject:object forKey:key];
+        }];
     }
     return self;
 }
@@ -243,479 +443,2521 @@
 
 #pragma mark - Utility Behaviors
 
-/// Used as the comparator for _expireList sorting.
+/// Determines whether the number of tracked objects exceeds the preferred max object count.
 ///
-/// @param first An expirable object.
+/// @param preferredMaxObjectCount The preferred max object count of the cache or shard.
 ///
-/// @param second The expirable object used in the comparison.
+/// @param trackedCount The number of tracked objects in the cache.
 ///
-/// @returns True if second should come after first, false otherwise.
+/// @returns True if objects should be evicted to satisfy the preferred max object count, false otherwise.
 ///
-bool compare_expirations (const void* first, const void* second)
-{
-    VDSExpirableObject* fexp = (__bridge VDSExpirableObject*)first;
-    VDSExpirableObject* sexp = (__bridge VDSExpirableObject*)second;
-    if ([fexp.expiration compare:sexp.expiration] == NSOrderedDescending) {
-        return true;
-    }
-    return false;
-}
-
-
-
-#pragma mark - Eviction Behaviors
-
-- (void)processEvictions:(NSTimer* _Nonnull)timer
+static inline bool exceeds_preferred_count (NSInteger preferredMaxObjectCount, NSUInteger trackedCount)
 {
-    /// Launches the eviction operation unless one exists on the queue.
-    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
-        [self processCacheEvictions];
-    });
+    if (preferredMaxObjectCount == 0) { return false; }
+    if (preferredMaxObjectCount < 0) { return trackedCount > 0; }
+    return trackedCount > (NSUInteger)preferredMaxObjectCount;
 }
 
 
-- (void)processCacheEvictions
+/// Divides the preferred max object count evenly between the shards of the cache, rounding up
+/// so that a small positive count never becomes 0 (no limit) for a shard.
+///
+/// @param preferredMaxObjectCount The preferred max object count of the cache.
+///
+/// @param shardCount The number of shards in the cache.
+///
+/// @returns The preferred max object count for each shard.
+///
+static inline NSInteger preferred_shard_count (NSInteger preferredMaxObjectCount, NSUInteger shardCount)
 {
-    [_coordinatorLock lock];
-
-    ///
-    /// The cache takes an aggressive approach, removing objects that are
-    /// unused and expired, according to the eviction policy, regardless of the max object count.
-    ///
-    /// The database cache will decrement the object count for any object that has expired.
-    /// If the cache is configured to track uses and the object has no additional uses,
-    /// then the object will be removed.
-    ///
-    /// If cache is configured to remove items that have expired regardless of use,
-    /// then the expired object will be removed. Otherwise, it will be left in the cache.
-    ///
-    /// If the object has not expired but has no users, then the object will be removed if
-    /// the cache exceeds the max object count. Otherwise, the object will be left in the cache.
-    ///
-    
-    /// expiredKeys is used as a bin that can be enumerated without mutation when removing items.
-    NSMutableArray* expiredKeys = [NSMutableArray new];
-    /// removableKeys is used as a bin for keys that can be removed but do not have to be if space
-    /// permits.
-    NSMutableArray* removableKeys = [NSMutableArray new];
-    
-    /// This is the only time expired keys are sorted.
-    if (_expireList != NULL) {
-        _expireList->sort(compare_expirations);
-    }
-    
-    /// Step 1. Update the usage count for tracked objects if appropriate.
-    if (_configuration.expiresObjects) {
-        std::list<void*>::reverse_iterator iter;
-        for (iter = _expireList->rbegin(); iter != _expireList->rend(); ++iter) {
-            VDSExpirableObject* object = (__bridge VDSExpirableObject*)(*iter);
-            if (object.isExpired &&
-                ([object.expiration compare:_priorEvictionTime] == NSOrderedAscending ||
-                 [object.expiration compare:_priorEvictionTime] == NSOrderedSame)) {
-                /// This is the first eviction cycle where the object is expired. Decrement its usage count
-                /// to account for initial use increment when the object was added to the object cache.
-                if (_configuration.tracksObjectUsage) {
-                    [self decrementUsageCount:object.object];
-                    if ([_usageList countForObject:object.object] == 0) {
-                        [expiredKeys addObject:object.object];
-                    } else if (_configuration.evictsObjectsInUse) {
-                        [removableKeys addObject:object.object];
-                    }
-                } else {
-                    [expiredKeys addObject:object.object];
-                }
-            } else if (object.isExpired == NO) {
-                /// This will be the first object in the ordered array that is not expired in the current
-                /// eviction cycle. It's date will be used to set the priorEvictionTime and the loop
-                /// will be broken to continue the eviction process.
-                _priorEvictionTime = object.expiration;
-                break;
-            }
-        }
-    }
-    
-    /// Step 2. Remove Objects that are expired and unused.
-    for (id key in expiredKeys) {
-        [self removeObjectForKey:key];
-    }
-    
-    /// Step 3. If the cache exceeds the preferred max object count, remove objects
-    /// using the removableKeys array. In this implementation, it's an all or nothing affair.
-    if (_configuration.preferredMaxObjectCount < _expireList->size()) {
-        for (id key in removableKeys) {
-            [self removeObjectForKey:key];
-        }
-    }
-    
-    /// Step 4. If the cache still exceeds the preferred max object count, remove in LIFO, FIFO, or OAT
-    /// order all unused objects until the cache meets the preferred max object count. In the cache,
-    /// unused objects that have not expried have a usage count of 1. At this point, no cache object
-    /// that is unexpired will have a usage count of 1 unless it is not being used.
-    if (_configuration.preferredMaxObjectCount < _expireList->size()) {
-        if (_configuration.evictionPolicy == VDSFIFOPolicy) {
-            for (std::list<id>::iterator iter = _oatList->begin(); iter!=_oatList->end(); ++iter) {
-                id key = *iter;
-                /// If the object is before the priorEvictionTime, it is in use and should be skipped.
-                std::list<id>::iterator iterator = *((std::list<id>::iterator*)NSMapGet(_expirationMap, (__bridge void *)key));
-                if ([((NSDate*)*iterator) compare:_priorEvictionTime] == NSOrderedDescending) { continue; }
-                /// If the object has a usage count of 1, it should be removed until we hit preferred
-                /// max object count.
-                if ([_usageList countForObject:key] == 1) { [self removeObjectForKey:key]; }
-                /// When the count is at the object count, break to stop removing objects.
-                if (_configuration.preferredMaxObjectCount == _expireList->size()) {
-                    break;
-                }
-            }
-        } else {
-            for (std::list<id>::reverse_iterator iter = _oatList->rbegin(); iter!=_oatList->rend(); ++iter) {
-                id key = *iter;
-                /// If the object is before the priorEvictionTime, it is in use and should be skipped.
-                std::list<id>::iterator iterator = *((std::list<id>::iterator*)NSMapGet(_expirationMap, (__bridge void *)key));
-                if ([((VDSExpirableObject*)*iterator).expiration compare:_priorEvictionTime] == NSOrderedDescending) { continue; }
-                /// If the object has a usage count of 1, it should be removed until we hit preferred
-                /// max object count.
-                if ([_usageList countForObject:key] == 1) { [self removeObjectForKey:key]; }
-                /// When the count is at the object count, break to stop removing objects.
-                if (_configuration.preferredMaxObjectCount == _expireList->size()) {
-                    break;
-                }
-            }
-        }
-    }
-    
-    [_coordinatorLock unlock];
+    if (preferredMaxObjectCount <= 0 || shardCount == 1) { return preferredMaxObjectCount; }
+    return (preferredMaxObjectCount + (NSInteger)shardCount - 1) / (NSInteger)shardCount;
 }
 
 
-- (BOOL)incrementUsageCount:(id _Nonnull)key
+/// Determines whether the cost of tracked objects exceeds the preferred max total cost.
+///
+/// @param preferredMaxTotalCost The preferred max total cost of the cache or shard. 0 sets no limit.
+///
+/// @param trackedCost The total cost of the tracked objects in the cache.
+///
+/// @returns True if objects should be evicted to satisfy the preferred max total cost, false otherwise.
+///
+static inline bool exceeds_preferred_cost (NSUInteger preferredMaxTotalCost, NSUInteger trackedCost)
 {
-    BOOL success = NO;
-    /// You can not increment the usage count of a key that
-    /// is not already in the usage list.
-    [_coordinatorLock lock];
-    if ([_usageList countForObject:key] > 0) {
-        [_usageList addObject:key];
-        success = YES;
-        /// If the tracking is OAT, then the access time
-        /// needs to be updated.
-        if (_configuration.evictionPolicy == VDSOATPolicy) {
-            [self updatedAccessTimeForKey:key];
-        }
-    }
-    [_coordinatorLock unlock];
-    return success;
+    return preferredMaxTotalCost > 0 && trackedCost > preferredMaxTotalCost;
 }
 
 
-- (BOOL)decrementUsageCount:(id _Nonnull)key
+/// Divides the preferred max total cost evenly between the shards of the cache, rounding up
+/// so that a small cost limit never becomes 0 (no limit) for a shard.
+///
+/// @param preferredMaxTotalCost The preferred max total cost of the cache.
+///
+/// @param shardCount The number of shards in the cache.
+///
+/// @returns The preferred max total cost for each shard.
+///
+static inline NSUInteger preferred_shard_cost (NSUInteger preferredMaxTotalCost, NSUInteger shardCount)
 {
-    BOOL success = NO;
-    /// You can not decrement the usage count of a key that
-    /// is not already in the usage list.
-    [_coordinatorLock lock];
-    if ([_usageList countForObject:key] > 0) {
-        [_usageList removeObject:key];
-        success = YES;
-    }
-    [_coordinatorLock unlock];
-    return success;
+    if (preferredMaxTotalCost == 0 || shardCount == 1) { return preferredMaxTotalCost; }
+    return preferredMaxTotalCost / shardCount + (preferredMaxTotalCost % shardCount != 0 ? 1 : 0);
 }
 
 
+/// Passed as the cost of an object to indicate that the cost should be requested from the
+/// stored object, which reports it if it conforms to VDSCostableObject.
+static const NSUInteger VDSCacheObjectProvidedCost = NSNotFound;
 
-#pragma mark - Supporting Behaviors
 
-- (void)setObject:(id _Nonnull)object forKey:(id _Nonnull)key
+/// Determines the cost of an object that was stored without an explicit cost.
+///
+/// @param object The stored object.
+///
+/// @param traits The traits of the class of object.
+///
+/// @returns The cost reported by the object if it conforms to VDSCostableObject, otherwise 0.
+///
+static inline NSUInteger cost_of_object (id object, uint8_t traits)
 {
-    [_coordinatorLock lock];
-    [self setObject:object forKey:key tracked:NO expires:nil];
-    [_coordinatorLock unlock];
+    return (traits & VDSCacheClassTraits::Costable) ? [(id<VDSCostableObject>)object cacheCost] : 0;
 }
 
 
--(void)setObject:(id)object forKey:(id)key tracked:(BOOL)tracked
+/// Merges an update into a cached object, using mergeFromObject: if the cached object implements it,
+/// and otherwise merging the values of the update's mergeable keys that it reports as changed.
+///
+/// @param cachedObject The cached object, which conforms to VDSMergeableObject.
+///
+/// @param update The update, which conforms to VDSMergeableObject.
+///
+/// @param cachedTraits The traits of the class of cachedObject.
+///
+/// @param updateTraits The traits of the class of update.
+///
+/// @returns false if the update did not change the cached object.
+///
+static bool merge_object (id cachedObject, id update, uint8_t cachedTraits, uint8_t updateTraits)
 {
-    [_coordinatorLock lock];
-    [self setObject:object forKey:key tracked:tracked expires:nil];
-    [_coordinatorLock unlock];
-}
+    if (cachedTraits & VDSCacheClassTraits::MergesFromObject) {
+        return [(id<VDSMergeableObject>)cachedObject mergeFromObject:update];
+    }
 
+    uint64_t changedKeys = (updateTraits & VDSCacheClassTraits::ReportsChangedKeys) ? [(id<VDSMergeableObject>)update changedMergeableKeyMask] : UINT64_MAX;
+    NSArray* keys = [(id<VDSMergeableObject>)update mergeableKeys];
+    if (changedKeys == 0 && keys.count <= 64) { return false; }
 
-- (void)setObject:(id _Nonnull)object
-           forKey:(id _Nonnull)key
-          tracked:(BOOL)tracked
-          expires:(NSDate * _Nullable)expiration
-{
-    /// When setting an object, its important to lock down the various parts of the
-    /// cache that support the state of the object as the change needs to be 'atomic'.
-    [_coordinatorLock lock];
-    
-    /// If the object contained in the cache is mergable, then the object
-    /// needs to be extracted, merged, and then reset. If the object is
-    /// not mergable, then it needs to be replaced.
-    id cachedObject = [_cacheObjects objectForKey:key];
-    if (cachedObject != nil &&
-        _configuration.replacesObjectsOnUpdate == NO &&
-        [object conformsToProtocol:@protocol(VDSMergeableObject)] &&
-        [cachedObject conformsToProtocol:@protocol(VDSMergeableObject)]) {
-        id mergableObject = (id<VDSMergableObject>)object;
-        for (id key in [mergableObject mergeableKeys]) {
-            id value = [mergableObject valueForKey:key];
-            [cachedObject mergeValue:value forKey:key];
+    NSUInteger index = 0;
+    for (NSString* key in keys) {
+        if (index >= 64 || (changedKeys & (1ull << index))) {
+            [(id<VDSMergeableObject>)cachedObject mergeValue:[update valueForKey:key] forKey:key];
         }
-    } else {
-        [_cacheObjects setObject:object forKey:key];
-    }
-    
-    if (_configuration.expiresObjects) {
-        /// To keep the eviction policy list (FIFO, LIFO, or OAT/LRU) accurate,
-        /// it's necessary to remove the prior instance of the key
-        /// that was added to the list before adding the new entry.
-        if (cachedObject != nil) { [self updatedAccessTimeForKey:key]; }
-    
-        /// If expiration is supported, the timing must be calculated (even if it's just
-        /// read in from a value in object or key). As with the  eviction policy list,
-        /// the expirable object must be removed and a new one created. Expirable object
-        /// overrides hash so that equality (and therefore searching) is a function of the
-        /// object value in expirable, not the timestamp which is used as a sorting key to
-        /// speed up eviction.
-        [self updateExpirationForKey:key expiration:expiration];
-    
-        /// Usage Tracking
-        if (_configuration.tracksObjectUsage) { [_usageList addObject:key]; }
+        index++;
     }
-    /// Once all of the changes have been made, unlock the coordinator.
-    [_coordinatorLock unlock];
+    return true;
 }
 
 
-/// Utility method for insertion to keep the eviction list in the correct order.
+/// Determines the time at which a tracked entry becomes stale.
 ///
-/// @param key The key used to retrieve and set the eviction policy key map objects.
+/// @param stored The time, on the cache clock, at which the entry was stored.
 ///
-- (void)updatedAccessTimeForKey:(id)key
+/// @param expiration The time, on the cache clock, at which the entry expires.
+///
+/// @param refreshInterval The refresh interval of the cache, or 0 if entries do not become stale.
+///
+/// @returns The time the entry becomes stale, or DBL_MAX if it expires first or never becomes stale.
+///
+static inline NSTimeInterval refresh_time (NSTimeInterval stored, NSTimeInterval expiration, NSTimeInterval refreshInterval)
 {
-    /// To keep the eviction policy list (FIFO, LIFO, or OAT/LRU) accurate,
-    /// it's necessary to remove the prior instance of the key
-    /// that was added to the list before adding the new entry.
-    std::list<id>::iterator* iterPointer = (( std::list<id>::iterator*)NSMapGet(_evictionPolicyKeyMap, (__bridge void*)key));
-    if (iterPointer != NULL) { _oatList->erase(*iterPointer); }
-    _oatList->push_front(key);
-    auto iter = _oatList->begin();
-    NSMapInsert(_evictionPolicyKeyMap, (__bridge void*)key, &iter);
+    return refreshInterval > 0 && stored + refreshInterval < expiration ? stored + refreshInterval : DBL_MAX;
 }
 
 
-/// Utility method for insertion to keep the expiration list updated.
+/// Selects the shard for a key hash.
+///
+/// @discussion The hash is mixed (using the MurmurHash3 finalizer) before it is reduced to a shard
+/// index, because many hash implementations, such as NSNumber's, produce sequential values that
+/// would otherwise cluster in a few shards.
 ///
-/// @param key The key used to retrieve and set the expiration list objects.
+/// @param hash The hash of the key.
 ///
-/// @param expiration An optional expiration date.
+/// @param shardCount The number of shards in the cache.
 ///
-- (void)updateExpirationForKey:(id _Nonnull)key
-                    expiration:(NSDate* _Nullable)expiration
+/// @returns The index of the shard that holds the key.
+///
+static inline NSUInteger shard_index_for_hash (NSUInteger hash, NSUInteger shardCount)
 {
-    /// If expiration is supported, the timing must be calculated (even if it's just
-    /// read in from a value in object or key). As with the  eviction policy list,
-    /// the expirable object must be removed and a new one created. Expirable object
-    /// overrides hash so that equality (and therefore searching) is a function of the
-    /// object value in expirable, not the timestamp which is used as a sorting key to
-    /// speed up eviction.
-    std::list<void*>::iterator* iterP = ((std::list<void*>::iterator*)NSMapGet(_expirationMap, (__bridge void*)key));
-    if (iterP != NULL) {
-        VDSExpirableObject* object = (__bridge_transfer VDSExpirableObject*)(**iterP);
-        object = nil;
-        _expireList->erase(*iterP);
-        NSMapRemove(_expirationMap, (__bridge void*)key);
-    }
-
-    
-    /// Determine the expiration.
-    NSDate* expires = nil;
-    
-    /// If an expiration is provided as a parameter, that overrides all other options.
-    if (expiration != nil) {
-        expires = expiration;
-    } else if (_expirationTimingMapKey != nil && _expirationTimingMap != nil) {
-        id timingKey = [_expirationTimingMapKey expressionValueWithObject:key
-                                                                  context:[NSMutableDictionary dictionaryWithObject:[_cacheObjects objectForKey:key] forKey:VDSEntrySnapshotKey]];
-        expires = [_expirationTimingMap[timingKey] expressionValueWithObject:key
-                                                                     context:[NSMutableDictionary dictionaryWithObject:[_cacheObjects objectForKey:key] forKey:VDSEntrySnapshotKey]];
-    } else {
-        expires = [NSDate dateWithTimeIntervalSinceNow:self.defaultExpirationInterval];
-    }
-    
-    _expireList->push_front((__bridge_retained void*)[[VDSExpirableObject alloc] initWithExpiration:expires object:key]);
-    
+    if (shardCount == 1) { return 0; }
+    uint64_t mixed = hash;
+    mixed ^= mixed >> 33;
+    mixed *= 0xff51afd7ed558ccdull;
+    mixed ^= mixed >> 33;
+    mixed *= 0xc4ceb9fe1a85ec53ull;
+    mixed ^= mixed >> 33;
+    return (NSUInteger)(mixed % shardCount);
 }
 
 
-- (void)removeObjectForKey:(id _Nonnull)key
+/// The nanoseconds that have elapsed since start.
+static inline uint64_t nanoseconds_since (std::chrono::steady_clock::time_point start)
 {
-    /// Removal mechanics depends on whether an object is tracked.
-    [_coordinatorLock lock];
-    if (_configuration.expiresObjects) {
-        std::list<id>::iterator* iterPointer = (std::list<id>::iterator*)NSMapGet(_evictionPolicyKeyMap, (__bridge void*)key);
-        if (iterPointer != NULL) {
-            NSMapRemove(_evictionPolicyKeyMap, (__bridge void*)key);
-            _oatList->erase(*iterPointer);
-        }
-        
-        std::list<void*>::iterator* iterP = ((std::list<void*>::iterator*)NSMapGet(_expirationMap, (__bridge void*)key));
-        if (iterP != NULL) {
-            VDSExpirableObject* object = (VDSExpirableObject*)CFBridgingRelease(**iterP);
-            object = nil;
-            _expireList->erase(*iterP);
-            NSMapRemove(_expirationMap, (__bridge void*)key);
-        }
-        
-        if (_configuration.tracksObjectUsage) {
-            for (NSInteger count = [_usageList countForObject:key]; count > 0; count--) {
-                [_usageList removeObject:key];
-            }
-        }
-    }
-    
-    /// Remove the object at the end so that it and its key are retained until
-    /// there are no further pointers to them.
-    [_cacheObjects removeObjectForKey:key];
-
-    [_coordinatorLock unlock];
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
 }
 
 
-- (void)removeAllObjects
-{
-    /// This method empties the cache and all associated tracking data
-    /// effectively taking the cache back to a clean initialization state.
-    [_coordinatorLock lock];
+/// @summary Bounds the work that an eviction cycle does on a shard while holding its lock.
+///
+/// @discussion Each object an eviction removes or moves between segments is a unit of work. Once a
+/// slice has done evictionBatchSize units, or has run for evictionTimeSlice, the cycle releases the
+/// shard's lock and begins a new slice once it has reacquired it. A budget with neither bound never
+/// ends a slice.
+///
+struct VDSCacheEvictionBudget {
 
-    NSArray* allKeys = NSAllMapTableKeys(_expirationMap);
-    for (id key in allKeys) {
-        std::list<void*>::iterator* iterP = ((std::list<void*>::iterator*)NSMapGet(_expirationMap, (__bridge void*)key));
-        if (iterP != NULL) {
-            VDSExpirableObject* object = (VDSExpirableObject*)CFBridgingRelease(**iterP);
-            object = nil;
-            _expireList->erase(*iterP);
-            NSMapRemove(_expirationMap, (__bridge void*)key);
-        }
-    }
-    
-    [_cacheObjects removeAllObjects];
-    NSResetMapTable(_evictionPolicyKeyMap);
-    if (_oatList != NULL) { _oatList->clear(); }
-    [_usageList removeAllObjects];
+    /// The units of work in a slice, or 0 for no bound.
+    NSUInteger batchSize = 0;
 
-    [_coordinatorLock unlock];
-}
+    /// The nanoseconds in a slice, or 0 for no bound.
+    uint64_t sliceNanoseconds = 0;
 
+    /// The units of work done in the current slice.
+    NSUInteger spent = 0;
 
-- (id _Nullable)objectForKey:(id _Nonnull)key
-{
-    [_coordinatorLock lock];
-    id object = [_cacheObjects objectForKey:key];
-    [_coordinatorLock unlock];
-    return object;
-}
+    /// The time the current slice began, when the slice is bounded by time.
+    std::chrono::steady_clock::time_point sliceStart;
 
+    /// The nanoseconds spent waiting to reacquire shard locks between slices.
+    uint64_t lockWait = 0;
 
-- (NSArray*)allObjects
-{
-    [_coordinatorLock lock];
-    NSArray* objects = [_cacheObjects allValues];
-    [_coordinatorLock unlock];
-    return objects;
-}
+    bool bounded() const { return batchSize > 0 || sliceNanoseconds > 0; }
 
+    void beginSlice()
+    {
+        spent = 0;
+        if (sliceNanoseconds > 0) { sliceStart = std::chrono::steady_clock::now(); }
+    }
 
-- (NSArray* _Nonnull)trackedObjects
-{
-    [_coordinatorLock lock];
-    NSArray* trackedKeys = [self trackedKeys];
-    NSArray* objects = [_cacheObjects objectsForKeys:trackedKeys notFoundMarker:[NSNull null]];
-    [_coordinatorLock unlock];
-    return objects;
-}
+    /// Records a unit of work. The clock is read every 16 units, which keeps the cost of the time
+    /// bound small relative to the work it bounds.
+    ///
+    /// @returns true if the slice is over.
+    ///
+    bool spend()
+    {
+        spent++;
+        if (batchSize > 0 && spent >= batchSize) { return true; }
+        return sliceNanoseconds > 0 && (spent & 15) == 0 && nanoseconds_since(sliceStart) >= sliceNanoseconds;
+    }
+};
 
 
-- (NSArray* _Nonnull)untrackedObjects
-{
-    [_coordinatorLock lock];
-    NSArray* untrackedKeys = [self untrackedKeys];
-    NSArray* objects = [_cacheObjects objectsForKeys:untrackedKeys notFoundMarker:[NSNull null]];
-    [_coordinatorLock unlock];
-    return objects;
-}
+/// @summary What an eviction cycle did to a single shard, collected by the thread that processed
+/// the shard and combined with the other shards once every shard has been processed.
+///
+struct VDSCacheShardSweep {
 
+    /// YES if the shard defers its evictions until the delegate has been consulted. Set before the
+    /// shard is processed.
+    bool defersEvictions = false;
 
-- (NSArray*)allKeys
-{
-    [_coordinatorLock lock];
-    NSArray* keys = [_cacheObjects allKeys];
-    [_coordinatorLock unlock];
-    return keys;
-}
+    uint64_t expiredEvictions = 0;
+    uint64_t countEvictions = 0;
+    uint64_t costEvictions = 0;
 
+    /// The nanoseconds spent waiting for the shard's lock.
+    uint64_t lockWait = 0;
 
-- (NSArray* _Nonnull)trackedKeys
-{
-    [_coordinatorLock lock];
-    NSArray* keys = NSAllMapTableKeys(_evictionPolicyKeyMap);
-    [_coordinatorLock unlock];
-    return keys;
-}
+    /// The earliest expiration remaining in the shard, or DBL_MAX if none remain.
+    NSTimeInterval nextExpiration = DBL_MAX;
 
+    /// The objects evicted from the shard that will be written to the disk tier.
+    std::vector<VDSCacheDemotion> demotions;
 
-- (NSArray* _Nonnull)untrackedKeys
-{
-    [_coordinatorLock lock];
-    NSSet* trackedKeys = [NSSet setWithArray:[self trackedKeys]];
-    NSMutableSet* untrackedKeys = [NSMutableSet setWithArray:[_cacheObjects allKeys]];
-    [untrackedKeys minusSet:trackedKeys];
-    [_coordinatorLock unlock];
-    return untrackedKeys.allObjects;
-}
+    /// The objects selected for eviction from the shard when it defers its evictions.
+    std::vector<VDSCacheEviction> evictions;
+};
 
 
-- (NSDictionary*)allObjectsAndKeys
+/// Locks a shard, adding the time spent waiting for the lock to the shard's metrics. The clock is
+/// only read when the lock is contended, so an uncontended lock costs no more than it would otherwise.
+///
+/// @returns The nanoseconds spent waiting for the lock.
+///
+static inline uint64_t lock_shard (VDSCacheShard* shard)
 {
-    [_coordinatorLock lock];
-    NSDictionary* objectsAndKeys = [_cacheObjects copy];
-    [_coordinatorLock unlock];
-    return objectsAndKeys;
+    if ([shard->lock tryLock]) { return 0; }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    [shard->lock lock];
+    uint64_t wait = nanoseconds_since(start);
+    VDSCacheMetricCounters::add(shard->metrics.lockWaitNanoseconds, wait);
+    return wait;
 }
 
 
-- (NSDictionary* _Nonnull)trackedObjectsAndKeys
+/// Locks every shard, always in index order so that concurrent callers can not deadlock.
+static inline void lock_shards (VDSCacheShard* shards, NSUInteger shardCount)
 {
-    [_coordinatorLock lock];
-    NSArray* untrackedKeys = [self untrackedKeys];
-    NSMutableDictionary* trackedObjectsAndKeys = [_cacheObjects mutableCopy];
-    [trackedObjectsAndKeys removeObjectsForKeys:untrackedKeys];
-    [_coordinatorLock unlock];
-    return trackedObjectsAndKeys;
+    for (NSUInteger index = 0; index < shardCount; index++) { lock_shard(&shards[index]); }
 }
 
 
-- (NSDictionary* _Nonnull)untrackedObjectsAndKeys
+/// Unlocks every shard locked by lock_shards.
+static inline void unlock_shards (VDSCacheShard* shards, NSUInteger shardCount)
 {
-    [_coordinatorLock lock];
-    NSArray* trackedKeys = [self trackedKeys];
-    NSMutableDictionary* untrackedObjectsAndKeys = [_cacheObjects mutableCopy];
-    [untrackedObjectsAndKeys removeObjectsForKeys:trackedKeys];
-    [_coordinatorLock unlock];
-    return untrackedObjectsAndKeys;
+    for (NSUInteger index = shardCount; index > 0; index--) { [shards[index - 1].lock unlock]; }
 }
 
 
+/// @summary The keys of a batch operation, hashed once and grouped by shard so that the
+/// operation can lock each shard once.
+///
+struct VDSCacheKeyBatch {
 
-#pragma mark - Fast Enumeration Behaviors
+    /// The number of keys in the batch.
+    NSUInteger count;
 
-- (NSUInteger)countByEnumeratingWithState:(nonnull NSFastEnumerationState *)state objects:(__unsafe_unretained id  _Nullable * _Nonnull)buffer count:(NSUInteger)len
-{
-    return [_cacheObjects countByEnumeratingWithState:state
-                                               objects:buffer
-                                                 count:len];
+    /// The keys of the batch, in the order they were passed in.
+    std::vector<__unsafe_unretained id> keys;
+
+    /// The hash of each key.
+    std::vector<NSUInteger> hashes;
+
+    /// The indexes of the keys, ordered by shard.
+    std::vector<NSUInteger> order;
+
+    /// The range of order for shard i is [shardStarts[i], shardStarts[i + 1]).
+    std::vector<NSUInteger> shardStarts;
+
+    VDSCacheKeyBatch(NSArray* keyArray, NSUInteger shardCount)
+    : count(keyArray.count), keys(count), hashes(count), order(count), shardStarts(shardCount + 1, 0)
+    {
+        [keyArray getObjects:keys.data() range:NSMakeRange(0, count)];
+
+        /// A counting sort by shard, which is stable, so keys are visited in their original
+        /// order within each shard.
+        std::vector<NSUInteger> shards(count);
+        for (NSUInteger index = 0; index < count; index++) {
+            hashes[index] = [keys[index] hash];
+            shards[index] = shard_index_for_hash(hashes[index], shardCount);
+            shardStarts[shards[index] + 1]++;
+        }
+        for (NSUInteger shard = 0; shard < shardCount; shard++) { shardStarts[shard + 1] += shardStarts[shard]; }
+        std::vector<NSUInteger> positions(shardStarts.begin(), shardStarts.end() - 1);
+        for (NSUInteger index = 0; index < count; index++) { order[positions[shards[index]]++] = index; }
+    }
+};
+
+
+
+#pragma mark - Admission Behaviors
+
+/// The preferred max object count and total cost that an eviction cycle enforces for a shard.
+struct VDSCacheEvictionLimits {
+
+    NSInteger preferredMaxObjectCount;
+    NSUInteger preferredMaxTotalCost;
+
+    /// YES if the tracked entries of table exceed either preference.
+    bool exceededBy(const VDSCacheEntryTable& table) const
+    {
+        return exceeds_preferred_count(preferredMaxObjectCount, table.trackedCount()) ||
+               exceeds_preferred_cost(preferredMaxTotalCost, table.trackedCost());
+    }
+};
+
+
+/// Determines whether the eviction cycle may remove a tracked entry to satisfy the cache size
+/// preferences. Objects that have expired but are still in use, and objects with additional users,
+/// are not removable. In the cache, unused objects that have not expired have a usage count of 1.
+static inline bool is_evictable (const VDSCacheEntry* entry, bool tracksObjectUsage)
+{
+    return entry->expired == false && (tracksObjectUsage == false || entry->usageCount <= 1);
+}
+
+
+/// Returns entry, or the nearest entry toward the head of its segment, that is evictable.
+static inline VDSCacheEntry* least_recent_evictable (VDSCacheEntry* entry, bool tracksObjectUsage)
+{
+    while (entry != NULL && is_evictable(entry, tracksObjectUsage) == false) { entry = entry->recencyPrev; }
+    return entry;
+}
+
+
+/// Marks an entry that an eviction cycle has selected as pending eviction, recording it so that the cycle
+/// can remove it or restore it once the delegate has been consulted. The caller must hold the shard's lock.
+static inline void defer_eviction (VDSCacheShard* shard, VDSCacheEntry* entry, VDSCacheEviction::Cause cause)
+{
+    shard->evictions.emplace_back();
+    VDSCacheEviction& eviction = shard->evictions.back();
+    eviction.key = entry->key;
+    eviction.object = entry->object;
+    eviction.hash = entry->hash;
+    eviction.expiration = entry->expiration;
+    eviction.refreshTime = entry->refreshTime;
+    eviction.usageCount = entry->usageCount;
+    eviction.segment = entry->segment;
+    eviction.scheduled = entry->heapIndex != NSNotFound;
+    eviction.expired = entry->expired;
+    eviction.cause = cause;
+    shard->table.untrackPendingEviction(entry);
+}
+
+
+/// Removes an entry that has expired, or defers its removal if the shard defers evictions. The caller
+/// must hold the shard's lock.
+static inline void expire_entry (VDSCacheShard* shard, VDSCacheEntry* entry)
+{
+    if (shard->defersEvictions) {
+        defer_eviction(shard, entry, VDSCacheEviction::Expired);
+        return;
+    }
+    shard->table.remove(entry);
+}
+
+
+/// Removes an entry that is evicted to meet the size preferences, recording it for demotion to the
+/// disk tier if the shard demotes evictions, or defers its removal if the shard defers evictions.
+/// The caller must hold the shard's lock.
+static inline void evict_entry (VDSCacheShard* shard, VDSCacheEntry* entry)
+{
+    if (shard->defersEvictions) {
+        defer_eviction(shard, entry, VDSCacheEviction::Count);
+        return;
+    }
+    if (shard->demotesEvictions) {
+        shard->demotions.emplace_back();
+        VDSCacheDemotion& demotion = shard->demotions.back();
+        demotion.key = entry->key;
+        demotion.object = entry->object;
+        demotion.expiration = entry->expiration;
+        demotion.cost = entry->cost;
+    }
+    shard->table.remove(entry);
+}
+
+
+/// The number of entries the scan resistant policies size their segments against: the preferred
+/// max object count for the shard if there is one, otherwise the number of tracked entries.
+static inline NSUInteger policy_capacity (NSInteger preferredMaxObjectCount, NSUInteger trackedCount)
+{
+    return preferredMaxObjectCount > 0 ? (NSUInteger)preferredMaxObjectCount : trackedCount;
+}
+
+
+/// Evicts entries from a shard using W-TinyLFU until it meets its limits.
+///
+/// @discussion The window holds 1% of the capacity. Entries beyond that share leave the window for the
+/// probation segment as candidates for admission to the main segments. While the shard exceeds its limits,
+/// the least recent candidate competes with the least recent probation entry, or protected entry once
+/// probation is exhausted, and whichever has been accessed less often, according to the frequency sketch,
+/// is evicted. Candidates that win remain on probation.
+///
+/// @returns false if the budget ended the slice before the shard met its limits.
+///
+static bool evict_tiny_lfu_entries (VDSCacheShard* shard, const VDSCacheEvictionLimits& limits, bool tracksObjectUsage,
+                                    VDSCacheEvictionBudget* budget)
+{
+    VDSCacheEntryTable* table = &shard->table;
+    NSUInteger windowCapacity = MAX(policy_capacity(limits.preferredMaxObjectCount, table->trackedCount()) / 100, (NSUInteger)1);
+
+    /// Each candidate is linked ahead of the previous one, so the first candidate moved is the least recent.
+    VDSCacheEntry* candidate = NULL;
+    while (table->segmentCount(VDSCacheWindowSegment) > windowCapacity) {
+        VDSCacheEntry* entry = table->leastRecent(VDSCacheWindowSegment);
+        table->moveToSegment(entry, VDSCacheProbationSegment);
+        if (candidate == NULL) { candidate = entry; }
+        if (budget != NULL && budget->spend()) { return false; }
+    }
+    candidate = least_recent_evictable(candidate, tracksObjectUsage);
+
+    VDSCacheEntry* probationVictim = least_recent_evictable(table->leastRecent(VDSCacheProbationSegment), tracksObjectUsage);
+    VDSCacheEntry* protectedVictim = least_recent_evictable(table->leastRecent(VDSCacheProtectedSegment), tracksObjectUsage);
+    while (limits.exceededBy(*table)) {
+        /// Once the probation victims reach the candidates, the candidates are evicted in LRU order.
+        if (probationVictim == candidate) { probationVictim = NULL; }
+        VDSCacheEntry* victim = probationVictim != NULL ? probationVictim : protectedVictim;
+        if (candidate == NULL && victim == NULL) {
+            /// The remaining entries are in the window or in use.
+            victim = least_recent_evictable(table->leastRecent(VDSCacheWindowSegment), tracksObjectUsage);
+            if (victim == NULL) { break; }
+            evict_entry(shard, victim);
+            if (budget != NULL && budget->spend()) { return false; }
+            continue;
+        }
+
+        /// Either the candidate is evicted or it is admitted in place of the victim, so every
+        /// comparison moves on to the next candidate.
+        VDSCacheEntry* nextCandidate = candidate != NULL ? least_recent_evictable(candidate->recencyPrev, tracksObjectUsage) : NULL;
+        bool evictsCandidate = candidate != NULL &&
+            (victim == NULL || shard->sketch->frequency(candidate->hash) <= shard->sketch->frequency(victim->hash));
+        if (evictsCandidate) {
+            evict_entry(shard, candidate);
+            candidate = nextCandidate;
+            if (budget != NULL && budget->spend()) { return false; }
+            continue;
+        }
+        candidate = nextCandidate;
+        if (victim == probationVictim) {
+            probationVictim = least_recent_evictable(victim->recencyPrev, tracksObjectUsage);
+            evict_entry(shard, victim);
+        } else {
+            protectedVictim = least_recent_evictable(victim->recencyPrev, tracksObjectUsage);
+            evict_entry(shard, victim);
+        }
+        if (budget != NULL && budget->spend()) { return false; }
+    }
+    return true;
+}
+
+
+/// Evicts entries from a shard using 2Q until it meets its limits.
+///
+/// @discussion While the A1in queue holds more than a quarter of the capacity, entries are evicted
+/// from it in FIFO order and their hashes are remembered in the ghost list, which holds up to half
+/// the capacity. Otherwise entries are evicted from the Am queue in LRU order.
+///
+/// @returns false if the budget ended the slice before the shard met its limits.
+///
+static bool evict_two_queue_entries (VDSCacheShard* shard, const VDSCacheEvictionLimits& limits, bool tracksObjectUsage,
+                                     VDSCacheEvictionBudget* budget)
+{
+    VDSCacheEntryTable* table = &shard->table;
+    NSUInteger capacity = policy_capacity(limits.preferredMaxObjectCount, table->trackedCount());
+    NSUInteger inCapacity = MAX(capacity / 4, (NSUInteger)1);
+    shard->ghosts.setCapacity(MAX(capacity / 2, (NSUInteger)1));
+
+    VDSCacheEntry* inVictim = least_recent_evictable(table->leastRecent(VDSCacheWindowSegment), tracksObjectUsage);
+    VDSCacheEntry* mainVictim = least_recent_evictable(table->leastRecent(VDSCacheProtectedSegment), tracksObjectUsage);
+    while (limits.exceededBy(*table)) {
+        if (inVictim != NULL && (mainVictim == NULL || table->segmentCount(VDSCacheWindowSegment) > inCapacity)) {
+            VDSCacheEntry* next = least_recent_evictable(inVictim->recencyPrev, tracksObjectUsage);
+            shard->ghosts.add(inVictim->hash);
+            evict_entry(shard, inVictim);
+            inVictim = next;
+        } else if (mainVictim != NULL) {
+            VDSCacheEntry* next = least_recent_evictable(mainVictim->recencyPrev, tracksObjectUsage);
+            evict_entry(shard, mainVictim);
+            mainVictim = next;
+        } else {
+            break;
+        }
+        if (budget != NULL && budget->spend()) { return false; }
+    }
+    return true;
+}
+
+
+/// Evicts entries from a shard using CLOCK until it meets its limits.
+///
+/// @discussion The recency order serves as the clock, with the hand at its least recent entry. An entry
+/// whose reference bit is set has its bit cleared and moves to the head of the order, so it is only
+/// evicted if it has not been referenced again by the time the hand returns to it. Accesses therefore
+/// only set the bit, and the ordering work is done here. Lock free readers may set bits while the hand
+/// moves, so each call gives at most one second chance per tracked entry.
+///
+/// @returns false if the budget ended the slice before the shard met its limits.
+///
+static bool evict_clock_entries (VDSCacheShard* shard, const VDSCacheEvictionLimits& limits, bool tracksObjectUsage,
+                                 VDSCacheEvictionBudget* budget)
+{
+    VDSCacheEntryTable* table = &shard->table;
+    NSUInteger secondChances = table->trackedCount();
+    VDSCacheEntry* entry = table->leastRecent();
+    while (entry != NULL && limits.exceededBy(*table)) {
+        /// Entries given a second chance are passed again once the hand reaches the head.
+        VDSCacheEntry* next = entry->recencyPrev;
+        if (entry->referenced.isSet() && secondChances > 0) {
+            secondChances--;
+            entry->referenced.clear();
+            table->touch(entry);
+            if (next == NULL) { next = table->leastRecent(); }
+        } else if (is_evictable(entry, tracksObjectUsage)) {
+            evict_entry(shard, entry);
+        } else {
+            entry = next;
+            continue;
+        }
+        if (budget != NULL && budget->spend()) { return false; }
+        entry = next;
+    }
+    return true;
+}
+
+
+- (void)configureAdmissionSystem
+{
+    if (_evictionPolicy != VDSTinyLFUPolicy) { return; }
+    NSInteger preferredMaxObjectCount = preferred_shard_count(_configuration.preferredMaxObjectCount, _shardCount);
+    NSUInteger sketchCapacity = preferredMaxObjectCount > 0 ? (NSUInteger)preferredMaxObjectCount : VDSCacheDefaultSketchCapacity / _shardCount;
+    for (NSUInteger index = 0; index < _shardCount; index++) {
+        _shards[index].sketch.reset(new VDSCacheFrequencySketch(sketchCapacity));
+    }
+}
+
+
+/// Selects the segment that a newly tracked entry is linked into. The caller must hold the lock of the
+/// entry's shard.
+///
+/// @param entry The entry that will be tracked.
+///
+/// @param shard The shard that holds the entry.
+///
+/// @returns The segment for the entry.
+///
+- (NSUInteger)segmentForNewEntry:(VDSCacheEntry*)entry inShard:(VDSCacheShard*)shard
+{
+    /// 2Q admits a key that was evicted from A1in and referenced again directly to Am.
+    if (_evictionPolicy == VDS2QPolicy && shard->ghosts.contains(entry->hash)) {
+        return VDSCacheProtectedSegment;
+    }
+    return VDSCacheWindowSegment;
+}
+
+
+/// Updates the position of an accessed entry in the segments of a scan resistant eviction policy.
+/// The caller must hold the lock of the entry's shard.
+///
+/// @param entry The tracked entry that was accessed.
+///
+/// @param shard The shard that holds the entry.
+///
+- (void)recordAccessToEntry:(VDSCacheEntry*)entry inShard:(VDSCacheShard*)shard
+{
+    VDSCacheEntryTable* table = &shard->table;
+    if (entry->tracked == false) { return; }
+
+    if (_evictionPolicy == VDSClockPolicy) {
+        /// The eviction cycle does the reordering, so an access only marks the entry.
+        entry->referenced.set();
+    } else if (_evictionPolicy == VDS2QPolicy) {
+        /// Accesses to entries in A1in are ignored, so that an entry used several times in quick
+        /// succession is not mistaken for a frequently used one.
+        if (entry->segment == VDSCacheProtectedSegment) { table->touch(entry); }
+    } else if (_evictionPolicy == VDSTinyLFUPolicy) {
+        if (entry->segment != VDSCacheProbationSegment) {
+            table->touch(entry);
+            return;
+        }
+
+        /// An entry accessed while on probation is promoted. If the protected segment exceeds its
+        /// share of the main segments, its least recent entry is demoted to probation.
+        table->moveToSegment(entry, VDSCacheProtectedSegment);
+        NSInteger preferredMaxObjectCount = preferred_shard_count(_configuration.preferredMaxObjectCount, _shardCount);
+        NSUInteger capacity = policy_capacity(preferredMaxObjectCount, table->trackedCount());
+        NSUInteger protectedCapacity = MAX((capacity - MAX(capacity / 100, (NSUInteger)1)) * 4 / 5, (NSUInteger)1);
+        if (table->segmentCount(VDSCacheProtectedSegment) > protectedCapacity) {
+            table->moveToSegment(table->leastRecent(VDSCacheProtectedSegment), VDSCacheProbationSegment);
+        }
+    }
+}
+
+
+
+#pragma mark - Eviction Behaviors
+
+- (void)processEvictions:(NSTimer* _Nullable)timer
+{
+    /// Launches the eviction operation unless one exists on the queue.
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        [self processCacheEvictions];
+    });
+}
+
+
+- (void)processCacheEvictions
+{
+    /// A delegate that declines the cycle is asked again at the next eviction interval, or, without
+    /// one, once a setter schedules a cycle.
+    id<VDSDatabaseCacheDelegate> delegate = self.delegate;
+    if ([delegate respondsToSelector:@selector(databaseCacheShouldBeginEvictionCycle)] &&
+        [delegate databaseCacheShouldBeginEvictionCycle] == NO) {
+        _evictionDeadline.store(DBL_MAX, std::memory_order_relaxed);
+        if (_configuration.expiresObjects && _configuration.evictionInterval > 0) {
+            [self scheduleEvictionCycleBy:VDSCacheClockNow() + _configuration.evictionInterval];
+        }
+        return;
+    }
+
+    /// Eviction cycles are serialized by a lock of their own. Each shard is locked only while it is
+    /// processed, so accessors for keys in other shards proceed while the cycle runs. The coordinator
+    /// lock is the shard lock of an unsharded cache, so the delegate, which is told of the cycle
+    /// before any shard is locked, is never messaged while a shard lock is held.
+    VDSCacheEvictionBudget budget = [self evictionBudget];
+    [_evictionCycleLock lock];
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    VDSEvictionCycleKey cycleKey = [self evictionCycleKey];
+    BOOL defersEvictions = [self delegateObservesEvictions:delegate];
+    if ([delegate respondsToSelector:@selector(databaseCache:willBeginEvictionCycle:)]) {
+        [delegate databaseCache:self willBeginEvictionCycle:cycleKey];
+    }
+
+    /// The scheduled cycle is this one. Setters that run while the cycle is underway may schedule
+    /// the next cycle before it completes.
+    _evictionDeadline.store(DBL_MAX, std::memory_order_relaxed);
+
+    /// The clock is read once, and every shard compares its expirations against that reading.
+    VDSCacheEvictionLimits limits = [self shardLimits];
+    NSTimeInterval now = VDSCacheClockNow();
+    NSTimeInterval nextDeadline = _configuration.evictionInterval > 0 ? now + _configuration.evictionInterval : DBL_MAX;
+
+    /// Shards share no state, so they are processed in parallel when the cycle has more than one
+    /// thread. Each thread claims the next unprocessed shard until none remain, which balances the
+    /// threads however the work is divided between the shards. Every thread records what it did
+    /// in the sweep of the shard it processed, and the sweeps are combined once all are done.
+    std::vector<VDSCacheShardSweep> sweeps(_shardCount);
+    for (VDSCacheShardSweep& sweep : sweeps) { sweep.defersEvictions = defersEvictions; }
+    NSUInteger threadCount = [self evictionThreadCount];
+    if (threadCount <= 1) {
+        for (NSUInteger index = 0; index < _shardCount; index++) {
+            [self sweepShard:&_shards[index] limits:limits now:now budget:budget sweep:&sweeps[index]];
+        }
+    } else {
+        std::atomic<NSUInteger> nextShard(0);
+        std::atomic<NSUInteger>* cursor = &nextShard;
+        VDSCacheShardSweep* shardSweeps = sweeps.data();
+        VDSCacheShard* shards = _shards;
+        NSUInteger shardCount = _shardCount;
+        dispatch_apply(threadCount, dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^(size_t thread) {
+            for (NSUInteger index = cursor->fetch_add(1); index < shardCount; index = cursor->fetch_add(1)) {
+                [self sweepShard:&shards[index] limits:limits now:now budget:budget sweep:&shardSweeps[index]];
+            }
+        });
+    }
+
+    uint64_t expiredEvictions = 0, countEvictions = 0, costEvictions = 0, lockWait = 0;
+    std::vector<VDSCacheDemotion> demotions;
+    std::vector<VDSCacheEviction> evictions;
+    for (VDSCacheShardSweep& sweep : sweeps) {
+        expiredEvictions += sweep.expiredEvictions;
+        countEvictions += sweep.countEvictions;
+        costEvictions += sweep.costEvictions;
+        lockWait += sweep.lockWait;
+        nextDeadline = MIN(nextDeadline, sweep.nextExpiration);
+        std::move(sweep.demotions.begin(), sweep.demotions.end(), std::back_inserter(demotions));
+        std::move(sweep.evictions.begin(), sweep.evictions.end(), std::back_inserter(evictions));
+    }
+
+    /// The next cycle runs when the earliest remaining object expires, or when the eviction
+    /// interval elapses if that is sooner.
+    if (_configuration.expiresObjects) { [self scheduleEvictionCycleBy:nextDeadline]; }
+
+    uint64_t duration = nanoseconds_since(start);
+    _evictionCycleCount.fetch_add(1, std::memory_order_relaxed);
+    _evictionCycleNanoseconds.fetch_add(duration, std::memory_order_relaxed);
+    _lastEvictionCycleNanoseconds.store(duration, std::memory_order_relaxed);
+
+    [_evictionCycleLock unlock];
+
+    /// Evicted objects are written to the disk tier once every lock has been released.
+    if (demotions.empty() == false) { [self demoteObjects:demotions]; }
+
+    /// The delegate is consulted about the selected objects once every lock has been released, and
+    /// the objects it keeps are not counted as evicted.
+    if (evictions.empty() == false) {
+        uint64_t retained[VDSCacheEviction::CauseCount] = {};
+        [self completeEvictions:evictions inEvictionCycle:cycleKey delegate:delegate retained:retained];
+        expiredEvictions -= retained[VDSCacheEviction::Expired];
+        countEvictions -= retained[VDSCacheEviction::Count];
+        costEvictions -= retained[VDSCacheEviction::Cost];
+    }
+
+    if ([delegate respondsToSelector:@selector(databaseCache:didCompleteEvictionCycle:)]) {
+        [delegate databaseCache:self didCompleteEvictionCycle:cycleKey];
+    }
+    if ([delegate respondsToSelector:@selector(databaseCache:didCompleteEvictionCycle:withMetrics:)]) {
+        [delegate databaseCache:self
+       didCompleteEvictionCycle:cycleKey
+                    withMetrics:@{VDSCacheExpiredEvictionCountKey: @(expiredEvictions),
+                                  VDSCacheCountEvictionCountKey: @(countEvictions),
+                                  VDSCacheCostEvictionCountKey: @(costEvictions),
+                                  VDSCacheLastEvictionCycleDurationKey: @(duration / (double)NSEC_PER_SEC),
+                                  VDSCacheLockWaitDurationKey: @(lockWait / (double)NSEC_PER_SEC)}];
+    }
+}
+
+
+/// Processes a single shard for an eviction cycle, locking the shard while it is processed.
+///
+/// @param shard The shard to process.
+///
+/// @param limits The preferred max object count and total cost for the shard.
+///
+/// @param now The time, on the cache clock, that the cycle began.
+///
+/// @param budget The bound on the work done between releases of the shard's lock.
+///
+/// @param sweep Receives what the cycle did to the shard.
+///
+- (void)sweepShard:(VDSCacheShard*)shard
+            limits:(const VDSCacheEvictionLimits&)limits
+               now:(NSTimeInterval)now
+            budget:(VDSCacheEvictionBudget)budget
+             sweep:(VDSCacheShardSweep*)sweep
+{
+    /// Eviction counters only change while their shard is locked, so the difference across the
+    /// processing of a shard is exactly what the cycle evicted from it, along with any inline
+    /// evictions made by setters between the slices of a time sliced cycle.
+    VDSCacheMetricCounters* metrics = &shard->metrics;
+    sweep->lockWait += lock_shard(shard);
+    uint64_t expired = metrics->expiredEvictions.load(std::memory_order_relaxed);
+    uint64_t count = metrics->countEvictions.load(std::memory_order_relaxed);
+    uint64_t cost = metrics->costEvictions.load(std::memory_order_relaxed);
+    shard->defersEvictions = sweep->defersEvictions;
+    budget.beginSlice();
+    [self processCacheEvictionsInShard:shard limits:limits now:now budget:budget];
+    sweep->expiredEvictions = metrics->expiredEvictions.load(std::memory_order_relaxed) - expired;
+    sweep->countEvictions = metrics->countEvictions.load(std::memory_order_relaxed) - count;
+    sweep->costEvictions = metrics->costEvictions.load(std::memory_order_relaxed) - cost;
+    sweep->lockWait += budget.lockWait;
+    /// Release anything evicted or replaced that lock free readers can no longer observe.
+    shard->table.collectRetiredItems();
+    if (VDSCacheEntry* entry = shard->table.earliestExpiration()) { sweep->nextExpiration = entry->expiration; }
+    sweep->demotions.swap(shard->demotions);
+    sweep->evictions.swap(shard->evictions);
+    shard->defersEvictions = false;
+    [shard->lock unlock];
+}
+
+
+/// The number of threads that process the shards of an eviction cycle, from the configuration.
+- (NSUInteger)evictionThreadCount
+{
+    NSUInteger threadCount = _configuration.evictionConcurrency;
+    if (threadCount == 0) { threadCount = NSProcessInfo.processInfo.activeProcessorCount; }
+    return MIN(threadCount, _shardCount);
+}
+
+
+/// The cycle key reported to the delegate, which identifies the eviction policy of the cycle.
+- (VDSEvictionCycleKey)evictionCycleKey
+{
+    switch (_evictionPolicy) {
+        case VDSFIFOPolicy: return VDSFIFOPolicyCycleKey;
+        case VDSLIFOPolicy: return VDSLIFOPolicyCycleKey;
+        case VDSOATPolicy: return VDSOATPolicyCycleKey;
+        case VDSTinyLFUPolicy: return VDSTinyLFUPolicyCycleKey;
+        case VDS2QPolicy: return VDS2QPolicyCycleKey;
+        case VDSClockPolicy: return VDSClockPolicyCycleKey;
+    }
+    return VDSUnknownCycleKey;
+}
+
+
+/// Schedules an eviction cycle to run no later than deadline. Has no effect if a cycle is already
+/// scheduled to run at or before deadline.
+///
+/// @param deadline The time, on the cache clock, when the cycle should run.
+///
+- (void)scheduleEvictionCycleBy:(NSTimeInterval)deadline
+{
+    NSTimeInterval scheduled = _evictionDeadline.load(std::memory_order_relaxed);
+    while (deadline < scheduled) {
+        if (_evictionDeadline.compare_exchange_weak(scheduled, deadline, std::memory_order_relaxed)) {
+            [VDSDatabaseCacheEvictionScheduler.sharedScheduler scheduleCache:self atDeadline:deadline];
+            return;
+        }
+    }
+}
+
+
+/// Runs the eviction cycle for a single shard. The caller must hold the shard's lock.
+///
+/// @param shard The shard to process.
+///
+/// @param limits The preferred max object count and total cost for the shard.
+///
+/// @param now The time, on the cache clock, that the cycle began.
+///
+/// @param budget The bound on the work done between releases of the shard's lock. The lock is held
+/// again when the method returns.
+///
+- (void)processCacheEvictionsInShard:(VDSCacheShard*)shard
+                              limits:(const VDSCacheEvictionLimits&)limits
+                                 now:(NSTimeInterval)now
+                              budget:(VDSCacheEvictionBudget&)budget
+{
+    VDSCacheEntryTable* table = &shard->table;
+
+    ///
+    /// The cache takes an aggressive approach, removing objects that are
+    /// unused and expired, according to the eviction policy, regardless of the max object count.
+    ///
+    /// The database cache will decrement the object count for any object that has expired.
+    /// If the cache is configured to track uses and the object has no additional uses,
+    /// then the object will be removed.
+    ///
+    /// If cache is configured to remove items that have expired regardless of use,
+    /// then the expired object will be removed. Otherwise, it will be left in the cache.
+    ///
+    /// If the object has not expired but has no users, then the object will be removed if
+    /// the cache exceeds the max object count or the max total cost. Otherwise, the object
+    /// will be left in the cache.
+    ///
+    /// Every step resumes from the expiration heap, the retained expired list, or the recency
+    /// order, which only hold the entries the step has not yet processed, so the shard's lock may
+    /// be released between any two removals without losing the cycle's place.
+    ///
+
+    BOOL tracksObjectUsage = _configuration.tracksObjectUsage;
+
+    if (_configuration.expiresObjects) {
+        /// Step 1. Objects that expired in a prior cycle but were retained because they were in use
+        /// are reconsidered, as their users may have released them since. The list only holds objects
+        /// that are in use, so it is walked without releasing the lock.
+        uint64_t expiredEvictions = 0;
+        for (VDSCacheEntry* entry = table->firstRetainedExpiration(); entry != NULL; ) {
+            VDSCacheEntry* next = entry->expiryNext;
+            if (tracksObjectUsage == NO || entry->usageCount == 0) {
+                expire_entry(shard, entry);
+                expiredEvictions++;
+            }
+            entry = next;
+        }
+
+        /// Step 2. Remove objects that are expired and unused. The expiration heap yields only the
+        /// objects that have expired since the prior cycle, in expiration order, so the cost of this
+        /// step is proportional to the number of newly expired objects rather than the size of the
+        /// cache. Expired objects that are still in use join the retained expired list.
+        VDSCacheEntry* entry = NULL;
+        while ((entry = table->popExpiration(now)) != NULL) {
+            /// This is the first eviction cycle where the object is expired. Decrement its usage count
+            /// to account for initial use increment when the object was added to the object cache.
+            if (tracksObjectUsage && entry->usageCount > 0) { entry->usageCount--; }
+            if (tracksObjectUsage == NO || entry->usageCount == 0) {
+                expire_entry(shard, entry);
+                expiredEvictions++;
+                if (budget.spend()) {
+                    VDSCacheMetricCounters::add(shard->metrics.expiredEvictions, expiredEvictions);
+                    expiredEvictions = 0;
+                    [self yieldShard:shard budget:budget];
+                }
+            }
+        }
+        VDSCacheMetricCounters::add(shard->metrics.expiredEvictions, expiredEvictions);
+
+        /// Step 3. If the cache exceeds the preferred max object count or total cost, and objects in
+        /// use may be evicted, remove the expired objects that are in use. In this implementation, it's
+        /// an all or nothing affair.
+        if (_configuration.evictsObjectsInUse && limits.exceededBy(*table)) {
+            while ((entry = table->firstRetainedExpiration()) != NULL) {
+                expire_entry(shard, entry);
+                VDSCacheMetricCounters::add(shard->metrics.expiredEvictions);
+                if (budget.spend()) { [self yieldShard:shard budget:budget]; }
+            }
+        }
+    }
+
+    /// Step 4. If the cache still exceeds the preferred max object count or total cost, remove in LIFO,
+    /// FIFO, OAT, W-TinyLFU, 2Q, or CLOCK order all unused objects until the cache meets both preferences. In the
+    /// cache, unused objects that have not expried have a usage count of 1. At this point, no cache object
+    /// that is unexpired will have a usage count of 1 unless it is not being used.
+    while ([self evictEntriesInShard:shard limits:limits budget:&budget] == NO) {
+        [self yieldShard:shard budget:budget];
+    }
+}
+
+
+/// Releases a shard's lock between slices of an eviction cycle, so that the accessors waiting for
+/// it proceed, and then reacquires it and begins a new slice.
+///
+/// @param shard The shard the cycle is processing. The caller must hold its lock exactly once.
+///
+/// @param budget The budget of the cycle.
+///
+- (void)yieldShard:(VDSCacheShard*)shard budget:(VDSCacheEvictionBudget&)budget
+{
+    shard->table.collectRetiredItems();
+    [self unlockShardAndDemoteEvictions:shard];
+    std::this_thread::yield();
+    budget.lockWait += lock_shard(shard);
+    budget.beginSlice();
+}
+
+
+/// The bounds on the work an eviction cycle does between releases of a shard's lock, from the configuration.
+- (VDSCacheEvictionBudget)evictionBudget
+{
+    VDSCacheEvictionBudget budget;
+    budget.batchSize = _configuration.evictionBatchSize;
+    budget.sliceNanoseconds = (uint64_t)(MAX(_configuration.evictionTimeSlice, 0.0) * NSEC_PER_SEC);
+    return budget;
+}
+
+
+/// Removes unused tracked objects from a shard, in the order determined by the eviction policy,
+/// until the shard meets its limits. The caller must hold the shard's lock.
+///
+/// @param shard The shard to evict from.
+///
+/// @param limits The preferred max object count and total cost for the shard.
+///
+- (void)evictEntriesInShard:(VDSCacheShard*)shard limits:(const VDSCacheEvictionLimits&)limits
+{
+    [self evictEntriesInShard:shard limits:limits budget:NULL];
+}
+
+
+/// Removes unused tracked objects from a shard, in the order determined by the eviction policy,
+/// until the shard meets its limits or the budget ends the slice. The caller must hold the shard's lock.
+///
+/// @param shard The shard to evict from.
+///
+/// @param limits The preferred max object count and total cost for the shard.
+///
+/// @param budget The bound on the work done in the current slice, or NULL for no bound. Evicting
+/// again after the budget ends a slice resumes from the recency order, which no longer holds the
+/// entries already evicted.
+///
+/// @returns NO if the budget ended the slice before the shard met its limits, otherwise YES.
+///
+- (BOOL)evictEntriesInShard:(VDSCacheShard*)shard
+                     limits:(const VDSCacheEvictionLimits&)limits
+                     budget:(VDSCacheEvictionBudget* _Nullable)budget
+{
+    VDSCacheEntryTable* table = &shard->table;
+    if (limits.exceededBy(*table) == false) { return YES; }
+
+    /// The evictions needed to meet the preferred max object count are attributed to it, and any
+    /// further evictions to the preferred max total cost.
+    NSUInteger trackedCount = table->trackedCount();
+    NSUInteger countExcess = limits.preferredMaxObjectCount > 0 && trackedCount > (NSUInteger)limits.preferredMaxObjectCount ?
+                             trackedCount - (NSUInteger)limits.preferredMaxObjectCount : 0;
+
+    NSUInteger deferred = shard->evictions.size();
+    BOOL finished = [self removeEntriesInShard:shard limits:limits budget:budget];
+
+    NSUInteger evicted = trackedCount - table->trackedCount();
+    VDSCacheMetricCounters::add(shard->metrics.countEvictions, MIN(evicted, countExcess));
+    VDSCacheMetricCounters::add(shard->metrics.costEvictions, evicted - MIN(evicted, countExcess));
+    for (NSUInteger index = deferred + MIN(evicted, countExcess); index < shard->evictions.size(); index++) {
+        shard->evictions[index].cause = VDSCacheEviction::Cost;
+    }
+    return finished;
+}
+
+
+/// Removes unused tracked objects from a shard, in the order determined by the eviction policy,
+/// until the shard meets limits or the budget ends the slice, without recording the evictions in
+/// the shard's metrics. The caller must hold the shard's lock.
+///
+/// @returns NO if the budget ended the slice before the shard met its limits, otherwise YES.
+///
+- (BOOL)removeEntriesInShard:(VDSCacheShard*)shard
+                      limits:(const VDSCacheEvictionLimits&)limits
+                      budget:(VDSCacheEvictionBudget* _Nullable)budget
+{
+    VDSCacheEntryTable* table = &shard->table;
+    bool tracksObjectUsage = _configuration.tracksObjectUsage;
+    bool finished = true;
+    if (_evictionPolicy == VDSTinyLFUPolicy) {
+        finished = evict_tiny_lfu_entries(shard, limits, tracksObjectUsage, budget);
+    } else if (_evictionPolicy == VDS2QPolicy) {
+        finished = evict_two_queue_entries(shard, limits, tracksObjectUsage, budget);
+    } else if (_evictionPolicy == VDSClockPolicy) {
+        finished = evict_clock_entries(shard, limits, tracksObjectUsage, budget);
+    } else {
+        BOOL evictsNewestFirst = _evictionPolicy == VDSLIFOPolicy;
+        VDSCacheEntry* entry = evictsNewestFirst ? table->mostRecent() : table->leastRecent();
+        while (entry != NULL && limits.exceededBy(*table)) {
+            VDSCacheEntry* next = evictsNewestFirst ? entry->recencyNext : entry->recencyPrev;
+            /// Objects that have expired but are still in use, and objects with additional users,
+            /// are skipped.
+            if (is_evictable(entry, tracksObjectUsage)) {
+                evict_entry(shard, entry);
+                if (budget != NULL && budget->spend()) {
+                    finished = next == NULL || limits.exceededBy(*table) == false;
+                    break;
+                }
+            }
+            entry = next;
+        }
+    }
+    return finished;
+}
+
+
+/// The limits that an eviction of a single shard enforces, which are the preferences of the
+/// configuration divided between the shards.
+- (VDSCacheEvictionLimits)shardLimits
+{
+    return VDSCacheEvictionLimits{preferred_shard_count(_configuration.preferredMaxObjectCount, _shardCount),
+                                  preferred_shard_cost(_configuration.preferredMaxTotalCost, _shardCount)};
+}
+
+
+- (BOOL)incrementUsageCount:(id _Nonnull)key
+{
+    BOOL success = NO;
+    /// You can not increment the usage count of a key that
+    /// is not already in the usage list.
+    NSUInteger hash = [key hash];
+    VDSCacheShard* shard = &_shards[shard_index_for_hash(hash, _shardCount)];
+    lock_shard(shard);
+    VDSCacheEntry* entry = shard->table.find(key, hash);
+    if (entry != NULL && entry->usageCount > 0) {
+        entry->usageCount++;
+        success = YES;
+        /// If the tracking is OAT, then the access time
+        /// needs to be updated. CLOCK only sets the reference bit.
+        if (_evictionPolicy == VDSOATPolicy) {
+            shard->table.touch(entry);
+        }
+        if (shard->sketch != nullptr) { shard->sketch->increment(hash); }
+        [self recordAccessToEntry:entry inShard:shard];
+    }
+    [shard->lock unlock];
+    return success;
+}
+
+
+- (BOOL)decrementUsageCount:(id _Nonnull)key
+{
+    BOOL success = NO;
+    /// You can not decrement the usage count of a key that
+    /// is not already in the usage list.
+    NSUInteger hash = [key hash];
+    VDSCacheShard* shard = &_shards[shard_index_for_hash(hash, _shardCount)];
+    lock_shard(shard);
+    VDSCacheEntry* entry = shard->table.find(key, hash);
+    if (entry != NULL && entry->usageCount > 0) {
+        entry->usageCount--;
+        success = YES;
+    }
+    [shard->lock unlock];
+    return success;
+}
+
+
+
+#pragma mark - Memory Pressure Behaviors
+
+- (void)evictObjectsForMemoryPressure:(VDSMemoryPressureLevel)level
+{
+    if (level == VDSMemoryPressureNormal) { return; }
+
+    /// The cycle is serialized with the scheduled eviction cycles, and, like them, only holds one
+    /// shard's lock at a time.
+    VDSCacheEvictionBudget budget = [self evictionBudget];
+    [_evictionCycleLock lock];
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    id<VDSDatabaseCacheDelegate> delegate = self.delegate;
+    if ([delegate respondsToSelector:@selector(databaseCache:willBeginEvictionCycle:)]) {
+        [delegate databaseCache:self willBeginEvictionCycle:VDSLowMemoryCycleKey];
+    }
+
+    uint64_t lowMemoryEvictions = 0, lockWait = 0;
+    BOOL defersEvictions = [self delegateObservesEvictions:delegate];
+    std::vector<VDSCacheDemotion> demotions;
+    std::vector<VDSCacheEviction> evictions;
+    for (NSUInteger index = 0; index < _shardCount; index++) {
+        VDSCacheShard* shard = &_shards[index];
+        lockWait += lock_shard(shard);
+        shard->defersEvictions = defersEvictions;
+        budget.beginSlice();
+        uint64_t trackedCount = shard->table.trackedCount();
+        VDSCacheEvictionLimits limits = [self memoryPressureLimitsForLevel:level trackedCount:trackedCount];
+        while ([self removeEntriesInShard:shard limits:limits budget:&budget] == NO) {
+            [self yieldShard:shard budget:budget];
+        }
+        uint64_t evicted = trackedCount - shard->table.trackedCount();
+        VDSCacheMetricCounters::add(shard->metrics.lowMemoryEvictions, evicted);
+        lowMemoryEvictions += evicted;
+        shard->table.collectRetiredItems();
+        std::move(shard->demotions.begin(), shard->demotions.end(), std::back_inserter(demotions));
+        shard->demotions.clear();
+        for (VDSCacheEviction& eviction : shard->evictions) { eviction.cause = VDSCacheEviction::LowMemory; }
+        std::move(shard->evictions.begin(), shard->evictions.end(), std::back_inserter(evictions));
+        shard->evictions.clear();
+        shard->defersEvictions = false;
+        [shard->lock unlock];
+    }
+    uint64_t duration = nanoseconds_since(start);
+    lockWait += budget.lockWait;
+
+    [_evictionCycleLock unlock];
+
+    /// Demoting to the disk tier releases the objects from memory just as discarding them would.
+    if (demotions.empty() == false) { [self demoteObjects:demotions]; }
+
+    if (evictions.empty() == false) {
+        uint64_t retained[VDSCacheEviction::CauseCount] = {};
+        [self completeEvictions:evictions inEvictionCycle:VDSLowMemoryCycleKey delegate:delegate retained:retained];
+        lowMemoryEvictions -= retained[VDSCacheEviction::LowMemory];
+    }
+
+    if ([delegate respondsToSelector:@selector(databaseCache:didCompleteEvictionCycle:)]) {
+        [delegate databaseCache:self didCompleteEvictionCycle:VDSLowMemoryCycleKey];
+    }
+    if ([delegate respondsToSelector:@selector(databaseCache:didCompleteEvictionCycle:withMetrics:)]) {
+        [delegate databaseCache:self
+       didCompleteEvictionCycle:VDSLowMemoryCycleKey
+                    withMetrics:@{VDSCacheLowMemoryEvictionCountKey: @(lowMemoryEvictions),
+                                  VDSCacheLastEvictionCycleDurationKey: @(duration / (double)NSEC_PER_SEC),
+                                  VDSCacheLockWaitDurationKey: @(lockWait / (double)NSEC_PER_SEC)}];
+    }
+}
+
+
+/// The limits that shed the share of a shard's tracked objects for a memory pressure level. A
+/// warning keeps three quarters of them, an urgent level keeps half, and a critical level keeps
+/// none, with a negative preferred max object count, so every evictable object is shed.
+///
+/// @param level The memory pressure level. Must not be VDSMemoryPressureNormal.
+///
+/// @param trackedCount The number of tracked objects in the shard.
+///
+/// @returns The limits for the shard.
+///
+- (VDSCacheEvictionLimits)memoryPressureLimitsForLevel:(VDSMemoryPressureLevel)level trackedCount:(NSUInteger)trackedCount
+{
+    NSUInteger retainedCount = 0;
+    if (level == VDSMemoryPressureWarning) {
+        retainedCount = trackedCount - trackedCount / 4;
+    } else if (level == VDSMemoryPressureUrgent) {
+        retainedCount = trackedCount - trackedCount / 2;
+    }
+    return VDSCacheEvictionLimits{retainedCount > 0 ? (NSInteger)retainedCount : -1, 0};
+}
+
+
+
+#pragma mark - Eviction Delegation Behaviors
+
+/// YES if the delegate implements any of the messages about the objects an eviction cycle evicts, in
+/// which case the cycle defers its evictions until the delegate has been consulted.
+- (BOOL)delegateObservesEvictions:(id<VDSDatabaseCacheDelegate>)delegate
+{
+    return [delegate respondsToSelector:@selector(databaseCache:shouldEvictObjects:usingKeys:inEvictionCycle:)] ||
+           [delegate respondsToSelector:@selector(databaseCache:shouldEvictObject:usingKey:inEvictionCycle:)] ||
+           [delegate respondsToSelector:@selector(databaseCache:willEvictObjects:usingKeys:inEvictionCycle:)] ||
+           [delegate respondsToSelector:@selector(databaseCache:didEvictObjects:usingKeys:inEvictionCycle:)];
+}
+
+
+/// Consults the delegate about the objects an eviction cycle selected, removes the objects it approves,
+/// and tracks the others again as they were. Called once the cycle has released every lock.
+///
+/// @discussion The delegate is asked about every selected object in a single batch, and is told of
+/// the objects that will be evicted in another, so it is never called while a shard is locked. Each
+/// shard is then locked once to remove or restore its objects. An object whose key has been removed
+/// or stored again since it was selected is no longer pending eviction and is left as it is. An object
+/// whose usage count has risen since it was selected is in use, and is restored. The objects that were evicted are reported
+/// with databaseCache:didEvictObjects:usingKeys:inEvictionCycle: on the delegate queue.
+///
+/// @param evictions The objects the cycle selected.
+///
+/// @param cycleKey The type of the cycle.
+///
+/// @param delegate The delegate of the cache when the cycle began.
+///
+/// @param retained Receives the number of selected objects that were not evicted, indexed by cause.
+///
+- (void)completeEvictions:(std::vector<VDSCacheEviction>&)evictions
+          inEvictionCycle:(VDSEvictionCycleKey)cycleKey
+                 delegate:(id<VDSDatabaseCacheDelegate>)delegate
+                 retained:(uint64_t*)retained
+{
+    NSUInteger count = evictions.size();
+    std::vector<__unsafe_unretained id> keyBuffer(count), objectBuffer(count);
+    for (NSUInteger index = 0; index < count; index++) {
+        keyBuffer[index] = evictions[index].key;
+        objectBuffer[index] = evictions[index].object;
+    }
+    NSArray* keys = [NSArray arrayWithObjects:keyBuffer.data() count:count];
+    NSArray* objects = [NSArray arrayWithObjects:objectBuffer.data() count:count];
+
+    /// The batched message is preferred. A delegate that only decides object by object is asked about
+    /// each one here, outside of every lock.
+    std::vector<bool> evicts(count, true);
+    if ([delegate respondsToSelector:@selector(databaseCache:shouldEvictObjects:usingKeys:inEvictionCycle:)]) {
+        NSIndexSet* indexes = [delegate databaseCache:self shouldEvictObjects:objects usingKeys:keys inEvictionCycle:cycleKey];
+        for (NSUInteger index = 0; index < count; index++) { evicts[index] = [indexes containsIndex:index]; }
+    } else if ([delegate respondsToSelector:@selector(databaseCache:shouldEvictObject:usingKey:inEvictionCycle:)]) {
+        for (NSUInteger index = 0; index < count; index++) {
+            evicts[index] = [delegate databaseCache:self shouldEvictObject:objectBuffer[index] usingKey:keyBuffer[index] inEvictionCycle:cycleKey];
+        }
+    }
+
+    NSMutableIndexSet* approved = [NSMutableIndexSet indexSet];
+    for (NSUInteger index = 0; index < count; index++) {
+        if (evicts[index]) { [approved addIndex:index]; }
+    }
+    if (approved.count > 0 && [delegate respondsToSelector:@selector(databaseCache:willEvictObjects:usingKeys:inEvictionCycle:)]) {
+        [delegate databaseCache:self
+               willEvictObjects:approved.count == count ? objects : [objects objectsAtIndexes:approved]
+                      usingKeys:approved.count == count ? keys : [keys objectsAtIndexes:approved]
+                inEvictionCycle:cycleKey];
+    }
+
+    /// The selections are visited by shard, so that each shard is locked once.
+    std::vector<NSUInteger> order(count);
+    std::vector<NSUInteger> shardIndexes(count);
+    for (NSUInteger index = 0; index < count; index++) {
+        order[index] = index;
+        shardIndexes[index] = shard_index_for_hash(evictions[index].hash, _shardCount);
+    }
+    std::stable_sort(order.begin(), order.end(), [&shardIndexes](NSUInteger a, NSUInteger b) { return shardIndexes[a] < shardIndexes[b]; });
+
+    NSMutableArray* evictedKeys = [NSMutableArray arrayWithCapacity:approved.count];
+    NSMutableArray* evictedObjects = [NSMutableArray arrayWithCapacity:approved.count];
+    std::vector<VDSCacheDemotion> demotions;
+    for (NSUInteger start = 0; start < count; ) {
+        VDSCacheShard* shard = &_shards[shardIndexes[order[start]]];
+        VDSCacheEntryTable* table = &shard->table;
+        NSUInteger end = start;
+        lock_shard(shard);
+        for (; end < count && shardIndexes[order[end]] == shardIndexes[order[start]]; end++) {
+            NSUInteger index = order[end];
+            VDSCacheEviction& eviction = evictions[index];
+            VDSCacheEntry* entry = table->find(eviction.key, eviction.hash);
+            bool pending = entry != NULL && entry->pendingEviction;
+            bool inUse = pending && entry->usageCount > eviction.usageCount;
+            if (pending && inUse == false && evicts[index]) {
+                if (shard->demotesEvictions && eviction.cause != VDSCacheEviction::Expired) {
+                    demotions.emplace_back();
+                    VDSCacheDemotion& demotion = demotions.back();
+                    demotion.key = eviction.key;
+                    demotion.object = eviction.object;
+                    demotion.expiration = eviction.expiration;
+                    demotion.cost = entry->cost;
+                }
+                table->remove(entry);
+                [evictedKeys addObject:eviction.key];
+                [evictedObjects addObject:eviction.object];
+                continue;
+            }
+
+            if (pending) {
+                table->track(entry, eviction.segment);
+                entry->refreshTime = eviction.refreshTime;
+                if (eviction.expired) {
+                    entry->expiration = eviction.expiration;
+                    table->retainExpired(entry);
+                } else if (eviction.scheduled) {
+                    table->scheduleExpiration(entry, eviction.expiration);
+                    [self scheduleEvictionCycleBy:eviction.expiration];
+                }
+            }
+            retained[eviction.cause]++;
+            switch (eviction.cause) {
+                case VDSCacheEviction::Expired: VDSCacheMetricCounters::subtract(shard->metrics.expiredEvictions, 1); break;
+                case VDSCacheEviction::Count: VDSCacheMetricCounters::subtract(shard->metrics.countEvictions, 1); break;
+                case VDSCacheEviction::Cost: VDSCacheMetricCounters::subtract(shard->metrics.costEvictions, 1); break;
+                case VDSCacheEviction::LowMemory: VDSCacheMetricCounters::subtract(shard->metrics.lowMemoryEvictions, 1); break;
+                case VDSCacheEviction::CauseCount: break;
+            }
+        }
+        table->collectRetiredItems();
+        [shard->lock unlock];
+        start = end;
+    }
+    if (demotions.empty() == false) { [self demoteObjects:demotions]; }
+
+    if (evictedKeys.count == 0 || [delegate respondsToSelector:@selector(databaseCache:didEvictObjects:usingKeys:inEvictionCycle:)] == NO) { return; }
+    void (^notification)(void) = ^{
+        [delegate databaseCache:self didEvictObjects:evictedObjects usingKeys:evictedKeys inEvictionCycle:cycleKey];
+    };
+    VDSOperationQueue* queue = self.delegateQueue;
+    if (queue != nil) {
+        [queue addOperation:[NSBlockOperation blockOperationWithBlock:notification]];
+    } else {
+        dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), notification);
+    }
+}
+
+
+
+#pragma mark - Supporting Behaviors
+
+- (void)setObject:(id _Nonnull)object forKey:(id _Nonnull)key
+{
+    [self setObject:object forKey:key tracked:NO expires:nil];
+}
+
+
+-(void)setObject:(id)object forKey:(id)key tracked:(BOOL)tracked
+{
+    [self setObject:object forKey:key tracked:tracked expires:nil];
+}
+
+
+- (void)setObject:(id _Nonnull)object
+           forKey:(id _Nonnull)key
+          tracked:(BOOL)tracked
+          expires:(NSDate * _Nullable)expiration
+{
+    [self setObject:object forKey:key tracked:tracked expires:expiration cost:VDSCacheObjectProvidedCost];
+}
+
+
+- (void)setObject:(id _Nonnull)object
+           forKey:(id _Nonnull)key
+          tracked:(BOOL)tracked
+          expires:(NSDate * _Nullable)expiration
+             cost:(NSUInteger)cost
+{
+    /// When setting an object, its important to lock down the various parts of the
+    /// cache that support the state of the object as the change needs to be 'atomic'.
+    /// All of the state for a key is held by its shard, so only the shard is locked.
+    /// The stored object supersedes any object for the key in the disk tier.
+    [self.diskTier removeObjectForKey:key];
+    NSUInteger hash = [key hash];
+    VDSCacheShard* shard = &_shards[shard_index_for_hash(hash, _shardCount)];
+    VDSCacheEntryTable* table = &shard->table;
+    lock_shard(shard);
+
+    VDSCacheEntry* entry = [self storeObject:object forKey:key hash:hash cost:cost tracked:tracked inShard:shard];
+
+    /// If expiration is supported, the timing must be calculated (even if it's just
+    /// read in from a value in object or key). Rescheduling an expired object makes it
+    /// unexpired.
+    if (entry != NULL && entry->tracked) {
+        VDSCacheTime now = VDSCacheTimeNow();
+        NSTimeInterval expires = expiration != nil ? VDSCacheClockTimeForReferenceTime(now, expiration.timeIntervalSinceReferenceDate) : [self expirationForEntry:entry inShard:shard now:now];
+        table->scheduleExpiration(entry, expires);
+        entry->refreshTime = refresh_time(now.clock, expires, _refreshInterval);
+        if (_configuration.expiresObjects) { [self scheduleEvictionCycleBy:expires]; }
+    }
+
+    /// Inline eviction happens once the entry is fully stored, as the policy may select the new
+    /// entry itself for eviction.
+    if (_evictsOnInsert) { [self evictEntriesInShard:shard limits:[self shardLimits]]; }
+
+    /// Once all of the changes have been made, unlock the shard.
+    [self unlockShardAndDemoteEvictions:shard];
+}
+
+
+- (void)setObjects:(NSArray* _Nonnull)objects
+           forKeys:(NSArray* _Nonnull)keys
+           tracked:(BOOL)tracked
+           expires:(NSDate* _Nullable)expiration
+{
+    NSAssert(objects.count == keys.count, VDS_MISMATCHED_OBJECTS_AND_KEYS_MESSAGE(objects.count, keys.count, _cmd));
+
+    VDSCacheKeyBatch batch(keys, _shardCount);
+    std::vector<__unsafe_unretained id> batchObjects(batch.count);
+    VDSDatabaseCacheDiskTier* diskTier = self.diskTier;
+    for (NSUInteger index = 0; diskTier != nil && index < batch.count; index++) { [diskTier removeObjectForKey:batch.keys[index]]; }
+    [objects getObjects:batchObjects.data() range:NSMakeRange(0, batch.count)];
+
+    /// The expiration is the same for every object unless it is determined by the timing map,
+    /// so it is only calculated once.
+    VDSCacheTime now = VDSCacheTimeNow();
+    BOOL usesTimingMap = expiration == nil && (_expirationEvaluator != nil || !_expirationIntervals.empty());
+    NSTimeInterval sharedExpiration = expiration != nil ? VDSCacheClockTimeForReferenceTime(now, expiration.timeIntervalSinceReferenceDate) : now.clock + self.defaultExpirationInterval;
+
+    std::vector<VDSCacheEntry*> scheduledEntries;
+    std::vector<NSTimeInterval> scheduledExpirations;
+    for (NSUInteger shardIndex = 0; shardIndex < _shardCount; shardIndex++) {
+        NSUInteger start = batch.shardStarts[shardIndex];
+        NSUInteger end = batch.shardStarts[shardIndex + 1];
+        if (start == end) { continue; }
+
+        VDSCacheShard* shard = &_shards[shardIndex];
+        VDSCacheEntryTable* table = &shard->table;
+        lock_shard(shard);
+
+        /// Size the table for the batch up front so that it grows at most once.
+        table->reserve(table->count() + (end - start));
+        scheduledEntries.clear();
+        scheduledExpirations.clear();
+        for (NSUInteger position = start; position < end; position++) {
+            NSUInteger index = batch.order[position];
+            VDSCacheEntry* entry = [self storeObject:batchObjects[index]
+                                                  forKey:batch.keys[index]
+                                                    hash:batch.hashes[index]
+                                                    cost:VDSCacheObjectProvidedCost
+                                                 tracked:tracked
+                                                 inShard:shard];
+            if (entry != NULL && entry->tracked) {
+                scheduledEntries.push_back(entry);
+                scheduledExpirations.push_back(usesTimingMap ? [self expirationForEntry:entry inShard:shard now:now] : sharedExpiration);
+                entry->refreshTime = refresh_time(now.clock, scheduledExpirations.back(), _refreshInterval);
+            }
+        }
+        table->scheduleExpirations(scheduledEntries.data(), scheduledExpirations.data(), scheduledEntries.size());
+        if (_configuration.expiresObjects && scheduledEntries.size() > 0) {
+            [self scheduleEvictionCycleBy:*std::min_element(scheduledExpirations.begin(), scheduledExpirations.end())];
+        }
+        if (_evictsOnInsert) { [self evictEntriesInShard:shard limits:[self shardLimits]]; }
+
+        [self unlockShardAndDemoteEvictions:shard];
+    }
+}
+
+
+/// Stores an object in a shard, merging with or replacing an existing object for the key and
+/// updating the tracking state of its entry. The caller must hold the lock of the shard,
+/// and must schedule the expiration of the returned entry if it is tracked.
+///
+/// An update that is merged without changing the cached object, and that leaves its tracking
+/// state and cost as they were, is skipped, so the entry's expiration and recency are not touched.
+/// An update of a stale entry is never skipped, so that a refresh always renews its deadlines.
+///
+/// @param object The object to store.
+///
+/// @param key The key for the object.
+///
+/// @param hash The hash of key.
+///
+/// @param cost The cost of the object, or VDSCacheObjectProvidedCost to request the cost from
+/// the stored object once any merge is complete.
+///
+/// @param tracked YES if the object should be tracked.
+///
+/// @param shard The shard that the key is assigned to.
+///
+/// @returns The entry for the key, or NULL if the update was skipped.
+///
+- (VDSCacheEntry*)storeObject:(id)object
+                       forKey:(id)key
+                         hash:(NSUInteger)hash
+                         cost:(NSUInteger)cost
+                      tracked:(BOOL)tracked
+                      inShard:(VDSCacheShard*)shard
+{
+    VDSCacheEntryTable* table = &shard->table;
+
+    /// If the object contained in the cache is mergable, then the object
+    /// needs to be extracted, merged, and then reset. If the object is
+    /// not mergable, then it needs to be replaced.
+    VDSCacheEntry* entry = table->find(key, hash);
+    uint8_t updateTraits = 0, cachedTraits = 0;
+    if (entry != NULL && _configuration.replacesObjectsOnUpdate == NO) {
+        updateTraits = shard->classTraits.of(object);
+        cachedTraits = (updateTraits & VDSCacheClassTraits::Mergeable) ? shard->classTraits.of(entry->object) : 0;
+    }
+    if (cachedTraits & VDSCacheClassTraits::Mergeable) {
+        bool changed = merge_object(entry->object, object, cachedTraits, updateTraits);
+        bool tracks = _configuration.expiresObjects && tracked;
+        if (changed == false && entry->tracked == tracks && entry->expired == false && entry->pendingEviction == false &&
+            (cost == VDSCacheObjectProvidedCost || cost == entry->cost) &&
+            (entry->refreshTime == DBL_MAX || VDSCacheClockNow() < entry->refreshTime)) {
+            VDSCacheMetricCounters::add(shard->metrics.unchangedMerges);
+            return NULL;
+        }
+        VDSCacheMetricCounters::add(shard->metrics.merges);
+    } else if (entry != NULL) {
+        table->setObject(entry, object);
+        VDSCacheMetricCounters::add(shard->metrics.replacements);
+    } else {
+        /// Keys are copied, matching the behavior of NSMutableDictionary.
+        entry = table->insert([key copy], object, hash);
+        VDSCacheMetricCounters::add(shard->metrics.inserts);
+    }
+
+    /// A merged object is asked for its cost once the update has been merged into it.
+    table->setCost(entry, cost != VDSCacheObjectProvidedCost ? cost : cost_of_object(entry->object, shard->classTraits.of(entry->object)));
+
+    if (_configuration.expiresObjects && tracked) {
+        /// To keep the eviction policy order (FIFO, LIFO, or OAT/LRU) accurate,
+        /// an updated object is moved to the head of the recency order.
+        if (entry->tracked == false) {
+            table->track(entry, [self segmentForNewEntry:entry inShard:shard]);
+        } else if (_evictionPolicy == VDSTinyLFUPolicy || _evictionPolicy == VDS2QPolicy || _evictionPolicy == VDSClockPolicy) {
+            [self recordAccessToEntry:entry inShard:shard];
+        } else {
+            table->touch(entry);
+        }
+        if (shard->sketch != nullptr) { shard->sketch->increment(hash); }
+
+        /// Usage Tracking. A newly tracked object, or an object whose initial use was
+        /// released when it expired, receives the initial use increment.
+        if (_configuration.tracksObjectUsage && (entry->usageCount == 0 || entry->expired)) {
+            entry->usageCount++;
+        }
+    } else {
+        /// An object that is updated without tracking leaves the tracking system, or, if an eviction
+        /// cycle selected it, is no longer pending eviction.
+        table->untrack(entry);
+    }
+    return entry;
+}
+
+
+/// Determines the expiration of a tracked entry when no expiration date is provided, using the
+/// expiration interval for its entity or class if the cache has one, then the expiration timing map
+/// if the cache has one, and the default expiration interval otherwise.
+///
+/// @param entry The tracked entry whose expiration will be determined.
+///
+/// @param shard The shard that holds the entry. The caller must hold the shard's lock.
+///
+/// @param now The current time. Timing map expressions are evaluated against its wall clock time.
+///
+/// @returns The expiration, on the cache clock.
+///
+- (NSTimeInterval)expirationForEntry:(VDSCacheEntry*)entry inShard:(VDSCacheShard*)shard now:(VDSCacheTime)now
+{
+    NSTimeInterval interval = 0;
+    if (_expirationIntervals.find(entry->key, entry->object, &interval)) {
+        return now.clock + interval;
+    }
+    if (_expirationEvaluator != nil) {
+        NSTimeInterval expiration = [_expirationEvaluator expirationForKey:entry->key object:entry->object now:now.reference context:shard->expressionContext];
+        return VDSCacheClockTimeForReferenceTime(now, expiration);
+    }
+    return now.clock + self.defaultExpirationInterval;
+}
+
+
+- (void)removeObjectForKey:(id _Nonnull)key
+{
+    /// Removing the entry unlinks it from all tracking orders.
+    NSUInteger hash = [key hash];
+    VDSCacheShard* shard = &_shards[shard_index_for_hash(hash, _shardCount)];
+    lock_shard(shard);
+    VDSCacheEntry* entry = shard->table.find(key, hash);
+    if (entry != NULL) { shard->table.remove(entry); }
+    [shard->lock unlock];
+    [self.diskTier removeObjectForKey:key];
+}
+
+
+- (void)removeObjectsForKeys:(NSArray* _Nonnull)keys
+{
+    VDSCacheKeyBatch batch(keys, _shardCount);
+    for (NSUInteger shardIndex = 0; shardIndex < _shardCount; shardIndex++) {
+        NSUInteger start = batch.shardStarts[shardIndex];
+        NSUInteger end = batch.shardStarts[shardIndex + 1];
+        if (start == end) { continue; }
+
+        VDSCacheShard* shard = &_shards[shardIndex];
+        lock_shard(shard);
+        for (NSUInteger position = start; position < end; position++) {
+            NSUInteger index = batch.order[position];
+            VDSCacheEntry* entry = shard->table.find(batch.keys[index], batch.hashes[index]);
+            if (entry != NULL) { shard->table.remove(entry); }
+        }
+        [shard->lock unlock];
+    }
+    VDSDatabaseCacheDiskTier* diskTier = self.diskTier;
+    for (NSUInteger index = 0; diskTier != nil && index < batch.count; index++) { [diskTier removeObjectForKey:batch.keys[index]]; }
+}
+
+
+- (void)removeAllObjects
+{
+    /// This method empties the cache and all associated tracking data
+    /// effectively taking the cache back to a clean initialization state.
+    lock_shards(_shards, _shardCount);
+    for (NSUInteger index = 0; index < _shardCount; index++) {
+        _shards[index].table.removeAll();
+    }
+    unlock_shards(_shards, _shardCount);
+    [self.diskTier removeAllObjects];
+}
+
+
+- (id _Nullable)objectForKey:(id _Nonnull)key
+{
+    BOOL stale = NO;
+    id object = [self objectForKey:key countsLookup:YES stale:&stale];
+    if (stale) {
+        VDSDatabaseCacheLoader loader = self.refreshLoader;
+        if (loader != nil) { [self refreshObjectForKey:key loader:loader queue:self.refreshQueue]; }
+    }
+    return object;
+}
+
+
+/// Retrieves an object from the cache if it exists, promoting it from the disk tier if it is there.
+///
+/// @discussion When the cache has a refresh interval, an object that has reached its expiration is
+/// treated as a miss, and a stale object is returned and reported through stale.
+///
+/// @param key A key used to store an object in the cache.
+///
+/// @param countsLookup YES to record the lookup as a hit or miss in the metrics, NO for a lookup
+/// that repeats one that was already recorded.
+///
+/// @param stale If not NULL, set to YES if the object is stale, otherwise NO.
+///
+/// @returns An object if found, otherwise nil.
+///
+- (id _Nullable)objectForKey:(id _Nonnull)key countsLookup:(BOOL)countsLookup stale:(BOOL* _Nullable)stale
+{
+    NSUInteger hash = [key hash];
+    VDSCacheShard* shard = &_shards[shard_index_for_hash(hash, _shardCount)];
+    /// The frequency sketch counts every lookup, including misses, so a key that is requested
+    /// repeatedly builds up the frequency it needs to be admitted once it is stored.
+    if (shard->sketch != nullptr) { shard->sketch->increment(hash); }
+    VDSCacheEntryDeadlines deadlines;
+    id object = nil;
+    if (_usesLockFreeReads) {
+        /// Lock free reads can not reorder the segments, so only the sketch and the reference bits
+        /// of CLOCK observe them.
+        object = shard->table.concurrentObjectForKey(key, hash, _refreshInterval > 0 ? &deadlines : NULL,
+                                                     _evictionPolicy == VDSClockPolicy);
+    } else {
+        lock_shard(shard);
+        VDSCacheEntry* entry = shard->table.find(key, hash);
+        if (entry != NULL) {
+            object = entry->object;
+            if (entry->tracked) {
+                deadlines.expiration = entry->expiration;
+                deadlines.refreshTime = entry->refreshTime;
+            }
+            [self recordAccessToEntry:entry inShard:shard];
+        }
+        [shard->lock unlock];
+    }
+
+    /// Deadlines are only consulted when objects become stale, so caches without a refresh interval
+    /// keep returning expired objects until an eviction cycle removes them.
+    BOOL isStale = NO;
+    if (object != nil && _refreshInterval > 0 && deadlines.expiration != DBL_MAX) {
+        NSTimeInterval now = VDSCacheClockNow();
+        if (now >= deadlines.expiration) {
+            object = nil;
+        } else if (now >= deadlines.refreshTime) {
+            isStale = YES;
+            if (countsLookup) { VDSCacheMetricCounters::add(shard->metrics.staleHits); }
+        }
+    }
+    if (stale != NULL) { *stale = isStale; }
+    if (countsLookup) { VDSCacheMetricCounters::add(object != nil ? shard->metrics.hits : shard->metrics.misses); }
+    return object ?: [self promoteObjectForKey:key];
+}
+
+
+
+- (NSArray* _Nonnull)objectsForKeys:(NSArray* _Nonnull)keys notFoundMarker:(id _Nonnull)marker
+{
+    VDSCacheKeyBatch batch(keys, _shardCount);
+    std::vector<id> objects(batch.count);
+    std::vector<VDSCacheEntryDeadlines> deadlines(_refreshInterval > 0 ? batch.count : 0);
+    std::vector<NSUInteger> staleIndexes;
+    NSTimeInterval now = _refreshInterval > 0 ? VDSCacheClockNow() : 0;
+    for (NSUInteger shardIndex = 0; shardIndex < _shardCount; shardIndex++) {
+        NSUInteger start = batch.shardStarts[shardIndex];
+        NSUInteger end = batch.shardStarts[shardIndex + 1];
+        if (start == end) { continue; }
+
+        VDSCacheShard* shard = &_shards[shardIndex];
+        if (shard->sketch != nullptr) {
+            for (NSUInteger position = start; position < end; position++) { shard->sketch->increment(batch.hashes[batch.order[position]]); }
+        }
+        if (_usesLockFreeReads) {
+            for (NSUInteger position = start; position < end; position++) {
+                NSUInteger index = batch.order[position];
+                objects[index] = shard->table.concurrentObjectForKey(batch.keys[index], batch.hashes[index], deadlines.empty() ? NULL : &deadlines[index],
+                                                                     _evictionPolicy == VDSClockPolicy);
+            }
+        } else {
+            lock_shard(shard);
+            for (NSUInteger position = start; position < end; position++) {
+                NSUInteger index = batch.order[position];
+                VDSCacheEntry* entry = shard->table.find(batch.keys[index], batch.hashes[index]);
+                if (entry == NULL) { continue; }
+                objects[index] = entry->object;
+                if (deadlines.empty() == false && entry->tracked) {
+                    deadlines[index].expiration = entry->expiration;
+                    deadlines[index].refreshTime = entry->refreshTime;
+                }
+                [self recordAccessToEntry:entry inShard:shard];
+            }
+            [shard->lock unlock];
+        }
+
+        /// The counters are updated once per shard rather than once per key.
+        uint64_t hits = 0, staleHits = 0;
+        for (NSUInteger position = start; position < end; position++) {
+            NSUInteger index = batch.order[position];
+            if (objects[index] != nil && deadlines.empty() == false) {
+                if (now >= deadlines[index].expiration) {
+                    objects[index] = nil;
+                } else if (now >= deadlines[index].refreshTime) {
+                    staleIndexes.push_back(index);
+                    staleHits++;
+                }
+            }
+            if (objects[index] != nil) { hits++; }
+            else { objects[index] = marker; }
+        }
+        VDSCacheMetricCounters::add(shard->metrics.hits, hits);
+        VDSCacheMetricCounters::add(shard->metrics.staleHits, staleHits);
+        VDSCacheMetricCounters::add(shard->metrics.misses, (end - start) - hits);
+    }
+
+    /// Refreshes are started once no shard is locked.
+    VDSDatabaseCacheLoader loader = staleIndexes.empty() ? nil : self.refreshLoader;
+    if (loader != nil) {
+        VDSOperationQueue* queue = self.refreshQueue;
+        for (NSUInteger index : staleIndexes) { [self refreshObjectForKey:batch.keys[index] loader:loader queue:queue]; }
+    }
+
+    /// Misses are promoted from the disk tier once no shard is locked.
+    if (self.diskTier != nil) {
+        for (NSUInteger index = 0; index < batch.count; index++) {
+            if (objects[index] == marker) { objects[index] = [self promoteObjectForKey:batch.keys[index]] ?: marker; }
+        }
+    }
+    return [NSArray arrayWithObjects:objects.data() count:batch.count];
+}
+
+
+
+#pragma mark - Loading Behaviors
+
+- (void)objectForKey:(id _Nonnull)key
+              loader:(VDSDatabaseCacheLoader _Nonnull)loader
+          completion:(VDSDatabaseCacheLoadCompletion _Nonnull)completion
+{
+    [self objectForKey:key loader:loader queue:nil completion:completion];
+}
+
+
+- (void)objectForKey:(id _Nonnull)key
+              loader:(VDSDatabaseCacheLoader _Nonnull)loader
+               queue:(VDSOperationQueue* _Nullable)queue
+          completion:(VDSDatabaseCacheLoadCompletion _Nonnull)completion
+{
+    BOOL stale = NO;
+    id object = [self objectForKey:key countsLookup:YES stale:&stale];
+    if (object != nil) {
+        completion(object, nil);
+        if (stale) { [self refreshObjectForKey:key loader:loader queue:queue]; }
+        return;
+    }
+
+    /// The first request to miss starts the load, and every later request waits for it.
+    os_unfair_lock_lock(&_loadLock);
+    NSMutableArray<VDSDatabaseCacheLoadCompletion>* waiters = _loads[key];
+    BOOL startsLoad = waiters == nil;
+    if (startsLoad) {
+        waiters = [NSMutableArray new];
+        _loads[key] = waiters;
+    }
+    [waiters addObject:[completion copy]];
+    os_unfair_lock_unlock(&_loadLock);
+    if (startsLoad == NO) { return; }
+
+    /// A load that finished between the lookup and the registration has already stored its object,
+    /// which is stored before the load leaves the loads in flight.
+    object = [self objectForKey:key countsLookup:NO stale:NULL];
+    if (object != nil) {
+        [self finishLoadForKey:key object:object error:nil];
+        return;
+    }
+    [self startLoadForKey:key loader:loader queue:queue location:_cmd];
+}
+
+
+/// Starts a refresh of a stale object unless a load of its key is already in flight.
+///
+/// @param key The key of the stale object.
+///
+/// @param loader The block that loads the refreshed object.
+///
+/// @param queue The queue that runs the refresh, or nil to call the loader on a global dispatch queue.
+///
+- (void)refreshObjectForKey:(id)key loader:(VDSDatabaseCacheLoader)loader queue:(VDSOperationQueue* _Nullable)queue
+{
+    /// A refresh is registered as a load with no waiting completions, so reads that miss while it
+    /// is in flight wait for it rather than starting a load of their own.
+    os_unfair_lock_lock(&_loadLock);
+    BOOL startsLoad = _loads[key] == nil;
+    if (startsLoad) { _loads[key] = [NSMutableArray new]; }
+    os_unfair_lock_unlock(&_loadLock);
+    if (startsLoad == NO) { return; }
+
+    if (queue != nil) {
+        [self startLoadForKey:key loader:loader queue:queue location:_cmd];
+        return;
+    }
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        [self startLoadForKey:key loader:loader queue:nil location:_cmd];
+    });
+}
+
+
+/// Runs the loader for a load that has been registered with the loads in flight, storing the loaded
+/// object before the load is finished.
+///
+/// @param key The key being loaded.
+///
+/// @param loader The block that loads the object.
+///
+/// @param queue The queue that runs the load, or nil to call the loader on the calling thread.
+///
+/// @param location The selector reported by the error of a cancelled load.
+///
+- (void)startLoadForKey:(id)key loader:(VDSDatabaseCacheLoader)loader queue:(VDSOperationQueue* _Nullable)queue location:(SEL)location
+{
+    /// The load finishes once, whether the loader completes or the operation running it is cancelled.
+    std::shared_ptr<std::atomic<bool>> finished = std::make_shared<std::atomic<bool>>(false);
+    VDSDatabaseCacheLoadCompletion finish = ^(id loadedObject, NSError* error) {
+        if (finished->exchange(true)) { return; }
+        if (loadedObject != nil) { [self setObject:loadedObject forKey:key tracked:YES]; }
+        [self finishLoadForKey:key object:loadedObject error:error];
+    };
+    if (queue == nil) {
+        loader(key, finish);
+        return;
+    }
+
+    VDSBlockOperation* operation = [[VDSBlockOperation alloc] initWithBlock:^(void (^continuation)(void)) {
+        loader(key, ^(id loadedObject, NSError* error) {
+            finish(loadedObject, error);
+            continuation();
+        });
+    }];
+    [operation addCompletionBlock:^{
+        finish(nil, [NSError errorWithDomain:VDSKitErrorDomain
+                                        code:VDSCacheLoadCancelled
+                                    userInfo:@{VDSLocationErrorKey: NSStringFromSelector(location),
+                                               VDSLocationParametersErrorKey: @{@"key": [key description]},
+                                               NSDebugDescriptionErrorKey: VDS_LOAD_CANCELLED_MESSAGE(key)}]);
+    }];
+    [queue addOperation:operation];
+}
+
+
+- (id _Nullable)objectForKey:(id _Nonnull)key
+                      loader:(VDSDatabaseCacheLoader _Nonnull)loader
+                       error:(NSError* _Nullable __autoreleasing * _Nullable)error
+{
+    dispatch_semaphore_t loaded = dispatch_semaphore_create(0);
+    __block id object = nil;
+    __block NSError* loadError = nil;
+    [self objectForKey:key loader:loader queue:nil completion:^(id loadedObject, NSError* failure) {
+        object = loadedObject;
+        loadError = failure;
+        dispatch_semaphore_signal(loaded);
+    }];
+    dispatch_semaphore_wait(loaded, DISPATCH_TIME_FOREVER);
+    if (error != NULL) { *error = loadError; }
+    return object;
+}
+
+
+/// Removes a load from the loads in flight and passes its result to every waiting completion.
+///
+/// @param key The key that was loaded.
+///
+/// @param object The loaded object, which has already been stored, or nil.
+///
+/// @param error The error of the load, or nil.
+///
+- (void)finishLoadForKey:(id)key object:(id _Nullable)object error:(NSError* _Nullable)error
+{
+    os_unfair_lock_lock(&_loadLock);
+    NSMutableArray<VDSDatabaseCacheLoadCompletion>* waiters = _loads[key];
+    [_loads removeObjectForKey:key];
+    os_unfair_lock_unlock(&_loadLock);
+
+    for (VDSDatabaseCacheLoadCompletion completion in waiters) { completion(object, error); }
+}
+
+
+
+#pragma mark - Metrics Behaviors
+
+- (NSDictionary<NSString*, NSNumber*>* _Nonnull)metrics
+{
+    uint64_t hits = 0, staleHits = 0, misses = 0, inserts = 0, merges = 0, unchangedMerges = 0, replacements = 0;
+    uint64_t expiredEvictions = 0, countEvictions = 0, costEvictions = 0, lowMemoryEvictions = 0;
+    uint64_t lockWait = 0;
+    for (NSUInteger index = 0; index < _shardCount; index++) {
+        VDSCacheMetricCounters* metrics = &_shards[index].metrics;
+        hits += metrics->hits.load(std::memory_order_relaxed);
+        staleHits += metrics->staleHits.load(std::memory_order_relaxed);
+        misses += metrics->misses.load(std::memory_order_relaxed);
+        inserts += metrics->inserts.load(std::memory_order_relaxed);
+        merges += metrics->merges.load(std::memory_order_relaxed);
+        unchangedMerges += metrics->unchangedMerges.load(std::memory_order_relaxed);
+        replacements += metrics->replacements.load(std::memory_order_relaxed);
+        expiredEvictions += metrics->expiredEvictions.load(std::memory_order_relaxed);
+        countEvictions += metrics->countEvictions.load(std::memory_order_relaxed);
+        costEvictions += metrics->costEvictions.load(std::memory_order_relaxed);
+        lowMemoryEvictions += metrics->lowMemoryEvictions.load(std::memory_order_relaxed);
+        lockWait += metrics->lockWaitNanoseconds.load(std::memory_order_relaxed);
+    }
+
+    return @{VDSCacheLookupCountKey: @(hits + misses),
+             VDSCacheHitCountKey: @(hits),
+             VDSCacheStaleHitCountKey: @(staleHits),
+             VDSCacheMissCountKey: @(misses),
+             VDSCacheInsertCountKey: @(inserts),
+             VDSCacheMergeCountKey: @(merges),
+             VDSCacheUnchangedMergeCountKey: @(unchangedMerges),
+             VDSCacheReplacementCountKey: @(replacements),
+             VDSCacheExpiredEvictionCountKey: @(expiredEvictions),
+             VDSCacheCountEvictionCountKey: @(countEvictions),
+             VDSCacheCostEvictionCountKey: @(costEvictions),
+             VDSCacheLowMemoryEvictionCountKey: @(lowMemoryEvictions),
+             VDSCacheEvictionCycleCountKey: @(_evictionCycleCount.load(std::memory_order_relaxed)),
+             VDSCacheEvictionCycleDurationKey: @(_evictionCycleNanoseconds.load(std::memory_order_relaxed) / (double)NSEC_PER_SEC),
+             VDSCacheLastEvictionCycleDurationKey: @(_lastEvictionCycleNanoseconds.load(std::memory_order_relaxed) / (double)NSEC_PER_SEC),
+             VDSCacheLockWaitDurationKey: @(lockWait / (double)NSEC_PER_SEC),
+             VDSCachePeakObjectCountKey: @(_objectCount.peak.load(std::memory_order_relaxed))};
+}
+
+
+- (void)resetMetrics
+{
+    /// The shards are locked while the peak is reset so that it restarts from the number of
+    /// objects the cache currently holds, and no cycle runs while the cycle metrics are reset.
+    [_evictionCycleLock lock];
+    lock_shards(_shards, _shardCount);
+    for (NSUInteger index = 0; index < _shardCount; index++) {
+        _shards[index].metrics.reset();
+    }
+    _objectCount.resetPeak();
+    unlock_shards(_shards, _shardCount);
+    _evictionCycleCount.store(0, std::memory_order_relaxed);
+    _evictionCycleNanoseconds.store(0, std::memory_order_relaxed);
+    _lastEvictionCycleNanoseconds.store(0, std::memory_order_relaxed);
+    [_evictionCycleLock unlock];
+}
+
+
+
+#pragma mark - Snapshot Behaviors
+
+- (BOOL)writeSnapshotToURL:(NSURL* _Nonnull)url
+                serializer:(id<VDSDatabaseCacheSerializer> _Nullable)serializer
+                     error:(NSError* _Nullable __autoreleasing * _Nullable)error
+{
+    NSAssert(url != nil, VDS_NIL_ARGUMENT_MESSAGE(@"url", _cmd));
+
+    VDSCacheSnapshotWriter writer(serializer ?: [VDSDatabaseCacheStandardSerializer new]);
+    bool success = writer.open(url, (uint32_t)_evictionPolicy);
+
+    /// Each shard's entries are collected under its lock and serialized once it is released.
+    std::vector<VDSCacheSnapshotRecord> records;
+    for (NSUInteger index = 0; success && index < _shardCount; index++) {
+        VDSCacheShard* shard = &_shards[index];
+        records.clear();
+        lock_shard(shard);
+        [self collectSnapshotRecords:records inShard:shard now:VDSCacheTimeNow()];
+        [shard->lock unlock];
+        for (const VDSCacheSnapshotRecord& record : records) {
+            if ((success = writer.write(record)) == false) { break; }
+        }
+    }
+    success = success && writer.close();
+
+    if (success == false && error != NULL) {
+        *error = [self snapshotErrorWithCode:VDSCacheSnapshotWriteFailed
+                                     message:VDS_SNAPSHOT_WRITE_FAILED_MESSAGE(url.path, writer.failureReason())
+                             underlyingError:writer.underlyingError()
+                                         url:url
+                                    location:_cmd];
+    }
+    return success;
+}
+
+
+/// Appends the state of every entry in a shard to records, with tracked entries segment by segment
+/// from least to most recently used, followed by untracked entries. Entries pending eviction are left
+/// out. The caller must hold the shard's lock.
+///
+/// @param records The records to append to.
+///
+/// @param shard The shard to collect.
+///
+/// @param now The current time, used to convert expirations to dates.
+///
+- (void)collectSnapshotRecords:(std::vector<VDSCacheSnapshotRecord>&)records
+                       inShard:(VDSCacheShard*)shard
+                           now:(VDSCacheTime)now
+{
+    VDSCacheEntryTable* table = &shard->table;
+    records.reserve(table->count());
+    for (NSUInteger segment = 0; segment < VDSCacheEntryTable::SegmentCount; segment++) {
+        for (VDSCacheEntry* entry = table->leastRecent(segment); entry != NULL; entry = entry->recencyPrev) {
+            records.emplace_back();
+            VDSCacheSnapshotRecord& record = records.back();
+            record.key = entry->key;
+            record.object = entry->object;
+            record.expiration = VDSCacheReferenceTimeForClockTime(now, entry->expiration);
+            record.usageCount = entry->usageCount;
+            record.cost = entry->cost;
+            record.segment = entry->segment;
+            record.tracked = true;
+        }
+    }
+    table->enumerateUntrackedEntries([&](VDSCacheEntry* entry) {
+        records.emplace_back();
+        VDSCacheSnapshotRecord& record = records.back();
+        record.key = entry->key;
+        record.object = entry->object;
+        record.cost = entry->cost;
+    });
+}
+
+
+- (BOOL)loadSnapshotFromURL:(NSURL* _Nonnull)url
+                 serializer:(id<VDSDatabaseCacheSerializer> _Nullable)serializer
+                      error:(NSError* _Nullable __autoreleasing * _Nullable)error
+{
+    NSAssert(url != nil, VDS_NIL_ARGUMENT_MESSAGE(@"url", _cmd));
+
+    VDSCacheSnapshotReader reader(serializer ?: [VDSDatabaseCacheStandardSerializer new]);
+    bool success = reader.open(url);
+
+    /// The whole snapshot is read before any of it is stored, so a snapshot that can not be read
+    /// leaves the cache unchanged.
+    VDSCacheTime now = VDSCacheTimeNow();
+    std::vector<std::vector<VDSCacheSnapshotRecord>> shardRecords(_shardCount);
+    std::vector<std::vector<NSUInteger>> shardHashes(_shardCount);
+    bool done = false;
+    while (success && done == false) {
+        VDSCacheSnapshotRecord record;
+        success = reader.read(&record, &done);
+        if (success == false || done) { break; }
+        if (record.tracked && record.expiration <= now.reference) { continue; }
+        NSUInteger hash = [record.key hash];
+        NSUInteger shardIndex = shard_index_for_hash(hash, _shardCount);
+        shardRecords[shardIndex].push_back(std::move(record));
+        shardHashes[shardIndex].push_back(hash);
+    }
+
+    if (success == false) {
+        if (error != NULL) {
+            *error = [self snapshotErrorWithCode:VDSCacheSnapshotReadFailed
+                                         message:VDS_SNAPSHOT_READ_FAILED_MESSAGE(url.path, reader.failureReason())
+                                 underlyingError:reader.underlyingError()
+                                             url:url
+                                        location:_cmd];
+        }
+        return NO;
+    }
+
+    BOOL restoresSegments = reader.policy() == (uint32_t)_evictionPolicy;
+    for (NSUInteger index = 0; index < _shardCount; index++) {
+        if (shardRecords[index].empty()) { continue; }
+        [self restoreSnapshotRecords:shardRecords[index]
+                              hashes:shardHashes[index]
+                             inShard:&_shards[index]
+                                 now:now
+                    restoresSegments:restoresSegments];
+    }
+    return YES;
+}
+
+
+/// Stores the records read from a snapshot in a shard, taking the shard's lock once.
+///
+/// @param records The records assigned to the shard, in the order they were written.
+///
+/// @param hashes The hash of the key of each record.
+///
+/// @param shard The shard to store the records in.
+///
+/// @param now The current time, used to convert expirations from dates.
+///
+/// @param restoresSegments YES if tracked entries return to the recency segments they were written
+/// from, NO if they are ordered within the segment the eviction policy places new entries in.
+///
+- (void)restoreSnapshotRecords:(const std::vector<VDSCacheSnapshotRecord>&)records
+                        hashes:(const std::vector<NSUInteger>&)hashes
+                       inShard:(VDSCacheShard*)shard
+                           now:(VDSCacheTime)now
+              restoresSegments:(BOOL)restoresSegments
+{
+    VDSCacheEntryTable* table = &shard->table;
+    VDSDatabaseCacheDiskTier* diskTier = self.diskTier;
+    for (NSUInteger index = 0; diskTier != nil && index < records.size(); index++) { [diskTier removeObjectForKey:records[index].key]; }
+    lock_shard(shard);
+    table->reserve(table->count() + records.size());
+
+    /// Records are stored from least to most recently used, so linking each at the head of its
+    /// segment reproduces the recency order.
+    std::vector<VDSCacheEntry*> scheduledEntries;
+    std::vector<NSTimeInterval> scheduledExpirations;
+    for (NSUInteger index = 0; index < records.size(); index++) {
+        const VDSCacheSnapshotRecord& record = records[index];
+        VDSCacheEntry* entry = [self storeObject:record.object
+                                          forKey:record.key
+                                            hash:hashes[index]
+                                            cost:record.cost
+                                         tracked:record.tracked
+                                         inShard:shard];
+        if (entry == NULL || entry->tracked == false) { continue; }
+        if (restoresSegments && record.segment < VDSCacheEntryTable::SegmentCount) {
+            table->moveToSegment(entry, record.segment);
+        }
+        if (_configuration.tracksObjectUsage) { entry->usageCount = record.usageCount; }
+        scheduledEntries.push_back(entry);
+        scheduledExpirations.push_back(VDSCacheClockTimeForReferenceTime(now, record.expiration));
+        entry->refreshTime = refresh_time(now.clock, scheduledExpirations.back(), _refreshInterval);
+    }
+    table->scheduleExpirations(scheduledEntries.data(), scheduledExpirations.data(), scheduledEntries.size());
+    if (_configuration.expiresObjects && scheduledEntries.size() > 0) {
+        [self scheduleEvictionCycleBy:*std::min_element(scheduledExpirations.begin(), scheduledExpirations.end())];
+    }
+    if (_evictsOnInsert) { [self evictEntriesInShard:shard limits:[self shardLimits]]; }
+
+    [self unlockShardAndDemoteEvictions:shard];
+}
+
+
+/// Creates an error for a snapshot that could not be written or read.
+- (NSError*)snapshotErrorWithCode:(VDSKitErrorCode)code
+                          message:(NSString*)message
+                  underlyingError:(NSError* _Nullable)underlyingError
+                              url:(NSURL*)url
+                         location:(SEL)location
+{
+    NSMutableDictionary* userInfo = [NSMutableDictionary dictionaryWithDictionary:@{VDSLocationErrorKey: NSStringFromSelector(location),
+                                                                                    VDSLocationParametersErrorKey: @{@"url": url.description},
+                                                                                    NSDebugDescriptionErrorKey: message}];
+    if (underlyingError != nil) { userInfo[NSUnderlyingErrorKey] = underlyingError; }
+    return [NSError errorWithDomain:VDSKitErrorDomain code:code userInfo:userInfo];
+}
+
+
+
+#pragma mark - Disk Tier Behaviors
+
+
+- (VDSDatabaseCacheDiskTier*)diskTier
+{
+    os_unfair_lock_lock(&_diskTierLock);
+    VDSDatabaseCacheDiskTier* diskTier = _diskTier;
+    os_unfair_lock_unlock(&_diskTierLock);
+    return diskTier;
+}
+
+
+- (void)setDiskTier:(VDSDatabaseCacheDiskTier*)diskTier
+{
+    /// Shards only collect demotions while there is a tier to write them to.
+    lock_shards(_shards, _shardCount);
+    for (NSUInteger index = 0; index < _shardCount; index++) {
+        _shards[index].demotesEvictions = diskTier != nil;
+    }
+    os_unfair_lock_lock(&_diskTierLock);
+    _diskTier = diskTier;
+    os_unfair_lock_unlock(&_diskTierLock);
+    unlock_shards(_shards, _shardCount);
+}
+
+
+/// Unlocks a shard that the caller locked, then writes the objects evicted while it was locked to
+/// the disk tier, so the lock is not held while they are serialized and appended.
+///
+/// @discussion A store for a key whose previous object is demoted at the same moment may remove the
+/// key from the disk tier before the demotion is written. The object in the cache is still the
+/// newer one, and the demoted object is only read if the newer one leaves the cache without being
+/// demoted or removed.
+///
+/// @param shard The locked shard.
+///
+- (void)unlockShardAndDemoteEvictions:(VDSCacheShard*)shard
+{
+    std::vector<VDSCacheDemotion> demotions;
+    demotions.swap(shard->demotions);
+    [shard->lock unlock];
+    if (demotions.empty() == false) { [self demoteObjects:demotions]; }
+}
+
+
+/// Writes evicted objects to the disk tier, skipping any that have expired.
+- (void)demoteObjects:(const std::vector<VDSCacheDemotion>&)demotions
+{
+    VDSDatabaseCacheDiskTier* diskTier = self.diskTier;
+    if (diskTier == nil) { return; }
+    VDSCacheTime now = VDSCacheTimeNow();
+    for (const VDSCacheDemotion& demotion : demotions) {
+        if (demotion.expiration <= now.clock) { continue; }
+        NSDate* expiration = demotion.expiration != DBL_MAX ?
+            [NSDate dateWithTimeIntervalSinceReferenceDate:VDSCacheReferenceTimeForClockTime(now, demotion.expiration)] : nil;
+        [diskTier setObject:demotion.object forKey:demotion.key expires:expiration cost:demotion.cost];
+    }
+}
+
+
+/// Reads the object for a key that missed the cache from the disk tier and, if it is there,
+/// promotes it back to the cache as a tracked object.
+///
+/// @returns The promoted object, or nil if the disk tier does not hold it.
+///
+- (id _Nullable)promoteObjectForKey:(id)key
+{
+    VDSDatabaseCacheDiskTier* diskTier = self.diskTier;
+    if (diskTier == nil) { return nil; }
+    NSDate* expiration = nil;
+    NSUInteger cost = 0;
+    id object = [diskTier promoteObjectForKey:key expires:&expiration cost:&cost];
+    if (object != nil) { [self setObject:object forKey:key tracked:YES expires:expiration cost:cost]; }
+    return object;
+}
+
+
+#pragma mark - Collection Behaviors
+
+/// Counts the entries in all shards. The collection accessors lock every shard, in index order,
+/// so that they return a consistent view of the entire cache, and call this while holding the locks.
+/// Like every collection accessor, the count leaves out entries that are pending eviction.
+///
+/// @param tracked YES to count tracked entries.
+///
+/// @param untracked YES to count untracked entries.
+///
+- (NSUInteger)countOfEntriesTracked:(BOOL)tracked untracked:(BOOL)untracked
+{
+    NSUInteger count = 0;
+    for (NSUInteger index = 0; index < _shardCount; index++) {
+        const VDSCacheEntryTable& table = _shards[index].table;
+        if (tracked) { count += table.trackedCount(); }
+        if (untracked) { count += table.untrackedCount(); }
+    }
+    return count;
+}
+
+
+- (NSUInteger)totalCost
+{
+    NSUInteger totalCost = 0;
+    lock_shards(_shards, _shardCount);
+    for (NSUInteger index = 0; index < _shardCount; index++) {
+        totalCost += _shards[index].table.totalCost();
+    }
+    unlock_shards(_shards, _shardCount);
+    return totalCost;
+}
+
+
+- (NSArray*)allObjects
+{
+    lock_shards(_shards, _shardCount);
+    NSMutableArray* objects = [NSMutableArray arrayWithCapacity:[self countOfEntriesTracked:YES untracked:YES]];
+    for (NSUInteger index = 0; index < _shardCount; index++) {
+        _shards[index].table.enumerateEntries([objects](VDSCacheEntry* entry) {
+            if (entry->pendingEviction == false) { [objects addObject:entry->object]; }
+        });
+    }
+    unlock_shards(_shards, _shardCount);
+    return objects;
+}
+
+
+- (NSArray* _Nonnull)trackedObjects
+{
+    lock_shards(_shards, _shardCount);
+    NSMutableArray* objects = [NSMutableArray arrayWithCapacity:[self countOfEntriesTracked:YES untracked:NO]];
+    for (NSUInteger index = 0; index < _shardCount; index++) {
+        _shards[index].table.enumerateTrackedEntries([&](VDSCacheEntry* entry) {
+            [objects addObject:entry->object];
+        });
+    }
+    unlock_shards(_shards, _shardCount);
+    return objects;
+}
+
+
+- (NSArray* _Nonnull)untrackedObjects
+{
+    lock_shards(_shards, _shardCount);
+    NSMutableArray* objects = [NSMutableArray arrayWithCapacity:[self countOfEntriesTracked:NO untracked:YES]];
+    for (NSUInteger index = 0; index < _shardCount; index++) {
+        _shards[index].table.enumerateUntrackedEntries([objects](VDSCacheEntry* entry) {
+            [objects addObject:entry->object];
+        });
+    }
+    unlock_shards(_shards, _shardCount);
+    return objects;
+}
+
+
+- (NSArray*)allKeys
+{
+    lock_shards(_shards, _shardCount);
+    NSMutableArray* keys = [NSMutableArray arrayWithCapacity:[self countOfEntriesTracked:YES untracked:YES]];
+    for (NSUInteger index = 0; index < _shardCount; index++) {
+        _shards[index].table.enumerateEntries([keys](VDSCacheEntry* entry) {
+            if (entry->pendingEviction == false) { [keys addObject:entry->key]; }
+        });
+    }
+    unlock_shards(_shards, _shardCount);
+    return keys;
+}
+
+
+- (NSArray* _Nonnull)trackedKeys
+{
+    lock_shards(_shards, _shardCount);
+    NSMutableArray* keys = [NSMutableArray arrayWithCapacity:[self countOfEntriesTracked:YES untracked:NO]];
+    for (NSUInteger index = 0; index < _shardCount; index++) {
+        _shards[index].table.enumerateTrackedEntries([&](VDSCacheEntry* entry) {
+            [keys addObject:entry->key];
+        });
+    }
+    unlock_shards(_shards, _shardCount);
+    return keys;
+}
+
+
+- (NSArray* _Nonnull)untrackedKeys
+{
+    lock_shards(_shards, _shardCount);
+    NSMutableArray* keys = [NSMutableArray arrayWithCapacity:[self countOfEntriesTracked:NO untracked:YES]];
+    for (NSUInteger index = 0; index < _shardCount; index++) {
+        _shards[index].table.enumerateUntrackedEntries([keys](VDSCacheEntry* entry) {
+            [keys addObject:entry->key];
+        });
+    }
+    unlock_shards(_shards, _shardCount);
+    return keys;
+}
+
+
+- (NSDictionary*)allObjectsAndKeys
+{
+    lock_shards(_shards, _shardCount);
+    NSMutableDictionary* objectsAndKeys = [NSMutableDictionary dictionaryWithCapacity:[self countOfEntriesTracked:YES untracked:YES]];
+    for (NSUInteger index = 0; index < _shardCount; index++) {
+        _shards[index].table.enumerateEntries([objectsAndKeys](VDSCacheEntry* entry) {
+            if (entry->pendingEviction == false) { [objectsAndKeys setObject:entry->object forKey:entry->key]; }
+        });
+    }
+    unlock_shards(_shards, _shardCount);
+    return objectsAndKeys;
+}
+
+
+- (NSDictionary* _Nonnull)trackedObjectsAndKeys
+{
+    lock_shards(_shards, _shardCount);
+    NSMutableDictionary* trackedObjectsAndKeys = [NSMutableDictionary dictionaryWithCapacity:[self countOfEntriesTracked:YES untracked:NO]];
+    for (NSUInteger index = 0; index < _shardCount; index++) {
+        _shards[index].table.enumerateTrackedEntries([&](VDSCacheEntry* entry) {
+            [trackedObjectsAndKeys setObject:entry->object forKey:entry->key];
+        });
+    }
+    unlock_shards(_shards, _shardCount);
+    return trackedObjectsAndKeys;
+}
+
+
+- (NSDictionary* _Nonnull)untrackedObjectsAndKeys
+{
+    lock_shards(_shards, _shardCount);
+    NSMutableDictionary* untrackedObjectsAndKeys = [NSMutableDictionary dictionaryWithCapacity:[self countOfEntriesTracked:NO untracked:YES]];
+    for (NSUInteger index = 0; index < _shardCount; index++) {
+        _shards[index].table.enumerateUntrackedEntries([untrackedObjectsAndKeys](VDSCacheEntry* entry) {
+            [untrackedObjectsAndKeys setObject:entry->object forKey:entry->key];
+        });
+    }
+    unlock_shards(_shards, _shardCount);
+    return untrackedObjectsAndKeys;
+}
+
+
+- (void)enumerateKeysAndObjectsUsingBlock:(void (^ _Nonnull)(id _Nonnull key, id _Nonnull object, BOOL* _Nonnull stop))block
+{
+    [self enumerateEntriesTracked:YES untracked:YES usingBlock:block];
+}
+
+
+- (void)enumerateTrackedKeysAndObjectsUsingBlock:(void (^ _Nonnull)(id _Nonnull key, id _Nonnull object, BOOL* _Nonnull stop))block
+{
+    [self enumerateEntriesTracked:YES untracked:NO usingBlock:block];
+}
+
+
+- (void)enumerateUntrackedKeysAndObjectsUsingBlock:(void (^ _Nonnull)(id _Nonnull key, id _Nonnull object, BOOL* _Nonnull stop))block
+{
+    [self enumerateEntriesTracked:NO untracked:YES usingBlock:block];
+}
+
+
+/// Calls a block with the key and object of each entry in one or both partitions, without copying
+/// them. Every shard is locked, in index order, for the duration of the enumeration, matching the
+/// collection accessors.
+///
+/// @param tracked YES to enumerate tracked entries.
+///
+/// @param untracked YES to enumerate untracked entries.
+///
+/// @param block The block to call, which may set its stop argument to YES to end the enumeration.
+///
+- (void)enumerateEntriesTracked:(BOOL)tracked
+                      untracked:(BOOL)untracked
+                     usingBlock:(void (^)(id key, id object, BOOL* stop))block
+{
+    lock_shards(_shards, _shardCount);
+    BOOL stop = NO;
+    auto visit = [&](VDSCacheEntry* entry) {
+        if (stop == NO) { block(entry->key, entry->object, &stop); }
+    };
+    for (NSUInteger index = 0; index < _shardCount && stop == NO; index++) {
+        const VDSCacheEntryTable& table = _shards[index].table;
+        if (tracked) { table.enumerateTrackedEntries(visit); }
+        if (untracked) { table.enumerateUntrackedEntries(visit); }
+    }
+    unlock_shards(_shards, _shardCount);
+}
+
+
+
+#pragma mark - Fast Enumeration Behaviors
+
+- (NSUInteger)countByEnumeratingWithState:(nonnull NSFastEnumerationState *)state objects:(__unsafe_unretained id  _Nullable * _Nonnull)buffer count:(NSUInteger)len
+{
+    /// Enumerates the keys of each shard as they were when the enumeration started, so the cache may
+    /// be changed by the enumerating thread, other threads, or eviction cycles without invalidating it.
+    /// state->extra[0] holds the snapshots of the shards' keys, state->extra[1] is the index of the
+    /// current shard, and state->state is the index cursor within it. A snapshot never mutates, so
+    /// state->mutationsPtr points to a count that never changes.
+    if (state->mutationsPtr == NULL) {
+        /// The fast enumeration protocol has no callback for the end of an enumeration, so the
+        /// snapshots are kept alive by the autorelease pool that the enumeration runs in.
+        NSArray<NSArray*>* snapshots = [self keySnapshots];
+        CFAutorelease((__bridge_retained CFTypeRef)snapshots);
+        state->extra[0] = (unsigned long)(__bridge void*)snapshots;
+        state->extra[1] = 0;
+        state->extra[2] = 0;
+        state->state = 0;
+        state->mutationsPtr = &state->extra[2];
+    }
+    state->itemsPtr = buffer;
+
+    NSArray<NSArray*>* snapshots = (__bridge NSArray<NSArray*>*)(void*)state->extra[0];
+    NSUInteger count = 0;
+    while (state->extra[1] < snapshots.count && count < len) {
+        NSArray* keys = snapshots[state->extra[1]];
+        NSUInteger length = MIN(len - count, keys.count - state->state);
+        [keys getObjects:buffer + count range:NSMakeRange(state->state, length)];
+        count += length;
+        state->state += length;
+        if (state->state == keys.count) {
+            state->extra[1]++;
+            state->state = 0;
+        }
+    }
+    return count;
+}
+
+
+/// Returns an immutable snapshot of the keys of each shard, all taken at the same point in time.
+///
+/// @discussion Every shard is locked, in index order, while the snapshots are taken, so together
+/// they hold exactly the keys the cache held at that moment. Each shard's table keeps its keys in a
+/// persistent vector, so a snapshot is taken in O(1) and the shards are locked only for as long as
+/// it takes to visit each of them once. Writers never wait for the enumerations that use the
+/// snapshots. The first write to a shard after a snapshot is taken copies the nodes of the vector
+/// that it changes, no more than one per level.
+///
+/// @returns An array holding an array of keys for each shard.
+///
+- (NSArray<NSArray*>*)keySnapshots
+{
+    std::vector<id> snapshots(_shardCount);
+    lock_shards(_shards, _shardCount);
+    for (NSUInteger index = 0; index < _shardCount; index++) {
+        snapshots[index] = _shards[index].table.keySnapshot();
+    }
+    unlock_shards(_shards, _shardCount);
+    return [NSArray arrayWithObjects:snapshots.data() count:_shardCount];
 }
 
 
@@ -0,0 +1,109 @@
+//
+//  VDSDatabaseCacheAdmission.h
+//  VDSKit
+//
+//  Created by Erikheath Thomas on 6/8/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+
+
+
+
+
+#pragma mark - VDSCacheFrequencySketch -
+
+/// @summary A count-min sketch that estimates how often each key hash has been accessed,
+/// used by the W-TinyLFU policy to decide whether a new object should displace an existing one.
+///
+/// @discussion The sketch holds four rows of saturating counters that never exceed 15. An access
+/// increments one counter in each row, and the estimate for a hash is the smallest of its counters,
+/// so collisions can only overestimate. Once the number of recorded accesses reaches ten times the
+/// width of the sketch, every counter is halved, so the estimates favor recent history and keys that
+/// were popular long ago age out.
+///
+/// Counters are updated with relaxed atomics, so accesses may be recorded without holding the lock
+/// of the shard that owns the sketch. Concurrent increments of the same counter may be lost, which
+/// only makes the estimate less precise.
+///
+class VDSCacheFrequencySketch {
+
+public:
+
+    /// Creates a sketch sized for approximately capacity distinct keys.
+    explicit VDSCacheFrequencySketch(NSUInteger capacity);
+
+    VDSCacheFrequencySketch(const VDSCacheFrequencySketch&) = delete;
+    VDSCacheFrequencySketch& operator=(const VDSCacheFrequencySketch&) = delete;
+
+    /// Records an access to the key with hash.
+    void increment(NSUInteger hash);
+
+    /// The estimated number of recent accesses to the key with hash, from 0 to 15.
+    NSUInteger frequency(NSUInteger hash) const;
+
+
+private:
+
+    static const NSUInteger RowCount = 4;
+    static const uint8_t MaximumCount = 15;
+
+    NSUInteger counterIndex(NSUInteger hash, NSUInteger row) const;
+    void age();
+
+    NSUInteger _width;
+    NSUInteger _shift;
+    NSUInteger _sampleSize;
+    std::unique_ptr<std::atomic<uint8_t>[]> _counters;
+    std::atomic<NSUInteger> _additions;
+};
+
+
+
+
+
+#pragma mark - VDSCacheGhostList -
+
+/// @summary A bounded FIFO of the hashes of keys recently evicted from the 2Q policy's
+/// A1in queue, used to recognize keys that are re-referenced shortly after their eviction.
+///
+/// @discussion The list stores hashes rather than keys, so evicted keys and objects are released
+/// immediately. Distinct keys with the same hash are indistinguishable, which at worst admits a key
+/// directly to the Am queue.
+///
+class VDSCacheGhostList {
+
+public:
+
+    VDSCacheGhostList() : _capacity(0) {}
+
+    VDSCacheGhostList(const VDSCacheGhostList&) = delete;
+    VDSCacheGhostList& operator=(const VDSCacheGhostList&) = delete;
+
+    /// Sets the maximum number of hashes held, discarding the oldest hashes if necessary.
+    void setCapacity(NSUInteger capacity);
+
+    /// Adds a hash, discarding the oldest hash if the list is full.
+    void add(NSUInteger hash);
+
+    /// YES if the list holds hash.
+    bool contains(NSUInteger hash) const { return _counts.find(hash) != _counts.end(); }
+
+    /// The number of hashes in the list.
+    NSUInteger count() const { return _order.size(); }
+
+
+private:
+
+    void discardOldest();
+
+    NSUInteger _capacity;
+    std::deque<NSUInteger> _order;
+    std::unordered_map<NSUInteger, NSUInteger> _counts;
+};
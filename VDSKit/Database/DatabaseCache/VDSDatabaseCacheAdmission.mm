@@ -0,0 +1,112 @@
+//
+//  VDSDatabaseCacheAdmission.mm
+//  VDSKit
+//
+//  Created by Erikheath Thomas on 6/8/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import "VDSDatabaseCacheAdmission.h"
+
+
+/// The smallest sketch width, so that small caches still get useful estimates.
+static const NSUInteger VDSCacheFrequencySketchMinimumWidth = 1024;
+
+/// Odd multipliers used to derive an independent counter index for each row of the sketch.
+static const uint64_t VDSCacheFrequencySketchSeeds[] = {
+    0x9e3779b97f4a7c15ull,
+    0xc2b2ae3d27d4eb4full,
+    0x165667b19e3779f9ull,
+    0xd6e8feb86659fd93ull,
+};
+
+
+
+
+
+#pragma mark - VDSCacheFrequencySketch -
+
+VDSCacheFrequencySketch::VDSCacheFrequencySketch(NSUInteger capacity)
+: _width(VDSCacheFrequencySketchMinimumWidth),
+  _shift(64),
+  _additions(0)
+{
+    while (_width < capacity) { _width <<= 1; }
+    for (NSUInteger size = _width; size > 1; size >>= 1) { _shift--; }
+    _sampleSize = _width * 10;
+    _counters.reset(new std::atomic<uint8_t>[_width * RowCount]);
+    for (NSUInteger index = 0; index < _width * RowCount; index++) {
+        _counters[index].store(0, std::memory_order_relaxed);
+    }
+}
+
+
+NSUInteger VDSCacheFrequencySketch::counterIndex(NSUInteger hash, NSUInteger row) const
+{
+    return row * _width + (NSUInteger)(((uint64_t)hash * VDSCacheFrequencySketchSeeds[row]) >> _shift);
+}
+
+
+void VDSCacheFrequencySketch::increment(NSUInteger hash)
+{
+    bool incremented = false;
+    for (NSUInteger row = 0; row < RowCount; row++) {
+        std::atomic<uint8_t>& counter = _counters[counterIndex(hash, row)];
+        uint8_t count = counter.load(std::memory_order_relaxed);
+        if (count < MaximumCount) {
+            counter.store(count + 1, std::memory_order_relaxed);
+            incremented = true;
+        }
+    }
+
+    /// Only the thread whose increment reaches the sample size ages the sketch.
+    if (incremented && _additions.fetch_add(1, std::memory_order_relaxed) + 1 == _sampleSize) { age(); }
+}
+
+
+NSUInteger VDSCacheFrequencySketch::frequency(NSUInteger hash) const
+{
+    NSUInteger frequency = MaximumCount;
+    for (NSUInteger row = 0; row < RowCount; row++) {
+        frequency = MIN(frequency, (NSUInteger)_counters[counterIndex(hash, row)].load(std::memory_order_relaxed));
+    }
+    return frequency;
+}
+
+
+void VDSCacheFrequencySketch::age()
+{
+    for (NSUInteger index = 0; index < _width * RowCount; index++) {
+        _counters[index].store(_counters[index].load(std::memory_order_relaxed) >> 1, std::memory_order_relaxed);
+    }
+    _additions.store(_sampleSize / 2, std::memory_order_relaxed);
+}
+
+
+
+
+
+#pragma mark - VDSCacheGhostList -
+
+void VDSCacheGhostList::setCapacity(NSUInteger capacity)
+{
+    _capacity = capacity;
+    while (_order.size() > _capacity) { discardOldest(); }
+}
+
+
+void VDSCacheGhostList::add(NSUInteger hash)
+{
+    if (_capacity == 0) { return; }
+    if (_order.size() == _capacity) { discardOldest(); }
+    _order.push_back(hash);
+    _counts[hash]++;
+}
+
+
+void VDSCacheGhostList::discardOldest()
+{
+    auto count = _counts.find(_order.front());
+    if (--count->second == 0) { _counts.erase(count); }
+    _order.pop_front();
+}
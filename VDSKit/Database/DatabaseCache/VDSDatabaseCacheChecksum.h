@@ -0,0 +1,49 @@
+//
+//  VDSDatabaseCacheChecksum.h
+//  VDSKit
+//
+//  Created by Erikheath Thomas on 6/16/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+
+
+#pragma mark - VDSCacheChecksum -
+
+/// @summary The checksum that the files written by a VDSDatabaseCache use to detect corrupt records.
+///
+/// @discussion The checksum is the CRC-32 of the record, using the IEEE polynomial. A record that is
+/// written in pieces is checksummed by passing the checksum of each piece to the next update.
+///
+
+
+
+/// @summary Extends checksum, which is 0 for the first piece, with the CRC-32 of bytes.
+///
+static inline uint32_t VDSCacheChecksumUpdate(uint32_t checksum, const void* _Nullable bytes, size_t length)
+{
+    static uint32_t table[256];
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        for (uint32_t index = 0; index < 256; index++) {
+            uint32_t value = index;
+            for (int bit = 0; bit < 8; bit++) { value = (value & 1) ? 0xEDB88320 ^ (value >> 1) : value >> 1; }
+            table[index] = value;
+        }
+    });
+
+    const uint8_t* position = (const uint8_t*)bytes;
+    uint32_t crc = checksum ^ 0xFFFFFFFF;
+    for (size_t index = 0; index < length; index++) { crc = table[(crc ^ position[index]) & 0xFF] ^ (crc >> 8); }
+    return crc ^ 0xFFFFFFFF;
+}
+
+
+/// @summary The CRC-32 of bytes.
+///
+static inline uint32_t VDSCacheChecksum(const void* _Nullable bytes, size_t length)
+{
+    return VDSCacheChecksumUpdate(0, bytes, length);
+}
@@ -0,0 +1,88 @@
+//
+//  VDSDatabaseCacheClock.h
+//  VDSKit
+//
+//  Created by Erikheath Thomas on 6/12/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#include <time.h>
+
+
+
+#pragma mark - VDSCacheClock -
+
+/// @summary The clock that a VDSDatabaseCache measures expirations and eviction deadlines against.
+///
+/// @discussion The cache clock is monotonic, so changes to the system's wall clock neither expire
+/// objects early nor keep them alive longer than intended, and it keeps advancing while the system
+/// sleeps, so an interval measured on it is elapsed time. Reading it is a single call that does not
+/// allocate, so an eviction cycle reads it once and compares every expiration against that reading.
+///
+/// Expirations that are provided as dates, or that a timing map produces as dates, are converted to
+/// the cache clock by their distance from a reading of the wall clock taken alongside a reading of the
+/// cache clock.
+///
+
+
+
+/// @summary The current time on the cache clock, in seconds.
+///
+static inline NSTimeInterval VDSCacheClockNow(void)
+{
+    return (NSTimeInterval)clock_gettime_nsec_np(CLOCK_MONOTONIC_RAW) / (NSTimeInterval)NSEC_PER_SEC;
+}
+
+
+/// @summary A reading of the cache clock and the wall clock taken at the same moment.
+///
+typedef struct VDSCacheTime {
+
+    /// The time on the cache clock, in seconds.
+    NSTimeInterval clock;
+
+    /// The time on the wall clock, as an interval since the reference date.
+    NSTimeInterval reference;
+
+} VDSCacheTime;
+
+
+/// @summary Reads the cache clock and the wall clock.
+///
+static inline VDSCacheTime VDSCacheTimeNow(void)
+{
+    VDSCacheTime now;
+    now.clock = VDSCacheClockNow();
+    now.reference = [NSDate timeIntervalSinceReferenceDate];
+    return now;
+}
+
+
+/// @summary Converts a time on the wall clock, as an interval since the reference date, to the cache clock.
+///
+/// @param now A reading of both clocks.
+///
+/// @param reference The time to convert.
+///
+/// @returns The time on the cache clock that is as far from now.clock as reference is from now.reference.
+///
+static inline NSTimeInterval VDSCacheClockTimeForReferenceTime(VDSCacheTime now, NSTimeInterval reference)
+{
+    return now.clock + (reference - now.reference);
+}
+
+
+/// @summary Converts a time on the cache clock to the wall clock, as an interval since the reference date.
+///
+/// @param now A reading of both clocks.
+///
+/// @param clock The time to convert.
+///
+/// @returns The time on the wall clock that is as far from now.reference as clock is from now.clock.
+///
+static inline NSTimeInterval VDSCacheReferenceTimeForClockTime(VDSCacheTime now, NSTimeInterval clock)
+{
+    return now.reference + (clock - now.clock);
+}
@@ -28,6 +28,15 @@
 @synthesize archivesUntrackedObjects = _archivesUntrackedObjects;
 @synthesize expirationTimingMapKey = _expirationTimingMapKey;
 @synthesize expirationTimingMap = _expirationTimingMap;
+@synthesize shardCount = _shardCount;
+@synthesize usesLockFreeReads = _usesLockFreeReads;
+@synthesize preferredMaxTotalCost = _preferredMaxTotalCost;
+@synthesize evictsOnInsert = _evictsOnInsert;
+@synthesize expirationIntervals = _expirationIntervals;
+@synthesize evictionBatchSize = _evictionBatchSize;
+@synthesize evictionTimeSlice = _evictionTimeSlice;
+@synthesize refreshInterval = _refreshInterval;
+@synthesize evictionConcurrency = _evictionConcurrency;
 
 
 #pragma mark Object Lifecycle
@@ -52,6 +61,15 @@
         _archivesUntrackedObjects = [dictionary[VDSCacheArchivesUntrackedObjectsKey] boolValue];
         _expirationTimingMapKey = [dictionary[VDSCacheExpirationTimingMapExpressionKey] copy];
         _expirationTimingMap = [dictionary[VDSCacheExpirationTimingMapKey] copy];
+        _shardCount = [dictionary[VDSCacheShardCountKey] unsignedIntegerValue];
+        _usesLockFreeReads = [dictionary[VDSCacheUsesLockFreeReadsKey] boolValue];
+        _preferredMaxTotalCost = [dictionary[VDSCachePreferredMaxTotalCostKey] unsignedIntegerValue];
+        _evictsOnInsert = [dictionary[VDSCacheEvictsOnInsertKey] boolValue];
+        _expirationIntervals = [dictionary[VDSCacheExpirationIntervalsKey] copy];
+        _evictionBatchSize = [dictionary[VDSCacheEvictionBatchSizeKey] unsignedIntegerValue];
+        _evictionTimeSlice = [dictionary[VDSCacheEvictionTimeSliceKey] doubleValue];
+        _refreshInterval = [dictionary[VDSCacheRefreshIntervalKey] doubleValue];
+        _evictionConcurrency = [dictionary[VDSCacheEvictionConcurrencyKey] unsignedIntegerValue];
     }
     return self;
 }
@@ -78,6 +96,15 @@
         _archivesUntrackedObjects = [coder decodeBoolForKey:NSStringFromSelector(@selector(archivesUntrackedObjects))];
         _expirationTimingMapKey = [coder decodeObjectOfClass:[NSExpression class] forKey:NSStringFromSelector(@selector(expirationTimingMapKey))];
         _expirationTimingMap = [coder decodeObjectOfClass:[NSDictionary class] forKey:NSStringFromSelector(@selector(expirationTimingMap))];
+        _shardCount = (NSUInteger)[coder decodeIntegerForKey:NSStringFromSelector(@selector(shardCount))];
+        _usesLockFreeReads = [coder decodeBoolForKey:NSStringFromSelector(@selector(usesLockFreeReads))];
+        _preferredMaxTotalCost = (NSUInteger)[coder decodeIntegerForKey:NSStringFromSelector(@selector(preferredMaxTotalCost))];
+        _evictsOnInsert = [coder decodeBoolForKey:NSStringFromSelector(@selector(evictsOnInsert))];
+        _expirationIntervals = [coder decodeObjectOfClass:[NSDictionary class] forKey:NSStringFromSelector(@selector(expirationIntervals))];
+        _evictionBatchSize = (NSUInteger)[coder decodeIntegerForKey:NSStringFromSelector(@selector(evictionBatchSize))];
+        _evictionTimeSlice = [coder decodeDoubleForKey:NSStringFromSelector(@selector(evictionTimeSlice))];
+        _refreshInterval = [coder decodeDoubleForKey:NSStringFromSelector(@selector(refreshInterval))];
+        _evictionConcurrency = (NSUInteger)[coder decodeIntegerForKey:NSStringFromSelector(@selector(evictionConcurrency))];
     }
     return self;
 }
@@ -94,6 +121,15 @@
     [coder encodeBool:_archivesUntrackedObjects forKey:NSStringFromSelector(@selector(archivesUntrackedObjects))];
     [coder encodeObject:_expirationTimingMapKey forKey:NSStringFromSelector(@selector(expirationTimingMapKey))];
     [coder encodeObject:_expirationTimingMap forKey:NSStringFromSelector(@selector(expirationTimingMap))];
+    [coder encodeInteger:_shardCount forKey:NSStringFromSelector(@selector(shardCount))];
+    [coder encodeBool:_usesLockFreeReads forKey:NSStringFromSelector(@selector(usesLockFreeReads))];
+    [coder encodeInteger:_preferredMaxTotalCost forKey:NSStringFromSelector(@selector(preferredMaxTotalCost))];
+    [coder encodeBool:_evictsOnInsert forKey:NSStringFromSelector(@selector(evictsOnInsert))];
+    [coder encodeObject:_expirationIntervals forKey:NSStringFromSelector(@selector(expirationIntervals))];
+    [coder encodeInteger:_evictionBatchSize forKey:NSStringFromSelector(@selector(evictionBatchSize))];
+    [coder encodeDouble:_evictionTimeSlice forKey:NSStringFromSelector(@selector(evictionTimeSlice))];
+    [coder encodeDouble:_refreshInterval forKey:NSStringFromSelector(@selector(refreshInterval))];
+    [coder encodeInteger:_evictionConcurrency forKey:NSStringFromSelector(@selector(evictionConcurrency))];
 }
 
 
@@ -113,6 +149,15 @@
     dictionary[VDSCacheArchivesUntrackedObjectsKey] = @(_archivesUntrackedObjects);
     dictionary[VDSCacheExpirationTimingMapExpressionKey] = [_expirationTimingMapKey copy];
     dictionary[VDSCacheExpirationTimingMapKey] = [_expirationTimingMap copy];
+    dictionary[VDSCacheShardCountKey] = @(_shardCount);
+    dictionary[VDSCacheUsesLockFreeReadsKey] = @(_usesLockFreeReads);
+    dictionary[VDSCachePreferredMaxTotalCostKey] = @(_preferredMaxTotalCost);
+    dictionary[VDSCacheEvictsOnInsertKey] = @(_evictsOnInsert);
+    dictionary[VDSCacheExpirationIntervalsKey] = [_expirationIntervals copy];
+    dictionary[VDSCacheEvictionBatchSizeKey] = @(_evictionBatchSize);
+    dictionary[VDSCacheEvictionTimeSliceKey] = @(_evictionTimeSlice);
+    dictionary[VDSCacheRefreshIntervalKey] = @(_refreshInterval);
+    dictionary[VDSCacheEvictionConcurrencyKey] = @(_evictionConcurrency);
     
     return [[VDSDatabaseCacheConfiguration alloc] initWithDictionary:dictionary];
 }
@@ -134,6 +179,15 @@
     dictionary[VDSCacheArchivesUntrackedObjectsKey] = @(_archivesUntrackedObjects);
     dictionary[VDSCacheExpirationTimingMapExpressionKey] = [_expirationTimingMapKey copy];
     dictionary[VDSCacheExpirationTimingMapKey] = [_expirationTimingMap copy];
+    dictionary[VDSCacheShardCountKey] = @(_shardCount);
+    dictionary[VDSCacheUsesLockFreeReadsKey] = @(_usesLockFreeReads);
+    dictionary[VDSCachePreferredMaxTotalCostKey] = @(_preferredMaxTotalCost);
+    dictionary[VDSCacheEvictsOnInsertKey] = @(_evictsOnInsert);
+    dictionary[VDSCacheExpirationIntervalsKey] = [_expirationIntervals copy];
+    dictionary[VDSCacheEvictionBatchSizeKey] = @(_evictionBatchSize);
+    dictionary[VDSCacheEvictionTimeSliceKey] = @(_evictionTimeSlice);
+    dictionary[VDSCacheRefreshIntervalKey] = @(_refreshInterval);
+    dictionary[VDSCacheEvictionConcurrencyKey] = @(_evictionConcurrency);
 
 
     return [[VDSMutableDatabaseCacheConfiguration alloc] initWithDictionary:dictionary];
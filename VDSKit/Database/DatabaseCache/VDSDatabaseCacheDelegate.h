@@ -46,8 +46,32 @@
     didCompleteEvictionCycle:(VDSEvictionCycleKey _Nonnull)cycleKey;
 
 
+/// @summary Notifies the delegate that the eviction cycle of type 'cycleKey' has completed, and
+/// reports what the cycle did.
+///
+/// @discussion The metrics hold the number of objects the cycle evicted by cause, keyed by
+/// VDSCacheExpiredEvictionCountKey, VDSCacheCountEvictionCountKey, and VDSCacheCostEvictionCountKey,
+/// the duration of the cycle, keyed by VDSCacheLastEvictionCycleDurationKey, and the time the cycle
+/// waited for shard locks, keyed by VDSCacheLockWaitDurationKey. This message is sent after
+/// databaseCache:didCompleteEvictionCycle:.
+///
+/// @param cache The database cache that evicted objects
+///
+/// @param cycleKey The type of eviction cycle that was used to evict objects.
+///
+/// @param metrics The activity of the cycle, keyed by VDSCacheMetricKey.
+///
+- (void)databaseCache:(VDSDatabaseCache* _Nonnull)cache
+    didCompleteEvictionCycle:(VDSEvictionCycleKey _Nonnull)cycleKey
+                 withMetrics:(NSDictionary<VDSCacheMetricKey, NSNumber*>* _Nonnull)metrics;
+
+
 /// @summary Allows the delegate to determine if a specific object should be evicted from the database cache.
 ///
+/// @discussion This message is only sent when the delegate does not implement
+/// databaseCache:shouldEvictObjects:usingKeys:inEvictionCycle:. It is sent once for each object the
+/// cycle selects, after the cache has released its locks.
+///
 /// @param cache The database cache that will be evicting objects.
 ///
 /// @param object The object from the database cache that will be evicted.
@@ -62,8 +86,33 @@
       inEvictionCycle:(VDSEvictionCycleKey _Nonnull)cycleKey;
 
 
+/// @summary Allows the delegate to determine which of the objects selected by an eviction cycle should
+/// be evicted from the database cache.
+///
+/// @discussion The cycle selects every object it would evict before consulting the delegate, and sends
+/// this message once, after the cache has released its locks. The objects that are not evicted are
+/// kept as they were. This message is preferred to databaseCache:shouldEvictObject:usingKey:inEvictionCycle:.
+///
+/// @param cache The database cache that will be evicting objects.
+///
+/// @param objects The objects from the database cache that the cycle selected for eviction.
+///
+/// @param cacheKeys The keys used by the database cache to store the objects.
+///
+/// @param cycleKey The type of eviction cycle that is being used to evict the objects.
+///
+/// @returns The indexes of the objects that should be evicted.
+///
+- (NSIndexSet* _Nonnull)databaseCache:(VDSDatabaseCache* _Nonnull)cache
+                   shouldEvictObjects:(NSArray* _Nonnull)objects
+                            usingKeys:(NSArray* _Nonnull)cacheKeys
+                      inEvictionCycle:(VDSEvictionCycleKey _Nonnull)cycleKey;
+
+
 /// @summary Notifies the delegate that a set of objects will be evicted from the database cache.
 ///
+/// @discussion This message is sent once per cycle, after the cache has released its locks.
+///
 /// @param cache The database cache that will be evicting objects.
 ///
 /// @param objects The objects from the database cache that will be evicted.
@@ -80,6 +129,9 @@
 
 /// @summary Notifies the delegate that a set of objects was evicted from the datbase cache.
 ///
+/// @discussion This message is sent once per cycle, on the cache's delegateQueue, after the objects
+/// have been removed and the cache has released its locks.
+///
 /// @param cache The database cache that evicted the objects.
 ///
 /// @param objects The objects that were evicted from the database cache.
@@ -0,0 +1,177 @@
+//
+//  VDSDatabaseCacheDiskTier.h
+//  VDSKit
+//
+//  Created by Erikheath Thomas on 6/14/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+
+@protocol VDSDatabaseCacheSerializer;
+
+
+
+#pragma mark - VDSDatabaseCacheDiskTier -
+
+
+/// @summary A VDSDatabaseCacheDiskTier is a secondary cache on local disk that holds the objects a
+/// VDSDatabaseCache evicts, so that a miss in memory can be served from disk instead of the database.
+///
+/// @discussion The tier stores its objects in an append-only log file, VDSDatabaseCacheDiskTier.log,
+/// in its directory. Storing an object appends a record holding the serialized key and object, and
+/// removing one appends a tombstone, so every write is a single sequential append. An index of the
+/// keys in the tier, and the location of each object in the log, is kept in memory. Objects are read
+/// through a memory mapping of the log and are only deserialized when they are requested.
+///
+/// Every record carries a checksum. When a tier is opened, the index is rebuilt by reading the keys
+/// of the records in the log, without reading their objects, and a record that was only partly
+/// written when the process or system stopped ends the log there. The index therefore never refers
+/// to an incomplete record, and the tier survives restarts.
+///
+/// When the log grows beyond the maximum size, it is compacted in the background: the live records
+/// are copied to a new log, which replaces the old one once it is complete. Expired objects are
+/// dropped, and if the live records alone exceed three quarters of the maximum size, the oldest
+/// are dropped until they do not. The tier remains available while the records are copied. Only the
+/// records appended during the copy are copied while reads and writes wait, along with the update of
+/// the index and the replacement of the log.
+///
+/// A disk tier is thread safe. A directory must only be used by one disk tier at a time.
+///
+@interface VDSDatabaseCacheDiskTier : NSObject
+
+#pragma mark - Properties
+
+/// @summary The directory that holds the tier's log.
+///
+@property(strong, readonly, nonnull) NSURL* directoryURL;
+
+
+/// @summary The size, in bytes, that the log may grow to before it is compacted.
+///
+@property(readonly) NSUInteger maximumSize;
+
+
+/// @summary The number of objects in the tier.
+///
+@property(readonly) NSUInteger count;
+
+
+/// @summary The size of the log, in bytes, including records that have been superseded or removed.
+///
+@property(readonly) NSUInteger fileSize;
+
+
+/// @summary The size, in bytes, of the records for the objects in the tier.
+///
+@property(readonly) NSUInteger liveSize;
+
+
+#pragma mark - Object Lifecycle
+
+/// @summary Opens the disk tier in a directory, creating the directory and the log if necessary.
+///
+/// @param directoryURL The file URL of the directory that holds the log.
+///
+/// @param maximumSize The size, in bytes, that the log may grow to before it is compacted.
+///
+/// @param serializer The serializer used to convert keys and objects to and from data, or nil to use a
+/// VDSDatabaseCacheStandardSerializer. A tier must be opened with the serializer its log was written with.
+///
+/// @param error On failure, set to an error with the code VDSCacheDiskTierFailed.
+///
+/// @returns An initialized disk tier, or nil if the directory or log could not be opened or the log
+/// was not written by a disk tier.
+///
+- (instancetype _Nullable)initWithDirectoryURL:(NSURL* _Nonnull)directoryURL
+                                   maximumSize:(NSUInteger)maximumSize
+                                    serializer:(id<VDSDatabaseCacheSerializer> _Nullable)serializer
+                                         error:(NSError* _Nullable __autoreleasing * _Nullable)error NS_DESIGNATED_INITIALIZER;
+
+- (instancetype _Nonnull)init NS_UNAVAILABLE;
+
+
+#pragma mark - Object Storage Behaviors
+
+/// @summary Appends an object to the log, replacing any object already stored for the key.
+///
+/// @param object The object to store.
+///
+/// @param key The key for the object.
+///
+/// @param expiration The date the object expires, or nil if it does not expire. Expired objects are
+/// never returned and are dropped when the log is compacted.
+///
+/// @param cost The cost of the object in the cache it was evicted from.
+///
+/// @returns YES if the object was stored, NO if the serializer could not convert the key or object or
+/// the log could not be written.
+///
+- (BOOL)setObject:(id _Nonnull)object
+           forKey:(id _Nonnull)key
+          expires:(NSDate* _Nullable)expiration
+             cost:(NSUInteger)cost;
+
+
+/// @summary Removes the object for a key, if the tier holds one.
+///
+- (void)removeObjectForKey:(id _Nonnull)key;
+
+
+/// @summary Removes every object, emptying the log.
+///
+- (void)removeAllObjects;
+
+
+#pragma mark - Object Access Behaviors
+
+/// @summary YES if the tier holds an unexpired object for key. Does not read the object.
+///
+- (BOOL)containsObjectForKey:(id _Nonnull)key;
+
+
+/// @summary Reads and deserializes the object for a key, leaving it in the tier.
+///
+/// @returns The object, or nil if the tier does not hold an unexpired object for key.
+///
+- (id _Nullable)objectForKey:(id _Nonnull)key;
+
+
+/// @summary Reads and deserializes the object for a key and removes it from the tier. Used to
+/// promote an object back to the memory tier.
+///
+/// @param key The key of the object.
+///
+/// @param expiration Set to the date the object expires, or nil if it does not expire.
+///
+/// @param cost Set to the cost the object was stored with.
+///
+/// @returns The object, or nil if the tier does not hold an unexpired object for key.
+///
+- (id _Nullable)promoteObjectForKey:(id _Nonnull)key
+                            expires:(NSDate* _Nullable __autoreleasing * _Nullable)expiration
+                               cost:(NSUInteger* _Nullable)cost;
+
+
+#pragma mark - Maintenance Behaviors
+
+/// @summary Compacts the log immediately, rather than waiting for it to exceed the maximum size.
+///
+/// @param error On failure, set to an error with the code VDSCacheDiskTierFailed.
+///
+/// @returns YES if the log was compacted.
+///
+- (BOOL)compact:(NSError* _Nullable __autoreleasing * _Nullable)error;
+
+
+/// @summary Flushes the log to permanent storage. Appends are otherwise left to the system to write back.
+///
+/// @param error On failure, set to an error with the code VDSCacheDiskTierFailed.
+///
+/// @returns YES if the log was flushed.
+///
+- (BOOL)synchronize:(NSError* _Nullable __autoreleasing * _Nullable)error;
+
+
+@end
@@ -0,0 +1,724 @@
+//
+//  VDSDatabaseCacheDiskTier.mm
+//  VDSKit
+//
+//  Created by Erikheath Thomas on 6/14/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import "VDSDatabaseCacheDiskTier.h"
+#import "VDSDatabaseCacheSerializer.h"
+#import "VDSDatabaseCacheChecksum.h"
+#import "../../VDSErrorConstants.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <libkern/OSByteOrder.h>
+
+
+/// The name of the log in the tier's directory, and of the log written during compaction.
+static NSString* const VDSDiskTierLogName = @"VDSDatabaseCacheDiskTier.log";
+static NSString* const VDSDiskTierCompactionLogName = @"VDSDatabaseCacheDiskTier.log.compact";
+
+/// 'VDSD', the first word of the log, followed by the format version and a reserved word.
+static const uint32_t VDSDiskTierMagic = 0x44534456;
+static const uint32_t VDSDiskTierVersion = 1;
+static const size_t VDSDiskTierHeaderSize = 16;
+
+/// Each record is a 32 bit checksum of the rest of the record, a 1 byte type, 3 reserved bytes, the
+/// 32 bit lengths of the key and object data, the 64 bit expiration and cost, and then the data.
+static const size_t VDSDiskTierRecordHeaderSize = 4 + 4 + 4 + 4 + 8 + 8;
+
+/// The types of record.
+static const uint8_t VDSDiskTierObjectRecord = 1;
+static const uint8_t VDSDiskTierTombstoneRecord = 2;
+
+/// The fraction of the maximum size that compaction reduces the live records to.
+static const double VDSDiskTierCompactionTarget = 0.75;
+
+
+
+
+
+#pragma mark - Record Encoding
+
+static inline void put_uint32 (uint8_t* buffer, uint32_t value)
+{
+    value = OSSwapHostToLittleInt32(value);
+    memcpy(buffer, &value, sizeof(value));
+}
+
+
+static inline void put_uint64 (uint8_t* buffer, uint64_t value)
+{
+    value = OSSwapHostToLittleInt64(value);
+    memcpy(buffer, &value, sizeof(value));
+}
+
+
+static inline uint32_t get_uint32 (const uint8_t* buffer)
+{
+    uint32_t value = 0;
+    memcpy(&value, buffer, sizeof(value));
+    return OSSwapLittleToHostInt32(value);
+}
+
+
+static inline uint64_t get_uint64 (const uint8_t* buffer)
+{
+    uint64_t value = 0;
+    memcpy(&value, buffer, sizeof(value));
+    return OSSwapLittleToHostInt64(value);
+}
+
+
+/// Reads all of length bytes from a file at offset. Fails if the file ends first.
+static bool read_fully (int descriptor, uint8_t* bytes, size_t length, off_t offset)
+{
+    while (length > 0) {
+        ssize_t count = pread(descriptor, bytes, length, offset);
+        if (count < 0 && errno == EINTR) { continue; }
+        if (count <= 0) { return false; }
+        bytes += count;
+        offset += count;
+        length -= (size_t)count;
+    }
+    return true;
+}
+
+
+/// Writes all of length bytes to a file at offset.
+static bool write_fully (int descriptor, const uint8_t* bytes, size_t length, off_t offset)
+{
+    while (length > 0) {
+        ssize_t written = pwrite(descriptor, bytes, length, offset);
+        if (written < 0 && errno == EINTR) { continue; }
+        if (written < 0) { return false; }
+        bytes += written;
+        offset += written;
+        length -= (size_t)written;
+    }
+    return true;
+}
+
+
+/// The location of an object's record in the log, along with the values needed without reading it.
+struct VDSDiskTierLocation {
+    uint64_t offset;
+    uint32_t keyLength;
+    uint32_t objectLength;
+    double expiration;
+    uint64_t cost;
+
+    uint64_t size() const { return VDSDiskTierRecordHeaderSize + keyLength + objectLength; }
+};
+
+
+/// Hashes and compares keys the way NSDictionary does.
+struct VDSDiskTierKeyHash {
+    size_t operator()(id key) const { return [key hash]; }
+};
+
+struct VDSDiskTierKeyEqual {
+    bool operator()(id first, id second) const { return first == second || [first isEqual:second]; }
+};
+
+typedef std::unordered_map<id, VDSDiskTierLocation, VDSDiskTierKeyHash, VDSDiskTierKeyEqual> VDSDiskTierIndex;
+
+
+
+
+
+#pragma mark - VDSDatabaseCacheDiskTier Extension -
+
+@interface VDSDatabaseCacheDiskTier () {
+
+    /// Guards every other instance variable.
+    NSRecursiveLock* _lock;
+
+    /// Serializes compactions, which hold _lock only while they take a snapshot of the index and while
+    /// they install the compacted log.
+    NSLock* _compactionLock;
+
+    id<VDSDatabaseCacheSerializer> _serializer;
+    NSString* _logPath;
+    int _descriptor;
+    uint64_t _fileSize;
+    uint64_t _liveSize;
+
+    /// A read only mapping of the log, which may be shorter than the log until it is remapped.
+    uint8_t* _map;
+    size_t _mapLength;
+
+    /// The location of the record for each key in the tier.
+    VDSDiskTierIndex _index;
+
+    /// YES while a compaction is scheduled on the background queue.
+    BOOL _compactionScheduled;
+
+    /// Incremented whenever the log is emptied, so that a compaction in progress can tell that the
+    /// records it copied are gone.
+    uint64_t _generation;
+}
+
+@end
+
+
+
+
+
+#pragma mark - VDSDatabaseCacheDiskTier -
+
+@implementation VDSDatabaseCacheDiskTier
+
+#pragma mark - Properties
+
+@synthesize directoryURL = _directoryURL;
+@synthesize maximumSize = _maximumSize;
+
+
+- (NSUInteger)count
+{
+    [_lock lock];
+    NSUInteger count = _index.size();
+    [_lock unlock];
+    return count;
+}
+
+
+- (NSUInteger)fileSize
+{
+    [_lock lock];
+    NSUInteger fileSize = (NSUInteger)_fileSize;
+    [_lock unlock];
+    return fileSize;
+}
+
+
+- (NSUInteger)liveSize
+{
+    [_lock lock];
+    NSUInteger liveSize = (NSUInteger)_liveSize;
+    [_lock unlock];
+    return liveSize;
+}
+
+
+
+#pragma mark - Object Lifecycle
+
+- (instancetype _Nullable)initWithDirectoryURL:(NSURL* _Nonnull)directoryURL
+                                   maximumSize:(NSUInteger)maximumSize
+                                    serializer:(id<VDSDatabaseCacheSerializer> _Nullable)serializer
+                                         error:(NSError* _Nullable __autoreleasing * _Nullable)error
+{
+    NSAssert(directoryURL != nil, VDS_NIL_ARGUMENT_MESSAGE(@"directoryURL", _cmd));
+
+    self = [super init];
+    if (self != nil) {
+        _directoryURL = [directoryURL copy];
+        _maximumSize = maximumSize;
+        _serializer = serializer ?: [VDSDatabaseCacheStandardSerializer new];
+        _lock = [NSRecursiveLock new];
+        _compactionLock = [NSLock new];
+        _descriptor = -1;
+        _logPath = [directoryURL.path stringByAppendingPathComponent:VDSDiskTierLogName];
+
+        NSString* reason = nil;
+        int code = 0;
+        NSError* underlyingError = nil;
+        if ([[NSFileManager defaultManager] createDirectoryAtURL:directoryURL withIntermediateDirectories:YES attributes:nil error:&underlyingError] == NO) {
+            reason = @"The directory could not be created.";
+        } else if ((_descriptor = open(_logPath.fileSystemRepresentation, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0) {
+            reason = @"The log could not be opened.";
+            code = errno;
+        } else {
+            reason = [self recoverLog:&code];
+        }
+
+        if (reason != nil) {
+            if (error != NULL) {
+                if (underlyingError == nil && code != 0) { underlyingError = [NSError errorWithDomain:NSPOSIXErrorDomain code:code userInfo:nil]; }
+                *error = [self errorWithReason:reason underlyingError:underlyingError location:_cmd];
+            }
+            return nil;
+        }
+    }
+    return self;
+}
+
+
+- (void)dealloc
+{
+    if (_map != NULL) { munmap(_map, _mapLength); }
+    if (_descriptor >= 0) { close(_descriptor); }
+}
+
+
+/// Rebuilds the index from the log, truncating the log after the last complete record.
+///
+/// @param code Set to the POSIX error code of a failed file operation.
+///
+/// @returns nil on success, otherwise the reason the log could not be recovered.
+///
+- (NSString* _Nullable)recoverLog:(int*)code
+{
+    struct stat status;
+    if (fstat(_descriptor, &status) != 0) {
+        *code = errno;
+        return @"The log could not be examined.";
+    }
+    _fileSize = (uint64_t)status.st_size;
+
+    /// A log that was created but never given a header is treated as new.
+    if (_fileSize < VDSDiskTierHeaderSize) {
+        uint8_t header[VDSDiskTierHeaderSize] = {0};
+        put_uint32(header, VDSDiskTierMagic);
+        put_uint32(header + 4, VDSDiskTierVersion);
+        if (ftruncate(_descriptor, 0) != 0 || write_fully(_descriptor, header, sizeof(header), 0) == false) {
+            *code = errno;
+            return @"The log could not be created.";
+        }
+        _fileSize = VDSDiskTierHeaderSize;
+        return nil;
+    }
+
+    if ([self remap] == false) {
+        *code = errno;
+        return @"The log could not be mapped.";
+    }
+    if (get_uint32(_map) != VDSDiskTierMagic) { return @"The log was not written by a disk tier."; }
+    if (get_uint32(_map + 4) != VDSDiskTierVersion) { return @"The log was written with an unsupported format version."; }
+
+    uint64_t offset = VDSDiskTierHeaderSize;
+    while (offset + VDSDiskTierRecordHeaderSize <= _fileSize) {
+        const uint8_t* record = _map + offset;
+        VDSDiskTierLocation location;
+        location.offset = offset;
+        location.keyLength = get_uint32(record + 8);
+        location.objectLength = get_uint32(record + 12);
+        uint64_t expirationBits = get_uint64(record + 16);
+        memcpy(&location.expiration, &expirationBits, sizeof(expirationBits));
+        location.cost = get_uint64(record + 24);
+
+        /// A record that extends past the end of the log, or whose checksum does not match, was
+        /// interrupted while it was written, and ends the log.
+        if (location.size() > _fileSize - offset) { break; }
+        if (VDSCacheChecksum(record + 4, (size_t)location.size() - 4) != get_uint32(record)) { break; }
+
+        NSData* keyData = [NSData dataWithBytesNoCopy:(void*)(record + VDSDiskTierRecordHeaderSize) length:location.keyLength freeWhenDone:NO];
+        id key = [_serializer objectWithSerializedData:keyData];
+        if (key != nil) {
+            [self removeLocationForKey:key];
+            if (record[4] == VDSDiskTierObjectRecord) {
+                _index[key] = location;
+                _liveSize += location.size();
+            }
+        }
+        offset += location.size();
+    }
+
+    if (offset < _fileSize) {
+        if (ftruncate(_descriptor, (off_t)offset) != 0) {
+            *code = errno;
+            return @"The log could not be truncated after an incomplete record.";
+        }
+        _fileSize = offset;
+    }
+    return nil;
+}
+
+
+/// Maps the whole log, replacing any existing mapping. Must be called while holding the lock.
+- (bool)remap
+{
+    if (_map != NULL) {
+        munmap(_map, _mapLength);
+        _map = NULL;
+        _mapLength = 0;
+    }
+    if (_fileSize == 0) { return true; }
+    void* map = mmap(NULL, (size_t)_fileSize, PROT_READ, MAP_SHARED, _descriptor, 0);
+    if (map == MAP_FAILED) { return false; }
+    _map = (uint8_t*)map;
+    _mapLength = (size_t)_fileSize;
+    return true;
+}
+
+
+- (NSError*)errorWithReason:(NSString*)reason underlyingError:(NSError* _Nullable)underlyingError location:(SEL)location
+{
+    NSMutableDictionary* userInfo = [NSMutableDictionary dictionaryWithDictionary:@{VDSLocationErrorKey: NSStringFromSelector(location),
+                                                                                    VDSLocationParametersErrorKey: @{@"directoryURL": _directoryURL.description},
+                                                                                    NSDebugDescriptionErrorKey: VDS_DISK_TIER_FAILED_MESSAGE(_directoryURL.path, reason)}];
+    if (underlyingError != nil) { userInfo[NSUnderlyingErrorKey] = underlyingError; }
+    return [NSError errorWithDomain:VDSKitErrorDomain code:VDSCacheDiskTierFailed userInfo:userInfo];
+}
+
+
+
+#pragma mark - Object Storage Behaviors
+
+- (BOOL)setObject:(id _Nonnull)object
+           forKey:(id _Nonnull)key
+          expires:(NSDate* _Nullable)expiration
+             cost:(NSUInteger)cost
+{
+    NSAssert(object != nil, VDS_NIL_ARGUMENT_MESSAGE(@"object", _cmd));
+    NSAssert(key != nil, VDS_NIL_ARGUMENT_MESSAGE(@"key", _cmd));
+
+    /// Serialization happens before the lock is taken, so concurrent writers only contend for the append.
+    NSData* keyData = [_serializer serializedDataForObject:key];
+    NSData* objectData = keyData != nil ? [_serializer serializedDataForObject:object] : nil;
+    if (keyData == nil || objectData == nil || keyData.length > UINT32_MAX || objectData.length > UINT32_MAX) { return NO; }
+
+    NSTimeInterval expires = expiration != nil ? expiration.timeIntervalSinceReferenceDate : DBL_MAX;
+    [_lock lock];
+    VDSDiskTierLocation location;
+    BOOL success = [self appendRecordOfType:VDSDiskTierObjectRecord keyData:keyData objectData:objectData expiration:expires cost:cost location:&location];
+    if (success) {
+        [self removeLocationForKey:key];
+        _index[[key copy]] = location;
+        _liveSize += location.size();
+        [self scheduleCompactionIfNeeded];
+    }
+    [_lock unlock];
+    return success;
+}
+
+
+- (void)removeObjectForKey:(id _Nonnull)key
+{
+    NSAssert(key != nil, VDS_NIL_ARGUMENT_MESSAGE(@"key", _cmd));
+
+    [_lock lock];
+    if (_index.find(key) != _index.end()) { [self appendTombstoneForKey:key]; }
+    [_lock unlock];
+}
+
+
+- (void)removeAllObjects
+{
+    [_lock lock];
+    _index.clear();
+    _liveSize = 0;
+    _generation++;
+    if (ftruncate(_descriptor, (off_t)VDSDiskTierHeaderSize) == 0) {
+        _fileSize = VDSDiskTierHeaderSize;
+        [self remap];
+    }
+    [_lock unlock];
+}
+
+
+/// Appends a tombstone for a key in the index and removes it from the index. Must be called while
+/// holding the lock.
+- (void)appendTombstoneForKey:(id)key
+{
+    NSData* keyData = [_serializer serializedDataForObject:key];
+    VDSDiskTierLocation location;
+    /// If the tombstone can not be written the key is still removed, and only returns if the
+    /// tier is reopened.
+    if (keyData != nil) {
+        [self appendRecordOfType:VDSDiskTierTombstoneRecord keyData:keyData objectData:[NSData data] expiration:0 cost:0 location:&location];
+    }
+    [self removeLocationForKey:key];
+    [self scheduleCompactionIfNeeded];
+}
+
+
+/// Removes a key from the index, accounting for its record becoming dead. Must be called while holding the lock.
+- (void)removeLocationForKey:(id)key
+{
+    VDSDiskTierIndex::iterator position = _index.find(key);
+    if (position == _index.end()) { return; }
+    _liveSize -= position->second.size();
+    _index.erase(position);
+}
+
+
+/// Appends a record to the log with a single write. Must be called while holding the lock.
+- (BOOL)appendRecordOfType:(uint8_t)type
+                   keyData:(NSData*)keyData
+                objectData:(NSData*)objectData
+                expiration:(NSTimeInterval)expiration
+                      cost:(NSUInteger)cost
+                  location:(VDSDiskTierLocation*)location
+{
+    location->offset = _fileSize;
+    location->keyLength = (uint32_t)keyData.length;
+    location->objectLength = (uint32_t)objectData.length;
+    location->expiration = expiration;
+    location->cost = cost;
+
+    std::vector<uint8_t> record((size_t)location->size());
+    record[4] = type;
+    put_uint32(record.data() + 8, location->keyLength);
+    put_uint32(record.data() + 12, location->objectLength);
+    uint64_t expirationBits = 0;
+    memcpy(&expirationBits, &expiration, sizeof(expirationBits));
+    put_uint64(record.data() + 16, expirationBits);
+    put_uint64(record.data() + 24, cost);
+    memcpy(record.data() + VDSDiskTierRecordHeaderSize, keyData.bytes, keyData.length);
+    if (objectData.length > 0) { memcpy(record.data() + VDSDiskTierRecordHeaderSize + keyData.length, objectData.bytes, objectData.length); }
+    put_uint32(record.data(), VDSCacheChecksum(record.data() + 4, record.size() - 4));
+
+    if (write_fully(_descriptor, record.data(), record.size(), (off_t)_fileSize) == false) {
+        /// A partial record is cut off so the next append does not follow it.
+        ftruncate(_descriptor, (off_t)_fileSize);
+        return NO;
+    }
+    _fileSize += record.size();
+    return YES;
+}
+
+
+
+#pragma mark - Object Access Behaviors
+
+- (BOOL)containsObjectForKey:(id _Nonnull)key
+{
+    NSAssert(key != nil, VDS_NIL_ARGUMENT_MESSAGE(@"key", _cmd));
+
+    [_lock lock];
+    VDSDiskTierIndex::iterator position = _index.find(key);
+    BOOL contains = position != _index.end() && position->second.expiration > [NSDate timeIntervalSinceReferenceDate];
+    [_lock unlock];
+    return contains;
+}
+
+
+- (id _Nullable)objectForKey:(id _Nonnull)key
+{
+    return [self objectForKey:key expires:NULL cost:NULL removes:NO];
+}
+
+
+- (id _Nullable)promoteObjectForKey:(id _Nonnull)key
+                            expires:(NSDate* _Nullable __autoreleasing * _Nullable)expiration
+                               cost:(NSUInteger* _Nullable)cost
+{
+    return [self objectForKey:key expires:expiration cost:cost removes:YES];
+}
+
+
+/// Reads the object for a key from the mapping, optionally removing it from the tier.
+- (id _Nullable)objectForKey:(id _Nonnull)key
+                     expires:(NSDate* _Nullable __autoreleasing * _Nullable)expiration
+                        cost:(NSUInteger* _Nullable)cost
+                     removes:(BOOL)removes
+{
+    NSAssert(key != nil, VDS_NIL_ARGUMENT_MESSAGE(@"key", _cmd));
+
+    [_lock lock];
+    id object = nil;
+    VDSDiskTierIndex::iterator position = _index.find(key);
+    if (position != _index.end()) {
+        VDSDiskTierLocation location = position->second;
+        if (location.expiration <= [NSDate timeIntervalSinceReferenceDate]) {
+            /// An expired object is gone for good.
+            [self appendTombstoneForKey:key];
+        } else if (location.offset + location.size() <= _mapLength || [self remap]) {
+            /// The object is only deserialized now that it has been requested.
+            const uint8_t* bytes = _map + location.offset + VDSDiskTierRecordHeaderSize + location.keyLength;
+            object = [_serializer objectWithSerializedData:[NSData dataWithBytesNoCopy:(void*)bytes length:location.objectLength freeWhenDone:NO]];
+            if (object != nil && expiration != NULL) {
+                *expiration = location.expiration != DBL_MAX ? [NSDate dateWithTimeIntervalSinceReferenceDate:location.expiration] : nil;
+            }
+            if (object != nil && cost != NULL) { *cost = (NSUInteger)location.cost; }
+            if (removes || object == nil) { [self appendTombstoneForKey:key]; }
+        }
+    }
+    [_lock unlock];
+    return object;
+}
+
+
+
+#pragma mark - Maintenance Behaviors
+
+- (BOOL)synchronize:(NSError* _Nullable __autoreleasing * _Nullable)error
+{
+    [_lock lock];
+    BOOL success = fsync(_descriptor) == 0;
+    int code = errno;
+    [_lock unlock];
+    if (success == NO && error != NULL) {
+        *error = [self errorWithReason:@"The log could not be synchronized."
+                       underlyingError:[NSError errorWithDomain:NSPOSIXErrorDomain code:code userInfo:nil]
+                              location:_cmd];
+    }
+    return success;
+}
+
+
+/// Compacts the log on a background queue once it exceeds the maximum size. Must be called while
+/// holding the lock.
+- (void)scheduleCompactionIfNeeded
+{
+    if (_compactionScheduled || _maximumSize == 0 || _fileSize <= _maximumSize) { return; }
+    _compactionScheduled = YES;
+    __weak VDSDatabaseCacheDiskTier* weakSelf = self;
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        [weakSelf compact:NULL];
+    });
+}
+
+
+- (BOOL)compact:(NSError* _Nullable __autoreleasing * _Nullable)error
+{
+    [_compactionLock lock];
+
+    /// The live records are collected under the lock, along with the size of the log at that moment.
+    /// Live records are copied in log order, which is the order they were stored in, so dropping
+    /// records from the front of the order drops the oldest.
+    [_lock lock];
+    _compactionScheduled = NO;
+    int sourceDescriptor = _descriptor;
+    uint64_t snapshotSize = _fileSize;
+    uint64_t generation = _generation;
+    std::vector<VDSDiskTierLocation> live;
+    live.reserve(_index.size());
+    for (const VDSDiskTierIndex::value_type& entry : _index) { live.push_back(entry.second); }
+    [_lock unlock];
+
+    std::sort(live.begin(), live.end(), [](const VDSDiskTierLocation& first, const VDSDiskTierLocation& second) {
+        return first.offset < second.offset;
+    });
+    NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+    uint64_t keptSize = 0;
+    for (const VDSDiskTierLocation& location : live) {
+        if (location.expiration > now) { keptSize += location.size(); }
+    }
+    uint64_t targetSize = _maximumSize > 0 ? (uint64_t)(_maximumSize * VDSDiskTierCompactionTarget) : UINT64_MAX;
+
+    NSString* compactionPath = [_directoryURL.path stringByAppendingPathComponent:VDSDiskTierCompactionLogName];
+    NSString* reason = nil;
+    int code = 0;
+    int descriptor = open(compactionPath.fileSystemRepresentation, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (descriptor < 0) {
+        reason = @"The compacted log could not be created.";
+        code = errno;
+    }
+
+    /// The kept records are copied as written, checksums included, through a buffer, without holding
+    /// the lock. Records are only ever appended to the log, so the records of the snapshot do not change
+    /// while they are copied, unless the log is emptied, which the read or the generation reveals.
+    std::vector<uint8_t> buffer;
+    buffer.reserve(1 << 20);
+    uint8_t header[VDSDiskTierHeaderSize] = {0};
+    put_uint32(header, VDSDiskTierMagic);
+    put_uint32(header + 4, VDSDiskTierVersion);
+    buffer.insert(buffer.end(), header, header + sizeof(header));
+    uint64_t written = 0;
+    bool emptied = false;
+    std::unordered_map<uint64_t, uint64_t> moved;
+    for (const VDSDiskTierLocation& location : live) {
+        if (reason != nil || emptied) { break; }
+        if (location.expiration <= now) { continue; }
+        if (keptSize > targetSize) {
+            keptSize -= location.size();
+            continue;
+        }
+        moved[location.offset] = written + buffer.size();
+        size_t start = buffer.size();
+        buffer.resize(start + (size_t)location.size());
+        if (read_fully(sourceDescriptor, buffer.data() + start, (size_t)location.size(), (off_t)location.offset) == false) {
+            emptied = true;
+            break;
+        }
+        if (buffer.size() >= (1 << 20)) {
+            if (write_fully(descriptor, buffer.data(), buffer.size(), (off_t)written) == false) {
+                reason = @"The compacted log could not be written.";
+                code = errno;
+            }
+            written += buffer.size();
+            buffer.clear();
+        }
+    }
+    if (reason == nil && emptied == false && write_fully(descriptor, buffer.data(), buffer.size(), (off_t)written) == false) {
+        reason = @"The compacted log could not be written.";
+        code = errno;
+    }
+    written += buffer.size();
+
+    /// The compacted records are on disk before they replace the log, so a crash leaves one or the other.
+    if (reason == nil && emptied == false && fsync(descriptor) != 0) {
+        reason = @"The compacted log could not be synchronized.";
+        code = errno;
+    }
+
+    [_lock lock];
+    emptied = emptied || _generation != generation;
+
+    /// Records appended while the snapshot was copied follow it in the compacted log unchanged. They
+    /// are only written back by the system, as any other append is, and a tail cut short by a crash is
+    /// ended at its last complete record when the log is recovered.
+    uint64_t tailSize = _fileSize - snapshotSize;
+    if (reason == nil && emptied == false && tailSize > 0) {
+        buffer.resize((size_t)tailSize);
+        if (read_fully(_descriptor, buffer.data(), buffer.size(), (off_t)snapshotSize) == false) {
+            reason = @"The log could not be read.";
+            code = errno;
+        } else if (write_fully(descriptor, buffer.data(), buffer.size(), (off_t)written) == false) {
+            reason = @"The compacted log could not be written.";
+            code = errno;
+        }
+    }
+    if (reason == nil && emptied == false && rename(compactionPath.fileSystemRepresentation, _logPath.fileSystemRepresentation) != 0) {
+        reason = @"The compacted log could not replace the log.";
+        code = errno;
+    }
+
+    if (reason != nil || emptied) {
+        if (descriptor >= 0) {
+            close(descriptor);
+            unlink(compactionPath.fileSystemRepresentation);
+        }
+    } else {
+        /// The index is reconciled with the changes made while the snapshot was copied. A location in the
+        /// snapshot moved with its record or was dropped with it, and a location in the tail moved with
+        /// the tail. Keys removed in the meantime are no longer in the index.
+        _liveSize = 0;
+        for (VDSDiskTierIndex::iterator position = _index.begin(); position != _index.end();) {
+            VDSDiskTierLocation& location = position->second;
+            if (location.offset >= snapshotSize) {
+                location.offset = location.offset - snapshotSize + written;
+            } else {
+                std::unordered_map<uint64_t, uint64_t>::const_iterator move = moved.find(location.offset);
+                if (move == moved.end()) {
+                    position = _index.erase(position);
+                    continue;
+                }
+                location.offset = move->second;
+            }
+            _liveSize += location.size();
+            ++position;
+        }
+        close(_descriptor);
+        _descriptor = descriptor;
+        _fileSize = written + tailSize;
+        [self remap];
+
+        /// The records appended during the copy may leave the log over the maximum size.
+        [self scheduleCompactionIfNeeded];
+    }
+    [_lock unlock];
+    [_compactionLock unlock];
+
+    if (reason != nil && error != NULL) {
+        *error = [self errorWithReason:reason
+                       underlyingError:code != 0 ? [NSError errorWithDomain:NSPOSIXErrorDomain code:code userInfo:nil] : nil
+                              location:_cmd];
+    }
+    return reason == nil;
+}
+
+
+@end
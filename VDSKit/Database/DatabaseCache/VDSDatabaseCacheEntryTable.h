@@ -0,0 +1,419 @@
+//
+//  VDSDatabaseCacheEntryTable.h
+//  VDSKit
+//
+//  Created by Erikheath Thomas on 6/2/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "VDSDatabaseCacheReclaimer.h"
+#import "VDSDatabaseCacheMetrics.h"
+#import "VDSDatabaseCacheKeyVector.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+
+
+
+
+#pragma mark - VDSCacheReferenceBit -
+
+/// @summary The reference bit of an entry under the CLOCK eviction policy. Readers set the bit with a
+/// relaxed store, without holding the table's lock, and the eviction cycle clears it.
+///
+/// @discussion Copying a bit copies its value, so entries can still be reset by assignment.
+///
+struct VDSCacheReferenceBit {
+
+    VDSCacheReferenceBit() = default;
+    VDSCacheReferenceBit(const VDSCacheReferenceBit& other) : _value(other.isSet()) {}
+    VDSCacheReferenceBit& operator=(const VDSCacheReferenceBit& other)
+    {
+        _value.store(other.isSet(), std::memory_order_relaxed);
+        return *this;
+    }
+
+    bool isSet() const { return _value.load(std::memory_order_relaxed); }
+
+    /// Sets the bit. The bit is read first so that repeated reads of a hot entry do not keep
+    /// writing to its cache line.
+    void set() { if (isSet() == false) { _value.store(true, std::memory_order_relaxed); } }
+
+    void clear() { _value.store(false, std::memory_order_relaxed); }
+
+private:
+
+    std::atomic<bool> _value{false};
+};
+
+
+
+
+
+#pragma mark - VDSCacheEntry -
+
+/// @summary The storage record for a single key in a VDSDatabaseCache. An entry holds the
+/// cached object, its key, and all of the tracking state the cache maintains for it.
+///
+/// @discussion Entries are allocated from slabs owned by a VDSCacheEntryTable and never move
+/// once allocated. Tracked entries are linked intrusively into the recency order (used by the
+/// FIFO, LIFO, and OAT eviction policies) and the expiration order, so tracking an object does
+/// not require any allocation beyond the entry itself. Tracked entries are also held in an indexed
+/// binary heap ordered by expiration, which the entry locates through its heap index.
+///
+/// The recency order is divided into segments, each with its own list. An entry is linked into
+/// exactly one segment while it is tracked, and into the untracked list while it is not, so either
+/// partition can be enumerated without visiting the other.
+///
+struct VDSCacheEntry {
+
+    /// The key used to store the object in the cache.
+    __strong id key = nil;
+
+    /// The cached object.
+    __strong id object = nil;
+
+    /// The hash of key, cached to avoid messaging the key when probing or resizing the index.
+    NSUInteger hash = 0;
+
+    /// The time, on the cache clock, when the entry expires. Stored inline so that scheduling an
+    /// expiration allocates nothing and the expiration heap compares plain numbers.
+    NSTimeInterval expiration = 0;
+
+    /// The time, on the cache clock, after which the entry is stale and a read starts a refresh of
+    /// its object, or DBL_MAX if the entry does not become stale.
+    NSTimeInterval refreshTime = DBL_MAX;
+
+    /// The number of uses recorded for the entry when the cache tracks object usage.
+    NSUInteger usageCount = 0;
+
+    /// The cost of the object, counted toward the total cost of the table.
+    NSUInteger cost = 0;
+
+    /// Links into the recency order of the entry's segment, or into the untracked list if the entry is
+    /// not tracked. The head of the order is the most recently added or accessed entry.
+    VDSCacheEntry* recencyPrev = NULL;
+    VDSCacheEntry* recencyNext = NULL;
+
+    /// The position of the entry in the expiration heap, or NSNotFound if the entry is not scheduled to expire.
+    NSUInteger heapIndex = NSNotFound;
+
+    /// Links into the list of expired entries that were retained because they are still in use.
+    VDSCacheEntry* expiryPrev = NULL;
+    VDSCacheEntry* expiryNext = NULL;
+
+    /// Set when the entry is read under the CLOCK eviction policy, and cleared when an eviction cycle
+    /// gives the entry a second chance.
+    VDSCacheReferenceBit referenced;
+
+    /// The recency segment the entry is linked into. FIFO, LIFO, and OAT only use segment 0, while the
+    /// scan resistant policies divide tracked entries between segments.
+    uint8_t segment = 0;
+
+    /// YES if the entry participates in expiration, usage, and eviction tracking.
+    bool tracked = false;
+
+    /// YES once an eviction cycle has processed the entry as expired. An expired entry has been removed
+    /// from the expiration heap and is linked into the retained expired list.
+    bool expired = false;
+
+    /// YES while an eviction cycle waits for its delegate to approve the eviction of the entry. A
+    /// pending entry is linked into the untracked list, so no cycle selects it again, but it keeps its
+    /// usage count and is not reported, enumerated, or archived as an untracked entry.
+    bool pendingEviction = false;
+
+    /// The position of the entry's key in the table's key vector, or NSNotFound while the entry is
+    /// pending eviction.
+    NSUInteger keyIndex = NSNotFound;
+};
+
+
+
+
+
+/// @summary The deadlines of an entry, as read by a concurrent lookup.
+///
+struct VDSCacheEntryDeadlines {
+
+    NSTimeInterval expiration = DBL_MAX;
+    NSTimeInterval refreshTime = DBL_MAX;
+};
+
+
+
+
+
+#pragma mark - VDSCacheEntryTable -
+
+/// @summary An open-addressing hash table of VDSCacheEntry records that provides storage and
+/// tracking for a VDSDatabaseCache.
+///
+/// @discussion Keys are located using linear probing over a single power of two sized index.
+/// Removal uses backward shift deletion so the index never accumulates tombstones. Entries are
+/// carved from slabs and recycled through a free list, making an insert allocation free once the
+/// table has warmed up.
+///
+/// The table is not thread safe. VDSDatabaseCache serializes access to each of its tables using
+/// the lock of the shard that owns the table. The one exception is concurrentObjectForKey(), which
+/// may be called without the lock once concurrent reads have been enabled. Writers then publish
+/// each change to the index under a sequence lock, and retire replaced keys, objects, and memory
+/// through an epoch reclaimer rather than releasing them, so lock free readers never observe a
+/// released key or object.
+///
+class VDSCacheEntryTable {
+
+public:
+
+    VDSCacheEntryTable();
+    ~VDSCacheEntryTable();
+
+    VDSCacheEntryTable(const VDSCacheEntryTable&) = delete;
+    VDSCacheEntryTable& operator=(const VDSCacheEntryTable&) = delete;
+
+
+#pragma mark Storage
+
+    /// The number of entries in the table.
+    NSUInteger count() const { return _count; }
+
+    /// The number of tracked entries in the table.
+    NSUInteger trackedCount() const { return _trackedCount; }
+
+    /// The number of untracked entries in the table, not counting entries pending eviction.
+    NSUInteger untrackedCount() const { return _count - _trackedCount - _pendingCount; }
+
+    /// The sum of the costs of the entries in the table.
+    NSUInteger totalCost() const { return _totalCost; }
+
+    /// The sum of the costs of the tracked entries in the table.
+    NSUInteger trackedCost() const { return _trackedCost; }
+
+    /// An immutable array of the keys of the entries in the table that are not pending eviction,
+    /// taken in O(1). Changes to the table after it is taken are never reflected in it.
+    NSArray* keySnapshot() const { return _keys.snapshot(); }
+
+    /// Returns the entry for key, or NULL if the key is not in the table.
+    VDSCacheEntry* find(id key) const { return find(key, [key hash]); }
+
+    /// Returns the entry for key using a hash the caller has already computed, or NULL if
+    /// the key is not in the table. hash must be equal to [key hash].
+    VDSCacheEntry* find(id key, NSUInteger hash) const;
+
+    /// Adds a new entry to the head of the untracked list. The key must not already be in the table.
+    VDSCacheEntry* insert(id key, id object) { return insert(key, object, [key hash]); }
+
+    /// Adds a new, untracked entry using a hash the caller has already computed. The key must
+    /// not already be in the table and hash must be equal to [key hash].
+    VDSCacheEntry* insert(id key, id object, NSUInteger hash);
+
+    /// Unlinks the entry from the index and tracking orders and recycles it.
+    void remove(VDSCacheEntry* entry);
+
+    /// Removes every entry from the table.
+    void removeAll();
+
+    /// Grows the index and entry slabs so that capacity entries can be held without further allocation.
+    void reserve(NSUInteger capacity);
+
+    /// Replaces the object of an entry.
+    void setObject(VDSCacheEntry* entry, id object);
+
+    /// Replaces the cost of an entry, updating the total cost of the table.
+    void setCost(VDSCacheEntry* entry, NSUInteger cost);
+
+    /// Adjusts objectCount, which may be shared with other tables, whenever entries are inserted or
+    /// removed. The entries already in the table are added to it. Must be called before the table is
+    /// shared between threads.
+    void shareObjectCount(VDSCacheObjectCount* objectCount);
+
+
+#pragma mark Concurrent Reads
+
+    /// Enables concurrentObjectForKey(). Must be called before the table is shared between threads.
+    void enableConcurrentReads();
+
+    /// YES if concurrent reads have been enabled.
+    bool allowsConcurrentReads() const { return _reclaimer != nullptr; }
+
+    /// Returns the object for key, or nil if the key is not in the table, without requiring the
+    /// caller to hold the table's lock. The lookup retries if it overlaps a write to the index and
+    /// never blocks writers. hash must be equal to [key hash].
+    ///
+    /// If deadlines is not NULL, it receives the expiration and refresh time of a tracked entry, or
+    /// DBL_MAX for an untracked entry. Deadlines are rescheduled without publishing to the index, so
+    /// they may lag a concurrent reschedule of the entry.
+    ///
+    /// If marksReferenced is true, the reference bit of the entry that was found is set.
+    id concurrentObjectForKey(id key, NSUInteger hash, VDSCacheEntryDeadlines* deadlines = NULL, bool marksReferenced = false) const;
+
+    /// Releases the keys, objects, and memory retired by writers that concurrent readers can no
+    /// longer observe. Writers call this periodically while holding the table's lock.
+    void collectRetiredItems() { if (_reclaimer != nullptr) { _reclaimer->collect(); } }
+
+
+#pragma mark Tracking
+
+    /// The number of recency segments.
+    static const NSUInteger SegmentCount = 3;
+
+    /// Moves an entry from the untracked list to the head of the recency order of a segment, clearing
+    /// its reference bit. An entry pending eviction is no longer pending.
+    void track(VDSCacheEntry* entry, NSUInteger segment = 0);
+
+    /// Unlinks an entry from the recency order, the expiration heap, and the retained expired list,
+    /// and links it into the untracked list, clearing its usage count. An entry pending eviction is
+    /// no longer pending.
+    void untrack(VDSCacheEntry* entry);
+
+    /// Untracks an entry as untrack() does, but marks it as pending eviction and keeps its usage count.
+    void untrackPendingEviction(VDSCacheEntry* entry);
+
+    /// Moves a tracked entry to the head of the recency order of its segment.
+    void touch(VDSCacheEntry* entry);
+
+    /// Moves a tracked entry to the head of the recency order of another segment.
+    void moveToSegment(VDSCacheEntry* entry, NSUInteger segment);
+
+    VDSCacheEntry* mostRecent(NSUInteger segment = 0) const { return _segments[segment].head; }
+    VDSCacheEntry* leastRecent(NSUInteger segment = 0) const { return _segments[segment].tail; }
+
+    /// The number of tracked entries linked into a segment.
+    NSUInteger segmentCount(NSUInteger segment) const { return _segments[segment].count; }
+
+    /// Calls function with every tracked entry, segment by segment, from most to least recent.
+    template <typename Function>
+    void enumerateTrackedEntries(Function function) const
+    {
+        for (const Segment& segment : _segments) {
+            for (VDSCacheEntry* entry = segment.head; entry != NULL; entry = entry->recencyNext) { function(entry); }
+        }
+    }
+
+    /// Calls function with every untracked entry, from the most to the least recently added or untracked.
+    /// Entries pending eviction are skipped.
+    template <typename Function>
+    void enumerateUntrackedEntries(Function function) const
+    {
+        for (VDSCacheEntry* entry = _untracked.head; entry != NULL; entry = entry->recencyNext) {
+            if (entry->pendingEviction == false) { function(entry); }
+        }
+    }
+
+
+#pragma mark Expiration
+
+    /// Sets the expiration of a tracked entry and positions it in the expiration heap in O(logN).
+    /// An entry that had expired is unlinked from the retained expired list and becomes unexpired.
+    void scheduleExpiration(VDSCacheEntry* entry, NSTimeInterval expiration);
+
+    /// Sets the expirations of a batch of tracked entries. A batch that is large relative to the heap
+    /// is appended and the heap is rebuilt in O(N), otherwise each entry is scheduled in O(logN).
+    void scheduleExpirations(VDSCacheEntry* const* entries, const NSTimeInterval* expirations, NSUInteger count);
+
+    /// Removes and returns the entry with the earliest expiration if it expires at or before now,
+    /// otherwise returns NULL. Calling this repeatedly yields the expired entries in expiration order,
+    /// touching only the expired entries. Each returned entry is marked as expired and linked into the
+    /// retained expired list.
+    VDSCacheEntry* popExpiration(NSTimeInterval now);
+
+    /// Marks a tracked entry that is not scheduled to expire as expired and links it into the retained
+    /// expired list, as though popExpiration had returned it.
+    void retainExpired(VDSCacheEntry* entry);
+
+    /// The unexpired entry with the earliest expiration, or NULL if no entries are scheduled to expire.
+    VDSCacheEntry* earliestExpiration() const { return _expirations.empty() ? NULL : _expirations.front(); }
+
+    /// The first entry in the list of expired entries that are retained because they are still in use.
+    VDSCacheEntry* firstRetainedExpiration() const { return _expiryHead; }
+
+
+#pragma mark Enumeration
+
+    /// Calls function with every entry in the table in index order, including entries pending eviction.
+    template <typename Function>
+    void enumerateEntries(Function function) const
+    {
+        const Index* index = _index.load(std::memory_order_relaxed);
+        for (const Slot& slot : index->slots) {
+            if (slot.entry != NULL) { function(slot.entry); }
+        }
+    }
+
+
+private:
+
+    struct Slot {
+        NSUInteger hash;
+        VDSCacheEntry* entry;
+    };
+
+    /// The slots of the table along with the values used to map a hash to a slot. An index is
+    /// replaced, never resized, so a concurrent reader always sees a mask that matches its slots.
+    struct Index {
+        std::vector<Slot> slots;
+        NSUInteger mask;
+        NSUInteger shift;
+
+        explicit Index(NSUInteger capacity);
+        NSUInteger slotForHash(NSUInteger hash) const;
+    };
+
+    void beginWrite();
+    void endWrite();
+    void resize(NSUInteger capacity);
+    void addSlab(NSUInteger size);
+    VDSCacheEntry* allocateEntry();
+    void recycleEntry(VDSCacheEntry* entry);
+    void linkRecency(VDSCacheEntry* entry);
+    void unlinkRecency(VDSCacheEntry* entry);
+    void unlinkTracking(VDSCacheEntry* entry);
+    void listKey(VDSCacheEntry* entry);
+    void unlistKey(VDSCacheEntry* entry);
+    void unlinkExpiry(VDSCacheEntry* entry);
+    void removeFromHeap(VDSCacheEntry* entry);
+    void siftUp(NSUInteger index);
+    void siftDown(NSUInteger index);
+
+    std::atomic<Index*> _index;
+    NSUInteger _count;
+    NSUInteger _trackedCount;
+    NSUInteger _pendingCount;
+    NSUInteger _totalCost;
+    NSUInteger _trackedCost;
+    VDSCacheObjectCount* _objectCount;
+
+    /// The keys of the entries that are not pending eviction, and the entry at each position of the
+    /// vector. A key is removed by moving the last key into its position.
+    VDSCacheKeyVector _keys;
+    std::vector<VDSCacheEntry*> _keyEntries;
+
+    std::vector<std::unique_ptr<VDSCacheEntry[]>> _slabs;
+    VDSCacheEntry* _freeList;
+    NSUInteger _freeCount;
+
+    /// A recency ordered list of tracked entries.
+    struct Segment {
+        VDSCacheEntry* head = NULL;
+        VDSCacheEntry* tail = NULL;
+        NSUInteger count = 0;
+    };
+
+    Segment _segments[SegmentCount];
+
+    /// The untracked entries, linked through their recency links.
+    Segment _untracked;
+
+    /// The list an entry is linked into: the recency order of its segment if it is tracked,
+    /// otherwise the untracked list.
+    Segment& listForEntry(VDSCacheEntry* entry) { return entry->tracked ? _segments[entry->segment] : _untracked; }
+
+    std::vector<VDSCacheEntry*> _expirations;
+    VDSCacheEntry* _expiryHead;
+
+    /// Odd while a writer is changing the index or the keys and objects of its entries.
+    std::atomic<unsigned long> _sequence;
+    std::unique_ptr<VDSCacheEpochReclaimer> _reclaimer;
+};
@@ -0,0 +1,604 @@
+//
+//  VDSDatabaseCacheEntryTable.mm
+//  VDSKit
+//
+//  Created by Erikheath Thomas on 6/2/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import "VDSDatabaseCacheEntryTable.h"
+
+#include <algorithm>
+
+
+/// The smallest index the table will allocate. Must be a power of two.
+static const NSUInteger VDSCacheEntryTableMinimumCapacity = 16;
+
+/// The number of entries carved from each slab when the free list is exhausted.
+static const NSUInteger VDSCacheEntrySlabSize = 1024;
+
+/// The golden ratio multiplier used to spread key hashes across the index (Fibonacci hashing).
+static const uint64_t VDSCacheEntryHashMultiplier = 11400714819323198485ull;
+
+
+
+
+
+#pragma mark - Object Lifecycle
+
+VDSCacheEntryTable::Index::Index(NSUInteger capacity)
+: slots(capacity, Slot{0, NULL}),
+  mask(capacity - 1),
+  shift(64)
+{
+    for (NSUInteger size = capacity; size > 1; size >>= 1) { shift--; }
+}
+
+
+VDSCacheEntryTable::VDSCacheEntryTable()
+: _index(new Index(VDSCacheEntryTableMinimumCapacity)),
+  _count(0),
+  _trackedCount(0),
+  _pendingCount(0),
+  _totalCost(0),
+  _trackedCost(0),
+  _objectCount(NULL),
+  _freeList(NULL),
+  _freeCount(0),
+  _segments(),
+  _untracked(),
+  _expiryHead(NULL),
+  _sequence(0)
+{
+}
+
+
+VDSCacheEntryTable::~VDSCacheEntryTable()
+{
+    /// Destroying the slabs releases every key and object held by the table.
+    delete _index.load(std::memory_order_relaxed);
+}
+
+
+
+#pragma mark - Storage Behaviors
+
+NSUInteger VDSCacheEntryTable::Index::slotForHash(NSUInteger hash) const
+{
+    return (NSUInteger)(((uint64_t)hash * VDSCacheEntryHashMultiplier) >> shift);
+}
+
+
+VDSCacheEntry* VDSCacheEntryTable::find(id key, NSUInteger hash) const
+{
+    /// The probe count is bounded so that a concurrent reader, which may observe entries
+    /// mid-move, can not loop indefinitely. Such a reader discards the result and retries.
+    const Index* index = _index.load(std::memory_order_acquire);
+    NSUInteger slotIndex = index->slotForHash(hash);
+    for (NSUInteger probes = 0; probes <= index->mask; probes++, slotIndex = (slotIndex + 1) & index->mask) {
+        const Slot& slot = index->slots[slotIndex];
+        if (slot.entry == NULL) { return NULL; }
+        if (slot.hash == hash && (slot.entry->key == key || [slot.entry->key isEqual:key])) {
+            return slot.entry;
+        }
+    }
+    return NULL;
+}
+
+
+VDSCacheEntry* VDSCacheEntryTable::insert(id key, id object, NSUInteger hash)
+{
+    /// Keep the load factor at or below 3/4 so probe sequences stay short.
+    NSUInteger capacity = _index.load(std::memory_order_relaxed)->mask + 1;
+    if ((_count + 1) * 4 > capacity * 3) { resize(capacity * 2); }
+
+    VDSCacheEntry* entry = allocateEntry();
+    Index* index = _index.load(std::memory_order_relaxed);
+
+    beginWrite();
+    entry->key = key;
+    entry->object = object;
+    entry->hash = hash;
+
+    NSUInteger slotIndex = index->slotForHash(entry->hash);
+    while (index->slots[slotIndex].entry != NULL) { slotIndex = (slotIndex + 1) & index->mask; }
+    index->slots[slotIndex] = Slot{entry->hash, entry};
+    endWrite();
+
+    linkRecency(entry);
+    listKey(entry);
+    _count++;
+    if (_objectCount != NULL) { _objectCount->add(1); }
+    return entry;
+}
+
+
+void VDSCacheEntryTable::remove(VDSCacheEntry* entry)
+{
+    Index* index = _index.load(std::memory_order_relaxed);
+    std::vector<Slot>& slots = index->slots;
+    NSUInteger mask = index->mask;
+    NSUInteger slotIndex = index->slotForHash(entry->hash);
+    while (slots[slotIndex].entry != entry) { slotIndex = (slotIndex + 1) & mask; }
+
+    beginWrite();
+    /// Backward shift deletion: walk the cluster following the hole and move back any
+    /// entry whose probe sequence passes through the hole.
+    slots[slotIndex] = Slot{0, NULL};
+    for (NSUInteger next = (slotIndex + 1) & mask; slots[next].entry != NULL; next = (next + 1) & mask) {
+        NSUInteger ideal = index->slotForHash(slots[next].hash);
+        if (((next - ideal) & mask) >= ((next - slotIndex) & mask)) {
+            slots[slotIndex] = slots[next];
+            slots[next] = Slot{0, NULL};
+            slotIndex = next;
+        }
+    }
+
+    untrack(entry);
+    unlinkRecency(entry);
+    unlistKey(entry);
+    _totalCost -= entry->cost;
+    _count--;
+    if (_objectCount != NULL) { _objectCount->add(-1); }
+
+    /// Recycling releases the key and object, which happens last so that any code
+    /// triggered by their deallocation sees a consistent table.
+    recycleEntry(entry);
+    endWrite();
+}
+
+
+void VDSCacheEntryTable::removeAll()
+{
+    /// The slabs are moved out of the table and destroyed when this method returns,
+    /// after the table has been returned to a consistent, empty state. Concurrent readers
+    /// may still be visiting the entries, so the slabs are retired instead when concurrent
+    /// reads are enabled.
+    std::vector<std::unique_ptr<VDSCacheEntry[]>> slabs;
+    slabs.swap(_slabs);
+
+    beginWrite();
+    Index* index = _index.load(std::memory_order_relaxed);
+    std::fill(index->slots.begin(), index->slots.end(), Slot{0, NULL});
+    if (_reclaimer != nullptr) {
+        for (std::unique_ptr<VDSCacheEntry[]>& slab : slabs) { _reclaimer->retire(std::move(slab)); }
+        slabs.clear();
+    }
+    endWrite();
+
+    if (_objectCount != NULL) { _objectCount->add(-(int64_t)_count); }
+    _count = 0;
+    _trackedCount = 0;
+    _pendingCount = 0;
+    _totalCost = 0;
+    _trackedCost = 0;
+    _keys.removeAll();
+    _keyEntries.clear();
+    _freeList = NULL;
+    _freeCount = 0;
+    for (Segment& segment : _segments) { segment = Segment(); }
+    _untracked = Segment();
+    _expirations.clear();
+    _expiryHead = NULL;
+}
+
+
+void VDSCacheEntryTable::reserve(NSUInteger capacity)
+{
+    NSUInteger currentCapacity = _index.load(std::memory_order_relaxed)->mask + 1;
+    NSUInteger indexCapacity = currentCapacity;
+    while (capacity * 4 > indexCapacity * 3) { indexCapacity *= 2; }
+    if (indexCapacity > currentCapacity) { resize(indexCapacity); }
+
+    NSUInteger available = _freeCount + _count;
+    if (capacity > available) { addSlab(capacity - available); }
+    _keyEntries.reserve(capacity);
+}
+
+
+void VDSCacheEntryTable::resize(NSUInteger capacity)
+{
+    /// The new index is filled before it is published, so concurrent readers see either
+    /// the complete old index or the complete new one.
+    std::unique_ptr<Index> previous(_index.load(std::memory_order_relaxed));
+    Index* index = new Index(capacity);
+    for (const Slot& slot : previous->slots) {
+        if (slot.entry == NULL) { continue; }
+        NSUInteger slotIndex = index->slotForHash(slot.hash);
+        while (index->slots[slotIndex].entry != NULL) { slotIndex = (slotIndex + 1) & index->mask; }
+        index->slots[slotIndex] = slot;
+    }
+    _index.store(index, std::memory_order_release);
+
+    if (_reclaimer != nullptr) { _reclaimer->retire(std::move(previous)); }
+}
+
+
+void VDSCacheEntryTable::setObject(VDSCacheEntry* entry, id object)
+{
+    if (_reclaimer == nullptr) {
+        entry->object = object;
+        return;
+    }
+
+    beginWrite();
+    _reclaimer->retire(entry->object);
+    entry->object = object;
+    endWrite();
+}
+
+
+void VDSCacheEntryTable::setCost(VDSCacheEntry* entry, NSUInteger cost)
+{
+    _totalCost = _totalCost - entry->cost + cost;
+    if (entry->tracked) { _trackedCost = _trackedCost - entry->cost + cost; }
+    entry->cost = cost;
+}
+
+
+void VDSCacheEntryTable::shareObjectCount(VDSCacheObjectCount* objectCount)
+{
+    _objectCount = objectCount;
+    if (_objectCount != NULL && _count > 0) { _objectCount->add((int64_t)_count); }
+}
+
+
+void VDSCacheEntryTable::beginWrite()
+{
+    if (_reclaimer == nullptr) { return; }
+    _sequence.store(_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+
+void VDSCacheEntryTable::endWrite()
+{
+    if (_reclaimer == nullptr) { return; }
+    _sequence.store(_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+
+    /// Collection releases objects, which may run arbitrary code, so it only happens once
+    /// the write is complete and readers are no longer excluded.
+    if (_reclaimer->needsCollection()) { _reclaimer->collect(); }
+}
+
+
+void VDSCacheEntryTable::addSlab(NSUInteger size)
+{
+    _slabs.emplace_back(new VDSCacheEntry[size]);
+    VDSCacheEntry* slab = _slabs.back().get();
+    for (NSUInteger index = size; index > 0; index--) {
+        slab[index - 1].recencyNext = _freeList;
+        _freeList = &slab[index - 1];
+    }
+    _freeCount += size;
+}
+
+
+VDSCacheEntry* VDSCacheEntryTable::allocateEntry()
+{
+    if (_freeList == NULL) { addSlab(VDSCacheEntrySlabSize); }
+    VDSCacheEntry* entry = _freeList;
+    _freeList = entry->recencyNext;
+    _freeCount--;
+    entry->recencyNext = NULL;
+    return entry;
+}
+
+
+void VDSCacheEntryTable::recycleEntry(VDSCacheEntry* entry)
+{
+    id key = entry->key;
+    id object = entry->object;
+    *entry = VDSCacheEntry();
+    entry->recencyNext = _freeList;
+    _freeList = entry;
+    _freeCount++;
+
+    /// key and object are released as they go out of scope, unless concurrent readers
+    /// may still be observing them.
+    if (_reclaimer != nullptr) {
+        _reclaimer->retire(key);
+        _reclaimer->retire(object);
+    }
+    key = nil;
+    object = nil;
+}
+
+
+
+#pragma mark - Tracking Behaviors
+
+void VDSCacheEntryTable::track(VDSCacheEntry* entry, NSUInteger segment)
+{
+    if (entry->tracked) { return; }
+    if (entry->pendingEviction) {
+        entry->pendingEviction = false;
+        _pendingCount--;
+        listKey(entry);
+    }
+    unlinkRecency(entry);
+    entry->tracked = true;
+    entry->referenced.clear();
+    _trackedCount++;
+    _trackedCost += entry->cost;
+
+    entry->segment = (uint8_t)segment;
+    linkRecency(entry);
+}
+
+
+void VDSCacheEntryTable::untrack(VDSCacheEntry* entry)
+{
+    if (entry->pendingEviction) {
+        entry->pendingEviction = false;
+        _pendingCount--;
+        listKey(entry);
+    } else if (entry->tracked) {
+        unlinkTracking(entry);
+    } else {
+        return;
+    }
+    entry->usageCount = 0;
+}
+
+
+void VDSCacheEntryTable::untrackPendingEviction(VDSCacheEntry* entry)
+{
+    if (entry->tracked == false) { return; }
+    unlinkTracking(entry);
+    entry->pendingEviction = true;
+    _pendingCount++;
+    unlistKey(entry);
+}
+
+
+void VDSCacheEntryTable::unlinkTracking(VDSCacheEntry* entry)
+{
+    unlinkRecency(entry);
+    if (entry->heapIndex != NSNotFound) { removeFromHeap(entry); }
+    if (entry->expired) { unlinkExpiry(entry); }
+    entry->tracked = false;
+    entry->expired = false;
+    entry->refreshTime = DBL_MAX;
+    _trackedCount--;
+    _trackedCost -= entry->cost;
+    linkRecency(entry);
+}
+
+
+void VDSCacheEntryTable::listKey(VDSCacheEntry* entry)
+{
+    entry->keyIndex = _keyEntries.size();
+    _keyEntries.push_back(entry);
+    _keys.append(entry->key);
+}
+
+
+void VDSCacheEntryTable::unlistKey(VDSCacheEntry* entry)
+{
+    /// The last key takes the position of the removed one, so the vector stays dense.
+    VDSCacheEntry* last = _keyEntries.back();
+    if (last != entry) {
+        _keys.replace(entry->keyIndex, last->key);
+        _keyEntries[entry->keyIndex] = last;
+        last->keyIndex = entry->keyIndex;
+    }
+    _keyEntries.pop_back();
+    _keys.removeLast();
+    entry->keyIndex = NSNotFound;
+}
+
+
+void VDSCacheEntryTable::touch(VDSCacheEntry* entry)
+{
+    if (entry->tracked == false || entry == _segments[entry->segment].head) { return; }
+    unlinkRecency(entry);
+    linkRecency(entry);
+}
+
+
+void VDSCacheEntryTable::moveToSegment(VDSCacheEntry* entry, NSUInteger segment)
+{
+    if (entry->tracked == false) { return; }
+    unlinkRecency(entry);
+    entry->segment = (uint8_t)segment;
+    linkRecency(entry);
+}
+
+
+void VDSCacheEntryTable::linkRecency(VDSCacheEntry* entry)
+{
+    Segment& segment = listForEntry(entry);
+    entry->recencyPrev = NULL;
+    entry->recencyNext = segment.head;
+    if (segment.head != NULL) { segment.head->recencyPrev = entry; }
+    segment.head = entry;
+    if (segment.tail == NULL) { segment.tail = entry; }
+    segment.count++;
+}
+
+
+void VDSCacheEntryTable::unlinkRecency(VDSCacheEntry* entry)
+{
+    Segment& segment = listForEntry(entry);
+    if (entry->recencyPrev != NULL) { entry->recencyPrev->recencyNext = entry->recencyNext; }
+    else { segment.head = entry->recencyNext; }
+    if (entry->recencyNext != NULL) { entry->recencyNext->recencyPrev = entry->recencyPrev; }
+    else { segment.tail = entry->recencyPrev; }
+    entry->recencyPrev = entry->recencyNext = NULL;
+    segment.count--;
+}
+
+
+void VDSCacheEntryTable::unlinkExpiry(VDSCacheEntry* entry)
+{
+    if (entry->expiryPrev != NULL) { entry->expiryPrev->expiryNext = entry->expiryNext; }
+    else { _expiryHead = entry->expiryNext; }
+    if (entry->expiryNext != NULL) { entry->expiryNext->expiryPrev = entry->expiryPrev; }
+    entry->expiryPrev = entry->expiryNext = NULL;
+}
+
+
+
+#pragma mark - Expiration Behaviors
+
+void VDSCacheEntryTable::scheduleExpiration(VDSCacheEntry* entry, NSTimeInterval expiration)
+{
+    if (entry->expired) {
+        unlinkExpiry(entry);
+        entry->expired = false;
+    }
+
+    NSTimeInterval previous = entry->expiration;
+    entry->expiration = expiration;
+    if (entry->heapIndex == NSNotFound) {
+        entry->heapIndex = _expirations.size();
+        _expirations.push_back(entry);
+        siftUp(entry->heapIndex);
+    } else if (expiration < previous) {
+        siftUp(entry->heapIndex);
+    } else if (expiration > previous) {
+        siftDown(entry->heapIndex);
+    }
+}
+
+
+void VDSCacheEntryTable::scheduleExpirations(VDSCacheEntry* const* entries, const NSTimeInterval* expirations, NSUInteger count)
+{
+    /// Scheduling individually costs O(K*logN) while rebuilding costs O(N), so the heap is only
+    /// rebuilt when the batch is large enough to make that cheaper.
+    NSUInteger heapSize = _expirations.size() + count;
+    NSUInteger logN = 1;
+    for (NSUInteger size = heapSize; size > 1; size >>= 1) { logN++; }
+    if (count * logN < heapSize) {
+        for (NSUInteger index = 0; index < count; index++) { scheduleExpiration(entries[index], expirations[index]); }
+        return;
+    }
+
+    for (NSUInteger index = 0; index < count; index++) {
+        VDSCacheEntry* entry = entries[index];
+        if (entry->expired) {
+            unlinkExpiry(entry);
+            entry->expired = false;
+        }
+        entry->expiration = expirations[index];
+        if (entry->heapIndex == NSNotFound) {
+            entry->heapIndex = _expirations.size();
+            _expirations.push_back(entry);
+        }
+    }
+    for (NSUInteger index = _expirations.size() / 2; index > 0; index--) { siftDown(index - 1); }
+}
+
+
+VDSCacheEntry* VDSCacheEntryTable::popExpiration(NSTimeInterval now)
+{
+    if (_expirations.empty() || _expirations.front()->expiration > now) { return NULL; }
+    VDSCacheEntry* entry = _expirations.front();
+    removeFromHeap(entry);
+    retainExpired(entry);
+    return entry;
+}
+
+
+void VDSCacheEntryTable::retainExpired(VDSCacheEntry* entry)
+{
+    entry->expired = true;
+    entry->expiryPrev = NULL;
+    entry->expiryNext = _expiryHead;
+    if (_expiryHead != NULL) { _expiryHead->expiryPrev = entry; }
+    _expiryHead = entry;
+}
+
+
+void VDSCacheEntryTable::removeFromHeap(VDSCacheEntry* entry)
+{
+    NSUInteger index = entry->heapIndex;
+    VDSCacheEntry* last = _expirations.back();
+    _expirations.pop_back();
+    entry->heapIndex = NSNotFound;
+    if (last == entry) { return; }
+
+    /// Move the last entry into the vacated position and restore the heap order from there.
+    _expirations[index] = last;
+    last->heapIndex = index;
+    if (index > 0 && last->expiration < _expirations[(index - 1) / 2]->expiration) {
+        siftUp(index);
+    } else {
+        siftDown(index);
+    }
+}
+
+
+void VDSCacheEntryTable::siftUp(NSUInteger index)
+{
+    VDSCacheEntry* entry = _expirations[index];
+    while (index > 0) {
+        NSUInteger parent = (index - 1) / 2;
+        if (_expirations[parent]->expiration <= entry->expiration) { break; }
+        _expirations[index] = _expirations[parent];
+        _expirations[index]->heapIndex = index;
+        index = parent;
+    }
+    _expirations[index] = entry;
+    entry->heapIndex = index;
+}
+
+
+void VDSCacheEntryTable::siftDown(NSUInteger index)
+{
+    VDSCacheEntry* entry = _expirations[index];
+    NSUInteger count = _expirations.size();
+    while (true) {
+        NSUInteger child = index * 2 + 1;
+        if (child >= count) { break; }
+        if (child + 1 < count && _expirations[child + 1]->expiration < _expirations[child]->expiration) { child++; }
+        if (entry->expiration <= _expirations[child]->expiration) { break; }
+        _expirations[index] = _expirations[child];
+        _expirations[index]->heapIndex = index;
+        index = child;
+    }
+    _expirations[index] = entry;
+    entry->heapIndex = index;
+}
+
+
+
+#pragma mark - Concurrent Read Behaviors
+
+void VDSCacheEntryTable::enableConcurrentReads()
+{
+    if (_reclaimer == nullptr) { _reclaimer.reset(new VDSCacheEpochReclaimer()); }
+}
+
+
+id VDSCacheEntryTable::concurrentObjectForKey(id key, NSUInteger hash, VDSCacheEntryDeadlines* deadlines, bool marksReferenced) const
+{
+    /// The guard keeps every key, object, entry, and index the lookup may touch alive,
+    /// so a lookup that overlaps a write can safely finish before it is discarded.
+    VDSCacheEpochReclaimer::ReadGuard guard(*_reclaimer);
+    while (true) {
+        unsigned long sequence = _sequence.load(std::memory_order_acquire);
+        if (sequence & 1) { continue; }
+
+        VDSCacheEntry* entry = find(key, hash);
+        __unsafe_unretained id candidate = entry != NULL ? entry->object : nil;
+        if (deadlines != NULL) {
+            bool tracked = entry != NULL && entry->tracked;
+            deadlines->expiration = tracked ? entry->expiration : DBL_MAX;
+            deadlines->refreshTime = tracked ? entry->refreshTime : DBL_MAX;
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (_sequence.load(std::memory_order_relaxed) == sequence) {
+            /// The guard keeps the entry's memory alive, so the bit can be set even if the entry has
+            /// since been recycled, which at worst gives another entry a second chance.
+            if (marksReferenced && entry != NULL) { entry->referenced.set(); }
+
+            /// The object is retained while the guard still protects it.
+            id object = candidate;
+            return object;
+        }
+    }
+}
+
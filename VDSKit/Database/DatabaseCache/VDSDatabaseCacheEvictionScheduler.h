@@ -0,0 +1,63 @@
+//
+//  VDSDatabaseCacheEvictionScheduler.h
+//  VDSKit
+//
+//  Created by Erikheath Thomas on 6/9/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+
+@class VDSDatabaseCache;
+
+
+
+
+
+#pragma mark - VDSDatabaseCacheEvictionScheduler -
+
+/// @summary The VDSDatabaseCacheEvictionScheduler provides a singleton that runs the eviction
+/// cycles of every live VDSDatabaseCache from a single dispatch timer source.
+///
+/// @discussion Each cache registers the deadline of its next eviction cycle, which is the earliest
+/// expiration it holds or the end of its eviction interval, whichever comes first. The timer is set
+/// for the earliest deadline of all caches, so the scheduler sleeps until there is work to do rather
+/// than waking at a fixed interval. Because the timer is a dispatch source, evictions proceed whether
+/// or not any run loop is running.
+///
+/// When the timer fires, every cache whose deadline falls within the timer's leeway is processed,
+/// coalescing the cycles of caches with nearby deadlines into a single wakeup. Each cycle runs on a
+/// global utility queue, and a cache registers its next deadline when its cycle completes.
+///
+/// Caches are held weakly, so a cache that is deallocated is simply dropped from the schedule.
+///
+@interface VDSDatabaseCacheEvictionScheduler : NSObject
+
+#pragma mark - Properties
+
+/// @summary The shared instance used by every VDSDatabaseCache.
+///
+@property(class, strong, readonly, nonnull) VDSDatabaseCacheEvictionScheduler* sharedScheduler;
+
+
+#pragma mark - Scheduling Behavior
+
+/// @summary Schedules an eviction cycle of a cache to run no later than deadline.
+///
+/// @discussion If the cache already has an earlier deadline, the earlier deadline is kept, so
+/// requests that arrive out of order never delay a cycle.
+///
+/// @param cache The cache whose eviction cycle should run.
+///
+/// @param deadline The time, on the cache clock, when the cycle should run.
+///
+- (void)scheduleCache:(VDSDatabaseCache* _Nonnull)cache atDeadline:(NSTimeInterval)deadline;
+
+
+/// @summary The number of caches with a scheduled eviction cycle. Intended for diagnostics.
+///
+- (NSUInteger)scheduledCacheCount;
+
+
+@end
@@ -0,0 +1,203 @@
+//
+//  VDSDatabaseCacheEvictionScheduler.m
+//  VDSKit
+//
+//  Created by Erikheath Thomas on 6/9/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import "VDSDatabaseCacheEvictionScheduler.h"
+#import "VDSDatabaseCache.h"
+#import "VDSDatabaseCacheClock.h"
+
+
+/// The fraction of the time until a deadline that the timer may be deferred to batch wakeups.
+static const double VDSEvictionSchedulerLeewayFraction = 0.1;
+
+/// The longest that the timer may be deferred past a deadline, in seconds.
+static const NSTimeInterval VDSEvictionSchedulerMaximumLeeway = 1.0;
+
+/// The shortest leeway, in seconds, so that deadlines that have already passed are still batched.
+static const NSTimeInterval VDSEvictionSchedulerMinimumLeeway = 0.001;
+
+
+
+
+
+#pragma mark - VDSDatabaseCacheEvictionScheduler Extension -
+
+@interface VDSDatabaseCacheEvictionScheduler ()
+
+#pragma mark - Properties
+
+/// A serial queue that guards the schedule and runs the timer's event handler.
+///
+@property(strong, readonly, nonnull) dispatch_queue_t serializer;
+
+
+/// The timer source, set for the earliest deadline in the schedule.
+///
+@property(strong, readonly, nonnull) dispatch_source_t timer;
+
+
+/// The deadline of each scheduled cache, with weak keys so that the schedule does not
+/// keep caches alive.
+///
+@property(strong, readonly, nonnull) NSMapTable<VDSDatabaseCache*, NSNumber*>* deadlines;
+
+
+/// The deadline the timer is currently set for, or DBL_MAX if it is not set.
+///
+@property(readwrite) NSTimeInterval timerDeadline;
+
+
+/// The leeway the timer is currently set with, in seconds.
+///
+@property(readwrite) NSTimeInterval timerLeeway;
+
+@end
+
+
+
+
+
+#pragma mark - VDSDatabaseCacheEvictionScheduler -
+
+@implementation VDSDatabaseCacheEvictionScheduler
+
+#pragma mark - Properties
+
+@synthesize serializer = _serializer;
+@synthesize timer = _timer;
+@synthesize deadlines = _deadlines;
+@synthesize timerDeadline = _timerDeadline;
+@synthesize timerLeeway = _timerLeeway;
+
+
++ (VDSDatabaseCacheEvictionScheduler*)sharedScheduler
+{
+    static VDSDatabaseCacheEvictionScheduler* sharedScheduler;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedScheduler = [[VDSDatabaseCacheEvictionScheduler alloc] init];
+    });
+    return sharedScheduler;
+}
+
+
+
+#pragma mark - Object Lifecycle
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self != nil) {
+        _serializer = dispatch_queue_create("VDSDatabaseCacheEvictionScheduler", DISPATCH_QUEUE_SERIAL);
+        _deadlines = [[NSMapTable alloc] initWithKeyOptions:NSPointerFunctionsWeakMemory | NSPointerFunctionsObjectPointerPersonality
+                                               valueOptions:NSPointerFunctionsStrongMemory
+                                                   capacity:0];
+        _timerDeadline = DBL_MAX;
+        _timerLeeway = VDSEvictionSchedulerMinimumLeeway;
+        _timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _serializer);
+        __weak VDSDatabaseCacheEvictionScheduler* weakSelf = self;
+        dispatch_source_set_event_handler(_timer, ^{
+            [weakSelf processDeadlines];
+        });
+        dispatch_source_set_timer(_timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        dispatch_resume(_timer);
+    }
+    return self;
+}
+
+
+
+#pragma mark - Scheduling Behavior
+
+- (void)scheduleCache:(VDSDatabaseCache* _Nonnull)cache atDeadline:(NSTimeInterval)deadline
+{
+    __weak VDSDatabaseCache* weakCache = cache;
+    dispatch_async(_serializer, ^{
+        VDSDatabaseCache* cache = weakCache;
+        if (cache == nil) { return; }
+        NSNumber* scheduled = [self.deadlines objectForKey:cache];
+        if (scheduled != nil && scheduled.doubleValue <= deadline) { return; }
+        [self.deadlines setObject:@(deadline) forKey:cache];
+        [self updateTimer];
+    });
+}
+
+
+- (NSUInteger)scheduledCacheCount
+{
+    __block NSUInteger count = 0;
+    dispatch_sync(_serializer, ^{
+        /// The count of a weak map table may include caches that have been deallocated.
+        for (VDSDatabaseCache* cache in self.deadlines.keyEnumerator) {
+            if (cache != nil) { count++; }
+        }
+    });
+    return count;
+}
+
+
+/// Runs the eviction cycle of every cache whose deadline has passed, then resets the timer for the earliest remaining deadline. Must be
+/// called on the serializer.
+///
+- (void)processDeadlines
+{
+    /// The timer may fire anywhere within its leeway of the earliest deadline, so every cache whose
+    /// deadline falls within the leeway of the wakeup shares it rather than waking the timer again.
+    NSTimeInterval horizon = VDSCacheClockNow() + self.timerLeeway;
+
+    NSMutableArray<VDSDatabaseCache*>* dueCaches = [NSMutableArray new];
+    for (VDSDatabaseCache* cache in self.deadlines.keyEnumerator) {
+        if (cache != nil && [[self.deadlines objectForKey:cache] doubleValue] <= horizon) {
+            [dueCaches addObject:cache];
+        }
+    }
+
+    /// A cache leaves the schedule while its cycle runs, and schedules its next deadline when the
+    /// cycle completes.
+    for (VDSDatabaseCache* cache in dueCaches) {
+        [self.deadlines removeObjectForKey:cache];
+        dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+            [cache processCacheEvictions];
+        });
+    }
+
+    self.timerDeadline = DBL_MAX;
+    [self updateTimer];
+}
+
+
+/// Sets the timer for the earliest deadline in the schedule, unless it is already set for that
+/// deadline. Must be called on the serializer.
+///
+- (void)updateTimer
+{
+    NSTimeInterval earliestDeadline = DBL_MAX;
+    for (VDSDatabaseCache* cache in self.deadlines.keyEnumerator) {
+        if (cache != nil) { earliestDeadline = MIN(earliestDeadline, [[self.deadlines objectForKey:cache] doubleValue]); }
+    }
+    if (earliestDeadline == self.timerDeadline) { return; }
+    self.timerDeadline = earliestDeadline;
+
+    if (earliestDeadline == DBL_MAX) {
+        self.timerLeeway = VDSEvictionSchedulerMinimumLeeway;
+        dispatch_source_set_timer(_timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        return;
+    }
+
+    /// The further away the deadline, the more the timer may be deferred to share a wakeup with
+    /// other work on the system.
+    NSTimeInterval delay = MAX(earliestDeadline - VDSCacheClockNow(), 0);
+    NSTimeInterval leeway = MIN(MAX(delay * VDSEvictionSchedulerLeewayFraction, VDSEvictionSchedulerMinimumLeeway), VDSEvictionSchedulerMaximumLeeway);
+    self.timerLeeway = leeway;
+    dispatch_source_set_timer(_timer,
+                              dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)),
+                              DISPATCH_TIME_FOREVER,
+                              (uint64_t)(leeway * NSEC_PER_SEC));
+}
+
+
+@end
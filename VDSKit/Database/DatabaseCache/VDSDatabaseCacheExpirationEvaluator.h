@@ -0,0 +1,142 @@
+//
+//  VDSDatabaseCacheExpirationEvaluator.h
+//  VDSKit
+//
+//  Created by Erikheath Thomas on 6/11/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#include <vector>
+
+
+
+
+
+#pragma mark - VDSCacheExpirationEvaluator -
+
+/// @summary Determines the expiration of objects added to a VDSDatabaseCache from the cache's
+/// expirationTimingMapKey and expirationTimingMap, which are compiled once when the cache is created.
+///
+/// @discussion Interpreting an NSExpression walks its tree and dispatches each node dynamically every
+/// time it is evaluated. The evaluator instead compiles each expression into a block, and compiles the
+/// shapes that timing maps are commonly built from directly:
+///
+/// - Constant values, which are returned without any evaluation.
+/// - The evaluated object, which is the incoming key, and variables such as $VDSEntrySnapshotKey,
+/// which are read from the context.
+/// - Key paths, which are read from their operand with valueForKeyPath:.
+/// - now(), which reads the time the expiration is being determined for.
+/// - Addition of an interval to a date, such as now() + 300, and FUNCTION(date, 'dateByAddingTimeInterval:', interval).
+///
+/// Any other expression, or a subexpression whose operands are not of the expected types, is evaluated
+/// by NSExpression, so a compiled expression always produces the same value as the original.
+///
+/// A timing map expression whose value is a constant date, a constant interval, or now() plus a constant
+/// interval is reduced to a number when the evaluator is created, so determining the expiration of an
+/// object that uses it needs no evaluation at all.
+///
+/// An expression may produce a date, which is the expiration, or a number, which is an interval from the
+/// time the expiration is being determined for. An object whose timing key has no expression in the map,
+/// or whose expression produces nil, expires at the reference date.
+///
+@interface VDSCacheExpirationEvaluator : NSObject
+
+#pragma mark - Object Lifecycle
+
+/// @summary Compiles a timing map key expression and a timing map.
+///
+/// @param timingMapKey An expression that evaluates to one of the keys of timingMap.
+///
+/// @param timingMap The expressions that determine the expiration of objects, keyed by timing key.
+///
+/// @returns An initialized evaluator.
+///
+- (instancetype _Nonnull)initWithTimingMapKey:(NSExpression* _Nonnull)timingMapKey
+                                    timingMap:(NSDictionary<id, NSExpression*>* _Nonnull)timingMap NS_DESIGNATED_INITIALIZER;
+
+- (instancetype _Nonnull)init NS_UNAVAILABLE;
+
+
+#pragma mark - Evaluation Behavior
+
+/// @summary Determines the expiration of an object.
+///
+/// @param key The key of the object, which is the evaluated object of each expression.
+///
+/// @param object The object, which is made available to expressions as $VDSEntrySnapshotKey.
+///
+/// @param now The current time, as an interval since the reference date.
+///
+/// @param context A mutable dictionary used as the context of each expression. Reusing a context
+/// for every object avoids allocating one per object. The evaluator sets VDSEntrySnapshotKey while
+/// evaluating and removes it afterward. A context may only be used by one thread at a time.
+///
+/// @returns The expiration, as an interval since the reference date.
+///
+- (NSTimeInterval)expirationForKey:(id _Nonnull)key
+                            object:(id _Nonnull)object
+                               now:(NSTimeInterval)now
+                           context:(NSMutableDictionary* _Nonnull)context;
+
+
+@end
+
+
+
+
+
+#pragma mark - VDSCacheIntervalTable -
+
+/// @summary A hash table of expiration intervals keyed by entity name and by class, built from the
+/// expirationIntervals of a VDSDatabaseCacheConfiguration.
+///
+/// @discussion The names in the table are copied when it is configured, and each name that is also the
+/// name of a class is entered a second time under the class itself. Entries are stored inline in flat,
+/// open addressed arrays, so a lookup is a hash probe followed by a pointer comparison, falling back to a
+/// string comparison only when an entity name is not the table's own copy. Classes are looked up by
+/// pointer, so resolving an object by its class never creates a string.
+///
+/// The table is immutable once configured, so it may be read by any number of threads.
+///
+class VDSCacheIntervalTable {
+
+public:
+
+    VDSCacheIntervalTable() : _names(nil) {}
+
+    VDSCacheIntervalTable(const VDSCacheIntervalTable&) = delete;
+    VDSCacheIntervalTable& operator=(const VDSCacheIntervalTable&) = delete;
+
+    /// Builds the table from intervals in seconds keyed by entity or class name.
+    void configure(NSDictionary<NSString*, NSNumber*>* _Nullable intervals);
+
+    /// YES if the table has no intervals.
+    bool empty() const { return _names.count == 0; }
+
+    /// Finds the interval for an object by the VDSEntryEntityNameKey value of its key or of the object,
+    /// when either is a dictionary that has one, and otherwise by its class or nearest superclass in the table.
+    ///
+    /// @returns YES if the table has an interval for the object, which is stored in interval.
+    ///
+    bool find(id _Nonnull key, id _Nonnull object, NSTimeInterval* _Nonnull interval) const;
+
+
+private:
+
+    struct Slot {
+        __unsafe_unretained id name = nil;
+        NSUInteger hash = 0;
+        NSTimeInterval interval = 0;
+    };
+
+    static void insert(std::vector<Slot>& slots, id _Nonnull name, NSUInteger hash, NSTimeInterval interval);
+    bool findName(NSString* _Nonnull name, NSTimeInterval* _Nonnull interval) const;
+    bool findClass(Class _Nonnull cls, NSTimeInterval* _Nonnull interval) const;
+
+    /// Holds the copied names, which the slots reference without retaining.
+    __strong NSArray<NSString*>* _names;
+    std::vector<Slot> _nameSlots;
+    std::vector<Slot> _classSlots;
+};
@@ -0,0 +1,394 @@
+//
+//  VDSDatabaseCacheExpirationEvaluator.mm
+//  VDSKit
+//
+//  Created by Erikheath Thomas on 6/11/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import "VDSDatabaseCacheExpirationEvaluator.h"
+#import "../../VDSConstants.h"
+
+#include <vector>
+
+
+/// A compiled expression. Evaluates to the value of the expression for the incoming key, the
+/// context holding the incoming object, and the current time.
+typedef id _Nullable (^VDSCacheExpressionBlock)(id _Nonnull key, NSMutableDictionary* _Nonnull context, NSTimeInterval now);
+
+
+
+
+
+#pragma mark - Expression Compilation
+
+/// Compiles an expression into a block that NSExpression evaluates.
+static VDSCacheExpressionBlock interpreted_expression (NSExpression* expression)
+{
+    return ^id(id key, NSMutableDictionary* context, NSTimeInterval now) {
+        return [expression expressionValueWithObject:key context:context];
+    };
+}
+
+
+/// The operand of a function or key path expression, or nil if the expression does not have one.
+static NSExpression* operand_of_expression (NSExpression* expression)
+{
+    @try {
+        return expression.operand;
+    } @catch (NSException* exception) {
+        return nil;
+    }
+}
+
+
+/// Adds an interval to a date, or two numbers. Returns nil for any other operands, so that the
+/// caller can defer to NSExpression.
+static id add_values (id first, id second)
+{
+    if ([first isKindOfClass:[NSDate class]] && [second isKindOfClass:[NSNumber class]]) {
+        return [(NSDate*)first dateByAddingTimeInterval:[second doubleValue]];
+    }
+    if ([first isKindOfClass:[NSNumber class]] && [second isKindOfClass:[NSDate class]]) {
+        return [(NSDate*)second dateByAddingTimeInterval:[first doubleValue]];
+    }
+    if ([first isKindOfClass:[NSNumber class]] && [second isKindOfClass:[NSNumber class]]) {
+        return @([first doubleValue] + [second doubleValue]);
+    }
+    return nil;
+}
+
+
+/// Compiles an expression into a block, directly for the shapes that timing maps are commonly built
+/// from and by deferring to NSExpression for everything else.
+static VDSCacheExpressionBlock compile_expression (NSExpression* expression)
+{
+    switch (expression.expressionType) {
+        case NSConstantValueExpressionType: {
+            id value = expression.constantValue;
+            return ^id(id key, NSMutableDictionary* context, NSTimeInterval now) { return value; };
+        }
+
+        case NSEvaluatedObjectExpressionType:
+            return ^id(id key, NSMutableDictionary* context, NSTimeInterval now) { return key; };
+
+        case NSVariableExpressionType: {
+            NSString* variable = expression.variable;
+            return ^id(id key, NSMutableDictionary* context, NSTimeInterval now) { return context[variable]; };
+        }
+
+        case NSKeyPathExpressionType: {
+            NSString* keyPath = expression.keyPath;
+            NSExpression* operand = operand_of_expression(expression);
+            if (operand == nil || operand.expressionType == NSEvaluatedObjectExpressionType) {
+                return ^id(id key, NSMutableDictionary* context, NSTimeInterval now) { return [key valueForKeyPath:keyPath]; };
+            }
+            VDSCacheExpressionBlock compiledOperand = compile_expression(operand);
+            return ^id(id key, NSMutableDictionary* context, NSTimeInterval now) {
+                return [compiledOperand(key, context, now) valueForKeyPath:keyPath];
+            };
+        }
+
+        case NSFunctionExpressionType: {
+            NSString* function = expression.function;
+            if ([function isEqualToString:@"now"]) {
+                return ^id(id key, NSMutableDictionary* context, NSTimeInterval now) {
+                    return [NSDate dateWithTimeIntervalSinceReferenceDate:now];
+                };
+            }
+
+            VDSCacheExpressionBlock interpreted = interpreted_expression(expression);
+            if ([function isEqualToString:@"add:to:"] && expression.arguments.count == 2) {
+                VDSCacheExpressionBlock first = compile_expression(expression.arguments[0]);
+                VDSCacheExpressionBlock second = compile_expression(expression.arguments[1]);
+                return ^id(id key, NSMutableDictionary* context, NSTimeInterval now) {
+                    return add_values(first(key, context, now), second(key, context, now)) ?: interpreted(key, context, now);
+                };
+            }
+            if ([function isEqualToString:@"dateByAddingTimeInterval:"] && expression.arguments.count == 1 &&
+                operand_of_expression(expression) != nil) {
+                VDSCacheExpressionBlock date = compile_expression(operand_of_expression(expression));
+                VDSCacheExpressionBlock interval = compile_expression(expression.arguments[0]);
+                return ^id(id key, NSMutableDictionary* context, NSTimeInterval now) {
+                    id operandValue = date(key, context, now);
+                    id intervalValue = interval(key, context, now);
+                    if ([operandValue isKindOfClass:[NSDate class]] && [intervalValue isKindOfClass:[NSNumber class]]) {
+                        return [(NSDate*)operandValue dateByAddingTimeInterval:[intervalValue doubleValue]];
+                    }
+                    return interpreted(key, context, now);
+                };
+            }
+            return interpreted;
+        }
+
+        default:
+            return interpreted_expression(expression);
+    }
+}
+
+
+/// YES if expression is now().
+static bool is_now_expression (NSExpression* expression)
+{
+    return expression.expressionType == NSFunctionExpressionType && [expression.function isEqualToString:@"now"];
+}
+
+
+/// YES if expression is a constant number, setting interval to its value.
+static bool is_constant_interval (NSExpression* expression, NSTimeInterval* interval)
+{
+    if (expression.expressionType != NSConstantValueExpressionType ||
+        [expression.constantValue isKindOfClass:[NSNumber class]] == NO) { return false; }
+    *interval = [expression.constantValue doubleValue];
+    return true;
+}
+
+
+
+
+
+#pragma mark - VDSCacheExpirationRule -
+
+/// @summary The compiled form of a timing map expression.
+///
+struct VDSCacheExpirationRule {
+
+    enum Kind {
+        /// The expiration is value.
+        Absolute,
+        /// The expiration is value seconds after now.
+        Relative,
+        /// The expiration is determined by evaluating block.
+        Evaluated,
+    };
+
+    Kind kind = Absolute;
+    NSTimeInterval value = 0;
+    __strong VDSCacheExpressionBlock block = nil;
+
+    /// A rule that expires objects at the reference date, which applies to objects whose timing
+    /// key has no expression.
+    VDSCacheExpirationRule() = default;
+
+    /// Reduces expression to a constant rule if its value only depends on the current time,
+    /// otherwise compiles it.
+    explicit VDSCacheExpirationRule(NSExpression* expression)
+    {
+        NSTimeInterval interval = 0;
+        if (expression.expressionType == NSConstantValueExpressionType && [expression.constantValue isKindOfClass:[NSDate class]]) {
+            kind = Absolute;
+            value = [expression.constantValue timeIntervalSinceReferenceDate];
+        } else if (is_constant_interval(expression, &interval)) {
+            kind = Relative;
+            value = interval;
+        } else if (expression.expressionType == NSFunctionExpressionType && [expression.function isEqualToString:@"add:to:"] &&
+                   expression.arguments.count == 2 &&
+                   ((is_now_expression(expression.arguments[0]) && is_constant_interval(expression.arguments[1], &interval)) ||
+                    (is_now_expression(expression.arguments[1]) && is_constant_interval(expression.arguments[0], &interval)))) {
+            kind = Relative;
+            value = interval;
+        } else if (expression.expressionType == NSFunctionExpressionType &&
+                   [expression.function isEqualToString:@"dateByAddingTimeInterval:"] && expression.arguments.count == 1 &&
+                   operand_of_expression(expression) != nil && is_now_expression(operand_of_expression(expression)) &&
+                   is_constant_interval(expression.arguments[0], &interval)) {
+            kind = Relative;
+            value = interval;
+        } else {
+            kind = Evaluated;
+            block = compile_expression(expression);
+        }
+    }
+
+    /// The expiration for the incoming key and object.
+    NSTimeInterval expiration(id key, NSMutableDictionary* context, NSTimeInterval now) const
+    {
+        switch (kind) {
+            case Absolute: return value;
+            case Relative: return now + value;
+            case Evaluated: break;
+        }
+        id result = block(key, context, now);
+        if ([result isKindOfClass:[NSDate class]]) { return [(NSDate*)result timeIntervalSinceReferenceDate]; }
+        if ([result isKindOfClass:[NSNumber class]]) { return now + [result doubleValue]; }
+        return 0;
+    }
+};
+
+
+
+
+
+#pragma mark - VDSCacheExpirationEvaluator Extension -
+
+@interface VDSCacheExpirationEvaluator () {
+
+    /// The compiled timing map expressions.
+    std::vector<VDSCacheExpirationRule> _rules;
+
+    /// The index of the rule in _rules for each timing key.
+    NSDictionary<id, NSNumber*>* _ruleIndexes;
+
+    /// The compiled timing map key expression.
+    VDSCacheExpressionBlock _timingKey;
+
+    /// The rule used for every object when the timing map key expression is a constant, otherwise NULL.
+    const VDSCacheExpirationRule* _constantRule;
+
+    /// The rule for objects whose timing key has no expression in the timing map.
+    VDSCacheExpirationRule _missingRule;
+}
+
+@end
+
+
+
+
+
+#pragma mark - VDSCacheExpirationEvaluator -
+
+@implementation VDSCacheExpirationEvaluator
+
+#pragma mark - Object Lifecycle
+
+- (instancetype _Nonnull)initWithTimingMapKey:(NSExpression* _Nonnull)timingMapKey
+                                    timingMap:(NSDictionary<id, NSExpression*>* _Nonnull)timingMap
+{
+    self = [super init];
+    if (self != nil) {
+        NSMutableDictionary<id, NSNumber*>* ruleIndexes = [NSMutableDictionary dictionaryWithCapacity:timingMap.count];
+        _rules.reserve(timingMap.count);
+        [timingMap enumerateKeysAndObjectsUsingBlock:^(id timingKey, NSExpression* expression, BOOL* stop) {
+            ruleIndexes[timingKey] = @(self->_rules.size());
+            self->_rules.emplace_back(expression);
+        }];
+        _ruleIndexes = ruleIndexes;
+        _timingKey = compile_expression(timingMapKey);
+        _constantRule = NULL;
+        if (timingMapKey.expressionType == NSConstantValueExpressionType) {
+            NSNumber* index = timingMapKey.constantValue != nil ? _ruleIndexes[timingMapKey.constantValue] : nil;
+            _constantRule = index != nil ? &_rules[index.unsignedIntegerValue] : &_missingRule;
+        }
+    }
+    return self;
+}
+
+
+
+#pragma mark - Evaluation Behavior
+
+- (NSTimeInterval)expirationForKey:(id _Nonnull)key
+                            object:(id _Nonnull)object
+                               now:(NSTimeInterval)now
+                           context:(NSMutableDictionary* _Nonnull)context
+{
+    /// Rules that do not evaluate anything never look at the context.
+    if (_constantRule != NULL && _constantRule->kind != VDSCacheExpirationRule::Evaluated) {
+        return _constantRule->expiration(key, context, now);
+    }
+
+    context[VDSEntrySnapshotKey] = object;
+    const VDSCacheExpirationRule* rule = _constantRule;
+    if (rule == NULL) {
+        id timingKey = _timingKey(key, context, now);
+        NSNumber* index = timingKey != nil ? _ruleIndexes[timingKey] : nil;
+        rule = index != nil ? &_rules[index.unsignedIntegerValue] : &_missingRule;
+    }
+    NSTimeInterval expiration = rule->expiration(key, context, now);
+    /// The context does not keep the object alive once its expiration has been determined.
+    [context removeObjectForKey:VDSEntrySnapshotKey];
+    return expiration;
+}
+
+
+@end
+
+
+
+
+
+#pragma mark - VDSCacheIntervalTable -
+
+/// The hash of a class, which is its address with the bits that alignment leaves zero removed.
+static inline NSUInteger class_hash (Class cls)
+{
+    return (NSUInteger)(__bridge void*)cls >> 4;
+}
+
+
+void VDSCacheIntervalTable::configure(NSDictionary<NSString*, NSNumber*>* _Nullable intervals)
+{
+    _nameSlots.clear();
+    _classSlots.clear();
+    _names = [[NSArray alloc] initWithArray:intervals.allKeys copyItems:YES];
+    if (_names.count == 0) { return; }
+
+    /// Tables are kept at most half full, so that probe sequences stay short.
+    NSUInteger capacity = 2;
+    while (capacity < _names.count * 2) { capacity <<= 1; }
+    _nameSlots.resize(capacity);
+    _classSlots.resize(capacity);
+
+    for (NSString* name in _names) {
+        NSTimeInterval interval = [intervals[name] doubleValue];
+        insert(_nameSlots, name, name.hash, interval);
+        Class cls = NSClassFromString(name);
+        if (cls != Nil) { insert(_classSlots, cls, class_hash(cls), interval); }
+    }
+}
+
+
+void VDSCacheIntervalTable::insert(std::vector<Slot>& slots, id _Nonnull name, NSUInteger hash, NSTimeInterval interval)
+{
+    NSUInteger mask = slots.size() - 1;
+    for (NSUInteger index = hash & mask; ; index = (index + 1) & mask) {
+        if (slots[index].name == nil) {
+            slots[index].name = name;
+            slots[index].hash = hash;
+            slots[index].interval = interval;
+            return;
+        }
+    }
+}
+
+
+bool VDSCacheIntervalTable::findName(NSString* _Nonnull name, NSTimeInterval* _Nonnull interval) const
+{
+    NSUInteger hash = name.hash;
+    NSUInteger mask = _nameSlots.size() - 1;
+    for (NSUInteger index = hash & mask; _nameSlots[index].name != nil; index = (index + 1) & mask) {
+        const Slot& slot = _nameSlots[index];
+        if (slot.hash == hash && (slot.name == name || [name isEqualToString:slot.name])) {
+            *interval = slot.interval;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool VDSCacheIntervalTable::findClass(Class _Nonnull cls, NSTimeInterval* _Nonnull interval) const
+{
+    NSUInteger mask = _classSlots.size() - 1;
+    for (; cls != Nil; cls = [cls superclass]) {
+        for (NSUInteger index = class_hash(cls) & mask; _classSlots[index].name != nil; index = (index + 1) & mask) {
+            if (_classSlots[index].name == (id)cls) {
+                *interval = _classSlots[index].interval;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+
+bool VDSCacheIntervalTable::find(id _Nonnull key, id _Nonnull object, NSTimeInterval* _Nonnull interval) const
+{
+    if (_names.count == 0) { return false; }
+
+    id entityName = nil;
+    if ([key isKindOfClass:[NSDictionary class]]) { entityName = ((NSDictionary*)key)[VDSEntryEntityNameKey]; }
+    if (entityName == nil && [object isKindOfClass:[NSDictionary class]]) { entityName = ((NSDictionary*)object)[VDSEntryEntityNameKey]; }
+    if ([entityName isKindOfClass:[NSString class]] && findName(entityName, interval)) { return true; }
+
+    return findClass([object class], interval);
+}
@@ -0,0 +1,65 @@
+//
+//  VDSDatabaseCacheKeyVector.h
+//  VDSKit
+//
+//  Created by Erikheath Thomas on 6/17/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+
+
+
+
+#pragma mark - VDSCacheKeyVector -
+
+struct VDSCacheKeyNode;
+
+/// @summary A persistent vector of the keys held by a VDSCacheEntryTable, from which immutable
+/// snapshots are taken in constant time.
+///
+/// @discussion The keys are held in the leaves of a trie with 32 slots per node. A snapshot retains
+/// the root of the trie and never changes afterward. A write copies each node on its path that is
+/// shared with a snapshot before changing it, so the first write after a snapshot is taken copies at
+/// most one node per level of the trie, and writes made while no snapshot is held change the nodes in
+/// place. Nodes are reference counted atomically, so a snapshot may be released on any thread.
+///
+/// The vector is not thread safe. It is written and snapshotted under the lock of the shard that owns
+/// its table, while the snapshots it returns may be read from any thread without a lock.
+///
+class VDSCacheKeyVector {
+
+public:
+
+    VDSCacheKeyVector();
+    ~VDSCacheKeyVector();
+
+    VDSCacheKeyVector(const VDSCacheKeyVector&) = delete;
+    VDSCacheKeyVector& operator=(const VDSCacheKeyVector&) = delete;
+
+    /// The number of keys in the vector.
+    NSUInteger count() const { return _count; }
+
+    /// Adds key to the end of the vector.
+    void append(id key);
+
+    /// Replaces the key at index, which must be less than count.
+    void replace(NSUInteger index, id key);
+
+    /// Removes the last key of the vector, which must not be empty.
+    void removeLast();
+
+    /// Removes every key from the vector.
+    void removeAll();
+
+    /// Returns an immutable array of the keys in the vector, in O(1). The array shares the nodes of
+    /// the vector, which are copied by the next write that touches them.
+    NSArray* snapshot() const;
+
+private:
+
+    VDSCacheKeyNode* _root;
+    NSUInteger _shift;
+    NSUInteger _count;
+};
@@ -0,0 +1,294 @@
+//
+//  VDSDatabaseCacheKeyVector.mm
+//  VDSKit
+//
+//  Created by Erikheath Thomas on 6/17/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import "VDSDatabaseCacheKeyVector.h"
+
+#include <atomic>
+
+
+/// The number of bits of a key's index consumed by each level of the trie.
+static const NSUInteger VDSCacheKeyNodeBits = 5;
+
+/// The number of slots in each node of the trie.
+static const NSUInteger VDSCacheKeyNodeWidth = 1 << VDSCacheKeyNodeBits;
+
+static const NSUInteger VDSCacheKeyNodeMask = VDSCacheKeyNodeWidth - 1;
+
+
+
+
+
+#pragma mark - Nodes
+
+/// The reference count shared by the leaves and branches of the trie. Whether a node is a leaf or a
+/// branch is determined by its level, so nodes carry no type of their own.
+struct VDSCacheKeyNode {
+    std::atomic<NSUInteger> references{1};
+};
+
+struct VDSCacheKeyLeaf : VDSCacheKeyNode {
+    __strong id keys[VDSCacheKeyNodeWidth];
+};
+
+struct VDSCacheKeyBranch : VDSCacheKeyNode {
+    VDSCacheKeyNode* children[VDSCacheKeyNodeWidth] = {};
+};
+
+
+static void retain_node(VDSCacheKeyNode* node)
+{
+    node->references.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+/// Releases a node at the level given by shift, destroying it, and releasing its children or keys,
+/// once no vector, snapshot, or other node refers to it.
+static void release_node(VDSCacheKeyNode* node, NSUInteger shift)
+{
+    if (node->references.fetch_sub(1, std::memory_order_acq_rel) != 1) { return; }
+    if (shift == 0) {
+        delete static_cast<VDSCacheKeyLeaf*>(node);
+        return;
+    }
+    VDSCacheKeyBranch* branch = static_cast<VDSCacheKeyBranch*>(node);
+    for (VDSCacheKeyNode* child : branch->children) {
+        if (child != NULL) { release_node(child, shift - VDSCacheKeyNodeBits); }
+    }
+    delete branch;
+}
+
+
+/// Returns the node in slot, at the level given by shift, in a form the vector may change. A missing
+/// node is created, and a node that is shared with a snapshot is replaced by a copy.
+///
+/// @discussion A node the vector holds the only reference to can not be shared, as snapshots are only
+/// taken, and nodes only copied, under the shard's lock. A node reachable from a snapshot is either
+/// shared itself or lies below a shared node, which is copied first, raising the count of its children.
+///
+static VDSCacheKeyNode* mutable_node(VDSCacheKeyNode*& slot, NSUInteger shift)
+{
+    if (slot == NULL) {
+        slot = shift == 0 ? static_cast<VDSCacheKeyNode*>(new VDSCacheKeyLeaf()) : new VDSCacheKeyBranch();
+        return slot;
+    }
+    if (slot->references.load(std::memory_order_acquire) == 1) { return slot; }
+
+    VDSCacheKeyNode* copy = NULL;
+    if (shift == 0) {
+        const VDSCacheKeyLeaf* source = static_cast<const VDSCacheKeyLeaf*>(slot);
+        VDSCacheKeyLeaf* leaf = new VDSCacheKeyLeaf();
+        for (NSUInteger index = 0; index < VDSCacheKeyNodeWidth; index++) { leaf->keys[index] = source->keys[index]; }
+        copy = leaf;
+    } else {
+        const VDSCacheKeyBranch* source = static_cast<const VDSCacheKeyBranch*>(slot);
+        VDSCacheKeyBranch* branch = new VDSCacheKeyBranch();
+        for (NSUInteger index = 0; index < VDSCacheKeyNodeWidth; index++) {
+            branch->children[index] = source->children[index];
+            if (branch->children[index] != NULL) { retain_node(branch->children[index]); }
+        }
+        copy = branch;
+    }
+    release_node(slot, shift);
+    slot = copy;
+    return copy;
+}
+
+
+/// Returns the leaf holding index, in a trie whose root is at the level given by shift.
+static const VDSCacheKeyLeaf* leaf_for_index(const VDSCacheKeyNode* root, NSUInteger shift, NSUInteger index)
+{
+    const VDSCacheKeyNode* node = root;
+    for (; shift > 0; shift -= VDSCacheKeyNodeBits) {
+        node = static_cast<const VDSCacheKeyBranch*>(node)->children[(index >> shift) & VDSCacheKeyNodeMask];
+    }
+    return static_cast<const VDSCacheKeyLeaf*>(node);
+}
+
+
+/// Clears the key at index, the last index of the trie below slot, releasing each node that held no
+/// other key.
+static void remove_last(VDSCacheKeyNode*& slot, NSUInteger shift, NSUInteger index)
+{
+    /// A node held only the last key when the key is the first that the node spans.
+    NSUInteger span = (NSUInteger)1 << (shift + VDSCacheKeyNodeBits);
+    if ((index & (span - 1)) == 0) {
+        release_node(slot, shift);
+        slot = NULL;
+        return;
+    }
+
+    VDSCacheKeyNode* node = mutable_node(slot, shift);
+    if (shift == 0) {
+        static_cast<VDSCacheKeyLeaf*>(node)->keys[index & VDSCacheKeyNodeMask] = nil;
+    } else {
+        remove_last(static_cast<VDSCacheKeyBranch*>(node)->children[(index >> shift) & VDSCacheKeyNodeMask],
+                    shift - VDSCacheKeyNodeBits, index);
+    }
+}
+
+
+
+
+
+#pragma mark - VDSCacheKeySnapshot -
+
+/// @summary An immutable array of the keys of a VDSCacheKeyVector, as they were when it was taken.
+///
+@interface VDSCacheKeySnapshot : NSArray
+
+- (instancetype _Nonnull)initWithRoot:(VDSCacheKeyNode* _Nullable)root shift:(NSUInteger)shift count:(NSUInteger)count;
+
+@end
+
+
+@implementation VDSCacheKeySnapshot {
+    VDSCacheKeyNode* _root;
+    NSUInteger _shift;
+    NSUInteger _count;
+}
+
+- (instancetype)initWithRoot:(VDSCacheKeyNode*)root shift:(NSUInteger)shift count:(NSUInteger)count
+{
+    self = [super init];
+    if (self != nil) {
+        _root = root;
+        _shift = shift;
+        _count = count;
+        if (_root != NULL) { retain_node(_root); }
+    }
+    return self;
+}
+
+
+- (void)dealloc
+{
+    if (_root != NULL) { release_node(_root, _shift); }
+}
+
+
+- (NSUInteger)count
+{
+    return _count;
+}
+
+
+- (id)objectAtIndex:(NSUInteger)index
+{
+    if (index >= _count) {
+        [NSException raise:NSRangeException format:@"index %lu beyond bounds [0 .. %ld]", (unsigned long)index, (long)_count - 1];
+    }
+    return leaf_for_index(_root, _shift, index)->keys[index & VDSCacheKeyNodeMask];
+}
+
+
+- (void)getObjects:(id __unsafe_unretained _Nonnull [])objects range:(NSRange)range
+{
+    if (NSMaxRange(range) > _count) {
+        [NSException raise:NSRangeException format:@"range %@ beyond bounds [0 .. %ld]", NSStringFromRange(range), (long)_count - 1];
+    }
+
+    /// Keys are copied a leaf at a time, so the trie is descended once per 32 keys.
+    NSUInteger index = range.location;
+    while (index < NSMaxRange(range)) {
+        const VDSCacheKeyLeaf* leaf = leaf_for_index(_root, _shift, index);
+        NSUInteger end = MIN(NSMaxRange(range), (index | VDSCacheKeyNodeMask) + 1);
+        for (; index < end; index++) { *objects++ = leaf->keys[index & VDSCacheKeyNodeMask]; }
+    }
+}
+
+
+- (id)copyWithZone:(NSZone*)zone
+{
+    return self;
+}
+
+@end
+
+
+
+
+
+#pragma mark - Object Lifecycle
+
+VDSCacheKeyVector::VDSCacheKeyVector()
+: _root(NULL),
+  _shift(0),
+  _count(0)
+{
+}
+
+
+VDSCacheKeyVector::~VDSCacheKeyVector()
+{
+    removeAll();
+}
+
+
+
+#pragma mark - Storage Behaviors
+
+void VDSCacheKeyVector::append(id key)
+{
+    /// A full trie gains a level, with the old root as the first child of the new one.
+    if (_root != NULL && _count == (NSUInteger)1 << (_shift + VDSCacheKeyNodeBits)) {
+        VDSCacheKeyBranch* root = new VDSCacheKeyBranch();
+        root->children[0] = _root;
+        _root = root;
+        _shift += VDSCacheKeyNodeBits;
+    }
+    _count++;
+    replace(_count - 1, key);
+}
+
+
+void VDSCacheKeyVector::replace(NSUInteger index, id key)
+{
+    VDSCacheKeyNode** slot = &_root;
+    NSUInteger shift = _shift;
+    VDSCacheKeyNode* node = mutable_node(*slot, shift);
+    for (; shift > 0; shift -= VDSCacheKeyNodeBits) {
+        slot = &static_cast<VDSCacheKeyBranch*>(node)->children[(index >> shift) & VDSCacheKeyNodeMask];
+        node = mutable_node(*slot, shift - VDSCacheKeyNodeBits);
+    }
+    static_cast<VDSCacheKeyLeaf*>(node)->keys[index & VDSCacheKeyNodeMask] = key;
+}
+
+
+void VDSCacheKeyVector::removeLast()
+{
+    _count--;
+    remove_last(_root, _shift, _count);
+    if (_root == NULL) {
+        _shift = 0;
+        return;
+    }
+
+    /// A root whose keys all fit in its first child is replaced by that child.
+    while (_shift > 0 && _count <= (NSUInteger)1 << _shift) {
+        VDSCacheKeyNode* child = static_cast<VDSCacheKeyBranch*>(_root)->children[0];
+        retain_node(child);
+        release_node(_root, _shift);
+        _root = child;
+        _shift -= VDSCacheKeyNodeBits;
+    }
+}
+
+
+void VDSCacheKeyVector::removeAll()
+{
+    if (_root != NULL) { release_node(_root, _shift); }
+    _root = NULL;
+    _shift = 0;
+    _count = 0;
+}
+
+
+NSArray* VDSCacheKeyVector::snapshot() const
+{
+    return [[VDSCacheKeySnapshot alloc] initWithRoot:_root shift:_shift count:_count];
+}
@@ -0,0 +1,139 @@
+//
+//  VDSDatabaseCacheMemoryMonitor.h
+//  VDSKit
+//
+//  Created by Erikheath Thomas on 6/15/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "../../VDSConstants.h"
+
+
+@class VDSDatabaseCache;
+
+
+
+
+
+#pragma mark - VDSDatabaseCacheMemoryMonitor -
+
+/// @summary The VDSDatabaseCacheMemoryMonitor watches the memory pressure on the process and tells
+/// every registered VDSDatabaseCache to shed objects when it rises.
+///
+/// @discussion The monitor grades memory pressure from two sources, taking the more severe:
+///
+/// - The memory controller of the process's cgroup (v2), read from memory.current and memory.max in
+/// the cgroup directory. Usage of 80% of the limit is a warning, 90% is urgent, and 95% is critical.
+/// A cgroup without a limit reports no pressure.
+/// - The pressure stall information for memory, read from the pressure file. Tasks stalled on memory
+/// for 10% of the last 10 seconds ("some avg10") is a warning, 30% is urgent, and all tasks stalled
+/// for 10% of the time ("full avg10") is critical.
+///
+/// The sources are polled while any cache is registered, and polling stops at the first poll after
+/// every registered cache has been unregistered or deallocated. On platforms that deliver memory pressure
+/// events through dispatch, warning and critical events are also graded as they arrive. A source
+/// whose files can not be read reports no pressure, so the monitor is inert where neither exists.
+///
+/// Caches are notified when the level rises, by sending each evictObjectsForMemoryPressure: on the
+/// monitor's queue. A level that persists is not reported again until it falls and rises once more,
+/// so a cache sheds once per episode rather than once per poll.
+///
+/// Each cache created with evictsOnLowMemory set registers with the shared monitor. Caches are held
+/// weakly, so a cache that is deallocated is dropped without unregistering and is never notified.
+///
+@interface VDSDatabaseCacheMemoryMonitor : NSObject
+
+#pragma mark - Properties
+
+/// @summary The shared instance that caches which evict on low memory register with. It reads the
+/// cgroup of the process, found by cgroupDirectoryURLWithMembershipFileURL:hierarchyURL: from
+/// /proc/self/cgroup and /sys/fs/cgroup, and /proc/pressure/memory once per second.
+///
+@property(class, strong, readonly, nonnull) VDSDatabaseCacheMemoryMonitor* sharedMonitor;
+
+
+/// @summary The cgroup v2 directory that holds memory.current and memory.max, or nil.
+///
+@property(strong, readonly, nullable) NSURL* cgroupDirectoryURL;
+
+
+/// @summary The pressure stall information file for memory, or nil.
+///
+@property(strong, readonly, nullable) NSURL* pressureFileURL;
+
+
+/// @summary The interval, in seconds, between polls of the sources.
+///
+@property(readonly) NSTimeInterval pollInterval;
+
+
+/// @summary The level of the most recent reading.
+///
+@property(readonly) VDSMemoryPressureLevel level;
+
+
+#pragma mark - Object Lifecycle
+
+/// @summary Creates a monitor that reads the given sources.
+///
+/// @param cgroupDirectoryURL The cgroup v2 directory to read memory.current and memory.max from,
+/// or nil to ignore the cgroup.
+///
+/// @param pressureFileURL The pressure stall information file to read, or nil to ignore it.
+///
+/// @param pollInterval The interval, in seconds, between polls, or 0 to only read the sources when
+/// checkMemoryPressure is called.
+///
+- (instancetype _Nonnull)initWithCgroupDirectoryURL:(NSURL* _Nullable)cgroupDirectoryURL
+                                    pressureFileURL:(NSURL* _Nullable)pressureFileURL
+                                       pollInterval:(NSTimeInterval)pollInterval NS_DESIGNATED_INITIALIZER;
+
+- (instancetype _Nonnull)init NS_UNAVAILABLE;
+
+
+/// @summary Resolves the cgroup v2 directory of a process from its cgroup membership.
+///
+/// @discussion The membership file lists one line for each hierarchy the process belongs to. The
+/// unified cgroup v2 hierarchy is listed as "0::" followed by the path of the process's cgroup
+/// within the hierarchy, which is appended to the hierarchy's mount point.
+///
+/// @param membershipFileURL The membership file of the process, such as /proc/self/cgroup.
+///
+/// @param hierarchyURL The directory the cgroup v2 hierarchy is mounted at, such as /sys/fs/cgroup.
+///
+/// @returns The directory of the process's cgroup, or nil if the membership file can not be read or
+/// does not list a cgroup v2 membership.
+///
++ (NSURL* _Nullable)cgroupDirectoryURLWithMembershipFileURL:(NSURL* _Nonnull)membershipFileURL
+                                               hierarchyURL:(NSURL* _Nonnull)hierarchyURL;
+
+
+#pragma mark - Registration Behaviors
+
+/// @summary Adds a cache to the caches notified when memory pressure rises.
+///
+- (void)registerCache:(VDSDatabaseCache* _Nonnull)cache;
+
+
+/// @summary Removes a cache from the caches notified when memory pressure rises.
+///
+- (void)unregisterCache:(VDSDatabaseCache* _Nonnull)cache;
+
+
+/// @summary The number of registered caches. Intended for diagnostics.
+///
+- (NSUInteger)registeredCacheCount;
+
+
+#pragma mark - Monitoring Behaviors
+
+/// @summary Reads the sources immediately, and if the level has risen since the previous reading,
+/// notifies every registered cache before returning.
+///
+/// @returns The level of the reading.
+///
+- (VDSMemoryPressureLevel)checkMemoryPressure;
+
+
+@end
@@ -0,0 +1,389 @@
+//
+//  VDSDatabaseCacheMemoryMonitor.m
+//  VDSKit
+//
+//  Created by Erikheath Thomas on 6/15/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import "VDSDatabaseCacheMemoryMonitor.h"
+#import "VDSDatabaseCache.h"
+#import "../../VDSErrorConstants.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+
+/// The fractions of the cgroup memory limit in use at which each level begins.
+static const double VDSMemoryMonitorCgroupWarningUsage = 0.80;
+static const double VDSMemoryMonitorCgroupUrgentUsage = 0.90;
+static const double VDSMemoryMonitorCgroupCriticalUsage = 0.95;
+
+/// The percentages of the last 10 seconds stalled on memory at which each level begins.
+static const double VDSMemoryMonitorSomeWarningStall = 10.0;
+static const double VDSMemoryMonitorSomeUrgentStall = 30.0;
+static const double VDSMemoryMonitorFullCriticalStall = 10.0;
+
+/// The pressure files are a few hundred bytes, and memory.max and memory.current a single line.
+static const size_t VDSMemoryMonitorMaximumFileSize = 1024;
+
+
+/// Reads a small file in a single read, without allocating, into the buffer and terminates it.
+/// Returns NO if the file does not exist or can not be read. Pseudo files in /sys and /proc report
+/// a size of zero, so they are read rather than measured.
+///
+static BOOL read_small_file(NSURL* _Nullable url, char* buffer, size_t capacity)
+{
+    if (url == nil) { return NO; }
+    int descriptor = open(url.fileSystemRepresentation, O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0) { return NO; }
+    ssize_t length = read(descriptor, buffer, capacity - 1);
+    close(descriptor);
+    if (length <= 0) { return NO; }
+    buffer[length] = '\0';
+    return YES;
+}
+
+
+/// Reads a cgroup memory file holding a byte count, or "max" when there is no limit, which is
+/// returned as 0.
+///
+static BOOL read_cgroup_bytes(NSURL* _Nonnull directoryURL, NSString* _Nonnull name, unsigned long long* bytes)
+{
+    char buffer[VDSMemoryMonitorMaximumFileSize];
+    if (read_small_file([directoryURL URLByAppendingPathComponent:name], buffer, sizeof(buffer)) == NO) { return NO; }
+    if (strncmp(buffer, "max", 3) == 0) {
+        *bytes = 0;
+        return YES;
+    }
+    char* end = NULL;
+    *bytes = strtoull(buffer, &end, 10);
+    return end != buffer;
+}
+
+
+/// Finds the avg10 value on the line of the pressure file that begins with the given prefix.
+///
+static BOOL read_pressure_average(const char* _Nonnull contents, const char* _Nonnull prefix, double* average)
+{
+    size_t prefixLength = strlen(prefix);
+    for (const char* line = contents; line != NULL && *line != '\0'; ) {
+        if (strncmp(line, prefix, prefixLength) == 0) {
+            const char* field = strstr(line, "avg10=");
+            const char* lineEnd = strchr(line, '\n');
+            if (field == NULL || (lineEnd != NULL && field > lineEnd)) { return NO; }
+            *average = strtod(field + 6, NULL);
+            return YES;
+        }
+        line = strchr(line, '\n');
+        if (line != NULL) { line++; }
+    }
+    return NO;
+}
+
+
+
+
+
+#pragma mark - VDSDatabaseCacheMemoryMonitor Extension -
+
+@interface VDSDatabaseCacheMemoryMonitor ()
+
+#pragma mark - Properties
+
+/// A serial queue that guards the registered caches and the levels, and delivers notifications.
+///
+@property(strong, readonly, nonnull) dispatch_queue_t serializer;
+
+
+/// The registered caches, held weakly.
+///
+@property(strong, readonly, nonnull) NSHashTable<VDSDatabaseCache*>* caches;
+
+
+/// The timer that polls the sources, or nil when no cache is registered or the monitor does not poll.
+///
+@property(strong, readwrite, nullable) dispatch_source_t timer;
+
+
+/// The memory pressure source of the platform, or nil where there is none.
+///
+@property(strong, readwrite, nullable) dispatch_source_t pressureSource;
+
+
+/// The level most recently delivered by the memory pressure source of the platform.
+///
+@property(readwrite) VDSMemoryPressureLevel platformLevel;
+
+
+/// The level that caches were last notified of. It falls with the level, so that a level that rises
+/// again is reported again.
+///
+@property(readwrite) VDSMemoryPressureLevel reportedLevel;
+
+
+@property(readwrite) VDSMemoryPressureLevel level;
+
+@end
+
+
+
+
+
+#pragma mark - VDSDatabaseCacheMemoryMonitor -
+
+@implementation VDSDatabaseCacheMemoryMonitor
+
+#pragma mark - Properties
+
+@synthesize cgroupDirectoryURL = _cgroupDirectoryURL;
+@synthesize pressureFileURL = _pressureFileURL;
+@synthesize pollInterval = _pollInterval;
+@synthesize level = _level;
+@synthesize serializer = _serializer;
+@synthesize caches = _caches;
+@synthesize timer = _timer;
+@synthesize pressureSource = _pressureSource;
+@synthesize platformLevel = _platformLevel;
+@synthesize reportedLevel = _reportedLevel;
+
+
++ (VDSDatabaseCacheMemoryMonitor*)sharedMonitor
+{
+    static VDSDatabaseCacheMemoryMonitor* sharedMonitor;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSURL* cgroupDirectoryURL = [VDSDatabaseCacheMemoryMonitor cgroupDirectoryURLWithMembershipFileURL:[NSURL fileURLWithPath:@"/proc/self/cgroup" isDirectory:NO]
+                                                                                              hierarchyURL:[NSURL fileURLWithPath:@"/sys/fs/cgroup" isDirectory:YES]];
+        sharedMonitor = [[VDSDatabaseCacheMemoryMonitor alloc] initWithCgroupDirectoryURL:cgroupDirectoryURL
+                                                                          pressureFileURL:[NSURL fileURLWithPath:@"/proc/pressure/memory" isDirectory:NO]
+                                                                             pollInterval:1.0];
+    });
+    return sharedMonitor;
+}
+
+
+
+#pragma mark - Object Lifecycle
+
+- (instancetype)initWithCgroupDirectoryURL:(NSURL*)cgroupDirectoryURL
+                           pressureFileURL:(NSURL*)pressureFileURL
+                              pollInterval:(NSTimeInterval)pollInterval
+{
+    self = [super init];
+    if (self != nil) {
+        _cgroupDirectoryURL = cgroupDirectoryURL;
+        _pressureFileURL = pressureFileURL;
+        _pollInterval = MAX(pollInterval, 0);
+        _serializer = dispatch_queue_create("VDSDatabaseCacheMemoryMonitor", DISPATCH_QUEUE_SERIAL);
+        _caches = [NSHashTable weakObjectsHashTable];
+        _level = VDSMemoryPressureNormal;
+        _platformLevel = VDSMemoryPressureNormal;
+        _reportedLevel = VDSMemoryPressureNormal;
+    }
+    return self;
+}
+
+
+- (void)dealloc
+{
+    if (_timer != nil) { dispatch_source_cancel(_timer); }
+    if (_pressureSource != nil) { dispatch_source_cancel(_pressureSource); }
+}
+
+
++ (NSURL*)cgroupDirectoryURLWithMembershipFileURL:(NSURL*)membershipFileURL hierarchyURL:(NSURL*)hierarchyURL
+{
+    NSAssert(membershipFileURL != nil, VDS_NIL_ARGUMENT_MESSAGE(@"membershipFileURL", _cmd));
+    NSAssert(hierarchyURL != nil, VDS_NIL_ARGUMENT_MESSAGE(@"hierarchyURL", _cmd));
+
+    char buffer[VDSMemoryMonitorMaximumFileSize];
+    if (read_small_file(membershipFileURL, buffer, sizeof(buffer)) == NO) { return nil; }
+    for (char* line = buffer; line != NULL && *line != '\0'; ) {
+        char* lineEnd = strchr(line, '\n');
+        if (lineEnd != NULL) { *lineEnd = '\0'; }
+        if (strncmp(line, "0::", 3) == 0) {
+            NSString* path = [NSString stringWithUTF8String:line + 3];
+            if (path.length == 0) { return nil; }
+            /// A path that climbs out of the hierarchy, which is how a cgroup outside of the process's
+            /// cgroup namespace is listed, can not be read.
+            if ([path.pathComponents containsObject:@".."]) { return nil; }
+            return [hierarchyURL URLByAppendingPathComponent:path isDirectory:YES];
+        }
+        line = lineEnd != NULL ? lineEnd + 1 : NULL;
+    }
+    return nil;
+}
+
+
+
+#pragma mark - Registration Behaviors
+
+- (void)registerCache:(VDSDatabaseCache*)cache
+{
+    dispatch_sync(_serializer, ^{
+        [self.caches addObject:cache];
+        [self startMonitoring];
+    });
+}
+
+
+- (void)unregisterCache:(VDSDatabaseCache*)cache
+{
+    dispatch_sync(_serializer, ^{
+        [self.caches removeObject:cache];
+        if (self.caches.allObjects.count == 0) { [self stopMonitoring]; }
+    });
+}
+
+
+- (NSUInteger)registeredCacheCount
+{
+    __block NSUInteger count = 0;
+    dispatch_sync(_serializer, ^{
+        /// The count of a weak hash table may include caches that have been deallocated.
+        count = self.caches.allObjects.count;
+    });
+    return count;
+}
+
+
+/// Creates the poll timer and the platform's memory pressure source, unless they already exist.
+/// Must be called on the serializer.
+///
+- (void)startMonitoring
+{
+    __weak VDSDatabaseCacheMemoryMonitor* weakSelf = self;
+    if (self.timer == nil && self.pollInterval > 0) {
+        self.timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _serializer);
+        dispatch_source_set_event_handler(self.timer, ^{
+            [weakSelf pollSources];
+        });
+        dispatch_source_set_timer(self.timer,
+                                  dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.pollInterval * NSEC_PER_SEC)),
+                                  (uint64_t)(self.pollInterval * NSEC_PER_SEC),
+                                  (uint64_t)(self.pollInterval * 0.1 * NSEC_PER_SEC));
+        dispatch_resume(self.timer);
+    }
+
+#ifdef DISPATCH_MEMORYPRESSURE_WARN
+    if (self.pressureSource == nil) {
+        self.pressureSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0,
+                                                     DISPATCH_MEMORYPRESSURE_NORMAL | DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL,
+                                                     _serializer);
+        dispatch_source_t pressureSource = self.pressureSource;
+        dispatch_source_set_event_handler(pressureSource, ^{
+            unsigned long event = dispatch_source_get_data(pressureSource);
+            VDSMemoryPressureLevel level = VDSMemoryPressureNormal;
+            if (event & DISPATCH_MEMORYPRESSURE_CRITICAL) {
+                level = VDSMemoryPressureCritical;
+            } else if (event & DISPATCH_MEMORYPRESSURE_WARN) {
+                level = VDSMemoryPressureWarning;
+            }
+            weakSelf.platformLevel = level;
+            [weakSelf pollSources];
+        });
+        dispatch_resume(pressureSource);
+    }
+#endif
+}
+
+
+/// Cancels the poll timer and the platform's memory pressure source. Must be called on the serializer.
+///
+- (void)stopMonitoring
+{
+    if (self.timer != nil) {
+        dispatch_source_cancel(self.timer);
+        self.timer = nil;
+    }
+    if (self.pressureSource != nil) {
+        dispatch_source_cancel(self.pressureSource);
+        self.pressureSource = nil;
+        self.platformLevel = VDSMemoryPressureNormal;
+    }
+}
+
+
+
+#pragma mark - Monitoring Behaviors
+
+- (VDSMemoryPressureLevel)checkMemoryPressure
+{
+    __block VDSMemoryPressureLevel level = VDSMemoryPressureNormal;
+    dispatch_sync(_serializer, ^{
+        level = [self pollSources];
+    });
+    return level;
+}
+
+
+/// Grades the sources and notifies every registered cache if the level has risen since they were
+/// last notified. Must be called on the serializer.
+///
+- (VDSMemoryPressureLevel)pollSources
+{
+    VDSMemoryPressureLevel level = MAX(MAX([self cgroupLevel], [self pressureStallLevel]), self.platformLevel);
+    self.level = level;
+
+    /// Registered caches that have been deallocated leave the table empty without unregistering.
+    if (self.caches.allObjects.count == 0) {
+        [self stopMonitoring];
+        self.reportedLevel = level;
+        return level;
+    }
+
+    if (level <= self.reportedLevel) {
+        self.reportedLevel = level;
+        return level;
+    }
+    self.reportedLevel = level;
+
+    /// Caches shed synchronously, so that a cache has shed before the next reading is taken. The
+    /// pool releases the monitor's references before the poll returns, so a cache whose last other
+    /// reference was released while it shed is deallocated here rather than at a later poll.
+    @autoreleasepool {
+        NSArray<VDSDatabaseCache*>* caches = self.caches.allObjects;
+        for (VDSDatabaseCache* cache in caches) {
+            [cache evictObjectsForMemoryPressure:level];
+        }
+    }
+    return level;
+}
+
+
+/// Grades the usage of the cgroup's memory limit.
+///
+- (VDSMemoryPressureLevel)cgroupLevel
+{
+    if (self.cgroupDirectoryURL == nil) { return VDSMemoryPressureNormal; }
+    unsigned long long limit = 0;
+    unsigned long long usage = 0;
+    if (read_cgroup_bytes(self.cgroupDirectoryURL, @"memory.max", &limit) == NO || limit == 0) { return VDSMemoryPressureNormal; }
+    if (read_cgroup_bytes(self.cgroupDirectoryURL, @"memory.current", &usage) == NO) { return VDSMemoryPressureNormal; }
+
+    double fraction = (double)usage / (double)limit;
+    if (fraction >= VDSMemoryMonitorCgroupCriticalUsage) { return VDSMemoryPressureCritical; }
+    if (fraction >= VDSMemoryMonitorCgroupUrgentUsage) { return VDSMemoryPressureUrgent; }
+    if (fraction >= VDSMemoryMonitorCgroupWarningUsage) { return VDSMemoryPressureWarning; }
+    return VDSMemoryPressureNormal;
+}
+
+
+/// Grades the memory pressure stall information.
+///
+- (VDSMemoryPressureLevel)pressureStallLevel
+{
+    char buffer[VDSMemoryMonitorMaximumFileSize];
+    if (read_small_file(self.pressureFileURL, buffer, sizeof(buffer)) == NO) { return VDSMemoryPressureNormal; }
+
+    double full = 0;
+    if (read_pressure_average(buffer, "full ", &full) && full >= VDSMemoryMonitorFullCriticalStall) { return VDSMemoryPressureCritical; }
+    double some = 0;
+    if (read_pressure_average(buffer, "some ", &some) == NO) { return VDSMemoryPressureNormal; }
+    if (some >= VDSMemoryMonitorSomeUrgentStall) { return VDSMemoryPressureUrgent; }
+    if (some >= VDSMemoryMonitorSomeWarningStall) { return VDSMemoryPressureWarning; }
+    return VDSMemoryPressureNormal;
+}
+
+
+@end
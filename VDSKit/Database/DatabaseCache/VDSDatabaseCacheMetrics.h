@@ -0,0 +1,127 @@
+//
+//  VDSDatabaseCacheMetrics.h
+//  VDSKit
+//
+//  Created by Erikheath Thomas on 6/10/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#include <atomic>
+
+
+
+
+
+#pragma mark - VDSCacheMetricCounters -
+
+/// @summary The activity counters of a single shard of a VDSDatabaseCache.
+///
+/// @discussion Counters are updated with relaxed atomic increments, which do not order any other
+/// memory access, so recording an event costs a single uncontended instruction in the common case.
+/// Each shard has its own counters, so threads working in different shards do not contend on them.
+/// Totals are produced by summing the counters of every shard, and may be slightly out of date with
+/// respect to one another while the cache is in use.
+///
+struct VDSCacheMetricCounters {
+
+    /// Lookups that found an object.
+    std::atomic<uint64_t> hits{0};
+
+    /// Hits that found a stale object, which start a refresh of the object if none is in flight.
+    std::atomic<uint64_t> staleHits{0};
+
+    /// Lookups that did not find an object.
+    std::atomic<uint64_t> misses{0};
+
+    /// Stores of keys that were not in the cache.
+    std::atomic<uint64_t> inserts{0};
+
+    /// Stores that merged an update into a cached VDSMergeableObject.
+    std::atomic<uint64_t> merges{0};
+
+    /// Stores of a VDSMergeableObject update that matched the cached object, which were skipped.
+    std::atomic<uint64_t> unchangedMerges{0};
+
+    /// Stores that replaced a cached object.
+    std::atomic<uint64_t> replacements{0};
+
+    /// Objects evicted because they expired.
+    std::atomic<uint64_t> expiredEvictions{0};
+
+    /// Objects evicted because the shard exceeded its preferred max object count.
+    std::atomic<uint64_t> countEvictions{0};
+
+    /// Objects evicted because the shard exceeded its preferred max total cost.
+    std::atomic<uint64_t> costEvictions{0};
+
+    /// Objects evicted in response to memory pressure.
+    std::atomic<uint64_t> lowMemoryEvictions{0};
+
+    /// The total time, in nanoseconds, that threads waited to acquire the shard's lock.
+    std::atomic<uint64_t> lockWaitNanoseconds{0};
+
+    /// Adds count to counter.
+    static void add(std::atomic<uint64_t>& counter, uint64_t count = 1)
+    {
+        counter.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    /// Subtracts count from counter, stopping at zero should the counter have been reset since
+    /// count was added to it.
+    static void subtract(std::atomic<uint64_t>& counter, uint64_t count)
+    {
+        uint64_t value = counter.load(std::memory_order_relaxed);
+        while (counter.compare_exchange_weak(value, value > count ? value - count : 0, std::memory_order_relaxed) == false) {}
+    }
+
+    /// Sets every counter to zero.
+    void reset()
+    {
+        for (std::atomic<uint64_t>* counter : {&hits, &staleHits, &misses, &inserts, &merges, &unchangedMerges, &replacements,
+                                               &expiredEvictions, &countEvictions, &costEvictions,
+                                               &lowMemoryEvictions, &lockWaitNanoseconds}) {
+            counter->store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+
+
+
+
+#pragma mark - VDSCacheObjectCount -
+
+/// @summary The number of objects held by every shard of a VDSDatabaseCache, along with the largest
+/// number it has held.
+///
+/// @discussion Each shard's entry table adjusts the count as it inserts and removes entries. The count
+/// is shared by every shard, so the peak is a number of objects the cache actually held at one time
+/// rather than a sum of peaks the shards reached at different times. An insert raises the peak with a
+/// compare and swap loop that only writes when the count has passed the peak, so inserts that do not
+/// set a new peak cost a single relaxed load.
+///
+struct VDSCacheObjectCount {
+
+    /// The number of objects held by the cache.
+    std::atomic<int64_t> count{0};
+
+    /// The largest number of objects the cache has held since the peak was last reset.
+    std::atomic<int64_t> peak{0};
+
+    /// Adds delta, which is negative for removals, to the count, raising the peak if the count passes it.
+    void add(int64_t delta)
+    {
+        int64_t value = count.fetch_add(delta, std::memory_order_relaxed) + delta;
+        if (delta <= 0) { return; }
+        int64_t current = peak.load(std::memory_order_relaxed);
+        while (value > current && peak.compare_exchange_weak(current, value, std::memory_order_relaxed) == false) {}
+    }
+
+    /// Restarts the peak from the number of objects the cache currently holds.
+    void resetPeak()
+    {
+        peak.store(count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+};
@@ -0,0 +1,112 @@
+//
+//  VDSDatabaseCacheReclaimer.h
+//  VDSKit
+//
+//  Created by Erikheath Thomas on 6/4/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+
+
+
+
+#pragma mark - VDSCacheEpochReclaimer -
+
+/// @summary Epoch based reclamation for the lock free read path of a VDSCacheEntryTable.
+///
+/// @discussion Readers that access a table without holding its lock pin the current epoch
+/// for the duration of the read using a ReadGuard. Writers, which are serialized by the table's
+/// lock, retire keys, objects, and memory that readers may still be observing instead of
+/// releasing them. Retired items are released by collect() once every reader that could have
+/// observed them has finished.
+///
+/// Readers register in one of a fixed number of slots, chosen per thread, each on its own cache
+/// line, so concurrent readers do not contend with each other. A reader pins an epoch by
+/// incrementing the slot's counter for the parity of that epoch. The epoch only advances when no
+/// reader holds the prior epoch, and an item retired in epoch E is released once the epoch reaches
+/// E + 2.
+///
+class VDSCacheEpochReclaimer {
+
+public:
+
+    VDSCacheEpochReclaimer();
+
+    /// Releases all retired items. The owner must guarantee that there are no active readers.
+    ~VDSCacheEpochReclaimer();
+
+    VDSCacheEpochReclaimer(const VDSCacheEpochReclaimer&) = delete;
+    VDSCacheEpochReclaimer& operator=(const VDSCacheEpochReclaimer&) = delete;
+
+
+#pragma mark Readers
+
+    /// Pins the current epoch for the lifetime of the guard. Items retired while the guard
+    /// exists are not released until it is destroyed.
+    class ReadGuard {
+
+    public:
+
+        explicit ReadGuard(const VDSCacheEpochReclaimer& reclaimer);
+        ~ReadGuard() { _readers->fetch_sub(1, std::memory_order_release); }
+
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+
+    private:
+
+        std::atomic<NSUInteger>* _readers;
+    };
+
+
+#pragma mark Writers
+
+    /// Defers the release of an object until no reader can observe it. Retiring never releases
+    /// anything, so it is safe to call while readers are excluded by a write in progress.
+    void retire(id object);
+
+    /// Defers the destruction of memory until no reader can observe it.
+    template <typename T>
+    void retire(std::unique_ptr<T> memory)
+    {
+        retire(std::shared_ptr<void>(std::move(memory)));
+    }
+
+    /// Advances the epoch if possible and releases the retired items that no reader can observe.
+    void collect();
+
+    /// The number of retired items that have not yet been released.
+    NSUInteger retiredCount() const { return _retired.size(); }
+
+    /// YES once enough items have been retired that the writer should call collect().
+    bool needsCollection() const { return _retired.size() >= 256; }
+
+
+private:
+
+    /// Padded so that the counters of adjacent slots never share a cache line.
+    struct Slot {
+        std::atomic<NSUInteger> readers[2];
+        char padding[128 - 2 * sizeof(std::atomic<NSUInteger>)];
+    };
+
+    struct Retired {
+        uint64_t epoch;
+        __strong id object;
+        std::shared_ptr<void> memory;
+    };
+
+    void retire(std::shared_ptr<void> memory);
+
+    static NSUInteger slotIndexForCurrentThread();
+
+    std::atomic<uint64_t> _epoch;
+    mutable std::unique_ptr<Slot[]> _slots;
+    std::vector<Retired> _retired;
+};
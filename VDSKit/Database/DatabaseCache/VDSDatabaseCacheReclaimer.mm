@@ -0,0 +1,108 @@
+//
+//  VDSDatabaseCacheReclaimer.mm
+//  VDSKit
+//
+//  Created by Erikheath Thomas on 6/4/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import "VDSDatabaseCacheReclaimer.h"
+
+#include <algorithm>
+
+
+/// The number of reader slots. Threads beyond this number share slots, which is correct but
+/// causes those readers to contend for the slot's cache line.
+static const NSUInteger VDSCacheReclaimerSlotCount = 32;
+
+/// Assigns reader slots to threads round robin.
+static std::atomic<NSUInteger> VDSCacheReclaimerNextSlot(0);
+
+
+
+
+
+#pragma mark - Object Lifecycle
+
+VDSCacheEpochReclaimer::VDSCacheEpochReclaimer()
+: _epoch(0),
+  _slots(new Slot[VDSCacheReclaimerSlotCount])
+{
+    for (NSUInteger index = 0; index < VDSCacheReclaimerSlotCount; index++) {
+        _slots[index].readers[0].store(0, std::memory_order_relaxed);
+        _slots[index].readers[1].store(0, std::memory_order_relaxed);
+    }
+}
+
+
+VDSCacheEpochReclaimer::~VDSCacheEpochReclaimer()
+{
+    /// Destroying _retired releases every retired object and memory block.
+}
+
+
+
+#pragma mark - Reader Behaviors
+
+NSUInteger VDSCacheEpochReclaimer::slotIndexForCurrentThread()
+{
+    static thread_local NSUInteger slotIndex = VDSCacheReclaimerNextSlot.fetch_add(1, std::memory_order_relaxed) % VDSCacheReclaimerSlotCount;
+    return slotIndex;
+}
+
+
+VDSCacheEpochReclaimer::ReadGuard::ReadGuard(const VDSCacheEpochReclaimer& reclaimer)
+{
+    Slot& slot = reclaimer._slots[slotIndexForCurrentThread()];
+    while (true) {
+        uint64_t epoch = reclaimer._epoch.load(std::memory_order_seq_cst);
+        _readers = &slot.readers[epoch & 1];
+        _readers->fetch_add(1, std::memory_order_seq_cst);
+
+        /// If the epoch advanced before the reader was registered, a writer may have concluded that
+        /// no reader holds the epoch. Withdraw and register with the current epoch instead.
+        if (reclaimer._epoch.load(std::memory_order_seq_cst) == epoch) { break; }
+        _readers->fetch_sub(1, std::memory_order_release);
+    }
+}
+
+
+
+#pragma mark - Writer Behaviors
+
+void VDSCacheEpochReclaimer::retire(id object)
+{
+    if (object == nil) { return; }
+    _retired.push_back(Retired{_epoch.load(std::memory_order_relaxed), object, nullptr});
+}
+
+
+void VDSCacheEpochReclaimer::retire(std::shared_ptr<void> memory)
+{
+    if (memory == nullptr) { return; }
+    _retired.push_back(Retired{_epoch.load(std::memory_order_relaxed), nil, std::move(memory)});
+}
+
+
+void VDSCacheEpochReclaimer::collect()
+{
+    if (_retired.empty()) { return; }
+
+    /// Readers of the prior epoch share a counter parity with the next epoch. If no reader holds
+    /// the prior epoch, every active reader started in the current epoch and the epoch can advance.
+    uint64_t epoch = _epoch.load(std::memory_order_relaxed);
+    bool priorEpochIsIdle = true;
+    for (NSUInteger index = 0; index < VDSCacheReclaimerSlotCount && priorEpochIsIdle; index++) {
+        priorEpochIsIdle = _slots[index].readers[(epoch + 1) & 1].load(std::memory_order_seq_cst) == 0;
+    }
+    if (priorEpochIsIdle) {
+        epoch++;
+        _epoch.store(epoch, std::memory_order_seq_cst);
+    }
+
+    /// Items are retired in epoch order, so the releasable items are a prefix of _retired.
+    auto end = std::find_if(_retired.begin(), _retired.end(), [epoch](const Retired& retired) {
+        return retired.epoch + 2 > epoch;
+    });
+    _retired.erase(_retired.begin(), end);
+}
@@ -0,0 +1,95 @@
+//
+//  VDSDatabaseCacheSerializer.h
+//  VDSKit
+//
+//  Created by Erikheath Thomas on 6/13/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+
+#pragma mark - VDSDatabaseCacheSerializer -
+
+
+/// @summary The VDSDatabaseCacheSerializer protocol converts the keys and objects of a
+/// VDSDatabaseCache to and from data when the cache writes or loads a snapshot.
+///
+/// @discussion A serializer is called once for each key and once for each object in a
+/// snapshot, so its cost largely determines the cost of writing and loading a snapshot.
+/// Serializers for an application's own types can write them directly, avoiding the
+/// general purpose archiving used by VDSDatabaseCacheStandardSerializer.
+///
+/// A snapshot must be loaded with a serializer that can read the data written by the
+/// serializer it was written with.
+///
+@protocol VDSDatabaseCacheSerializer <NSObject>
+
+@required
+
+/// @summary Converts a key or an object to data.
+///
+/// @param object The key or object to convert.
+///
+/// @returns The data for object, or nil if object can not be converted. An entry whose
+/// key or object can not be converted is left out of the snapshot.
+///
+- (NSData* _Nullable)serializedDataForObject:(id _Nonnull)object;
+
+
+/// @summary Converts data written by serializedDataForObject: back to a key or an object.
+///
+/// @param data The data to convert. The bytes of data may be mapped from the snapshot file
+/// and are only valid for the duration of the call, so a serializer that keeps them must
+/// copy them.
+///
+/// @returns The key or object, or nil if data can not be converted. An entry whose key or
+/// object can not be converted is skipped.
+///
+- (id _Nullable)objectWithSerializedData:(NSData* _Nonnull)data;
+
+
+@end
+
+
+
+
+
+#pragma mark - VDSDatabaseCacheStandardSerializer -
+
+
+/// @summary The serializer a VDSDatabaseCache uses when a snapshot is written or loaded without one.
+///
+/// @discussion Strings, numbers, data, and dates are written directly as compact binary values. Any other
+/// object that conforms to NSSecureCoding is written with NSKeyedArchiver, requiring secure coding, and
+/// objects that do not are left out. Objects are read back as immutable instances of their class cluster,
+/// so a mutable string is loaded as an NSString.
+///
+/// Archived objects are decoded securely, and only as instances of the serializer's allowed classes, so
+/// a snapshot or disk tier log can not instantiate arbitrary classes when it is loaded. An archive that
+/// can not be decoded, whether because it is corrupt or because it contains a class that is not allowed,
+/// is converted to nil rather than raising an exception.
+///
+@interface VDSDatabaseCacheStandardSerializer : NSObject <VDSDatabaseCacheSerializer>
+
+/// @summary The classes that archived objects may be decoded as, including the classes of the objects
+/// they contain.
+///
+@property(copy, readonly, nonnull) NSSet<Class>* allowedClasses;
+
+
+/// @summary Creates a serializer whose allowed classes are the property list classes: NSString,
+/// NSNumber, NSData, NSDate, NSArray, and NSDictionary.
+///
+- (instancetype _Nonnull)init;
+
+
+/// @summary Creates a serializer that decodes archived objects as instances of allowedClasses.
+///
+/// @param allowedClasses The classes that archived objects may be decoded as. An application that
+/// stores its own NSSecureCoding classes in a cache includes them, along with the classes of any
+/// objects they contain.
+///
+- (instancetype _Nonnull)initWithAllowedClasses:(NSSet<Class>* _Nonnull)allowedClasses NS_DESIGNATED_INITIALIZER;
+
+@end
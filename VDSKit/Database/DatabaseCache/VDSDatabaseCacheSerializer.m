@@ -0,0 +1,197 @@
+//
+//  VDSDatabaseCacheSerializer.m
+//  VDSKit
+//
+//  Created by Erikheath Thomas on 6/13/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import "VDSDatabaseCacheSerializer.h"
+#import "../../VDSErrorConstants.h"
+
+
+/// The first byte of the data written for each value, identifying how the rest was written.
+typedef NS_ENUM(uint8_t, VDSStandardSerializerTag) {
+    VDSStandardSerializerStringTag = 1, // UTF-8 bytes.
+    VDSStandardSerializerIntegerTag, // A signed 64 bit integer.
+    VDSStandardSerializerUnsignedIntegerTag, // An unsigned 64 bit integer.
+    VDSStandardSerializerDoubleTag, // A 64 bit floating point number.
+    VDSStandardSerializerBooleanTag, // A single byte, 0 or 1.
+    VDSStandardSerializerDataTag, // The bytes of the data.
+    VDSStandardSerializerDateTag, // The interval since the reference date, as a 64 bit floating point number.
+    VDSStandardSerializerArchiveTag, // A keyed archive.
+};
+
+
+/// Returns data holding tag followed by length bytes.
+static NSData* tagged_data (VDSStandardSerializerTag tag, const void* bytes, NSUInteger length)
+{
+    NSMutableData* data = [NSMutableData dataWithLength:length + 1];
+    uint8_t* buffer = (uint8_t*)data.mutableBytes;
+    buffer[0] = tag;
+    if (length > 0) { memcpy(buffer + 1, bytes, length); }
+    return data;
+}
+
+
+
+
+
+#pragma mark - VDSDatabaseCacheStandardSerializer -
+
+@implementation VDSDatabaseCacheStandardSerializer
+
+@synthesize allowedClasses = _allowedClasses;
+
+
+#pragma mark - Object Lifecycle
+
+- (instancetype)init
+{
+    return [self initWithAllowedClasses:[NSSet setWithObjects:[NSString class], [NSNumber class], [NSData class],
+                                         [NSDate class], [NSArray class], [NSDictionary class], nil]];
+}
+
+
+- (instancetype)initWithAllowedClasses:(NSSet<Class>*)allowedClasses
+{
+    NSAssert(allowedClasses != nil, VDS_NIL_ARGUMENT_MESSAGE(@"allowedClasses", _cmd));
+
+    self = [super init];
+    if (self != nil) {
+        _allowedClasses = [allowedClasses copy];
+    }
+    return self;
+}
+
+
+#pragma mark - Serialization Behaviors
+
+- (NSData* _Nullable)serializedDataForObject:(id _Nonnull)object
+{
+    if ([object isKindOfClass:[NSString class]]) {
+        NSData* data = [self serializedDataForString:object];
+        if (data != nil) { return data; }
+    } else if ([object isKindOfClass:[NSNumber class]]) {
+        return [self serializedDataForNumber:object];
+    } else if ([object isKindOfClass:[NSData class]]) {
+        return tagged_data(VDSStandardSerializerDataTag, [object bytes], [object length]);
+    } else if ([object isKindOfClass:[NSDate class]]) {
+        NSTimeInterval interval = [object timeIntervalSinceReferenceDate];
+        return tagged_data(VDSStandardSerializerDateTag, &interval, sizeof(interval));
+    }
+
+    if ([object conformsToProtocol:@protocol(NSSecureCoding)] == NO) { return nil; }
+    NSData* archive = [NSKeyedArchiver archivedDataWithRootObject:object requiringSecureCoding:YES error:NULL];
+    return archive != nil ? tagged_data(VDSStandardSerializerArchiveTag, archive.bytes, archive.length) : nil;
+}
+
+
+/// Writes the UTF-8 bytes of string directly after the tag, or returns nil if string can not be
+/// represented in UTF-8, such as a string with an unpaired surrogate.
+- (NSData* _Nullable)serializedDataForString:(NSString*)string
+{
+    NSUInteger length = [string lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+    if (length == 0 && string.length > 0) { return nil; }
+
+    NSMutableData* data = [NSMutableData dataWithLength:length + 1];
+    uint8_t* buffer = (uint8_t*)data.mutableBytes;
+    buffer[0] = VDSStandardSerializerStringTag;
+    [string getBytes:buffer + 1
+           maxLength:length
+          usedLength:NULL
+            encoding:NSUTF8StringEncoding
+             options:0
+               range:NSMakeRange(0, string.length)
+      remainingRange:NULL];
+    return data;
+}
+
+
+- (NSData* _Nonnull)serializedDataForNumber:(NSNumber*)number
+{
+    if (CFGetTypeID((__bridge CFTypeRef)number) == CFBooleanGetTypeID()) {
+        uint8_t value = number.boolValue ? 1 : 0;
+        return tagged_data(VDSStandardSerializerBooleanTag, &value, sizeof(value));
+    }
+
+    switch (number.objCType[0]) {
+        case 'f':
+        case 'd': {
+            double value = number.doubleValue;
+            return tagged_data(VDSStandardSerializerDoubleTag, &value, sizeof(value));
+        }
+        case 'Q': {
+            uint64_t value = number.unsignedLongLongValue;
+            return tagged_data(VDSStandardSerializerUnsignedIntegerTag, &value, sizeof(value));
+        }
+        default: {
+            int64_t value = number.longLongValue;
+            return tagged_data(VDSStandardSerializerIntegerTag, &value, sizeof(value));
+        }
+    }
+}
+
+
+- (id _Nullable)objectWithSerializedData:(NSData* _Nonnull)data
+{
+    if (data.length == 0) { return nil; }
+    const uint8_t* bytes = (const uint8_t*)data.bytes;
+    const uint8_t* value = bytes + 1;
+    NSUInteger length = data.length - 1;
+
+    switch ((VDSStandardSerializerTag)bytes[0]) {
+        case VDSStandardSerializerStringTag:
+            return [[NSString alloc] initWithBytes:value length:length encoding:NSUTF8StringEncoding];
+
+        case VDSStandardSerializerIntegerTag: {
+            int64_t integer = 0;
+            if (length != sizeof(integer)) { return nil; }
+            memcpy(&integer, value, sizeof(integer));
+            return @(integer);
+        }
+
+        case VDSStandardSerializerUnsignedIntegerTag: {
+            uint64_t integer = 0;
+            if (length != sizeof(integer)) { return nil; }
+            memcpy(&integer, value, sizeof(integer));
+            return @(integer);
+        }
+
+        case VDSStandardSerializerDoubleTag: {
+            double number = 0;
+            if (length != sizeof(number)) { return nil; }
+            memcpy(&number, value, sizeof(number));
+            return @(number);
+        }
+
+        case VDSStandardSerializerBooleanTag:
+            return length == 1 ? @(value[0] != 0) : nil;
+
+        case VDSStandardSerializerDataTag:
+            /// The bytes may be mapped from the snapshot, so they are copied.
+            return [NSData dataWithBytes:value length:length];
+
+        case VDSStandardSerializerDateTag: {
+            NSTimeInterval interval = 0;
+            if (length != sizeof(interval)) { return nil; }
+            memcpy(&interval, value, sizeof(interval));
+            return [NSDate dateWithTimeIntervalSinceReferenceDate:interval];
+        }
+
+        case VDSStandardSerializerArchiveTag: {
+            NSData* archive = [NSData dataWithBytesNoCopy:(void*)value length:length freeWhenDone:NO];
+            NSKeyedUnarchiver* unarchiver = [[NSKeyedUnarchiver alloc] initForReadingFromData:archive error:NULL];
+            if (unarchiver == nil) { return nil; }
+            unarchiver.requiresSecureCoding = YES;
+            unarchiver.decodingFailurePolicy = NSDecodingFailurePolicySetErrorAndReturn;
+            id object = [unarchiver decodeObjectOfClasses:_allowedClasses forKey:NSKeyedArchiveRootObjectKey];
+            [unarchiver finishDecoding];
+            return unarchiver.error == nil ? object : nil;
+        }
+    }
+    return nil;
+}
+
+
+@end
@@ -0,0 +1,153 @@
+//
+//  VDSDatabaseCacheSnapshot.h
+//  VDSKit
+//
+//  Created by Erikheath Thomas on 6/13/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "VDSDatabaseCacheSerializer.h"
+
+#include <vector>
+
+
+
+
+
+#pragma mark - VDSCacheSnapshotRecord -
+
+/// @summary The state of a single cache entry as it is written to or read from a snapshot.
+///
+struct VDSCacheSnapshotRecord {
+
+    __strong id key = nil;
+    __strong id object = nil;
+
+    /// The time, as an interval since the reference date, when the entry expires. Snapshots record
+    /// wall clock times, as the cache clock does not carry over from one launch to the next.
+    NSTimeInterval expiration = 0;
+
+    NSUInteger usageCount = 0;
+    NSUInteger cost = 0;
+
+    /// The recency segment of a tracked entry.
+    uint8_t segment = 0;
+
+    bool tracked = false;
+};
+
+
+
+
+
+#pragma mark - VDSCacheSnapshotWriter -
+
+/// @summary Writes the records of a snapshot sequentially through a buffer.
+///
+/// @discussion A snapshot is a header followed by records and a trailer. All values are little endian.
+///
+/// - The header is the magic number 'VDSS', the format version, the eviction policy of the cache that
+/// wrote it, and a reserved word, each 32 bits.
+/// - Each record is a 1 byte marker, a 32 bit checksum of the rest of the record, 1 byte of flags, the
+/// 1 byte segment, 2 reserved bytes, the 32 bit lengths of the key and object data, the 64 bit
+/// expiration, usage count, and cost, and then the key and object data.
+/// - The trailer is a 1 byte end marker followed by the 64 bit number of records.
+///
+/// Tracked records are written segment by segment from the least to the most recently used entry, so
+/// that inserting them in order reproduces the recency order.
+///
+/// The snapshot is written to a temporary file beside the destination, which replaces the destination
+/// only once the trailer has been written, so a snapshot that fails part way never replaces a good one.
+///
+class VDSCacheSnapshotWriter {
+
+public:
+
+    explicit VDSCacheSnapshotWriter(id<VDSDatabaseCacheSerializer> _Nonnull serializer);
+    ~VDSCacheSnapshotWriter();
+
+    VDSCacheSnapshotWriter(const VDSCacheSnapshotWriter&) = delete;
+    VDSCacheSnapshotWriter& operator=(const VDSCacheSnapshotWriter&) = delete;
+
+    /// Creates the temporary file and writes the header.
+    bool open(NSURL* _Nonnull url, uint32_t policy);
+
+    /// Serializes and writes a record. A record whose key or object the serializer can not convert
+    /// is skipped, which is not a failure.
+    bool write(const VDSCacheSnapshotRecord& record);
+
+    /// Writes the trailer and moves the snapshot into place.
+    bool close();
+
+    /// A description of the failure after open(), write(), or close() returns false.
+    NSString* _Nullable failureReason() const { return _failureReason; }
+
+    /// The error that caused the failure, if any.
+    NSError* _Nullable underlyingError() const { return _underlyingError; }
+
+
+private:
+
+    bool append(const void* _Nonnull bytes, size_t length);
+    bool flush();
+    bool fail(NSString* _Nonnull reason, int code);
+
+    __strong id<VDSDatabaseCacheSerializer> _serializer;
+    __strong NSURL* _url;
+    __strong NSString* _temporaryPath;
+    __strong NSString* _failureReason;
+    __strong NSError* _underlyingError;
+    std::vector<uint8_t> _buffer;
+    uint64_t _recordCount;
+    int _descriptor;
+};
+
+
+
+
+
+#pragma mark - VDSCacheSnapshotReader -
+
+/// @summary Reads the records of a snapshot written by VDSCacheSnapshotWriter from a memory mapping of the file.
+///
+class VDSCacheSnapshotReader {
+
+public:
+
+    explicit VDSCacheSnapshotReader(id<VDSDatabaseCacheSerializer> _Nonnull serializer);
+
+    VDSCacheSnapshotReader(const VDSCacheSnapshotReader&) = delete;
+    VDSCacheSnapshotReader& operator=(const VDSCacheSnapshotReader&) = delete;
+
+    /// Maps the file and reads the header.
+    bool open(NSURL* _Nonnull url);
+
+    /// The eviction policy of the cache that wrote the snapshot.
+    uint32_t policy() const { return _policy; }
+
+    /// Reads the next record. Sets done and returns true once the trailer has been read. A record whose
+    /// key or object the serializer can not convert is skipped. A record whose checksum does not match
+    /// its contents fails the read.
+    bool read(VDSCacheSnapshotRecord* _Nonnull record, bool* _Nonnull done);
+
+    /// A description of the failure after open() or read() returns false.
+    NSString* _Nullable failureReason() const { return _failureReason; }
+
+    /// The error that caused the failure, if any.
+    NSError* _Nullable underlyingError() const { return _underlyingError; }
+
+
+private:
+
+    bool consume(void* _Nonnull bytes, size_t length);
+    bool fail(NSString* _Nonnull reason);
+
+    __strong id<VDSDatabaseCacheSerializer> _serializer;
+    __strong NSData* _data;
+    __strong NSString* _failureReason;
+    __strong NSError* _underlyingError;
+    NSUInteger _offset;
+    uint64_t _recordCount;
+    uint32_t _policy;
+};
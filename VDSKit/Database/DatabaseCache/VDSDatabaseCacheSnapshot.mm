@@ -0,0 +1,321 @@
+//
+//  VDSDatabaseCacheSnapshot.mm
+//  VDSKit
+//
+//  Created by Erikheath Thomas on 6/13/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import "VDSDatabaseCacheSnapshot.h"
+#import "VDSDatabaseCacheChecksum.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libkern/OSByteOrder.h>
+
+
+/// 'VDSS', the first word of every snapshot.
+static const uint32_t VDSSnapshotMagic = 0x53534456;
+
+/// The version of the format written by VDSCacheSnapshotWriter. Readers reject any other version.
+static const uint32_t VDSSnapshotVersion = 2;
+
+/// The marker that begins each record, and the marker that begins the trailer.
+static const uint8_t VDSSnapshotRecordMarker = 1;
+static const uint8_t VDSSnapshotEndMarker = 0;
+
+/// The flag set for a tracked record.
+static const uint8_t VDSSnapshotTrackedFlag = 1 << 0;
+
+/// The size of the fixed portion of a record, which precedes the key and object data.
+static const size_t VDSSnapshotRecordHeaderSize = 1 + 4 + 4 + 4 + 4 + 8 + 8 + 8;
+
+/// The offset of the portion of a record covered by its checksum, which follows the marker and the checksum.
+static const size_t VDSSnapshotRecordChecksumOffset = 1 + 4;
+
+/// The amount of data collected before it is written to the file.
+static const size_t VDSSnapshotBufferSize = 1 << 20;
+
+
+/// Stores a value in buffer in little endian order and returns the position after it.
+static inline uint8_t* put_uint32 (uint8_t* buffer, uint32_t value)
+{
+    value = OSSwapHostToLittleInt32(value);
+    memcpy(buffer, &value, sizeof(value));
+    return buffer + sizeof(value);
+}
+
+
+static inline uint8_t* put_uint64 (uint8_t* buffer, uint64_t value)
+{
+    value = OSSwapHostToLittleInt64(value);
+    memcpy(buffer, &value, sizeof(value));
+    return buffer + sizeof(value);
+}
+
+
+static inline uint8_t* put_double (uint8_t* buffer, double value)
+{
+    uint64_t bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    return put_uint64(buffer, bits);
+}
+
+
+/// Reads a little endian value from buffer and returns the position after it.
+static inline const uint8_t* get_uint32 (const uint8_t* buffer, uint32_t* value)
+{
+    memcpy(value, buffer, sizeof(*value));
+    *value = OSSwapLittleToHostInt32(*value);
+    return buffer + sizeof(*value);
+}
+
+
+static inline const uint8_t* get_uint64 (const uint8_t* buffer, uint64_t* value)
+{
+    memcpy(value, buffer, sizeof(*value));
+    *value = OSSwapLittleToHostInt64(*value);
+    return buffer + sizeof(*value);
+}
+
+
+static inline const uint8_t* get_double (const uint8_t* buffer, double* value)
+{
+    uint64_t bits = 0;
+    buffer = get_uint64(buffer, &bits);
+    memcpy(value, &bits, sizeof(bits));
+    return buffer;
+}
+
+
+
+
+
+#pragma mark - VDSCacheSnapshotWriter -
+
+VDSCacheSnapshotWriter::VDSCacheSnapshotWriter(id<VDSDatabaseCacheSerializer> _Nonnull serializer)
+    : _serializer(serializer), _url(nil), _temporaryPath(nil), _failureReason(nil), _underlyingError(nil),
+      _recordCount(0), _descriptor(-1)
+{
+    _buffer.reserve(VDSSnapshotBufferSize);
+}
+
+
+VDSCacheSnapshotWriter::~VDSCacheSnapshotWriter()
+{
+    /// A snapshot that was not closed is incomplete, so its temporary file is discarded.
+    if (_descriptor >= 0) {
+        ::close(_descriptor);
+        ::unlink(_temporaryPath.fileSystemRepresentation);
+    }
+}
+
+
+bool VDSCacheSnapshotWriter::open(NSURL* _Nonnull url, uint32_t policy)
+{
+    if (url.isFileURL == NO) { return fail(@"The URL is not a file URL.", EINVAL); }
+    _url = url;
+    _temporaryPath = [url.path stringByAppendingString:@".tmp"];
+    _descriptor = ::open(_temporaryPath.fileSystemRepresentation, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (_descriptor < 0) { return fail(@"The file could not be created.", errno); }
+
+    uint8_t header[16];
+    uint8_t* position = put_uint32(header, VDSSnapshotMagic);
+    position = put_uint32(position, VDSSnapshotVersion);
+    position = put_uint32(position, policy);
+    put_uint32(position, 0);
+    return append(header, sizeof(header));
+}
+
+
+bool VDSCacheSnapshotWriter::write(const VDSCacheSnapshotRecord& record)
+{
+    NSData* keyData = [_serializer serializedDataForObject:record.key];
+    NSData* objectData = keyData != nil ? [_serializer serializedDataForObject:record.object] : nil;
+    if (keyData == nil || objectData == nil) { return true; }
+    if (keyData.length > UINT32_MAX || objectData.length > UINT32_MAX) {
+        return fail(@"A serialized key or object is larger than 4GB.", EFBIG);
+    }
+
+    uint8_t header[VDSSnapshotRecordHeaderSize] = {0};
+    header[0] = VDSSnapshotRecordMarker;
+    header[5] = record.tracked ? VDSSnapshotTrackedFlag : 0;
+    header[6] = record.segment;
+    uint8_t* position = put_uint32(header + 9, (uint32_t)keyData.length);
+    position = put_uint32(position, (uint32_t)objectData.length);
+    position = put_double(position, record.expiration);
+    position = put_uint64(position, record.usageCount);
+    put_uint64(position, record.cost);
+
+    uint32_t checksum = VDSCacheChecksum(header + VDSSnapshotRecordChecksumOffset, sizeof(header) - VDSSnapshotRecordChecksumOffset);
+    checksum = VDSCacheChecksumUpdate(checksum, keyData.bytes, keyData.length);
+    put_uint32(header + 1, VDSCacheChecksumUpdate(checksum, objectData.bytes, objectData.length));
+
+    _recordCount++;
+    return append(header, sizeof(header)) && append(keyData.bytes, keyData.length) && append(objectData.bytes, objectData.length);
+}
+
+
+bool VDSCacheSnapshotWriter::close()
+{
+    uint8_t trailer[1 + 8];
+    trailer[0] = VDSSnapshotEndMarker;
+    put_uint64(trailer + 1, _recordCount);
+    if (append(trailer, sizeof(trailer)) == false || flush() == false) { return false; }
+
+    /// The snapshot is on disk before it replaces the destination.
+    if (::fsync(_descriptor) != 0) { return fail(@"The file could not be synchronized.", errno); }
+    int result = ::close(_descriptor);
+    _descriptor = -1;
+    if (result != 0) {
+        ::unlink(_temporaryPath.fileSystemRepresentation);
+        return fail(@"The file could not be closed.", errno);
+    }
+    if (::rename(_temporaryPath.fileSystemRepresentation, _url.path.fileSystemRepresentation) != 0) {
+        int code = errno;
+        ::unlink(_temporaryPath.fileSystemRepresentation);
+        return fail(@"The snapshot could not be moved into place.", code);
+    }
+    return true;
+}
+
+
+bool VDSCacheSnapshotWriter::append(const void* _Nonnull bytes, size_t length)
+{
+    if (_buffer.size() + length > VDSSnapshotBufferSize && flush() == false) { return false; }
+    const uint8_t* start = (const uint8_t*)bytes;
+    _buffer.insert(_buffer.end(), start, start + length);
+    return true;
+}
+
+
+bool VDSCacheSnapshotWriter::flush()
+{
+    const uint8_t* position = _buffer.data();
+    size_t remaining = _buffer.size();
+    while (remaining > 0) {
+        ssize_t written = ::write(_descriptor, position, remaining);
+        if (written < 0 && errno == EINTR) { continue; }
+        if (written < 0) { return fail(@"The file could not be written.", errno); }
+        position += written;
+        remaining -= (size_t)written;
+    }
+    _buffer.clear();
+    return true;
+}
+
+
+bool VDSCacheSnapshotWriter::fail(NSString* _Nonnull reason, int code)
+{
+    _failureReason = reason;
+    _underlyingError = [NSError errorWithDomain:NSPOSIXErrorDomain code:code userInfo:nil];
+    return false;
+}
+
+
+
+
+
+#pragma mark - VDSCacheSnapshotReader -
+
+VDSCacheSnapshotReader::VDSCacheSnapshotReader(id<VDSDatabaseCacheSerializer> _Nonnull serializer)
+    : _serializer(serializer), _data(nil), _failureReason(nil), _underlyingError(nil),
+      _offset(0), _recordCount(0), _policy(0)
+{
+}
+
+
+bool VDSCacheSnapshotReader::open(NSURL* _Nonnull url)
+{
+    NSError* error = nil;
+    _data = [NSData dataWithContentsOfURL:url options:NSDataReadingMappedIfSafe error:&error];
+    if (_data == nil) {
+        _underlyingError = error;
+        return fail(@"The file could not be opened.");
+    }
+
+    uint8_t header[16];
+    if (consume(header, sizeof(header)) == false) { return false; }
+    uint32_t magic = 0, version = 0;
+    const uint8_t* position = get_uint32(header, &magic);
+    position = get_uint32(position, &version);
+    get_uint32(position, &_policy);
+    if (magic != VDSSnapshotMagic) { return fail(@"The file is not a cache snapshot."); }
+    if (version != VDSSnapshotVersion) {
+        return fail([NSString stringWithFormat:@"The snapshot format version %u is not supported.", version]);
+    }
+    return true;
+}
+
+
+bool VDSCacheSnapshotReader::read(VDSCacheSnapshotRecord* _Nonnull record, bool* _Nonnull done)
+{
+    *done = false;
+    while (true) {
+        uint8_t marker = 0;
+        if (consume(&marker, sizeof(marker)) == false) { return false; }
+
+        if (marker == VDSSnapshotEndMarker) {
+            uint8_t trailer[8];
+            if (consume(trailer, sizeof(trailer)) == false) { return false; }
+            uint64_t count = 0;
+            get_uint64(trailer, &count);
+            if (count != _recordCount) { return fail(@"The snapshot does not contain the number of records it lists."); }
+            *done = true;
+            return true;
+        }
+        if (marker != VDSSnapshotRecordMarker) { return fail(@"The snapshot contains an unrecognized record."); }
+
+        uint8_t header[VDSSnapshotRecordHeaderSize - 1];
+        if (consume(header, sizeof(header)) == false) { return false; }
+        uint32_t checksum = 0, keyLength = 0, objectLength = 0;
+        uint64_t usageCount = 0, cost = 0;
+        get_uint32(header, &checksum);
+        const uint8_t* position = get_uint32(header + 8, &keyLength);
+        position = get_uint32(position, &objectLength);
+        position = get_double(position, &record->expiration);
+        position = get_uint64(position, &usageCount);
+        get_uint64(position, &cost);
+        if ((uint64_t)keyLength + objectLength > _data.length - _offset) { return fail(@"The snapshot is truncated."); }
+
+        /// A corrupt record fails the load before any of its data reaches the serializer.
+        const uint8_t* bytes = (const uint8_t*)_data.bytes + _offset;
+        size_t checksummedHeaderSize = VDSSnapshotRecordHeaderSize - VDSSnapshotRecordChecksumOffset;
+        uint32_t computed = VDSCacheChecksum(header + 4, checksummedHeaderSize);
+        if (VDSCacheChecksumUpdate(computed, bytes, (size_t)keyLength + objectLength) != checksum) {
+            return fail(@"The snapshot contains a corrupt record.");
+        }
+
+        /// The serializer reads the data in place, without copying it out of the mapping.
+        NSData* keyData = [NSData dataWithBytesNoCopy:(void*)bytes length:keyLength freeWhenDone:NO];
+        NSData* objectData = [NSData dataWithBytesNoCopy:(void*)(bytes + keyLength) length:objectLength freeWhenDone:NO];
+        _offset += keyLength + objectLength;
+        _recordCount++;
+
+        record->key = [_serializer objectWithSerializedData:keyData];
+        record->object = record->key != nil ? [_serializer objectWithSerializedData:objectData] : nil;
+        if (record->key == nil || record->object == nil) { continue; }
+        record->tracked = (header[4] & VDSSnapshotTrackedFlag) != 0;
+        record->segment = header[5];
+        record->usageCount = (NSUInteger)usageCount;
+        record->cost = (NSUInteger)cost;
+        return true;
+    }
+}
+
+
+bool VDSCacheSnapshotReader::consume(void* _Nonnull bytes, size_t length)
+{
+    if (length > _data.length - _offset) { return fail(@"The snapshot is truncated."); }
+    memcpy(bytes, (const uint8_t*)_data.bytes + _offset, length);
+    _offset += length;
+    return true;
+}
+
+
+bool VDSCacheSnapshotReader::fail(NSString* _Nonnull reason)
+{
+    _failureReason = reason;
+    return false;
+}
@@ -19,6 +19,11 @@
 /// time sorted list to quickly determine which objects have expired
 /// and therefore are no longer valid when accessed.
 ///
+/// VDSDatabaseCache does not wrap its objects in expirable objects. It stores each
+/// expiration inline with the cached object as a time on a monotonic clock, so
+/// VDSExpirableObject is a standalone value type for clients that want to pair an
+/// object with an expiration date.
+///
 /// VDSExpirableObject overrides its hash method to enable searching for the
 /// object stored in its object property. This enables finding an object using
 /// isEquals where either the receiver or comparison object can be the object
@@ -12,9 +12,7 @@
 static NSString* const expiration = @"expiration";
 static NSString* const object = @"object";
 
-@interface VDSExpirableObject () {
-    dispatch_once_t _onceToken;
-}
+@interface VDSExpirableObject ()
 
 /// Overriden to support KVO notifications when expired is set to YES.
 @property(readwrite) BOOL expired;
@@ -31,23 +29,27 @@ static NSString* const object = @"object";
 @synthesize expired = _expired;
 
 
+/// Compares intervals rather than dates, so checking an object does not
+/// allocate a date for the current time.
+///
 - (BOOL)isExpired {
-    if (!_expired && [_expiration compare:[NSDate now]] == NSOrderedAscending) {
+    if (!_expired && _expiration.timeIntervalSinceReferenceDate < [NSDate timeIntervalSinceReferenceDate]) {
         self.expired = YES;
     }
     return _expired;
 }
 
 
-/// The expired ivar is set once to YES and then blocked from being
-/// changed through this setter. To prevent 'accidental' KVO access
-/// of the underlying value, accessInstanceVariablesDirectly is set
-/// to NO.
+/// The expired ivar can only be changed to YES through this setter, so
+/// once set it stays fixed. Setting it again stores the same value, so
+/// concurrent readers need no further coordination. To prevent 'accidental'
+/// KVO access of the underlying value, accessInstanceVariablesDirectly is
+/// set to NO.
 ///
 - (void)setExpired:(BOOL)expired {
-    dispatch_once(&_onceToken, ^{
-            _expired = YES;
-    });
+    if (expired) {
+        _expired = YES;
+    }
 }
 
 #pragma mark - Object Lifecycle
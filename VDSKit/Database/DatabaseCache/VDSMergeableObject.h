@@ -25,6 +25,15 @@
 /// or set the value to nil. To keep keys in a dictionary but indicate a null value, use
 /// NSNull as the value.
 ///
+/// Objects with many keys should implement mergeFromObject:, which replaces the per key
+/// merge with a single call that can copy values directly, without key value coding. Update
+/// objects that know which of their values changed can implement changedMergeableKeyMask so
+/// that only those values are merged. An update that changes nothing is detected, and leaves
+/// the expiration and recency of the cached object as they were.
+///
+/// The cache checks which of these methods a class implements once, and reuses the answer
+/// for every object of the class.
+///
 @protocol VDSMergeableObject <NSObject>
 
 @required
@@ -43,7 +52,27 @@
 /// an updatable object.
 ///
 - (NSArray* _Nonnull)mergeableKeys;
- 
+
+
+@optional
+
+/// @summary Merges every mergeable value of an update into receiver in a single call. When
+/// implemented by the cached object, it is used in place of mergeableKeys and mergeValue:forKey:.
+///
+/// @param object The update object, which is of a class that conforms to VDSMergeableObject.
+///
+/// @returns YES if any value of receiver changed, NO if the update matched receiver.
+///
+- (BOOL)mergeFromObject:(id<VDSMergeableObject> _Nonnull)object;
+
+
+/// @summary A bitmap of the values in an update object that changed. Bit i corresponds to
+/// the key at index i of mergeableKeys, and keys from index 64 on are always merged. When the
+/// update object implements this method and the cached object does not implement mergeFromObject:,
+/// only the values whose bits are set are merged, and an update with no bits set is skipped.
+///
+- (uint64_t)changedMergeableKeyMask;
+
 
 @end
 
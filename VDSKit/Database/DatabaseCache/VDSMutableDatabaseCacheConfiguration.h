@@ -41,6 +41,14 @@
 /// or FIFO (first in, first out) order when being processed for eviction based on
 /// cache size preferences. The default is VDSLIFOPolicy.
 ///
+/// @discussion VDSTinyLFUPolicy and VDS2QPolicy are scan resistant, admitting new objects into
+/// the bulk of the cache only when they are accessed again. Both size their queues relative to
+/// preferredMaxObjectCount, or relative to the number of tracked objects when there is no preferred
+/// max object count, and both record accesses made through objectForKey: and incrementUsageCount:.
+///
+/// VDSClockPolicy approximates VDSOATPolicy without reordering objects as they are accessed, so reads,
+/// including lock free reads, and incrementUsageCount: never splice the recency order.
+///
 /// Corresponds to the VDSEvictionPolicyKey.
 ///
 @property(readwrite, nonatomic) VDSEvictionPolicy evictionPolicy;
@@ -49,6 +57,9 @@
 /// @summary Determines whether the cache will dispatch an eviction operation when a low memory notification
 /// is received. The default is NO.
 ///
+/// @discussion A cache that evicts on low memory registers with the shared VDSDatabaseCacheMemoryMonitor,
+/// and sheds tracked objects with evictObjectsForMemoryPressure: as memory pressure rises.
+///
 /// Corresponds to the VDSEvictsOnLowMemoryKey.
 ///
 @property(readwrite, nonatomic) BOOL evictsOnLowMemory;
@@ -124,5 +135,128 @@
 ///
 @property(strong, readwrite, nullable, nonatomic) NSDictionary<id, NSExpression*>* expirationTimingMap;
 
+
+/// @summary The number of independent shards the cache divides its keyspace into. Each shard
+/// has its own storage, recency order, expiration heap, and lock, and a key is assigned to a
+/// shard by its hash. Accessors only lock the shard that holds their key, and the eviction cycle
+/// processes one shard at a time, so readers are never blocked for an entire eviction sweep.
+///
+/// @discussion A value of 0 or 1 creates a single shard guarded by the cache's coordinator lock.
+/// When the cache is sharded, the preferred max object count is divided evenly between the shards.
+/// The default is 0.
+///
+/// Corresponds to the VDSCacheShardCountKey.
+@property(readwrite, nonatomic) NSUInteger shardCount;
+
+
+/// @summary Determines whether objectForKey: reads the cache without acquiring a lock. When YES,
+/// lookups are validated using a per shard sequence counter and retried if they overlap a write,
+/// so readers never block on, or contend with, one another. Writers and the eviction cycle continue
+/// to coordinate using the shard locks.
+///
+/// @discussion Keys and objects that are removed or replaced while lock free reads are enabled are
+/// retained until every reader that could have observed them has finished, which may delay their
+/// release slightly. The default is NO.
+///
+/// Corresponds to the VDSCacheUsesLockFreeReadsKey.
+@property(readwrite, nonatomic) BOOL usesLockFreeReads;
+
+
+/// @summary The preferred maximum total cost of the tracked objects in the cache, typically
+/// measured in bytes. When the total cost exceeds this value, the eviction cycle removes unused
+/// tracked objects in the order determined by the eviction policy until the cache is within the
+/// limit. A value of 0 sets no limit. The default is 0.
+///
+/// @discussion The cost of an object is passed to setObject:forKey:tracked:expires:cost: or, when
+/// no cost is passed, is provided by objects that conform to VDSCostableObject. The limit is
+/// applied together with preferredMaxObjectCount, so eviction continues while either is exceeded.
+/// When the cache is sharded, the limit is divided evenly between the shards.
+///
+/// Corresponds to the VDSCachePreferredMaxTotalCostKey.
+@property(readwrite, nonatomic) NSUInteger preferredMaxTotalCost;
+
+
+/// @summary Determines whether the cache enforces preferredMaxObjectCount and preferredMaxTotalCost
+/// as objects are added. When YES, adding a tracked object that takes its shard over either limit
+/// evicts unused tracked objects, in the order determined by the eviction policy, before the setter
+/// returns. The default is NO, which enforces the limits only during eviction cycles.
+///
+/// @discussion Inline eviction keeps the cache within its limits during bursts of inserts, leaving
+/// the eviction cycle to remove expired objects. Each insert evicts only as many objects as it takes
+/// to bring its shard back within the limits, which is a single object in the common case.
+///
+/// Corresponds to the VDSCacheEvictsOnInsertKey.
+@property(readwrite, nonatomic) BOOL evictsOnInsert;
+
+
+/// @summary A table of expiration intervals, in seconds, keyed by entity name or class name. When
+/// an object is added without an expiration date, its interval is looked up by the value of
+/// VDSEntryEntityNameKey in its key or in the object, when either is a dictionary that has one,
+/// and otherwise by the name of the object's class. The default is nil.
+///
+/// @discussion The table is resolved with a single hash lookup and no expression evaluation, so it
+/// is the fastest way to assign expirations when they depend only on the kind of object. Objects
+/// that are not found in the table fall back to the expirationTimingMap, if there is one, and then
+/// to the defaultExpirationInterval of the cache.
+///
+/// Corresponds to the VDSCacheExpirationIntervalsKey.
+@property(strong, readwrite, nullable, nonatomic) NSDictionary<NSString*, NSNumber*>* expirationIntervals;
+
+
+/// @summary The maximum number of objects an eviction cycle removes from a shard before it releases
+/// the shard's lock, letting waiting accessors proceed, and then resumes where it left off. The default
+/// is 0, which processes each shard in a single pass.
+///
+/// @discussion An eviction cycle that removes a large number of objects in one pass blocks every
+/// accessor of the shard until it completes. Bounding the work done under the lock keeps the latency
+/// of accessors independent of the size of the cache and of the cycle. The cycle resumes from the
+/// expiration order and the recency order of the shard, which only hold entries that have not yet
+/// been processed, so no work is repeated when it resumes.
+///
+/// When either evictionBatchSize or evictionTimeSlice is set, the lock of an unsharded cache is
+/// released between slices.
+///
+/// Corresponds to the VDSCacheEvictionBatchSizeKey.
+@property(readwrite, nonatomic) NSUInteger evictionBatchSize;
+
+
+/// @summary The longest time, in seconds, that an eviction cycle holds a shard's lock before it
+/// releases the lock, letting waiting accessors proceed, and then resumes where it left off. The
+/// default is 0, which processes each shard in a single pass.
+///
+/// @discussion The time slice may be combined with evictionBatchSize, in which case the lock is
+/// released when either bound is reached. The elapsed time is checked every few objects, so a slice
+/// may run slightly past its bound.
+///
+/// Corresponds to the VDSCacheEvictionTimeSliceKey.
+@property(readwrite, nonatomic) NSTimeInterval evictionTimeSlice;
+
+
+/// @summary The time, in seconds, after a tracked object is stored at which it becomes stale. The
+/// default is 0, which never marks objects stale.
+///
+/// @discussion The refresh interval is a soft expiration that precedes the hard expiration of each
+/// object. A stale object is still returned by reads, but the first read after it becomes stale
+/// starts a single background refresh using the cache's refreshLoader, or the loader passed to
+/// objectForKey:loader:completion:. The refreshed object replaces the stale one and is given new
+/// deadlines. Once an object reaches its expiration it is no longer returned by reads, even if it is
+/// retained because it is in use. An object that expires before its refresh interval elapses never
+/// becomes stale.
+///
+/// Corresponds to the VDSCacheRefreshIntervalKey.
+@property(readwrite, nonatomic) NSTimeInterval refreshInterval;
+
+
+/// @summary The number of threads an eviction cycle uses to process the cache's shards. The default
+/// is 0, which uses one thread for each active processor. A cycle never uses more threads than the
+/// cache has shards, so an unsharded cache is always processed on the thread running the cycle.
+///
+/// @discussion Each thread takes the next unprocessed shard until every shard has been processed,
+/// so a thread that finishes a small shard moves on rather than waiting for one that is still
+/// busy. The delegate is messaged on the thread running the cycle.
+///
+/// Corresponds to the VDSCacheEvictionConcurrencyKey.
+@property(readwrite, nonatomic) NSUInteger evictionConcurrency;
+
 @end
 
@@ -25,6 +25,15 @@
 @dynamic archivesUntrackedObjects;
 @dynamic expirationTimingMapKey;
 @dynamic expirationTimingMap;
+@dynamic shardCount;
+@dynamic usesLockFreeReads;
+@dynamic preferredMaxTotalCost;
+@dynamic evictsOnInsert;
+@dynamic expirationIntervals;
+@dynamic evictionBatchSize;
+@dynamic evictionTimeSlice;
+@dynamic refreshInterval;
+@dynamic evictionConcurrency;
 
 
 - (void)setExpiresObjects:(BOOL)expiresObjects
@@ -93,4 +102,58 @@
 }
 
 
+- (void)setShardCount:(NSUInteger)shardCount
+{
+    _shardCount = shardCount;
+}
+
+
+- (void)setUsesLockFreeReads:(BOOL)usesLockFreeReads
+{
+    _usesLockFreeReads = usesLockFreeReads;
+}
+
+
+- (void)setPreferredMaxTotalCost:(NSUInteger)preferredMaxTotalCost
+{
+    _preferredMaxTotalCost = preferredMaxTotalCost;
+}
+
+
+- (void)setEvictsOnInsert:(BOOL)evictsOnInsert
+{
+    _evictsOnInsert = evictsOnInsert;
+}
+
+
+- (void)setExpirationIntervals:(NSDictionary<NSString*, NSNumber*>*)expirationIntervals
+{
+    _expirationIntervals = expirationIntervals;
+}
+
+
+- (void)setEvictionBatchSize:(NSUInteger)evictionBatchSize
+{
+    _evictionBatchSize = evictionBatchSize;
+}
+
+
+- (void)setEvictionTimeSlice:(NSTimeInterval)evictionTimeSlice
+{
+    _evictionTimeSlice = evictionTimeSlice;
+}
+
+
+- (void)setRefreshInterval:(NSTimeInterval)refreshInterval
+{
+    _refreshInterval = refreshInterval;
+}
+
+
+- (void)setEvictionConcurrency:(NSUInteger)evictionConcurrency
+{
+    _evictionConcurrency = evictionConcurrency;
+}
+
+
 @end
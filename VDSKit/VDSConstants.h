@@ -22,6 +22,10 @@ FOUNDATION_EXPORT VDSEvictionCycleKey VDSExpirationCycleKey;
 FOUNDATION_EXPORT VDSEvictionCycleKey VDSFIFOPolicyCycleKey;
 FOUNDATION_EXPORT VDSEvictionCycleKey VDSLIFOPolicyCycleKey;
 FOUNDATION_EXPORT VDSEvictionCycleKey VDSOATPolicyCycleKey;
+FOUNDATION_EXPORT VDSEvictionCycleKey VDSTinyLFUPolicyCycleKey;
+FOUNDATION_EXPORT VDSEvictionCycleKey VDS2QPolicyCycleKey;
+FOUNDATION_EXPORT VDSEvictionCycleKey VDSClockPolicyCycleKey;
+FOUNDATION_EXPORT VDSEvictionCycleKey VDSLowMemoryCycleKey;
 FOUNDATION_EXPORT VDSEvictionCycleKey VDSUnknownCycleKey;
 
 typedef NSString* const VDSCacheConfigurationKey;
@@ -37,16 +41,78 @@ FOUNDATION_EXPORT VDSCacheConfigurationKey VDSCacheArchivesUntrackedObjectsKey;
 FOUNDATION_EXPORT VDSCacheConfigurationKey VDSCacheExpirationTimingMapExpressionKey;
 FOUNDATION_EXPORT VDSCacheConfigurationKey VDSCacheExpirationTimingMapKey;
 FOUNDATION_EXPORT VDSCacheConfigurationKey VDSCacheEvictionOperationClassNameKey;
+FOUNDATION_EXPORT VDSCacheConfigurationKey VDSCacheShardCountKey;
+FOUNDATION_EXPORT VDSCacheConfigurationKey VDSCacheUsesLockFreeReadsKey;
+FOUNDATION_EXPORT VDSCacheConfigurationKey VDSCachePreferredMaxTotalCostKey;
+FOUNDATION_EXPORT VDSCacheConfigurationKey VDSCacheEvictsOnInsertKey;
+FOUNDATION_EXPORT VDSCacheConfigurationKey VDSCacheExpirationIntervalsKey;
+FOUNDATION_EXPORT VDSCacheConfigurationKey VDSCacheEvictionBatchSizeKey;
+FOUNDATION_EXPORT VDSCacheConfigurationKey VDSCacheEvictionTimeSliceKey;
+FOUNDATION_EXPORT VDSCacheConfigurationKey VDSCacheRefreshIntervalKey;
+FOUNDATION_EXPORT VDSCacheConfigurationKey VDSCacheEvictionConcurrencyKey;
+
+/// The VDSCacheMetricKey identifies a value in the metrics of a VDSDatabaseCache. Counts are
+/// NSNumbers holding unsigned integers, and durations are NSNumbers holding seconds. Eviction counts
+/// are broken down by cause: objects that expired, objects evicted to meet the preferred max object
+/// count or preferred max total cost, and objects evicted in response to memory pressure.
+typedef NSString* const VDSCacheMetricKey;
+FOUNDATION_EXPORT VDSCacheMetricKey VDSCacheLookupCountKey;
+FOUNDATION_EXPORT VDSCacheMetricKey VDSCacheHitCountKey;
+FOUNDATION_EXPORT VDSCacheMetricKey VDSCacheStaleHitCountKey;
+FOUNDATION_EXPORT VDSCacheMetricKey VDSCacheMissCountKey;
+FOUNDATION_EXPORT VDSCacheMetricKey VDSCacheInsertCountKey;
+FOUNDATION_EXPORT VDSCacheMetricKey VDSCacheMergeCountKey;
+FOUNDATION_EXPORT VDSCacheMetricKey VDSCacheUnchangedMergeCountKey;
+FOUNDATION_EXPORT VDSCacheMetricKey VDSCacheReplacementCountKey;
+FOUNDATION_EXPORT VDSCacheMetricKey VDSCacheExpiredEvictionCountKey;
+FOUNDATION_EXPORT VDSCacheMetricKey VDSCacheCountEvictionCountKey;
+FOUNDATION_EXPORT VDSCacheMetricKey VDSCacheCostEvictionCountKey;
+FOUNDATION_EXPORT VDSCacheMetricKey VDSCacheLowMemoryEvictionCountKey;
+FOUNDATION_EXPORT VDSCacheMetricKey VDSCacheEvictionCycleCountKey;
+FOUNDATION_EXPORT VDSCacheMetricKey VDSCacheEvictionCycleDurationKey;
+FOUNDATION_EXPORT VDSCacheMetricKey VDSCacheLastEvictionCycleDurationKey;
+FOUNDATION_EXPORT VDSCacheMetricKey VDSCacheLockWaitDurationKey;
+FOUNDATION_EXPORT VDSCacheMetricKey VDSCachePeakObjectCountKey;
 
 
 
 /// The VDSEvictionPolicy indicates how objects should be removed from a cache.
 /// VDSFIFOPolicy indicates a First In, First Out strategy.
 /// VDSLIFOPolicy indicates a Last In, First Out strategy.
+/// VDSOATPolicy indicates an Oldest Access Time (least recently used) strategy.
+/// VDSTinyLFUPolicy indicates a W-TinyLFU strategy: new objects enter a small LRU window and
+/// only displace objects in the main segmented LRU when they have been accessed more often,
+/// as estimated by a frequency sketch.
+/// VDS2QPolicy indicates a 2Q strategy: new objects enter a FIFO queue and are promoted to an
+/// LRU queue only when they are re-referenced after leaving it.
+/// VDSClockPolicy indicates a CLOCK (second chance) strategy that approximates least recently used:
+/// an access only sets a reference bit on the object, and the eviction cycle gives each referenced
+/// object another pass through the queue before it may be evicted.
+/// The VDSTinyLFUPolicy and VDS2QPolicy strategies are scan resistant, so a single pass over
+/// many objects does not evict the frequently used working set.
 typedef NS_ENUM(NSUInteger, VDSEvictionPolicy) {
     VDSFIFOPolicy = 0,
     VDSLIFOPolicy = 1,
     VDSOATPolicy = 2,
+    VDSTinyLFUPolicy = 3,
+    VDS2QPolicy = 4,
+    VDSClockPolicy = 5,
+};
+
+
+/// The VDSMemoryPressureLevel indicates how short of memory the process is, as reported by the
+/// VDSDatabaseCacheMemoryMonitor, and how much of its contents a cache that evicts on low memory sheds.
+/// VDSMemoryPressureNormal indicates that memory is available, and nothing is shed.
+/// VDSMemoryPressureWarning indicates that memory is becoming scarce, and a quarter of the tracked
+/// objects are shed.
+/// VDSMemoryPressureUrgent indicates that memory is scarce, and half of the tracked objects are shed.
+/// VDSMemoryPressureCritical indicates that the process is about to run out of memory, and every
+/// tracked object that is not in use is shed.
+typedef NS_ENUM(NSUInteger, VDSMemoryPressureLevel) {
+    VDSMemoryPressureNormal = 0,
+    VDSMemoryPressureWarning = 1,
+    VDSMemoryPressureUrgent = 2,
+    VDSMemoryPressureCritical = 3,
 };
 
 
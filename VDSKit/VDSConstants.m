@@ -18,6 +18,11 @@ VDSCacheEntryKey VDSEntrySnapshotKey = @"VDSEntrySnapshotKey";
 VDSEvictionCycleKey VDSExpirationCycleKey = @"VDSExpirationCycleKey";
 VDSEvictionCycleKey VDSFIFOPolicyCycleKey = @"VDSFIFOPolicyCycleKey";
 VDSEvictionCycleKey VDSLIFOPolicyCycleKey = @"VDSLIFOPolicyCycleKey";
+VDSEvictionCycleKey VDSOATPolicyCycleKey = @"VDSOATPolicyCycleKey";
+VDSEvictionCycleKey VDSTinyLFUPolicyCycleKey = @"VDSTinyLFUPolicyCycleKey";
+VDSEvictionCycleKey VDS2QPolicyCycleKey = @"VDS2QPolicyCycleKey";
+VDSEvictionCycleKey VDSClockPolicyCycleKey = @"VDSClockPolicyCycleKey";
+VDSEvictionCycleKey VDSLowMemoryCycleKey = @"VDSLowMemoryCycleKey";
 VDSEvictionCycleKey VDSUnknownCycleKey = @"VDSUnknownCycleKey";
 
 VDSCacheConfigurationKey VDSCacheExpiresObjectsKey = @"expiresObjects";
@@ -32,3 +37,30 @@ VDSCacheConfigurationKey VDSCacheArchivesUntrackedObjectsKey = @"archivesUntrack
 VDSCacheConfigurationKey VDSCacheExpirationTimingMapExpressionKey = @"expirationTimingMapKey";
 VDSCacheConfigurationKey VDSCacheExpirationTimingMapKey = @"expirationTimingMap";
 VDSCacheConfigurationKey VDSCacheEvictionOperationClassNameKey = @"evictionOperationClassName";
+VDSCacheConfigurationKey VDSCacheShardCountKey = @"shardCount";
+VDSCacheConfigurationKey VDSCacheUsesLockFreeReadsKey = @"usesLockFreeReads";
+VDSCacheConfigurationKey VDSCachePreferredMaxTotalCostKey = @"preferredMaxTotalCost";
+VDSCacheConfigurationKey VDSCacheEvictsOnInsertKey = @"evictsOnInsert";
+VDSCacheConfigurationKey VDSCacheExpirationIntervalsKey = @"expirationIntervals";
+VDSCacheConfigurationKey VDSCacheEvictionBatchSizeKey = @"evictionBatchSize";
+VDSCacheConfigurationKey VDSCacheEvictionTimeSliceKey = @"evictionTimeSlice";
+VDSCacheConfigurationKey VDSCacheRefreshIntervalKey = @"refreshInterval";
+VDSCacheConfigurationKey VDSCacheEvictionConcurrencyKey = @"evictionConcurrency";
+
+VDSCacheMetricKey VDSCacheLookupCountKey = @"VDSCacheLookupCountKey";
+VDSCacheMetricKey VDSCacheHitCountKey = @"VDSCacheHitCountKey";
+VDSCacheMetricKey VDSCacheStaleHitCountKey = @"VDSCacheStaleHitCountKey";
+VDSCacheMetricKey VDSCacheMissCountKey = @"VDSCacheMissCountKey";
+VDSCacheMetricKey VDSCacheInsertCountKey = @"VDSCacheInsertCountKey";
+VDSCacheMetricKey VDSCacheMergeCountKey = @"VDSCacheMergeCountKey";
+VDSCacheMetricKey VDSCacheUnchangedMergeCountKey = @"VDSCacheUnchangedMergeCountKey";
+VDSCacheMetricKey VDSCacheReplacementCountKey = @"VDSCacheReplacementCountKey";
+VDSCacheMetricKey VDSCacheExpiredEvictionCountKey = @"VDSCacheExpiredEvictionCountKey";
+VDSCacheMetricKey VDSCacheCountEvictionCountKey = @"VDSCacheCountEvictionCountKey";
+VDSCacheMetricKey VDSCacheCostEvictionCountKey = @"VDSCacheCostEvictionCountKey";
+VDSCacheMetricKey VDSCacheLowMemoryEvictionCountKey = @"VDSCacheLowMemoryEvictionCountKey";
+VDSCacheMetricKey VDSCacheEvictionCycleCountKey = @"VDSCacheEvictionCycleCountKey";
+VDSCacheMetricKey VDSCacheEvictionCycleDurationKey = @"VDSCacheEvictionCycleDurationKey";
+VDSCacheMetricKey VDSCacheLastEvictionCycleDurationKey = @"VDSCacheLastEvictionCycleDurationKey";
+VDSCacheMetricKey VDSCacheLockWaitDurationKey = @"VDSCacheLockWaitDurationKey";
+VDSCacheMetricKey VDSCachePeakObjectCountKey = @"VDSCachePeakObjectCountKey";
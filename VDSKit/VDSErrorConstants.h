@@ -129,6 +129,10 @@ typedef NS_ENUM(NSUInteger, VDSKitErrorCode) {
     VDSOperationModificationFailed, // The attempted modification of the operation failed.
     VDSOperationInvalidState, // The operation is in an invalid state for the request.
     VDSCacheObjectInUse, // The operation could not be removed because it is in use.
+    VDSCacheSnapshotWriteFailed, // The cache snapshot could not be written.
+    VDSCacheSnapshotReadFailed, // The cache snapshot could not be read.
+    VDSCacheDiskTierFailed, // The disk tier could not be opened or written.
+    VDSCacheLoadCancelled, // The load of an object was cancelled before it completed.
 };
 
 typedef NSString* const VDSCoreErrorKey;
@@ -175,6 +179,41 @@ FOUNDATION_EXPORT VDSCacheErrorMessage VDSObjectInUseErrorMessageFormat; // See
 #endif
 
 
+FOUNDATION_EXPORT VDSCacheErrorMessage VDSMismatchedObjectsAndKeysErrorMessageFormat; // See implementation for description.
+
+#ifndef VDS_MISMATCHED_OBJECTS_AND_KEYS_MESSAGE
+#define VDS_MISMATCHED_OBJECTS_AND_KEYS_MESSAGE(OBJECT_COUNT, KEY_COUNT, METHOD) [NSString stringWithFormat:VDSMismatchedObjectsAndKeysErrorMessageFormat, (unsigned long)OBJECT_COUNT, (unsigned long)KEY_COUNT, NSStringFromSelector(METHOD)]
+#endif
+
+
+FOUNDATION_EXPORT VDSCacheErrorMessage VDSSnapshotWriteFailedErrorMessageFormat; // See implementation for description.
+
+#ifndef VDS_SNAPSHOT_WRITE_FAILED_MESSAGE
+#define VDS_SNAPSHOT_WRITE_FAILED_MESSAGE(URL, REASON) [NSString stringWithFormat:VDSSnapshotWriteFailedErrorMessageFormat, URL, REASON]
+#endif
+
+
+FOUNDATION_EXPORT VDSCacheErrorMessage VDSSnapshotReadFailedErrorMessageFormat; // See implementation for description.
+
+#ifndef VDS_SNAPSHOT_READ_FAILED_MESSAGE
+#define VDS_SNAPSHOT_READ_FAILED_MESSAGE(URL, REASON) [NSString stringWithFormat:VDSSnapshotReadFailedErrorMessageFormat, URL, REASON]
+#endif
+
+
+FOUNDATION_EXPORT VDSCacheErrorMessage VDSDiskTierFailedErrorMessageFormat; // See implementation for description.
+
+#ifndef VDS_DISK_TIER_FAILED_MESSAGE
+#define VDS_DISK_TIER_FAILED_MESSAGE(URL, REASON) [NSString stringWithFormat:VDSDiskTierFailedErrorMessageFormat, URL, REASON]
+#endif
+
+
+FOUNDATION_EXPORT VDSCacheErrorMessage VDSLoadCancelledErrorMessageFormat; // See implementation for description.
+
+#ifndef VDS_LOAD_CANCELLED_MESSAGE
+#define VDS_LOAD_CANCELLED_MESSAGE(KEY) [NSString stringWithFormat:VDSLoadCancelledErrorMessageFormat, KEY]
+#endif
+
+
 #pragma mark - VDSOperationErrors -
 
 
@@ -30,6 +30,16 @@ VDSCoreErrorMessage VDSUnexpectedArgumentTypeErrorMessageFormat  = @"The argumen
  
 VDSCacheErrorMessage VDSObjectInUseErrorMessageFormat = @"The object\n%@\n using key\n%@\ncan not be removed because it is in use by the cache. To remove the object, message the cache to remove the object from use, and then attempt removal again.";
 
+VDSCacheErrorMessage VDSMismatchedObjectsAndKeysErrorMessageFormat = @"The %lu objects and %lu keys passed to method %@ must have the same count. Each object is stored using the key at the same index.";
+
+VDSCacheErrorMessage VDSSnapshotWriteFailedErrorMessageFormat = @"The cache snapshot could not be written to %@. %@ Ensure that the directory exists and is writable, and that the serializer can serialize the cached keys and objects.";
+
+VDSCacheErrorMessage VDSSnapshotReadFailedErrorMessageFormat = @"The cache snapshot at %@ could not be read. %@ Ensure that the file is a snapshot written by VDSDatabaseCache and that it is read with the serializer it was written with.";
+
+VDSCacheErrorMessage VDSDiskTierFailedErrorMessageFormat = @"The disk tier in %@ failed. %@ Ensure that the directory is writable and is only used by a single disk tier.";
+
+VDSCacheErrorMessage VDSLoadCancelledErrorMessageFormat = @"The load of the object for key\n%@\nwas cancelled before the loader completed. Ensure that the operation queue the load was added to is not suspended or cancelled while loads are in flight.";
+
 
 #pragma mark - VDSKit Extended Operation Errors
  // See implementation for description.
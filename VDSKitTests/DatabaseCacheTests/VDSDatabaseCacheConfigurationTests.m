@@ -31,6 +31,15 @@
     XCTAssert(config.evictionInterval == 0.0);
     XCTAssertNil(config.expirationTimingMapKey);
     XCTAssertNil(config.expirationTimingMap);
+    XCTAssert(config.shardCount == 0);
+    XCTAssertFalse(config.usesLockFreeReads);
+    XCTAssert(config.preferredMaxTotalCost == 0);
+    XCTAssertFalse(config.evictsOnInsert);
+    XCTAssertNil(config.expirationIntervals);
+    XCTAssertEqual(config.evictionBatchSize, 0);
+    XCTAssertEqual(config.evictionTimeSlice, 0);
+    XCTAssertEqual(config.refreshInterval, 0);
+    XCTAssertEqual(config.evictionConcurrency, 0);
     
     config = nil;
     config = [VDSDatabaseCacheConfiguration new];
@@ -46,6 +55,15 @@
     XCTAssert(config.evictionInterval == 0.0);
     XCTAssertNil(config.expirationTimingMapKey);
     XCTAssertNil(config.expirationTimingMap);
+    XCTAssert(config.shardCount == 0);
+    XCTAssertFalse(config.usesLockFreeReads);
+    XCTAssert(config.preferredMaxTotalCost == 0);
+    XCTAssertFalse(config.evictsOnInsert);
+    XCTAssertNil(config.expirationIntervals);
+    XCTAssertEqual(config.evictionBatchSize, 0);
+    XCTAssertEqual(config.evictionTimeSlice, 0);
+    XCTAssertEqual(config.refreshInterval, 0);
+    XCTAssertEqual(config.evictionConcurrency, 0);
 
 }
 
@@ -64,7 +82,16 @@
                                     VDSCacheEvictionPolicyKey: @(VDSFIFOPolicy),
                                  VDSCacheEvictionIntervalKey: @(300.0),
                                  VDSCacheExpirationTimingMapExpressionKey: expression,
-                                 VDSCacheExpirationTimingMapKey: expressionMap
+                                 VDSCacheExpirationTimingMapKey: expressionMap,
+                                 VDSCacheShardCountKey: @8,
+                                 VDSCacheUsesLockFreeReadsKey: @YES,
+                                 VDSCachePreferredMaxTotalCostKey: @(1 << 20),
+                                 VDSCacheEvictsOnInsertKey: @YES,
+                                 VDSCacheExpirationIntervalsKey: @{@"Person": @60},
+                                 VDSCacheEvictionBatchSizeKey: @500,
+                                 VDSCacheEvictionTimeSliceKey: @0.0005,
+                                 VDSCacheRefreshIntervalKey: @45,
+                                 VDSCacheEvictionConcurrencyKey: @4
     };
     
     VDSDatabaseCacheConfiguration* config = [[VDSDatabaseCacheConfiguration alloc] initWithDictionary:configDict];
@@ -82,6 +109,15 @@
     XCTAssertNotNil(config.expirationTimingMap);
     XCTAssertEqualObjects(expression, config.expirationTimingMapKey);
     XCTAssertEqualObjects(expressionMap, config.expirationTimingMap);
+    XCTAssert(config.shardCount == 8);
+    XCTAssertTrue(config.usesLockFreeReads);
+    XCTAssert(config.preferredMaxTotalCost == 1 << 20);
+    XCTAssertTrue(config.evictsOnInsert);
+    XCTAssertEqualObjects(config.expirationIntervals, @{@"Person": @60});
+    XCTAssertEqual(config.evictionBatchSize, 500);
+    XCTAssertEqual(config.evictionTimeSlice, 0.0005);
+    XCTAssertEqual(config.refreshInterval, 45);
+    XCTAssertEqual(config.evictionConcurrency, 4);
 }
 
 @end
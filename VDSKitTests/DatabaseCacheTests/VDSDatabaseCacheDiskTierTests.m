@@ -0,0 +1,239 @@
+//
+//  VDSDatabaseCacheDiskTierTests.m
+//  VDSKitTests
+//
+//  Created by Erikheath Thomas on 6/14/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "../../VDSKit/VDSKit.h"
+
+
+@interface VDSDatabaseCacheDiskTierTests : XCTestCase
+
+@property(strong, readwrite) NSURL* directoryURL;
+
+@end
+
+
+@implementation VDSDatabaseCacheDiskTierTests
+
+- (void)setUp
+{
+    self.directoryURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString]];
+}
+
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtURL:self.directoryURL error:NULL];
+}
+
+
+- (VDSDatabaseCacheDiskTier*)openTierWithMaximumSize:(NSUInteger)maximumSize
+{
+    NSError* error = nil;
+    VDSDatabaseCacheDiskTier* tier = [[VDSDatabaseCacheDiskTier alloc] initWithDirectoryURL:self.directoryURL
+                                                                                maximumSize:maximumSize
+                                                                                 serializer:nil
+                                                                                      error:&error];
+    XCTAssertNotNil(tier);
+    XCTAssertNil(error);
+    return tier;
+}
+
+
+- (void)testStorageSurvivesReopening
+{
+    VDSDatabaseCacheDiskTier* tier = [self openTierWithMaximumSize:1 << 20];
+    NSDate* expires = [NSDate dateWithTimeIntervalSinceNow:3000];
+    XCTAssertTrue([tier setObject:@"first" forKey:@1 expires:expires cost:5]);
+    XCTAssertTrue([tier setObject:@"second" forKey:@"two" expires:nil cost:0]);
+    XCTAssertTrue([tier setObject:@"replaced" forKey:@1 expires:expires cost:7]);
+    XCTAssertTrue([tier setObject:@"removed" forKey:@3 expires:nil cost:0]);
+    XCTAssertTrue([tier setObject:@"expired" forKey:@4 expires:[NSDate dateWithTimeIntervalSinceNow:-1] cost:0]);
+    [tier removeObjectForKey:@3];
+    XCTAssertEqual(tier.count, 3);
+    XCTAssertEqualObjects([tier objectForKey:@1], @"replaced");
+    XCTAssertNil([tier objectForKey:@3]);
+    XCTAssertFalse([tier containsObjectForKey:@4]);
+    XCTAssertTrue([tier synchronize:NULL]);
+    tier = nil;
+
+    /// The index is rebuilt from the log, including replacements and tombstones.
+    tier = [self openTierWithMaximumSize:1 << 20];
+    XCTAssertEqual(tier.count, 2);
+    XCTAssertEqualObjects([tier objectForKey:@"two"], @"second");
+    NSDate* expiration = nil;
+    NSUInteger cost = 0;
+    XCTAssertEqualObjects([tier promoteObjectForKey:@1 expires:&expiration cost:&cost], @"replaced");
+    XCTAssertEqualWithAccuracy(expiration.timeIntervalSinceReferenceDate, expires.timeIntervalSinceReferenceDate, 0.001);
+    XCTAssertEqual(cost, 7);
+
+    /// A promoted object leaves the tier.
+    XCTAssertFalse([tier containsObjectForKey:@1]);
+    tier = nil;
+    tier = [self openTierWithMaximumSize:1 << 20];
+    XCTAssertNil([tier objectForKey:@1]);
+    XCTAssertEqualObjects([tier objectForKey:@"two"], @"second");
+}
+
+
+- (void)testRecoveryTruncatesIncompleteRecords
+{
+    VDSDatabaseCacheDiskTier* tier = [self openTierWithMaximumSize:1 << 20];
+    for (NSUInteger index = 0; index < 100; index++) {
+        XCTAssertTrue([tier setObject:@(index * 2) forKey:@(index) expires:nil cost:0]);
+    }
+    NSUInteger fileSize = tier.fileSize;
+    tier = nil;
+
+    /// A record interrupted part way through is detected by its length or checksum.
+    NSURL* logURL = [self.directoryURL URLByAppendingPathComponent:@"VDSDatabaseCacheDiskTier.log"];
+    NSFileHandle* handle = [NSFileHandle fileHandleForWritingToURL:logURL error:NULL];
+    [handle seekToEndOfFile];
+    uint8_t torn[48];
+    memset(torn, 0xA5, sizeof(torn));
+    [handle writeData:[NSData dataWithBytes:torn length:sizeof(torn)]];
+    [handle closeFile];
+
+    tier = [self openTierWithMaximumSize:1 << 20];
+    XCTAssertEqual(tier.count, 100);
+    XCTAssertEqual(tier.fileSize, fileSize);
+    XCTAssertEqualObjects([tier objectForKey:@99], @198);
+
+    /// Appends continue after the last complete record.
+    XCTAssertTrue([tier setObject:@"after" forKey:@"after" expires:nil cost:0]);
+    tier = nil;
+    tier = [self openTierWithMaximumSize:1 << 20];
+    XCTAssertEqual(tier.count, 101);
+    XCTAssertEqualObjects([tier objectForKey:@"after"], @"after");
+
+    /// A file that was not written by a disk tier is rejected.
+    tier = nil;
+    [[@"not a disk tier log, but long enough to have a header" dataUsingEncoding:NSUTF8StringEncoding] writeToURL:logURL atomically:YES];
+    NSError* error = nil;
+    XCTAssertNil([[VDSDatabaseCacheDiskTier alloc] initWithDirectoryURL:self.directoryURL maximumSize:0 serializer:nil error:&error]);
+    XCTAssertEqualObjects(error.domain, VDSKitErrorDomain);
+    XCTAssertEqual(error.code, VDSCacheDiskTierFailed);
+}
+
+
+- (void)testCompaction
+{
+    VDSDatabaseCacheDiskTier* tier = [self openTierWithMaximumSize:0];
+    NSString* value = [@"" stringByPaddingToLength:200 withString:@"v" startingAtIndex:0];
+    for (NSUInteger index = 0; index < 100; index++) {
+        XCTAssertTrue([tier setObject:value forKey:@(index % 10) expires:nil cost:0]);
+    }
+    XCTAssertTrue([tier setObject:value forKey:@"expired" expires:[NSDate dateWithTimeIntervalSinceNow:-1] cost:0]);
+    XCTAssertEqual(tier.count, 11);
+    XCTAssertGreaterThan(tier.fileSize, tier.liveSize * 5);
+
+    /// Compaction drops superseded and expired records.
+    NSError* error = nil;
+    XCTAssertTrue([tier compact:&error]);
+    XCTAssertNil(error);
+    XCTAssertEqual(tier.count, 10);
+    XCTAssertEqual(tier.fileSize, tier.liveSize + 16);
+    XCTAssertEqualObjects([tier objectForKey:@9], value);
+    tier = nil;
+    tier = [self openTierWithMaximumSize:0];
+    XCTAssertEqual(tier.count, 10);
+    XCTAssertEqualObjects([tier objectForKey:@0], value);
+}
+
+
+- (void)testCompactionDuringWrites
+{
+    VDSDatabaseCacheDiskTier* tier = [self openTierWithMaximumSize:0];
+    NSString* value = [@"" stringByPaddingToLength:200 withString:@"v" startingAtIndex:0];
+    for (NSUInteger index = 0; index < 1000; index++) {
+        XCTAssertTrue([tier setObject:value forKey:@(index % 100) expires:nil cost:0]);
+    }
+    XCTAssertTrue([tier setObject:value forKey:@"removed" expires:nil cost:0]);
+
+    /// Objects stored and removed while the log is compacted are reflected in the compacted log.
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_group_async(group, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        for (NSUInteger index = 0; index < 1000; index++) {
+            [tier setObject:@(index) forKey:@(index % 100) expires:nil cost:0];
+            if (index % 100 == 50) { [tier removeObjectForKey:@"removed"]; }
+        }
+    });
+    for (NSUInteger pass = 0; pass < 10; pass++) { XCTAssertTrue([tier compact:NULL]); }
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    XCTAssertTrue([tier compact:NULL]);
+
+    XCTAssertEqual(tier.fileSize, tier.liveSize + 16);
+    tier = nil;
+    tier = [self openTierWithMaximumSize:0];
+    XCTAssertEqual(tier.count, 100);
+    for (NSUInteger index = 900; index < 1000; index++) {
+        XCTAssertEqualObjects([tier objectForKey:@(index % 100)], @(index));
+    }
+}
+
+
+- (void)testCompactionEnforcesMaximumSize
+{
+    VDSDatabaseCacheDiskTier* tier = [self openTierWithMaximumSize:64 * 1024];
+    NSString* value = [@"" stringByPaddingToLength:1000 withString:@"v" startingAtIndex:0];
+    for (NSUInteger index = 0; index < 200; index++) {
+        XCTAssertTrue([tier setObject:value forKey:@(index) expires:nil cost:0]);
+    }
+
+    /// The log is compacted in the background, dropping the oldest objects.
+    NSDate* deadline = [NSDate dateWithTimeIntervalSinceNow:5];
+    while (tier.fileSize > 64 * 1024 && [deadline timeIntervalSinceNow] > 0) { [NSThread sleepForTimeInterval:0.01]; }
+    XCTAssertLessThanOrEqual(tier.fileSize, 64 * 1024);
+    XCTAssertNil([tier objectForKey:@0]);
+    XCTAssertEqualObjects([tier objectForKey:@199], value);
+}
+
+
+- (void)testCacheDemotesAndPromotes
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.evictionInterval = 6000;
+    config.evictionPolicy = VDSFIFOPolicy;
+    config.preferredMaxObjectCount = 5;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+    cache.diskTier = [self openTierWithMaximumSize:1 << 20];
+    NSDate* expires = [NSDate dateWithTimeIntervalSinceNow:3000];
+
+    for (NSUInteger index = 0; index < 10; index++) {
+        [cache setObject:[NSString stringWithFormat:@"object %lu", (unsigned long)index] forKey:@(index) tracked:YES expires:expires cost:index];
+    }
+    [cache setObject:@"expiring" forKey:@"expiring" tracked:YES expires:[NSDate dateWithTimeIntervalSinceNow:0.1] cost:0];
+    [NSThread sleepForTimeInterval:0.2];
+    [cache processCacheEvictions];
+
+    /// Objects evicted for the size preference are demoted, while expired objects are discarded.
+    XCTAssertEqual([[cache trackedKeys] count], 5);
+    XCTAssertEqual(cache.diskTier.count, 5);
+    XCTAssertFalse([cache.diskTier containsObjectForKey:@"expiring"]);
+    XCTAssertTrue([cache.diskTier containsObjectForKey:@0]);
+
+    /// A miss is served from the disk tier and the object returns to the cache.
+    XCTAssertEqualObjects([cache objectForKey:@0], @"object 0");
+    XCTAssertFalse([cache.diskTier containsObjectForKey:@0]);
+    XCTAssertTrue([[cache trackedKeys] containsObject:@0]);
+    XCTAssertEqual(cache.totalCost, 35);
+
+    /// Storing and removing objects supersedes the disk tier.
+    [cache setObject:@"new" forKey:@1 tracked:YES expires:expires cost:0];
+    XCTAssertFalse([cache.diskTier containsObjectForKey:@1]);
+    [cache removeObjectForKey:@2];
+    XCTAssertFalse([cache.diskTier containsObjectForKey:@2]);
+    XCTAssertNil([cache objectForKey:@2]);
+    NSArray* objects = [cache objectsForKeys:@[@3, @"missing"] notFoundMarker:[NSNull null]];
+    XCTAssertEqualObjects(objects, (@[@"object 3", [NSNull null]]));
+    [cache removeAllObjects];
+    XCTAssertEqual(cache.diskTier.count, 0);
+}
+
+
+@end
@@ -0,0 +1,160 @@
+//
+//  VDSDatabaseCacheHitRatioTests.m
+//  VDSKitTests
+//
+//  Created by Erikheath Thomas on 6/8/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "../../VDSKit/VDSKit.h"
+
+
+/// Trace driven benchmarks that replay key streams against a VDSDatabaseCache configured with each
+/// eviction policy and report the hit ratio of each policy.
+///
+/// Recorded traces are read from the directory named by the VDS_CACHE_TRACE_DIRECTORY environment
+/// variable. Each file in the directory is a trace with one key per line. When the variable is not set,
+/// synthetic traces that model a skewed entity workload, the same workload interrupted by analytics
+/// scans, and a looping batch job are replayed instead.
+
+
+/// The number of cache misses between eviction cycles while replaying a trace.
+static const NSUInteger VDSHitRatioEvictionPeriod = 64;
+
+/// The preferred max object count of the cache used to replay each trace.
+static const NSInteger VDSHitRatioCacheSize = 5000;
+
+
+@interface VDSDatabaseCacheHitRatioTests : XCTestCase
+
+@end
+
+@implementation VDSDatabaseCacheHitRatioTests
+
+
+
+#pragma mark - Traces
+
+/// A trace of keys drawn from a Zipf distribution, so that a few entities receive most of the reads.
+///
+/// @param length The number of keys in the trace.
+///
+/// @param keyCount The number of distinct keys that may be drawn.
+///
+/// @param scanLength The number of never repeated keys read by a scan. 0 for no scans.
+///
+/// @param scanPeriod The number of skewed reads between scans.
+///
+- (NSArray*)zipfTraceWithLength:(NSUInteger)length
+                       keyCount:(NSUInteger)keyCount
+                     scanLength:(NSUInteger)scanLength
+                     scanPeriod:(NSUInteger)scanPeriod
+{
+    double* distribution = (double*)malloc(sizeof(double) * keyCount);
+    double total = 0;
+    for (NSUInteger index = 0; index < keyCount; index++) {
+        total += 1.0 / pow((double)(index + 1), 0.9);
+        distribution[index] = total;
+    }
+
+    /// A fixed seed makes every run replay the same trace.
+    srand48(7);
+    NSMutableArray* trace = [NSMutableArray arrayWithCapacity:length];
+    NSUInteger scanKey = keyCount;
+    for (NSUInteger index = 0; index < length; index++) {
+        if (scanLength > 0 && index % scanPeriod == 0) {
+            for (NSUInteger scan = 0; scan < scanLength; scan++) { [trace addObject:@(scanKey++)]; }
+        }
+        double draw = drand48() * total;
+        NSUInteger low = 0, high = keyCount - 1;
+        while (low < high) {
+            NSUInteger middle = (low + high) / 2;
+            if (distribution[middle] < draw) { low = middle + 1; } else { high = middle; }
+        }
+        [trace addObject:@(low)];
+    }
+    free(distribution);
+    return trace;
+}
+
+
+/// A trace that reads the same sequence of keys repeatedly, as a batch job does.
+- (NSArray*)loopTraceWithLength:(NSUInteger)length keyCount:(NSUInteger)keyCount
+{
+    NSMutableArray* trace = [NSMutableArray arrayWithCapacity:length];
+    for (NSUInteger index = 0; index < length; index++) { [trace addObject:@(index % keyCount)]; }
+    return trace;
+}
+
+
+/// The recorded traces in VDS_CACHE_TRACE_DIRECTORY, or the synthetic traces, by name.
+- (NSDictionary<NSString*, NSArray*>*)traces
+{
+    NSString* directory = NSProcessInfo.processInfo.environment[@"VDS_CACHE_TRACE_DIRECTORY"];
+    if (directory == nil) {
+        return @{@"zipf": [self zipfTraceWithLength:1000000 keyCount:100000 scanLength:0 scanPeriod:0],
+                 @"zipf+scans": [self zipfTraceWithLength:1000000 keyCount:100000 scanLength:20000 scanPeriod:50000],
+                 @"loop": [self loopTraceWithLength:1000000 keyCount:6000]};
+    }
+
+    NSMutableDictionary* traces = [NSMutableDictionary new];
+    for (NSString* name in [NSFileManager.defaultManager contentsOfDirectoryAtPath:directory error:NULL]) {
+        NSString* contents = [NSString stringWithContentsOfFile:[directory stringByAppendingPathComponent:name]
+                                                       encoding:NSUTF8StringEncoding
+                                                          error:NULL];
+        NSArray* lines = [contents componentsSeparatedByCharactersInSet:NSCharacterSet.newlineCharacterSet];
+        traces[name] = [lines filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"length > 0"]];
+    }
+    return traces;
+}
+
+
+
+#pragma mark - Replay
+
+/// Replays a trace, reading each key and storing it on a miss, and returns the fraction of reads that hit.
+- (double)hitRatioReplayingTrace:(NSArray*)trace usingPolicy:(VDSEvictionPolicy)policy
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.evictionInterval = 6000;
+    config.evictionPolicy = policy;
+    config.preferredMaxObjectCount = VDSHitRatioCacheSize;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+    NSDate* expires = [NSDate dateWithTimeIntervalSinceNow:3000];
+
+    NSUInteger hits = 0;
+    NSUInteger misses = 0;
+    for (id key in trace) {
+        if ([cache objectForKey:key] != nil) {
+            hits++;
+            continue;
+        }
+        [cache setObject:key forKey:key tracked:YES expires:expires];
+        if (++misses % VDSHitRatioEvictionPeriod == 0) { [cache processCacheEvictions]; }
+    }
+    return trace.count > 0 ? (double)hits / trace.count : 0;
+}
+
+
+- (void)testHitRatioByPolicy
+{
+    NSDictionary* policies = @{@"FIFO": @(VDSFIFOPolicy),
+                               @"LIFO": @(VDSLIFOPolicy),
+                               @"OAT": @(VDSOATPolicy),
+                               @"W-TinyLFU": @(VDSTinyLFUPolicy),
+                               @"2Q": @(VDS2QPolicy),
+                               @"CLOCK": @(VDSClockPolicy)};
+    NSDictionary* traces = [self traces];
+    for (NSString* traceName in [traces.allKeys sortedArrayUsingSelector:@selector(compare:)]) {
+        for (NSString* policyName in @[@"FIFO", @"LIFO", @"OAT", @"W-TinyLFU", @"2Q", @"CLOCK"]) {
+            double hitRatio = [self hitRatioReplayingTrace:traces[traceName]
+                                               usingPolicy:[policies[policyName] unsignedIntegerValue]];
+            NSLog(@"Hit ratio for %@ trace using %@: %.4f", traceName, policyName, hitRatio);
+        }
+    }
+}
+
+
+@end
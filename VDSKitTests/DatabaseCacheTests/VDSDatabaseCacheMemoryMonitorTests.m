@@ -0,0 +1,259 @@
+//
+//  VDSDatabaseCacheMemoryMonitorTests.m
+//  VDSKitTests
+//
+//  Created by Erikheath Thomas on 6/15/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "../../VDSKit/VDSKit.h"
+
+
+/// A cache that runs a block each time it sheds for memory pressure.
+@interface VDSSheddingTestCache : VDSDatabaseCache
+
+@property(copy, readwrite, nullable) void (^didShed)(void);
+
+@end
+
+
+@implementation VDSSheddingTestCache
+
+- (void)evictObjectsForMemoryPressure:(VDSMemoryPressureLevel)level
+{
+    [super evictObjectsForMemoryPressure:level];
+    if (self.didShed != nil) { self.didShed(); }
+}
+
+@end
+
+
+
+@interface VDSDatabaseCacheMemoryMonitorTests : XCTestCase
+
+@property(strong, readwrite) NSURL* directoryURL;
+
+@property(strong, readwrite) NSURL* pressureFileURL;
+
+@end
+
+
+@implementation VDSDatabaseCacheMemoryMonitorTests
+
+- (void)setUp
+{
+    self.directoryURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString]];
+    self.pressureFileURL = [self.directoryURL URLByAppendingPathComponent:@"pressure"];
+    [[NSFileManager defaultManager] createDirectoryAtURL:self.directoryURL withIntermediateDirectories:YES attributes:nil error:NULL];
+    [self writeUsage:@"0" limit:@"max"];
+    [self writeSomeStall:0 fullStall:0];
+}
+
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtURL:self.directoryURL error:NULL];
+}
+
+
+/// Simulates the cgroup memory.current and memory.max files.
+- (void)writeUsage:(NSString*)usage limit:(NSString*)limit
+{
+    [[usage stringByAppendingString:@"\n"] writeToURL:[self.directoryURL URLByAppendingPathComponent:@"memory.current"]
+                                           atomically:YES encoding:NSUTF8StringEncoding error:NULL];
+    [[limit stringByAppendingString:@"\n"] writeToURL:[self.directoryURL URLByAppendingPathComponent:@"memory.max"]
+                                           atomically:YES encoding:NSUTF8StringEncoding error:NULL];
+}
+
+
+/// Simulates the pressure stall information file for memory.
+- (void)writeSomeStall:(double)some fullStall:(double)full
+{
+    NSString* contents = [NSString stringWithFormat:@"some avg10=%.2f avg60=0.00 avg300=0.00 total=0\nfull avg10=%.2f avg60=0.00 avg300=0.00 total=0\n", some, full];
+    [contents writeToURL:self.pressureFileURL atomically:YES encoding:NSUTF8StringEncoding error:NULL];
+}
+
+
+- (VDSDatabaseCacheMemoryMonitor*)monitor
+{
+    return [[VDSDatabaseCacheMemoryMonitor alloc] initWithCgroupDirectoryURL:self.directoryURL
+                                                             pressureFileURL:self.pressureFileURL
+                                                                pollInterval:0];
+}
+
+
+- (VDSDatabaseCache*)cacheWithTrackedCount:(NSUInteger)count
+{
+    VDSMutableDatabaseCacheConfiguration* configuration = [VDSMutableDatabaseCacheConfiguration new];
+    configuration.expiresObjects = YES;
+    configuration.evictionInterval = 0;
+    configuration.evictionPolicy = VDSFIFOPolicy;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:configuration];
+    for (NSUInteger index = 0; index < count; index++) {
+        [cache setObject:@(index) forKey:@(index) tracked:YES expires:[NSDate dateWithTimeIntervalSinceNow:3000]];
+    }
+    [cache setObject:@"untracked" forKey:@"untracked"];
+    return cache;
+}
+
+
+- (void)testGradesCgroupUsage
+{
+    VDSDatabaseCacheMemoryMonitor* monitor = [self monitor];
+    XCTAssertEqual([monitor checkMemoryPressure], VDSMemoryPressureNormal);
+    [self writeUsage:@"790" limit:@"1000"];
+    XCTAssertEqual([monitor checkMemoryPressure], VDSMemoryPressureNormal);
+    [self writeUsage:@"800" limit:@"1000"];
+    XCTAssertEqual([monitor checkMemoryPressure], VDSMemoryPressureWarning);
+    [self writeUsage:@"900" limit:@"1000"];
+    XCTAssertEqual([monitor checkMemoryPressure], VDSMemoryPressureUrgent);
+    [self writeUsage:@"960" limit:@"1000"];
+    XCTAssertEqual([monitor checkMemoryPressure], VDSMemoryPressureCritical);
+    [self writeUsage:@"960" limit:@"max"];
+    XCTAssertEqual([monitor checkMemoryPressure], VDSMemoryPressureNormal);
+}
+
+
+- (void)testGradesPressureStalls
+{
+    VDSDatabaseCacheMemoryMonitor* monitor = [self monitor];
+    [self writeSomeStall:12.5 fullStall:0];
+    XCTAssertEqual([monitor checkMemoryPressure], VDSMemoryPressureWarning);
+    [self writeSomeStall:45 fullStall:2];
+    XCTAssertEqual([monitor checkMemoryPressure], VDSMemoryPressureUrgent);
+    [self writeSomeStall:45 fullStall:20];
+    XCTAssertEqual([monitor checkMemoryPressure], VDSMemoryPressureCritical);
+
+    /// The more severe of the sources is reported.
+    [self writeSomeStall:12.5 fullStall:0];
+    [self writeUsage:@"910" limit:@"1000"];
+    XCTAssertEqual([monitor checkMemoryPressure], VDSMemoryPressureUrgent);
+}
+
+
+- (void)testMissingSourcesReportNoPressure
+{
+    NSURL* missingURL = [self.directoryURL URLByAppendingPathComponent:@"missing"];
+    VDSDatabaseCacheMemoryMonitor* monitor = [[VDSDatabaseCacheMemoryMonitor alloc] initWithCgroupDirectoryURL:missingURL
+                                                                                               pressureFileURL:missingURL
+                                                                                                  pollInterval:0];
+    XCTAssertEqual([monitor checkMemoryPressure], VDSMemoryPressureNormal);
+}
+
+
+- (void)testResolvesCgroupDirectory
+{
+    NSURL* membershipURL = [self.directoryURL URLByAppendingPathComponent:@"cgroup"];
+    NSURL* hierarchyURL = [NSURL fileURLWithPath:@"/sys/fs/cgroup" isDirectory:YES];
+    [@"12:memory:/legacy\n0::/user.slice/app.scope\n" writeToURL:membershipURL atomically:YES encoding:NSUTF8StringEncoding error:NULL];
+    NSURL* directoryURL = [VDSDatabaseCacheMemoryMonitor cgroupDirectoryURLWithMembershipFileURL:membershipURL hierarchyURL:hierarchyURL];
+    XCTAssertEqualObjects(directoryURL.path, @"/sys/fs/cgroup/user.slice/app.scope");
+
+    /// A process without a cgroup v2 membership has no cgroup directory.
+    [@"12:memory:/legacy\n" writeToURL:membershipURL atomically:YES encoding:NSUTF8StringEncoding error:NULL];
+    XCTAssertNil([VDSDatabaseCacheMemoryMonitor cgroupDirectoryURLWithMembershipFileURL:membershipURL hierarchyURL:hierarchyURL]);
+    XCTAssertNil([VDSDatabaseCacheMemoryMonitor cgroupDirectoryURLWithMembershipFileURL:[self.directoryURL URLByAppendingPathComponent:@"missing"]
+                                                                          hierarchyURL:hierarchyURL]);
+}
+
+
+- (void)testRegisteredCachesShedAsPressureRises
+{
+    VDSDatabaseCacheMemoryMonitor* monitor = [self monitor];
+    VDSDatabaseCache* cache = [self cacheWithTrackedCount:100];
+    [monitor registerCache:cache];
+    XCTAssertEqual([monitor registeredCacheCount], 1);
+
+    [self writeUsage:@"850" limit:@"1000"];
+    XCTAssertEqual([monitor checkMemoryPressure], VDSMemoryPressureWarning);
+    XCTAssertEqual(cache.trackedKeys.count, 75);
+
+    /// FIFO sheds the oldest objects first.
+    XCTAssertNil([cache objectForKey:@0]);
+    XCTAssertEqualObjects([cache objectForKey:@99], @99);
+
+    /// A level that persists is not reported again.
+    XCTAssertEqual([monitor checkMemoryPressure], VDSMemoryPressureWarning);
+    XCTAssertEqual(cache.trackedKeys.count, 75);
+
+    [self writeUsage:@"920" limit:@"1000"];
+    XCTAssertEqual([monitor checkMemoryPressure], VDSMemoryPressureUrgent);
+    XCTAssertEqual(cache.trackedKeys.count, 38);
+
+    /// A level that falls and rises again is reported again.
+    [self writeUsage:@"100" limit:@"1000"];
+    XCTAssertEqual([monitor checkMemoryPressure], VDSMemoryPressureNormal);
+    [self writeSomeStall:0 fullStall:50];
+    XCTAssertEqual([monitor checkMemoryPressure], VDSMemoryPressureCritical);
+    XCTAssertEqual(cache.trackedKeys.count, 0);
+
+    /// Untracked objects are never shed.
+    XCTAssertEqualObjects([cache objectForKey:@"untracked"], @"untracked");
+    XCTAssertEqual([cache.metrics[VDSCacheLowMemoryEvictionCountKey] unsignedIntegerValue], 100);
+
+    [monitor unregisterCache:cache];
+    XCTAssertEqual([monitor registeredCacheCount], 0);
+}
+
+
+- (void)testObjectsInUseAreNotShed
+{
+    VDSMutableDatabaseCacheConfiguration* configuration = [VDSMutableDatabaseCacheConfiguration new];
+    configuration.expiresObjects = YES;
+    configuration.tracksObjectUsage = YES;
+    configuration.evictionInterval = 0;
+    configuration.shardCount = 4;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:configuration];
+    for (NSUInteger index = 0; index < 20; index++) {
+        [cache setObject:@(index) forKey:@(index) tracked:YES expires:[NSDate dateWithTimeIntervalSinceNow:3000]];
+    }
+    XCTAssertTrue([cache incrementUsageCount:@3]);
+
+    [cache evictObjectsForMemoryPressure:VDSMemoryPressureNormal];
+    XCTAssertEqual(cache.trackedKeys.count, 20);
+    [cache evictObjectsForMemoryPressure:VDSMemoryPressureCritical];
+    XCTAssertEqualObjects(cache.trackedKeys, @[@3]);
+}
+
+
+- (void)testCachesThatEvictOnLowMemoryRegister
+{
+    VDSMutableDatabaseCacheConfiguration* configuration = [VDSMutableDatabaseCacheConfiguration new];
+    configuration.evictsOnLowMemory = YES;
+    NSUInteger count = [VDSDatabaseCacheMemoryMonitor.sharedMonitor registeredCacheCount];
+    @autoreleasepool {
+        VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:configuration];
+        XCTAssertNotNil(cache);
+        XCTAssertEqual([VDSDatabaseCacheMemoryMonitor.sharedMonitor registeredCacheCount], count + 1);
+    }
+
+    /// A deallocated cache is no longer registered.
+    XCTAssertEqual([VDSDatabaseCacheMemoryMonitor.sharedMonitor registeredCacheCount], count);
+}
+
+
+- (void)testCacheReleasedWhileSheddingIsDeallocated
+{
+    VDSDatabaseCacheMemoryMonitor* monitor = [self monitor];
+    VDSMutableDatabaseCacheConfiguration* configuration = [VDSMutableDatabaseCacheConfiguration new];
+    configuration.evictsOnLowMemory = YES;
+    __block VDSSheddingTestCache* cache = nil;
+    __weak VDSSheddingTestCache* weakCache = nil;
+    @autoreleasepool {
+        cache = [[VDSSheddingTestCache alloc] initWithConfiguration:configuration];
+        weakCache = cache;
+        [monitor registerCache:cache];
+        cache.didShed = ^{ cache = nil; };
+    }
+
+    /// The monitor holds the last reference while the cache sheds, so the cache is deallocated on
+    /// the monitor's queue, which must not wait on that queue.
+    [self writeUsage:@"850" limit:@"1000"];
+    XCTAssertEqual([monitor checkMemoryPressure], VDSMemoryPressureWarning);
+    XCTAssertNil(weakCache);
+    XCTAssertEqual([monitor registeredCacheCount], 0);
+}
+
+
+@end
@@ -0,0 +1,655 @@
+//
+//  VDSDatabaseCachePerformanceTests.m
+//  VDSKitTests
+//
+//  Created by Erikheath Thomas on 6/2/20.
+//  Copyright © 2020 Erikheath Thomas. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "../../VDSKit/VDSKit.h"
+
+
+/// Benchmarks for VDSDatabaseCache. Each cache benchmark is paired with an NSMutableDictionary
+/// baseline performing the same work so that the cost of tracking can be compared directly.
+
+
+@interface VDSDatabaseCachePerformanceTests : XCTestCase
+
+@end
+
+@implementation VDSDatabaseCachePerformanceTests
+
+
+
+#pragma mark - Fixtures
+
+- (NSArray*)keysWithCount:(NSUInteger)count
+{
+    NSMutableArray* keys = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger index = 0; index < count; index++) {
+        [keys addObject:[NSString stringWithFormat:@"entity-%lu", (unsigned long)index]];
+    }
+    return keys;
+}
+
+
+- (VDSDatabaseCache*)trackingCache
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.tracksObjectUsage = YES;
+    config.evictionPolicy = VDSOATPolicy;
+    config.evictionInterval = 6000;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+    cache.defaultExpirationInterval = 3000;
+    return cache;
+}
+
+
+- (VDSDatabaseCache*)readCacheUsingLockFreeReads:(BOOL)usesLockFreeReads
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.evictionPolicy = VDSOATPolicy;
+    config.evictionInterval = 6000;
+    config.shardCount = 16;
+    config.usesLockFreeReads = usesLockFreeReads;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+    cache.defaultExpirationInterval = 3000;
+    return cache;
+}
+
+
+/// A timing key expression that reads the length of each key, and a timing map with an entry for
+/// every key length that exercises each of the compiled expression shapes.
+- (NSExpression*)timingMapKey
+{
+    return [NSExpression expressionWithFormat:@"length"];
+}
+
+
+- (NSDictionary<id, NSExpression*>*)timingMap
+{
+    NSMutableDictionary* timingMap = [NSMutableDictionary new];
+    for (NSUInteger length = 0; length < 32; length++) {
+        switch (length % 3) {
+            case 0: timingMap[@(length)] = [NSExpression expressionWithFormat:@"FUNCTION(now(), 'dateByAddingTimeInterval:', 3000)"]; break;
+            case 1: timingMap[@(length)] = [NSExpression expressionForConstantValue:@3000]; break;
+            default: timingMap[@(length)] = [NSExpression expressionWithFormat:@"FUNCTION(now(), 'dateByAddingTimeInterval:', $VDSEntrySnapshotKey.length * 100)"]; break;
+        }
+    }
+    return timingMap;
+}
+
+
+- (VDSDatabaseCache*)timingMapCache
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.evictionPolicy = VDSOATPolicy;
+    config.evictionInterval = 6000;
+    config.expirationTimingMapKey = [self timingMapKey];
+    config.expirationTimingMap = [self timingMap];
+    return [[VDSDatabaseCache alloc] initWithConfiguration:config];
+}
+
+
+/// A cache whose objects take their expiration from an interval table entry for their class, which
+/// stands in for the timing map of timingMapCache.
+- (VDSDatabaseCache*)intervalTableCache
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.evictionPolicy = VDSOATPolicy;
+    config.evictionInterval = 6000;
+    NSMutableDictionary* intervals = [NSMutableDictionary dictionaryWithObject:@3000 forKey:@"NSString"];
+    for (NSUInteger index = 0; index < 32; index++) {
+        intervals[[NSString stringWithFormat:@"Entity%lu", (unsigned long)index]] = @(index * 100);
+    }
+    config.expirationIntervals = intervals;
+    return [[VDSDatabaseCache alloc] initWithConfiguration:config];
+}
+
+
+/// A cache that holds up to maxObjectCount objects, evicting them in OAT order in slices of
+/// batchSize objects, or in a single pass when batchSize is 0.
+- (VDSDatabaseCache*)evictionCacheWithMaxObjectCount:(NSInteger)maxObjectCount batchSize:(NSUInteger)batchSize
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.evictionPolicy = VDSOATPolicy;
+    config.evictionInterval = 6000;
+    config.preferredMaxObjectCount = maxObjectCount;
+    config.evictionBatchSize = batchSize;
+    return [[VDSDatabaseCache alloc] initWithConfiguration:config];
+}
+
+
+- (VDSDatabaseCache*)sweepCacheWithMaxObjectCount:(NSInteger)maxObjectCount threadCount:(NSUInteger)threadCount
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.evictionPolicy = VDSOATPolicy;
+    config.evictionInterval = 6000;
+    config.preferredMaxObjectCount = maxObjectCount;
+    config.shardCount = 16;
+    config.evictionConcurrency = threadCount;
+    return [[VDSDatabaseCache alloc] initWithConfiguration:config];
+}
+
+
+/// A sharded cache with lock free reads that tracks object usage, evicting with policy.
+- (VDSDatabaseCache*)accessCacheUsingPolicy:(VDSEvictionPolicy)policy
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.tracksObjectUsage = YES;
+    config.evictionPolicy = policy;
+    config.evictionInterval = 6000;
+    config.shardCount = 16;
+    config.usesLockFreeReads = YES;
+    return [[VDSDatabaseCache alloc] initWithConfiguration:config];
+}
+
+
+- (void)fillCache:(VDSDatabaseCache*)cache withKeys:(NSArray*)keys
+{
+    NSDate* expiration = [NSDate dateWithTimeIntervalSinceNow:3000];
+    for (id key in keys) {
+        [cache setObject:key forKey:key tracked:YES expires:expiration];
+    }
+}
+
+
+
+#pragma mark - Measurements
+
+- (void)measureInsertWithCount:(NSUInteger)count
+{
+    NSArray* keys = [self keysWithCount:count];
+    [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+        VDSDatabaseCache* cache = [self trackingCache];
+        [self startMeasuring];
+        [self fillCache:cache withKeys:keys];
+        [self stopMeasuring];
+    }];
+}
+
+
+- (void)measureBatchInsertWithCount:(NSUInteger)count
+{
+    NSArray* keys = [self keysWithCount:count];
+    NSDate* expiration = [NSDate dateWithTimeIntervalSinceNow:3000];
+    [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+        VDSDatabaseCache* cache = [self trackingCache];
+        [self startMeasuring];
+        [cache setObjects:keys forKeys:keys tracked:YES expires:expiration];
+        [self stopMeasuring];
+    }];
+}
+
+
+- (void)measureBatchLookupWithCount:(NSUInteger)count
+{
+    NSArray* keys = [self keysWithCount:count];
+    VDSDatabaseCache* cache = [self trackingCache];
+    [self fillCache:cache withKeys:keys];
+    [self measureBlock:^{
+        [cache objectsForKeys:keys notFoundMarker:[NSNull null]];
+    }];
+}
+
+
+- (void)measureLookupWithCount:(NSUInteger)count
+{
+    NSArray* keys = [self keysWithCount:count];
+    VDSDatabaseCache* cache = [self trackingCache];
+    [self fillCache:cache withKeys:keys];
+    [self measureBlock:^{
+        for (id key in keys) {
+            [cache objectForKey:key];
+        }
+    }];
+}
+
+
+- (void)measureRemoveWithCount:(NSUInteger)count
+{
+    NSArray* keys = [self keysWithCount:count];
+    [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+        VDSDatabaseCache* cache = [self trackingCache];
+        [self fillCache:cache withKeys:keys];
+        [self startMeasuring];
+        for (id key in keys) {
+            [cache removeObjectForKey:key];
+        }
+        [self stopMeasuring];
+    }];
+}
+
+
+- (void)measureTimingMapInsertWithCount:(NSUInteger)count
+{
+    NSArray* keys = [self keysWithCount:count];
+    [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+        VDSDatabaseCache* cache = [self timingMapCache];
+        [self startMeasuring];
+        for (id key in keys) {
+            [cache setObject:key forKey:key tracked:YES];
+        }
+        [self stopMeasuring];
+    }];
+}
+
+
+/// Resolves each expiration from the interval table, for comparison with measureTimingMapInsertWithCount:.
+- (void)measureIntervalTableInsertWithCount:(NSUInteger)count
+{
+    NSArray* keys = [self keysWithCount:count];
+    [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+        VDSDatabaseCache* cache = [self intervalTableCache];
+        [self startMeasuring];
+        for (id key in keys) {
+            [cache setObject:key forKey:key tracked:YES];
+        }
+        [self stopMeasuring];
+    }];
+}
+
+
+/// Interprets the timing map for each key the way the cache did before the map was compiled, with
+/// two fresh contexts per key, as a baseline for measureTimingMapInsertWithCount:.
+- (void)measureInterpretedTimingMapWithCount:(NSUInteger)count
+{
+    NSArray* keys = [self keysWithCount:count];
+    NSExpression* timingMapKey = [self timingMapKey];
+    NSDictionary* timingMap = [self timingMap];
+    [self measureBlock:^{
+        for (id key in keys) {
+            id timingKey = [timingMapKey expressionValueWithObject:key
+                                                           context:[NSMutableDictionary dictionaryWithObject:key forKey:VDSEntrySnapshotKey]];
+            [timingMap[timingKey] expressionValueWithObject:key
+                                                    context:[NSMutableDictionary dictionaryWithObject:key forKey:VDSEntrySnapshotKey]];
+        }
+    }];
+}
+
+
+- (void)measureDictionaryInsertWithCount:(NSUInteger)count
+{
+    NSArray* keys = [self keysWithCount:count];
+    [self measureBlock:^{
+        NSMutableDictionary* dictionary = [NSMutableDictionary new];
+        for (id key in keys) {
+            [dictionary setObject:key forKey:key];
+        }
+    }];
+}
+
+
+- (void)measureDictionaryLookupWithCount:(NSUInteger)count
+{
+    NSArray* keys = [self keysWithCount:count];
+    NSDictionary* dictionary = [NSDictionary dictionaryWithObjects:keys forKeys:keys];
+    [self measureBlock:^{
+        for (id key in keys) {
+            [dictionary objectForKey:key];
+        }
+    }];
+}
+
+
+- (void)measureDictionaryRemoveWithCount:(NSUInteger)count
+{
+    NSArray* keys = [self keysWithCount:count];
+    [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+        NSMutableDictionary* dictionary = [NSMutableDictionary dictionaryWithObjects:keys forKeys:keys];
+        [self startMeasuring];
+        for (id key in keys) {
+            [dictionary removeObjectForKey:key];
+        }
+        [self stopMeasuring];
+    }];
+}
+
+
+
+/// Each reader thread performs the same number of lookups, so with perfect scaling the measured
+/// time stays flat as threads are added. The lookup rate is threadCount * 200K / measured time.
+- (void)measureReadScalingWithThreadCount:(NSUInteger)threadCount usingLockFreeReads:(BOOL)usesLockFreeReads
+{
+    NSArray* keys = [self keysWithCount:100000];
+    VDSDatabaseCache* cache = [self readCacheUsingLockFreeReads:usesLockFreeReads];
+    [self fillCache:cache withKeys:keys];
+    NSUInteger lookupsPerThread = 200000;
+    [self measureBlock:^{
+        /// Dedicated threads are used rather than a dispatch queue, which would limit the
+        /// number of concurrent readers to the number of cores.
+        dispatch_group_t group = dispatch_group_create();
+        for (NSUInteger thread = 0; thread < threadCount; thread++) {
+            dispatch_group_enter(group);
+            NSThread* reader = [[NSThread alloc] initWithBlock:^{
+                NSUInteger count = keys.count;
+                NSUInteger offset = thread * 7919;
+                for (NSUInteger lookup = 0; lookup < lookupsPerThread; lookup++) {
+                    [cache objectForKey:keys[(offset + lookup) % count]];
+                }
+                dispatch_group_leave(group);
+            }];
+            [reader start];
+        }
+        dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    }];
+}
+
+
+static int compare_latencies (const void* first, const void* second)
+{
+    uint64_t firstLatency = *(const uint64_t*)first, secondLatency = *(const uint64_t*)second;
+    return firstLatency < secondLatency ? -1 : firstLatency > secondLatency ? 1 : 0;
+}
+
+
+/// Runs an eviction cycle that evicts half of a cache of count objects while a reader thread looks
+/// up the objects that remain, and logs the p50, p99, and p999 latency of the lookups made during
+/// the cycle. The measured time is the duration of the cycle. With a bounded batch size, the
+/// percentiles stay flat as count grows, while in a single pass the tail latency grows with the
+/// number of objects evicted.
+- (void)measureEvictionReaderLatencyWithCount:(NSUInteger)count batchSize:(NSUInteger)batchSize
+{
+    NSArray* keys = [self keysWithCount:count];
+    NSUInteger capacity = 1 << 22;
+    uint64_t* latencies = malloc(capacity * sizeof(uint64_t));
+    [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+        VDSDatabaseCache* cache = [self evictionCacheWithMaxObjectCount:count / 2 batchSize:batchSize];
+        [self fillCache:cache withKeys:keys];
+
+        /// The cycle evicts the older half of the keys, so the reader looks up the newer half.
+        __block NSUInteger sampleCount = 0;
+        dispatch_semaphore_t started = dispatch_semaphore_create(0);
+        dispatch_semaphore_t finished = dispatch_semaphore_create(0);
+        NSThread* reader = [[NSThread alloc] initWithBlock:^{
+            NSUInteger half = count / 2;
+            dispatch_semaphore_signal(started);
+            for (NSUInteger lookup = 0; NSThread.currentThread.isCancelled == NO && sampleCount < capacity; lookup++) {
+                uint64_t begin = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+                [cache objectForKey:keys[half + lookup % half]];
+                latencies[sampleCount++] = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - begin;
+            }
+            dispatch_semaphore_signal(finished);
+        }];
+        [reader start];
+        dispatch_semaphore_wait(started, DISPATCH_TIME_FOREVER);
+
+        [self startMeasuring];
+        [cache processCacheEvictions];
+        [self stopMeasuring];
+        [reader cancel];
+        dispatch_semaphore_wait(finished, DISPATCH_TIME_FOREVER);
+
+        if (sampleCount == 0) { return; }
+        qsort(latencies, sampleCount, sizeof(uint64_t), compare_latencies);
+        NSLog(@"Eviction of %lu objects with batch size %lu: reader p50 %llu ns, p99 %llu ns, p999 %llu ns over %lu lookups",
+              (unsigned long)(count / 2), (unsigned long)batchSize,
+              latencies[sampleCount / 2], latencies[sampleCount * 99 / 100], latencies[sampleCount * 999 / 1000],
+              (unsigned long)sampleCount);
+    }];
+    free(latencies);
+}
+
+
+/// Measures the wall time of an eviction cycle over a sharded cache, processed by threadCount threads.
+/// A quarter of the objects have expired, and the cycle evicts half of the remainder to meet the
+/// preferred max object count.
+- (void)measureEvictionSweepWithCount:(NSUInteger)count threadCount:(NSUInteger)threadCount
+{
+    NSArray* keys = [self keysWithCount:count];
+    NSArray* expiredKeys = [keys subarrayWithRange:NSMakeRange(0, count / 4)];
+    NSArray* liveKeys = [keys subarrayWithRange:NSMakeRange(count / 4, count - count / 4)];
+    [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+        VDSDatabaseCache* cache = [self sweepCacheWithMaxObjectCount:liveKeys.count / 2 threadCount:threadCount];
+        [cache setObjects:expiredKeys forKeys:expiredKeys tracked:YES expires:[NSDate distantPast]];
+        [self fillCache:cache withKeys:liveKeys];
+        [self startMeasuring];
+        [cache processCacheEvictions];
+        [self stopMeasuring];
+    }];
+}
+
+
+/// Each thread performs the same mix of accesses: every lookup is followed, for one key in four, by
+/// an incrementUsageCount: and decrementUsageCount: pair. Under OAT each increment splices the key to
+/// the head of the recency order, while CLOCK only sets its reference bit, so the difference between
+/// the policies is the cost of keeping the order exact on every access.
+- (void)measureMixedAccessWithPolicy:(VDSEvictionPolicy)policy threadCount:(NSUInteger)threadCount
+{
+    NSArray* keys = [self keysWithCount:100000];
+    VDSDatabaseCache* cache = [self accessCacheUsingPolicy:policy];
+    [self fillCache:cache withKeys:keys];
+    NSUInteger accessesPerThread = 200000;
+    [self measureBlock:^{
+        dispatch_group_t group = dispatch_group_create();
+        for (NSUInteger thread = 0; thread < threadCount; thread++) {
+            dispatch_group_enter(group);
+            NSThread* accessor = [[NSThread alloc] initWithBlock:^{
+                NSUInteger count = keys.count;
+                NSUInteger offset = thread * 7919;
+                for (NSUInteger access = 0; access < accessesPerThread; access++) {
+                    id key = keys[(offset + access) % count];
+                    [cache objectForKey:key];
+                    if ((access & 3) == 0) {
+                        [cache incrementUsageCount:key];
+                        [cache decrementUsageCount:key];
+                    }
+                }
+                dispatch_group_leave(group);
+            }];
+            [accessor start];
+        }
+        dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    }];
+}
+
+
+- (NSURL*)snapshotURL
+{
+    return [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:@"VDSDatabaseCachePerformanceTests.snapshot"]];
+}
+
+
+- (void)measureSnapshotWriteWithCount:(NSUInteger)count
+{
+    NSArray* keys = [self keysWithCount:count];
+    VDSDatabaseCache* cache = [self trackingCache];
+    [self fillCache:cache withKeys:keys];
+    [self measureBlock:^{
+        [cache writeSnapshotToURL:[self snapshotURL] serializer:nil error:NULL];
+    }];
+    [[NSFileManager defaultManager] removeItemAtURL:[self snapshotURL] error:NULL];
+}
+
+
+- (void)measureSnapshotLoadWithCount:(NSUInteger)count
+{
+    NSArray* keys = [self keysWithCount:count];
+    VDSDatabaseCache* cache = [self trackingCache];
+    [self fillCache:cache withKeys:keys];
+    [cache writeSnapshotToURL:[self snapshotURL] serializer:nil error:NULL];
+    [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+        VDSDatabaseCache* restored = [self trackingCache];
+        [self startMeasuring];
+        [restored loadSnapshotFromURL:[self snapshotURL] serializer:nil error:NULL];
+        [self stopMeasuring];
+    }];
+    [[NSFileManager defaultManager] removeItemAtURL:[self snapshotURL] error:NULL];
+}
+
+
+/// Archives the tracked objects and keys with NSKeyedArchiver and writes them to a file, as a
+/// baseline for measureSnapshotWriteWithCount:.
+- (void)measureKeyedArchiverWriteWithCount:(NSUInteger)count
+{
+    NSArray* keys = [self keysWithCount:count];
+    VDSDatabaseCache* cache = [self trackingCache];
+    [self fillCache:cache withKeys:keys];
+    [self measureBlock:^{
+        NSData* archive = [NSKeyedArchiver archivedDataWithRootObject:[cache trackedObjectsAndKeys] requiringSecureCoding:NO error:NULL];
+        [archive writeToURL:[self snapshotURL] atomically:YES];
+    }];
+    [[NSFileManager defaultManager] removeItemAtURL:[self snapshotURL] error:NULL];
+}
+
+
+/// Reads and unarchives the file written by measureKeyedArchiverWriteWithCount: and stores its
+/// contents with a batch insert, as a baseline for measureSnapshotLoadWithCount:.
+- (void)measureKeyedArchiverLoadWithCount:(NSUInteger)count
+{
+    NSArray* keys = [self keysWithCount:count];
+    VDSDatabaseCache* cache = [self trackingCache];
+    [self fillCache:cache withKeys:keys];
+    NSData* archive = [NSKeyedArchiver archivedDataWithRootObject:[cache trackedObjectsAndKeys] requiringSecureCoding:NO error:NULL];
+    [archive writeToURL:[self snapshotURL] atomically:YES];
+    [self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^{
+        VDSDatabaseCache* restored = [self trackingCache];
+        [self startMeasuring];
+        NSData* data = [NSData dataWithContentsOfURL:[self snapshotURL]];
+        NSKeyedUnarchiver* unarchiver = [[NSKeyedUnarchiver alloc] initForReadingFromData:data error:NULL];
+        unarchiver.requiresSecureCoding = NO;
+        NSDictionary* objectsAndKeys = [unarchiver decodeObjectForKey:NSKeyedArchiveRootObjectKey];
+        [restored setObjects:objectsAndKeys.allValues forKeys:objectsAndKeys.allKeys tracked:YES expires:nil];
+        [self stopMeasuring];
+    }];
+    [[NSFileManager defaultManager] removeItemAtURL:[self snapshotURL] error:NULL];
+}
+
+
+
+#pragma mark - Insert
+
+- (void)testInsertPerformance10K { [self measureInsertWithCount:10000]; }
+- (void)testInsertPerformance100K { [self measureInsertWithCount:100000]; }
+- (void)testInsertPerformance1M { [self measureInsertWithCount:1000000]; }
+
+- (void)testDictionaryInsertPerformance10K { [self measureDictionaryInsertWithCount:10000]; }
+- (void)testDictionaryInsertPerformance100K { [self measureDictionaryInsertWithCount:100000]; }
+- (void)testDictionaryInsertPerformance1M { [self measureDictionaryInsertWithCount:1000000]; }
+
+- (void)testBatchInsertPerformance10K { [self measureBatchInsertWithCount:10000]; }
+- (void)testBatchInsertPerformance100K { [self measureBatchInsertWithCount:100000]; }
+- (void)testBatchInsertPerformance1M { [self measureBatchInsertWithCount:1000000]; }
+
+
+- (void)testTimingMapInsertPerformance10K { [self measureTimingMapInsertWithCount:10000]; }
+- (void)testTimingMapInsertPerformance100K { [self measureTimingMapInsertWithCount:100000]; }
+
+- (void)testIntervalTableInsertPerformance10K { [self measureIntervalTableInsertWithCount:10000]; }
+- (void)testIntervalTableInsertPerformance100K { [self measureIntervalTableInsertWithCount:100000]; }
+
+- (void)testInterpretedTimingMapPerformance10K { [self measureInterpretedTimingMapWithCount:10000]; }
+- (void)testInterpretedTimingMapPerformance100K { [self measureInterpretedTimingMapWithCount:100000]; }
+
+
+
+#pragma mark - Lookup
+
+- (void)testLookupPerformance10K { [self measureLookupWithCount:10000]; }
+- (void)testLookupPerformance100K { [self measureLookupWithCount:100000]; }
+- (void)testLookupPerformance1M { [self measureLookupWithCount:1000000]; }
+
+- (void)testDictionaryLookupPerformance10K { [self measureDictionaryLookupWithCount:10000]; }
+- (void)testDictionaryLookupPerformance100K { [self measureDictionaryLookupWithCount:100000]; }
+- (void)testDictionaryLookupPerformance1M { [self measureDictionaryLookupWithCount:1000000]; }
+
+- (void)testBatchLookupPerformance10K { [self measureBatchLookupWithCount:10000]; }
+- (void)testBatchLookupPerformance100K { [self measureBatchLookupWithCount:100000]; }
+- (void)testBatchLookupPerformance1M { [self measureBatchLookupWithCount:1000000]; }
+
+
+
+#pragma mark - Remove
+
+- (void)testRemovePerformance10K { [self measureRemoveWithCount:10000]; }
+- (void)testRemovePerformance100K { [self measureRemoveWithCount:100000]; }
+- (void)testRemovePerformance1M { [self measureRemoveWithCount:1000000]; }
+
+- (void)testDictionaryRemovePerformance10K { [self measureDictionaryRemoveWithCount:10000]; }
+- (void)testDictionaryRemovePerformance100K { [self measureDictionaryRemoveWithCount:100000]; }
+- (void)testDictionaryRemovePerformance1M { [self measureDictionaryRemoveWithCount:1000000]; }
+
+
+
+#pragma mark - Read Scaling
+
+- (void)testLockedReadScaling1Thread { [self measureReadScalingWithThreadCount:1 usingLockFreeReads:NO]; }
+- (void)testLockedReadScaling2Threads { [self measureReadScalingWithThreadCount:2 usingLockFreeReads:NO]; }
+- (void)testLockedReadScaling4Threads { [self measureReadScalingWithThreadCount:4 usingLockFreeReads:NO]; }
+- (void)testLockedReadScaling8Threads { [self measureReadScalingWithThreadCount:8 usingLockFreeReads:NO]; }
+- (void)testLockedReadScaling16Threads { [self measureReadScalingWithThreadCount:16 usingLockFreeReads:NO]; }
+- (void)testLockedReadScaling32Threads { [self measureReadScalingWithThreadCount:32 usingLockFreeReads:NO]; }
+
+- (void)testLockFreeReadScaling1Thread { [self measureReadScalingWithThreadCount:1 usingLockFreeReads:YES]; }
+- (void)testLockFreeReadScaling2Threads { [self measureReadScalingWithThreadCount:2 usingLockFreeReads:YES]; }
+- (void)testLockFreeReadScaling4Threads { [self measureReadScalingWithThreadCount:4 usingLockFreeReads:YES]; }
+- (void)testLockFreeReadScaling8Threads { [self measureReadScalingWithThreadCount:8 usingLockFreeReads:YES]; }
+- (void)testLockFreeReadScaling16Threads { [self measureReadScalingWithThreadCount:16 usingLockFreeReads:YES]; }
+- (void)testLockFreeReadScaling32Threads { [self measureReadScalingWithThreadCount:32 usingLockFreeReads:YES]; }
+
+
+
+#pragma mark - Snapshot
+
+- (void)testSnapshotWritePerformance100K { [self measureSnapshotWriteWithCount:100000]; }
+- (void)testSnapshotWritePerformance1M { [self measureSnapshotWriteWithCount:1000000]; }
+
+- (void)testKeyedArchiverWritePerformance100K { [self measureKeyedArchiverWriteWithCount:100000]; }
+- (void)testKeyedArchiverWritePerformance1M { [self measureKeyedArchiverWriteWithCount:1000000]; }
+
+- (void)testSnapshotLoadPerformance100K { [self measureSnapshotLoadWithCount:100000]; }
+- (void)testSnapshotLoadPerformance1M { [self measureSnapshotLoadWithCount:1000000]; }
+
+- (void)testKeyedArchiverLoadPerformance100K { [self measureKeyedArchiverLoadWithCount:100000]; }
+- (void)testKeyedArchiverLoadPerformance1M { [self measureKeyedArchiverLoadWithCount:1000000]; }
+
+
+
+#pragma mark - Eviction Latency
+
+- (void)testEvictionReaderLatency100K { [self measureEvictionReaderLatencyWithCount:100000 batchSize:0]; }
+- (void)testEvictionReaderLatency1M { [self measureEvictionReaderLatencyWithCount:1000000 batchSize:0]; }
+
+- (void)testSlicedEvictionReaderLatency100K { [self measureEvictionReaderLatencyWithCount:100000 batchSize:1000]; }
+- (void)testSlicedEvictionReaderLatency1M { [self measureEvictionReaderLatencyWithCount:1000000 batchSize:1000]; }
+
+
+
+#pragma mark - Eviction Sweep
+
+- (void)testEvictionSweep100K1Thread { [self measureEvictionSweepWithCount:100000 threadCount:1]; }
+- (void)testEvictionSweep100K4Threads { [self measureEvictionSweepWithCount:100000 threadCount:4]; }
+- (void)testEvictionSweep100K16Threads { [self measureEvictionSweepWithCount:100000 threadCount:16]; }
+
+- (void)testEvictionSweep1M1Thread { [self measureEvictionSweepWithCount:1000000 threadCount:1]; }
+- (void)testEvictionSweep1M2Threads { [self measureEvictionSweepWithCount:1000000 threadCount:2]; }
+- (void)testEvictionSweep1M4Threads { [self measureEvictionSweepWithCount:1000000 threadCount:4]; }
+- (void)testEvictionSweep1M8Threads { [self measureEvictionSweepWithCount:1000000 threadCount:8]; }
+- (void)testEvictionSweep1M16Threads { [self measureEvictionSweepWithCount:1000000 threadCount:16]; }
+
+- (void)testEvictionSweep4M1Thread { [self measureEvictionSweepWithCount:4000000 threadCount:1]; }
+- (void)testEvictionSweep4M16Threads { [self measureEvictionSweepWithCount:4000000 threadCount:16]; }
+
+
+
+#pragma mark - Mixed Access
+
+- (void)testOATMixedAccess1Thread { [self measureMixedAccessWithPolicy:VDSOATPolicy threadCount:1]; }
+- (void)testOATMixedAccess4Threads { [self measureMixedAccessWithPolicy:VDSOATPolicy threadCount:4]; }
+- (void)testOATMixedAccess16Threads { [self measureMixedAccessWithPolicy:VDSOATPolicy threadCount:16]; }
+
+- (void)testClockMixedAccess1Thread { [self measureMixedAccessWithPolicy:VDSClockPolicy threadCount:1]; }
+- (void)testClockMixedAccess4Threads { [self measureMixedAccessWithPolicy:VDSClockPolicy threadCount:4]; }
+- (void)testClockMixedAccess16Threads { [self measureMixedAccessWithPolicy:VDSClockPolicy threadCount:16]; }
+
+
+
+@end
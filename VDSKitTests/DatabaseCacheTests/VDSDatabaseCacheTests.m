@@ -13,6 +13,175 @@
 /// TODO: Add test for set with expiry, process evictions, track usage
 
 
+/// A cached object that reports a fixed cost.
+@interface VDSCostedTestObject : NSObject <VDSCostableObject>
+
+@property(readonly) NSUInteger cacheCost;
+
+- (instancetype)initWithCost:(NSUInteger)cost;
+
+@end
+
+@implementation VDSCostedTestObject
+
+- (instancetype)initWithCost:(NSUInteger)cost
+{
+    self = [super init];
+    if (self != nil) { _cacheCost = cost; }
+    return self;
+}
+
+@end
+
+
+/// A cached object that merges updates by key, and reports which of its values changed.
+@interface VDSMergeableTestObject : NSObject <VDSMergeableObject>
+
+@property(strong, readwrite) NSString* name;
+
+@property(strong, readwrite) NSNumber* value;
+
+@property(readwrite) uint64_t changedMergeableKeyMask;
+
+@property(readwrite) NSUInteger mergedValueCount;
+
+@end
+
+@implementation VDSMergeableTestObject
+
+- (NSArray*)mergeableKeys { return @[@"name", @"value"]; }
+
+- (void)mergeValue:(id)value forKey:(NSString*)key
+{
+    [self setValue:value forKey:key];
+    self.mergedValueCount++;
+}
+
+@end
+
+
+/// A cached object that merges an update in a single call.
+@interface VDSBulkMergeableTestObject : VDSMergeableTestObject
+
+@end
+
+@implementation VDSBulkMergeableTestObject
+
+- (BOOL)mergeFromObject:(VDSMergeableTestObject*)object
+{
+    if ([self.name isEqualToString:object.name] && [self.value isEqualToNumber:object.value]) { return NO; }
+    self.name = object.name;
+    self.value = object.value;
+    return YES;
+}
+
+@end
+
+
+/// A cache delegate that records the eviction cycles it is notified of.
+@interface VDSEvictionCycleTestDelegate : NSObject <VDSDatabaseCacheDelegate>
+
+@property(strong, readonly) NSMutableArray<NSString*>* events;
+
+@property(strong, readwrite) NSDictionary<VDSCacheMetricKey, NSNumber*>* cycleMetrics;
+
+@end
+
+@implementation VDSEvictionCycleTestDelegate
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self != nil) { _events = [NSMutableArray new]; }
+    return self;
+}
+
+- (void)databaseCache:(VDSDatabaseCache*)cache willBeginEvictionCycle:(VDSEvictionCycleKey)cycleKey
+{
+    [_events addObject:[@"willBegin:" stringByAppendingString:cycleKey]];
+}
+
+- (void)databaseCache:(VDSDatabaseCache*)cache didCompleteEvictionCycle:(VDSEvictionCycleKey)cycleKey
+{
+    [_events addObject:[@"didComplete:" stringByAppendingString:cycleKey]];
+}
+
+- (void)databaseCache:(VDSDatabaseCache*)cache
+    didCompleteEvictionCycle:(VDSEvictionCycleKey)cycleKey
+                 withMetrics:(NSDictionary<VDSCacheMetricKey, NSNumber*>*)metrics
+{
+    self.cycleMetrics = metrics;
+}
+
+@end
+
+
+/// A cache delegate that keeps the objects for a set of keys and records the objects it is told of.
+@interface VDSEvictionFilterTestDelegate : NSObject <VDSDatabaseCacheDelegate>
+
+@property(strong, readwrite) NSSet* keptKeys;
+
+@property(assign, readwrite) BOOL declinesCycles;
+
+@property(strong, readwrite) NSArray* consultedKeys;
+
+@property(strong, readwrite) NSArray* willEvictKeys;
+
+@property(strong, readwrite) NSArray* didEvictKeys;
+
+@property(strong, readonly) dispatch_semaphore_t didEvict;
+
+/// Called with the cache while the delegate is consulted, before it decides.
+@property(copy, readwrite) void (^whileConsulted)(VDSDatabaseCache* cache);
+
+@end
+
+@implementation VDSEvictionFilterTestDelegate
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self != nil) { _didEvict = dispatch_semaphore_create(0); }
+    return self;
+}
+
+- (BOOL)databaseCacheShouldBeginEvictionCycle
+{
+    return self.declinesCycles == NO;
+}
+
+- (NSIndexSet*)databaseCache:(VDSDatabaseCache*)cache
+          shouldEvictObjects:(NSArray*)objects
+                   usingKeys:(NSArray*)cacheKeys
+             inEvictionCycle:(VDSEvictionCycleKey)cycleKey
+{
+    self.consultedKeys = cacheKeys;
+    if (self.whileConsulted != nil) { self.whileConsulted(cache); }
+    return [cacheKeys indexesOfObjectsPassingTest:^BOOL(id key, NSUInteger index, BOOL* stop) {
+        return [self.keptKeys containsObject:key] == NO;
+    }];
+}
+
+- (void)databaseCache:(VDSDatabaseCache*)cache
+     willEvictObjects:(NSArray*)objects
+            usingKeys:(NSArray*)cacheKeys
+      inEvictionCycle:(VDSEvictionCycleKey)cycleKey
+{
+    self.willEvictKeys = cacheKeys;
+}
+
+- (void)databaseCache:(VDSDatabaseCache*)cache
+      didEvictObjects:(NSArray*)objects
+            usingKeys:(NSArray*)cacheKeys
+      inEvictionCycle:(VDSEvictionCycleKey)cycleKey
+{
+    self.didEvictKeys = cacheKeys;
+    dispatch_semaphore_signal(self.didEvict);
+}
+
+@end
+
+
 @interface VDSDatabaseCacheTests : XCTestCase
 
 @end
@@ -168,9 +337,1236 @@
 
 - (void)testCustomInitWithUsageTracking
 {
-    
+
+}
+
+- (void)testTrackedObjectEviction
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.tracksObjectUsage = YES;
+    config.preferredMaxObjectCount = 2;
+    config.evictionPolicy = VDSFIFOPolicy;
+    config.evictionInterval = 6000;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+
+    NSDate* future = [NSDate dateWithTimeIntervalSinceNow:3000];
+    [cache setObject:@"object1" forKey:@"testKey1" tracked:YES expires:future];
+    [cache setObject:@"object2" forKey:@"testKey2" tracked:YES expires:future];
+    [cache setObject:@"object3" forKey:@"testKey3" tracked:YES expires:future];
+    [cache setObject:@"expired" forKey:@"expiredKey" tracked:YES expires:[NSDate distantPast]];
+    [cache setObject:@"untracked" forKey:@"untrackedKey"];
+
+    XCTAssertEqual([[cache trackedKeys] count], 4);
+    XCTAssertEqualObjects([cache untrackedKeys], @[@"untrackedKey"]);
+
+    /// An object in use is not evicted to satisfy the preferred max object count.
+    XCTAssertTrue([cache incrementUsageCount:@"testKey2"]);
+
+    [cache processCacheEvictions];
+
+    /// The expired object and the oldest unused object are evicted. Untracked objects are never evicted.
+    XCTAssertNil([cache objectForKey:@"expiredKey"]);
+    XCTAssertNil([cache objectForKey:@"testKey1"]);
+    XCTAssertEqualObjects([cache objectForKey:@"testKey2"], @"object2");
+    XCTAssertEqualObjects([cache objectForKey:@"testKey3"], @"object3");
+    XCTAssertEqualObjects([cache objectForKey:@"untrackedKey"], @"untracked");
+    XCTAssertEqual([[cache trackedKeys] count], 2);
+
+    /// Updating a tracked object without tracking removes it from the tracking system.
+    [cache setObject:@"object3" forKey:@"testKey3"];
+    XCTAssertEqualObjects([NSSet setWithArray:[cache trackedKeys]], [NSSet setWithObject:@"testKey2"]);
+    XCTAssertFalse([cache incrementUsageCount:@"testKey3"]);
+
+    NSMutableSet* enumeratedKeys = [NSMutableSet new];
+    for (id key in cache) { [enumeratedKeys addObject:key]; }
+    XCTAssertEqualObjects(enumeratedKeys, ([NSSet setWithArray:@[@"testKey2", @"testKey3", @"untrackedKey"]]));
+}
+
+- (void)testExpiredObjectsInUseAreRetained
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.tracksObjectUsage = YES;
+    config.evictionInterval = 6000;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+
+    [cache setObject:@"object1" forKey:@"testKey1" tracked:YES expires:[NSDate dateWithTimeIntervalSinceNow:-20]];
+    [cache setObject:@"object2" forKey:@"testKey2" tracked:YES expires:[NSDate dateWithTimeIntervalSinceNow:-10]];
+    [cache setObject:@"object3" forKey:@"testKey3" tracked:YES expires:[NSDate dateWithTimeIntervalSinceNow:3000]];
+    XCTAssertTrue([cache incrementUsageCount:@"testKey2"]);
+
+    [cache processCacheEvictions];
+
+    /// The unused expired object is removed, the expired object in use is retained.
+    XCTAssertNil([cache objectForKey:@"testKey1"]);
+    XCTAssertEqualObjects([cache objectForKey:@"testKey2"], @"object2");
+    XCTAssertEqualObjects([cache objectForKey:@"testKey3"], @"object3");
+
+    /// Once its last user releases it, the retained object is removed in the next cycle.
+    XCTAssertTrue([cache decrementUsageCount:@"testKey2"]);
+    [cache processCacheEvictions];
+    XCTAssertNil([cache objectForKey:@"testKey2"]);
+    XCTAssertEqualObjects([cache objectForKey:@"testKey3"], @"object3");
+
+    /// Rescheduling an object moves its expiration.
+    [cache setObject:@"object3" forKey:@"testKey3" tracked:YES expires:[NSDate distantPast]];
+    [cache processCacheEvictions];
+    XCTAssertNil([cache objectForKey:@"testKey3"]);
+}
+
+
+
+- (void)testShardedCache
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.preferredMaxObjectCount = 800;
+    config.evictionPolicy = VDSFIFOPolicy;
+    config.evictionInterval = 6000;
+    config.shardCount = 8;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+    XCTAssertEqual(cache.configuration.shardCount, 8);
+
+    NSDate* future = [NSDate dateWithTimeIntervalSinceNow:3000];
+    for (NSUInteger index = 0; index < 1000; index++) {
+        [cache setObject:@(index) forKey:@(index) tracked:YES expires:index < 100 ? [NSDate distantPast] : future];
+    }
+    [cache setObject:@"untracked" forKey:@"untrackedKey"];
+    XCTAssertEqual([[cache allKeys] count], 1001);
+    XCTAssertEqual([[cache trackedKeys] count], 1000);
+    XCTAssertEqualObjects([cache untrackedKeys], @[@"untrackedKey"]);
+
+    /// Readers of every shard proceed while the eviction cycle runs.
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_group_async(group, dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        [cache processCacheEvictions];
+    });
+    dispatch_apply(8, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t iteration) {
+        for (NSUInteger index = 100; index < 1000; index++) {
+            id object = [cache objectForKey:@(index)];
+            if (object != nil) { XCTAssertEqualObjects(object, @(index)); }
+        }
+    });
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+
+    /// Expired objects are removed from every shard and each shard meets its share of the preferred max object count.
+    for (NSUInteger index = 0; index < 100; index++) {
+        XCTAssertNil([cache objectForKey:@(index)]);
+    }
+    XCTAssertLessThanOrEqual([[cache trackedKeys] count], 800);
+    XCTAssertGreaterThan([[cache trackedKeys] count], 0);
+    XCTAssertEqualObjects([cache objectForKey:@"untrackedKey"], @"untracked");
+
+    /// Fast enumeration visits the keys of every shard exactly once.
+    NSMutableArray* enumeratedKeys = [NSMutableArray new];
+    for (id key in cache) { [enumeratedKeys addObject:key]; }
+    XCTAssertEqual(enumeratedKeys.count, [[cache allKeys] count]);
+    XCTAssertEqualObjects([NSSet setWithArray:enumeratedKeys], [NSSet setWithArray:[cache allKeys]]);
+
+    [cache removeObjectForKey:@"untrackedKey"];
+    XCTAssertNil([cache objectForKey:@"untrackedKey"]);
+    [cache removeAllObjects];
+    XCTAssertEqual([[cache allKeys] count], 0);
+}
+
+
+- (void)testParallelEvictionCycle
+{
+    /// A cycle processed by several threads evicts exactly what a cycle processed by one thread does.
+    NSMutableArray<VDSDatabaseCache*>* caches = [NSMutableArray new];
+    for (NSNumber* threadCount in @[@1, @4]) {
+        VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+        config.expiresObjects = YES;
+        config.evictionPolicy = VDSFIFOPolicy;
+        config.evictionInterval = 0;
+        config.preferredMaxObjectCount = 400;
+        config.shardCount = 8;
+        config.evictionConcurrency = threadCount.unsignedIntegerValue;
+        VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+        for (NSUInteger index = 0; index < 1000; index++) {
+            [cache setObject:@(index) forKey:@(index) tracked:YES expires:index % 5 == 0 ? [NSDate distantPast] : [NSDate distantFuture]];
+        }
+        [cache setObject:@"untracked" forKey:@"untrackedKey"];
+        [cache processCacheEvictions];
+        [caches addObject:cache];
+    }
+
+    VDSDatabaseCache* serial = caches[0];
+    VDSDatabaseCache* parallel = caches[1];
+    XCTAssertEqualObjects([NSSet setWithArray:[parallel trackedKeys]], [NSSet setWithArray:[serial trackedKeys]]);
+    XCTAssertLessThanOrEqual([parallel trackedKeys].count, 400);
+    XCTAssertEqualObjects([parallel objectForKey:@"untrackedKey"], @"untracked");
+    for (VDSCacheMetricKey key in @[VDSCacheExpiredEvictionCountKey, VDSCacheCountEvictionCountKey, VDSCacheCostEvictionCountKey]) {
+        XCTAssertEqualObjects([parallel metrics][key], [serial metrics][key]);
+    }
+    XCTAssertEqualObjects([parallel metrics][VDSCacheExpiredEvictionCountKey], @200);
+}
+
+
+- (void)testEnumerationDuringMutation
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.evictionInterval = 0;
+    config.shardCount = 4;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+    for (NSUInteger index = 0; index < 200; index++) {
+        [cache setObject:@(index) forKey:@(index) tracked:YES expires:index < 50 ? [NSDate distantPast] : [NSDate distantFuture]];
+    }
+    NSSet* keys = [NSSet setWithArray:[cache allKeys]];
+
+    /// The enumeration visits the keys as they were when it started, while the enumerating thread
+    /// and an eviction cycle on another thread change the cache.
+    dispatch_group_t group = dispatch_group_create();
+    NSMutableArray* enumeratedKeys = [NSMutableArray new];
+    for (id key in cache) {
+        if (enumeratedKeys.count == 0) {
+            dispatch_group_async(group, dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+                [cache processCacheEvictions];
+            });
+        }
+        [enumeratedKeys addObject:key];
+        [cache removeObjectForKey:key];
+        [cache setObject:@"added" forKey:[NSString stringWithFormat:@"added-%@", key]];
+    }
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    XCTAssertEqual(enumeratedKeys.count, 200);
+    XCTAssertEqualObjects([NSSet setWithArray:enumeratedKeys], keys);
+
+    /// Later enumerations see the changes.
+    NSUInteger count = 0;
+    for (id key in cache) {
+        XCTAssertTrue([key isKindOfClass:[NSString class]]);
+        count++;
+    }
+    XCTAssertEqual(count, 200);
 }
 
 
+- (void)testNestedEnumerationsSeeTheirOwnSnapshots
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+    for (NSUInteger index = 0; index < 3000; index++) {
+        [cache setObject:@(index) forKey:@(index)];
+    }
+    NSSet* keys = [NSSet setWithArray:[cache allKeys]];
+
+    /// Enough keys are removed and added to shrink and regrow the snapshot's trie by several levels
+    /// while the outer enumeration still holds the original snapshot.
+    NSMutableArray* outerKeys = [NSMutableArray new];
+    NSMutableSet* innerKeys = [NSMutableSet new];
+    for (id key in cache) {
+        if (outerKeys.count == 0) {
+            for (NSUInteger index = 0; index < 2990; index++) { [cache removeObjectForKey:@(index)]; }
+            for (NSUInteger index = 0; index < 1100; index++) {
+                [cache setObject:@"added" forKey:[NSString stringWithFormat:@"added-%lu", (unsigned long)index]];
+            }
+            for (id innerKey in cache) { [innerKeys addObject:innerKey]; }
+        }
+        [outerKeys addObject:key];
+    }
+    XCTAssertEqual(outerKeys.count, 3000);
+    XCTAssertEqualObjects([NSSet setWithArray:outerKeys], keys);
+    XCTAssertEqual(innerKeys.count, 1110);
+    XCTAssertEqualObjects(innerKeys, [NSSet setWithArray:[cache allKeys]]);
+
+    /// Emptying the cache one key at a time leaves nothing to enumerate.
+    for (id key in [cache allKeys]) { [cache removeObjectForKey:key]; }
+    for (id key in cache) { XCTFail(@"Enumerated %@ after the cache was emptied", key); }
+    [cache setObject:@"last" forKey:@"last"];
+    for (id key in cache) { XCTAssertEqualObjects(key, @"last"); }
+}
+
+
+- (void)testPartitionedEnumeration
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.evictionInterval = 0;
+    config.shardCount = 4;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+    cache.defaultExpirationInterval = 3000;
+    for (NSUInteger index = 0; index < 100; index++) {
+        [cache setObject:@(index) forKey:@(index) tracked:(index % 4 != 0)];
+    }
+
+    /// Objects move between partitions when they are stored again with a different tracking state.
+    [cache setObject:@1 forKey:@1 tracked:NO];
+    [cache setObject:@4 forKey:@4 tracked:YES];
+    [cache removeObjectForKey:@8];
+    [cache removeObjectForKey:@9];
+
+    NSMutableSet* untracked = [NSMutableSet new];
+    for (NSUInteger index = 0; index < 100; index += 4) { [untracked addObject:@(index)]; }
+    [untracked addObject:@1];
+    [untracked removeObject:@4];
+    [untracked removeObject:@8];
+    XCTAssertEqualObjects([NSSet setWithArray:[cache untrackedKeys]], untracked);
+    XCTAssertEqualObjects([NSSet setWithArray:[cache untrackedObjectsAndKeys].allKeys], untracked);
+    XCTAssertEqual([cache trackedKeys].count, 98 - untracked.count);
+
+    NSMutableSet* enumeratedUntracked = [NSMutableSet new];
+    [cache enumerateUntrackedKeysAndObjectsUsingBlock:^(id key, id object, BOOL* stop) {
+        XCTAssertEqualObjects(key, object);
+        [enumeratedUntracked addObject:key];
+    }];
+    XCTAssertEqualObjects(enumeratedUntracked, untracked);
+
+    NSMutableSet* enumeratedTracked = [NSMutableSet new];
+    [cache enumerateTrackedKeysAndObjectsUsingBlock:^(id key, id object, BOOL* stop) {
+        [enumeratedTracked addObject:key];
+    }];
+    XCTAssertEqualObjects(enumeratedTracked, [NSSet setWithArray:[cache trackedKeys]]);
+    XCTAssertFalse([enumeratedTracked intersectsSet:untracked]);
+
+    __block NSUInteger visits = 0;
+    [cache enumerateKeysAndObjectsUsingBlock:^(id key, id object, BOOL* stop) {
+        *stop = ++visits == 10;
+    }];
+    XCTAssertEqual(visits, 10);
+
+    /// Clearing the cache empties both partitions.
+    [cache removeAllObjects];
+    XCTAssertEqual([cache untrackedKeys].count, 0);
+    [cache setObject:@"value" forKey:@"untracked"];
+    XCTAssertEqualObjects([cache untrackedKeys], @[@"untracked"]);
+}
+
+
+- (void)testLockFreeReads
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.evictionInterval = 6000;
+    config.shardCount = 4;
+    config.usesLockFreeReads = YES;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+
+    for (NSUInteger index = 0; index < 1000; index++) {
+        [cache setObject:@(index) forKey:@(index) tracked:YES];
+    }
+    [cache setObject:@"untracked" forKey:@"untrackedKey"];
+    XCTAssertEqualObjects([cache objectForKey:@(10)], @10);
+    XCTAssertEqualObjects([cache objectForKey:@"untrackedKey"], @"untracked");
+    XCTAssertNil([cache objectForKey:@"missingKey"]);
+
+    /// Readers always observe either no object or the object most recently set for a key while
+    /// a writer replaces, removes, and adds objects, and the eviction cycle runs.
+    __block BOOL finished = NO;
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_group_async(group, dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        for (NSUInteger pass = 0; pass < 20; pass++) {
+            for (NSUInteger index = 0; index < 1000; index++) {
+                if (index % 3 == 0) {
+                    [cache removeObjectForKey:@(index)];
+                } else {
+                    [cache setObject:@(index) forKey:@(index) tracked:YES];
+                }
+            }
+            for (NSUInteger index = 0; index < 1000; index += 3) {
+                [cache setObject:@(index) forKey:@(index) tracked:YES];
+            }
+            [cache processCacheEvictions];
+        }
+        finished = YES;
+    });
+    __block NSUInteger mismatches = 0;
+    dispatch_apply(4, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t iteration) {
+        NSUInteger localMismatches = 0;
+        while (finished == NO) {
+            for (NSUInteger index = 0; index < 1000; index++) {
+                id object = [cache objectForKey:@(index)];
+                if (object != nil && [object isEqual:@(index)] == NO) { localMismatches++; }
+            }
+        }
+        @synchronized (group) { mismatches += localMismatches; }
+    });
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+
+    XCTAssertEqual(mismatches, 0);
+    for (NSUInteger index = 0; index < 1000; index++) {
+        XCTAssertEqualObjects([cache objectForKey:@(index)], @(index));
+    }
+    XCTAssertEqualObjects([cache objectForKey:@"untrackedKey"], @"untracked");
+
+    [cache removeAllObjects];
+    XCTAssertNil([cache objectForKey:@(10)]);
+}
+
+
+- (void)testBatchOperations
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.tracksObjectUsage = YES;
+    config.evictionInterval = 6000;
+    config.shardCount = 4;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+
+    NSMutableArray* keys = [NSMutableArray new];
+    NSMutableArray* objects = [NSMutableArray new];
+    for (NSUInteger index = 0; index < 5000; index++) {
+        [keys addObject:[NSString stringWithFormat:@"key-%lu", (unsigned long)index]];
+        [objects addObject:@(index)];
+    }
+    [cache setObjects:objects forKeys:keys tracked:YES expires:[NSDate dateWithTimeIntervalSinceNow:3000]];
+    XCTAssertEqual([[cache trackedKeys] count], 5000);
+    XCTAssertTrue([cache incrementUsageCount:@"key-10"]);
+
+    /// Lookups return objects in the order of the keys, with the marker for missing keys.
+    NSArray* found = [cache objectsForKeys:@[@"key-3", @"missing", @"key-4999", @"key-0"] notFoundMarker:[NSNull null]];
+    XCTAssertEqualObjects(found, (@[@3, [NSNull null], @4999, @0]));
+
+    /// A batch can update existing objects and expire them.
+    [cache setObjects:@[@"updated-0", @"updated-1"] forKeys:@[@"key-0", @"key-1"] tracked:YES expires:[NSDate distantPast]];
+    XCTAssertEqualObjects([cache objectForKey:@"key-0"], @"updated-0");
+    [cache processCacheEvictions];
+    XCTAssertNil([cache objectForKey:@"key-0"]);
+    XCTAssertNil([cache objectForKey:@"key-1"]);
+    XCTAssertEqual([[cache trackedKeys] count], 4998);
+
+    /// Untracked batches leave the tracking system.
+    [cache setObjects:@[@"untracked"] forKeys:@[@"key-2"] tracked:NO expires:nil];
+    XCTAssertEqualObjects([cache untrackedKeys], @[@"key-2"]);
+
+    [cache removeObjectsForKeys:[keys subarrayWithRange:NSMakeRange(0, 2500)]];
+    XCTAssertEqual([[cache allKeys] count], 2500);
+    XCTAssertNil([cache objectForKey:@"key-10"]);
+    XCTAssertEqualObjects([cache objectForKey:@"key-2500"], @2500);
+}
+
+
+- (void)testCostEviction
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.evictionInterval = 6000;
+    config.evictionPolicy = VDSFIFOPolicy;
+    config.preferredMaxTotalCost = 1000;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+    NSDate* expires = [NSDate dateWithTimeIntervalSinceNow:3000];
+
+    /// Costs are either passed explicitly or provided by the object.
+    [cache setObject:@"first" forKey:@1 tracked:YES expires:expires cost:400];
+    [cache setObject:[[VDSCostedTestObject alloc] initWithCost:300] forKey:@2 tracked:YES expires:expires];
+    [cache setObject:@"untracked" forKey:@3 tracked:NO expires:nil cost:5000];
+    XCTAssertEqual(cache.totalCost, 5700);
+
+    /// Replacing an object replaces its cost.
+    [cache setObject:@"second" forKey:@2 tracked:YES expires:expires cost:200];
+    XCTAssertEqual(cache.totalCost, 5600);
+
+    /// Untracked objects do not count toward the preferred max total cost.
+    [cache processCacheEvictions];
+    XCTAssertEqual([[cache allKeys] count], 3);
+
+    /// Exceeding the preferred max total cost evicts the oldest objects until the limit is met.
+    [cache setObject:@"third" forKey:@4 tracked:YES expires:expires cost:600];
+    [cache processCacheEvictions];
+    XCTAssertNil([cache objectForKey:@1]);
+    XCTAssertEqualObjects([cache objectForKey:@2], @"second");
+    XCTAssertEqualObjects([cache objectForKey:@4], @"third");
+    XCTAssertEqual(cache.totalCost, 5800);
+
+    [cache removeObjectForKey:@3];
+    XCTAssertEqual(cache.totalCost, 800);
+    [cache removeAllObjects];
+    XCTAssertEqual(cache.totalCost, 0);
+}
+
+
+/// Repeatedly reads a hot set of 20 keys, interleaved with reads of keys that are never read
+/// again, then scans 1000 new keys through a cache limited to 100 objects.
+///
+/// @returns The number of hot keys still in the cache after the scan.
+///
+- (NSUInteger)hotKeysRetainedAfterScanUsingPolicy:(VDSEvictionPolicy)policy
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.evictionInterval = 6000;
+    config.evictionPolicy = policy;
+    config.preferredMaxObjectCount = 100;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+    NSDate* expires = [NSDate dateWithTimeIntervalSinceNow:3000];
+
+    void (^read)(NSNumber*) = ^(NSNumber* key) {
+        if ([cache objectForKey:key] == nil) { [cache setObject:key forKey:key tracked:YES expires:expires]; }
+    };
+
+    NSUInteger scanKey = 1000;
+    for (NSUInteger round = 0; round < 10; round++) {
+        for (NSUInteger key = 0; key < 20; key++) { read(@(key)); }
+        for (NSUInteger index = 0; index < 40; index++) { read(@(scanKey++)); }
+        [cache processCacheEvictions];
+    }
+    for (NSUInteger index = 0; index < 1000; index++) {
+        read(@(scanKey++));
+        if (index % 50 == 49) { [cache processCacheEvictions]; }
+    }
+
+    NSUInteger retained = 0;
+    for (NSUInteger key = 0; key < 20; key++) {
+        if ([cache objectForKey:@(key)] != nil) { retained++; }
+    }
+    XCTAssertEqual([[cache trackedKeys] count], 100);
+    return retained;
+}
+
+
+- (void)testScanResistantPolicies
+{
+    XCTAssertEqual([self hotKeysRetainedAfterScanUsingPolicy:VDSOATPolicy], 0);
+    XCTAssertEqual([self hotKeysRetainedAfterScanUsingPolicy:VDSTinyLFUPolicy], 20);
+    XCTAssertEqual([self hotKeysRetainedAfterScanUsingPolicy:VDS2QPolicy], 20);
+}
+
+
+- (void)testClockPolicy
+{
+    for (NSNumber* usesLockFreeReads in @[@NO, @YES]) {
+        VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+        config.expiresObjects = YES;
+        config.tracksObjectUsage = YES;
+        config.evictionInterval = 0;
+        config.evictionPolicy = VDSClockPolicy;
+        config.preferredMaxObjectCount = 5;
+        config.usesLockFreeReads = usesLockFreeReads.boolValue;
+        VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+        NSDate* expires = [NSDate dateWithTimeIntervalSinceNow:3000];
+        for (NSUInteger index = 0; index < 10; index++) {
+            [cache setObject:@(index) forKey:@(index) tracked:YES expires:expires];
+        }
+
+        /// Referenced objects receive a second chance, and the others are evicted oldest first.
+        XCTAssertEqualObjects([cache objectForKey:@0], @0);
+        XCTAssertTrue([cache incrementUsageCount:@1]);
+        XCTAssertTrue([cache decrementUsageCount:@1]);
+        [cache processCacheEvictions];
+        XCTAssertEqualObjects([NSSet setWithArray:cache.trackedKeys], ([NSSet setWithArray:@[@0, @1, @7, @8, @9]]));
+
+        /// The second chance clears the reference, so an object that is not referenced again is
+        /// evicted once the hand returns to it.
+        for (NSUInteger index = 10; index < 13; index++) {
+            [cache setObject:@(index) forKey:@(index) tracked:YES expires:expires];
+        }
+        XCTAssertEqualObjects([cache objectForKey:@8], @8);
+        [cache processCacheEvictions];
+        XCTAssertEqualObjects([NSSet setWithArray:cache.trackedKeys], ([NSSet setWithArray:@[@1, @8, @10, @11, @12]]));
+    }
+}
+
+
+- (void)testInlineEviction
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.evictionInterval = 6000;
+    config.evictionPolicy = VDSFIFOPolicy;
+    config.preferredMaxObjectCount = 10;
+    config.preferredMaxTotalCost = 1000;
+    config.evictsOnInsert = YES;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+    NSDate* expires = [NSDate dateWithTimeIntervalSinceNow:3000];
+
+    /// The count limit is enforced by each insert without an eviction cycle.
+    for (NSUInteger index = 0; index < 100; index++) {
+        [cache setObject:@(index) forKey:@(index) tracked:YES expires:expires];
+        XCTAssertLessThanOrEqual([[cache trackedKeys] count], 10);
+    }
+    XCTAssertNil([cache objectForKey:@89]);
+    XCTAssertEqualObjects([cache objectForKey:@90], @90);
+    XCTAssertEqualObjects([cache objectForKey:@99], @99);
+
+    /// The cost limit is enforced the same way, evicting as many objects as it takes.
+    [cache setObject:@"large" forKey:@"large" tracked:YES expires:expires cost:800];
+    XCTAssertEqual([[cache trackedKeys] count], 10);
+    [cache setObject:@"larger" forKey:@"larger" tracked:YES expires:expires cost:900];
+    XCTAssertNil([cache objectForKey:@"large"]);
+    XCTAssertEqualObjects([cache objectForKey:@"larger"], @"larger");
+    XCTAssertLessThanOrEqual(cache.totalCost, 1000);
+
+    /// Batches are evicted as they are stored as well.
+    NSMutableArray* keys = [NSMutableArray new];
+    for (NSUInteger index = 100; index < 200; index++) { [keys addObject:@(index)]; }
+    [cache setObjects:keys forKeys:keys tracked:YES expires:expires];
+    XCTAssertEqual([[cache trackedKeys] count], 10);
+    XCTAssertEqualObjects([cache objectForKey:@199], @199);
+
+    /// Untracked objects are never evicted.
+    [cache setObject:@"untracked" forKey:@"untracked" tracked:NO expires:nil cost:5000];
+    XCTAssertEqualObjects([cache objectForKey:@"untracked"], @"untracked");
+}
+
+
+- (void)testScheduledEvictionWithoutRunLoop
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.evictionInterval = 300;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+
+    /// The cycle runs when the object expires rather than when the eviction interval elapses,
+    /// and no run loop is needed to run it.
+    [cache setObject:@"expiring" forKey:@"expiring" tracked:YES expires:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    [cache setObject:@"retained" forKey:@"retained" tracked:YES expires:[NSDate dateWithTimeIntervalSinceNow:3000]];
+    NSDate* timeout = [NSDate dateWithTimeIntervalSinceNow:5];
+    while ([cache objectForKey:@"expiring"] != nil && [timeout timeIntervalSinceNow] > 0) {
+        [NSThread sleepForTimeInterval:0.05];
+    }
+    XCTAssertNil([cache objectForKey:@"expiring"]);
+    XCTAssertEqualObjects([cache objectForKey:@"retained"], @"retained");
+
+    /// The scheduler does not keep caches alive.
+    __weak VDSDatabaseCache* weakCache = nil;
+    @autoreleasepool {
+        VDSDatabaseCache* scheduledCache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+        [scheduledCache setObject:@"expiring" forKey:@"expiring" tracked:YES expires:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+        weakCache = scheduledCache;
+    }
+    XCTAssertNil(weakCache);
+}
+
+
+- (void)testMetrics
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.evictionInterval = 300;
+    config.evictionPolicy = VDSFIFOPolicy;
+    config.preferredMaxObjectCount = 10;
+    config.preferredMaxTotalCost = 1000;
+    config.shardCount = 4;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+    VDSEvictionCycleTestDelegate* delegate = [VDSEvictionCycleTestDelegate new];
+    cache.delegate = delegate;
+
+    NSDate* expires = [NSDate dateWithTimeIntervalSinceNow:3000];
+    for (NSUInteger index = 0; index < 20; index++) {
+        [cache setObject:@(index) forKey:@(index) tracked:YES expires:expires];
+    }
+    [cache setObject:@"replacement" forKey:@0 tracked:YES expires:expires];
+    XCTAssertNotNil([cache objectForKey:@1]);
+    XCTAssertNil([cache objectForKey:@"missing"]);
+    [cache objectsForKeys:@[@2, @3, @"missing"] notFoundMarker:[NSNull null]];
+
+    NSDictionary* metrics = [cache metrics];
+    XCTAssertEqualObjects(metrics[VDSCacheLookupCountKey], @5);
+    XCTAssertEqualObjects(metrics[VDSCacheHitCountKey], @3);
+    XCTAssertEqualObjects(metrics[VDSCacheMissCountKey], @2);
+    XCTAssertEqualObjects(metrics[VDSCacheInsertCountKey], @20);
+    XCTAssertEqualObjects(metrics[VDSCacheReplacementCountKey], @1);
+    XCTAssertEqualObjects(metrics[VDSCacheMergeCountKey], @0);
+    XCTAssertEqualObjects(metrics[VDSCachePeakObjectCountKey], @20);
+
+    /// The cycle evicts enough objects to meet the preferred max object count of each shard,
+    /// and reports what it did to the delegate.
+    [cache processCacheEvictions];
+    metrics = [cache metrics];
+    XCTAssertEqualObjects(metrics[VDSCacheExpiredEvictionCountKey], @0);
+    XCTAssertGreaterThan([metrics[VDSCacheCountEvictionCountKey] integerValue], 0);
+    XCTAssertEqualObjects(metrics[VDSCacheCostEvictionCountKey], @0);
+    XCTAssertEqualObjects(metrics[VDSCacheEvictionCycleCountKey], @1);
+    XCTAssertGreaterThan([metrics[VDSCacheEvictionCycleDurationKey] doubleValue], 0);
+    XCTAssertEqualObjects(metrics[VDSCacheEvictionCycleDurationKey], metrics[VDSCacheLastEvictionCycleDurationKey]);
+
+    NSArray* expectedEvents = @[[@"willBegin:" stringByAppendingString:VDSFIFOPolicyCycleKey],
+                                [@"didComplete:" stringByAppendingString:VDSFIFOPolicyCycleKey]];
+    XCTAssertEqualObjects(delegate.events, expectedEvents);
+    XCTAssertEqualObjects(delegate.cycleMetrics[VDSCacheExpiredEvictionCountKey], @0);
+    XCTAssertEqualObjects(delegate.cycleMetrics[VDSCacheCountEvictionCountKey], metrics[VDSCacheCountEvictionCountKey]);
+    XCTAssertEqualObjects(delegate.cycleMetrics[VDSCacheLastEvictionCycleDurationKey], metrics[VDSCacheLastEvictionCycleDurationKey]);
+
+    /// Expired objects are evicted by the cycle the scheduler runs when they expire.
+    [cache setObject:@"expired" forKey:@"expired" tracked:YES expires:[NSDate distantPast]];
+    NSDate* timeout = [NSDate dateWithTimeIntervalSinceNow:5];
+    while ([[cache metrics][VDSCacheExpiredEvictionCountKey] integerValue] == 0 && [timeout timeIntervalSinceNow] > 0) {
+        [NSThread sleepForTimeInterval:0.05];
+    }
+    XCTAssertEqualObjects([cache metrics][VDSCacheExpiredEvictionCountKey], @1);
+
+    /// Evictions beyond those needed to meet the preferred max object count are counted as cost evictions.
+    [cache setObject:@"large" forKey:@"large" tracked:YES expires:expires cost:5000];
+    [cache processCacheEvictions];
+    XCTAssertGreaterThan([[cache metrics][VDSCacheCostEvictionCountKey] integerValue], 0);
+
+    [cache resetMetrics];
+    metrics = [cache metrics];
+    XCTAssertEqualObjects(metrics[VDSCacheLookupCountKey], @0);
+    XCTAssertEqualObjects(metrics[VDSCacheInsertCountKey], @0);
+    XCTAssertEqualObjects(metrics[VDSCacheCountEvictionCountKey], @0);
+    XCTAssertEqualObjects(metrics[VDSCacheEvictionCycleCountKey], @0);
+    XCTAssertEqualObjects(metrics[VDSCachePeakObjectCountKey], @([[cache allKeys] count]));
+}
+
+
+- (void)testExpirationTimingMap
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.evictionInterval = 300;
+    config.expirationTimingMapKey = [NSExpression expressionWithFormat:@"$VDSEntrySnapshotKey.kind"];
+    config.expirationTimingMap = @{@"date": [NSExpression expressionForConstantValue:[NSDate distantFuture]],
+                                   @"pastDate": [NSExpression expressionForConstantValue:[NSDate distantPast]],
+                                   @"interval": [NSExpression expressionForConstantValue:@3000],
+                                   @"pastInterval": [NSExpression expressionForConstantValue:@(-10)],
+                                   @"function": [NSExpression expressionWithFormat:@"FUNCTION(now(), 'dateByAddingTimeInterval:', 3000)"],
+                                   @"pastFunction": [NSExpression expressionWithFormat:@"FUNCTION(now(), 'dateByAddingTimeInterval:', -10)"],
+                                   @"computed": [NSExpression expressionWithFormat:@"FUNCTION(now(), 'dateByAddingTimeInterval:', $VDSEntrySnapshotKey.ttl)"]};
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+
+    NSDictionary* objects = @{@"date": @{@"kind": @"date"},
+                              @"pastDate": @{@"kind": @"pastDate"},
+                              @"interval": @{@"kind": @"interval"},
+                              @"pastInterval": @{@"kind": @"pastInterval"},
+                              @"function": @{@"kind": @"function"},
+                              @"pastFunction": @{@"kind": @"pastFunction"},
+                              @"computed": @{@"kind": @"computed", @"ttl": @3000},
+                              @"pastComputed": @{@"kind": @"computed", @"ttl": @(-10)},
+                              @"unmapped": @{@"kind": @"unmapped"}};
+    for (NSString* key in objects) {
+        [cache setObject:objects[key] forKey:key tracked:YES];
+    }
+    [cache processCacheEvictions];
+
+    /// Objects whose timing key has no expression expire immediately.
+    NSArray* expected = @[@"computed", @"date", @"function", @"interval"];
+    XCTAssertEqualObjects([[cache allKeys] sortedArrayUsingSelector:@selector(compare:)], expected);
+
+    /// Batches use the timing map as well.
+    [cache removeAllObjects];
+    [cache setObjects:objects.allValues forKeys:objects.allKeys tracked:YES expires:nil];
+    [cache processCacheEvictions];
+    XCTAssertEqualObjects([[cache allKeys] sortedArrayUsingSelector:@selector(compare:)], expected);
+}
+
+
+- (void)testExpirationIntervals
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.evictionInterval = 300;
+    config.defaultExpirationInterval = -10;
+    config.expirationIntervals = @{@"Person": @3000,
+                                   @"Session": @(-10),
+                                   @"VDSCostedTestObject": @3000,
+                                   @"NSString": @3000};
+    config.expirationTimingMapKey = [NSExpression expressionWithFormat:@"$VDSEntrySnapshotKey.kind"];
+    config.expirationTimingMap = @{@"mapped": [NSExpression expressionForConstantValue:@3000]};
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+
+    /// Entity names are matched by value, so names built at runtime are found.
+    NSString* person = [@"Per" stringByAppendingString:@"son"];
+    NSDictionary* objects = @{@"keyEntity": @{@"name": @"object"},
+                              @"objectEntity": @{VDSEntryEntityNameKey: person},
+                              @"pastEntity": @{VDSEntryEntityNameKey: @"Session"},
+                              @"class": [[VDSCostedTestObject alloc] initWithCost:1],
+                              @"superclass": [NSMutableString stringWithString:@"object"],
+                              @"mapped": @{@"kind": @"mapped"},
+                              @"unmapped": @{@"kind": @"unmapped"}};
+    NSDictionary* keys = @{@"keyEntity": @{VDSEntryEntityNameKey: @"Person", @"id": @1}};
+    for (NSString* name in objects) {
+        [cache setObject:objects[name] forKey:keys[name] ?: name tracked:YES];
+    }
+    [cache processCacheEvictions];
+
+    /// Objects without an interval fall back to the timing map. Classes are matched by their
+    /// nearest superclass in the table.
+    NSSet* expected = [NSSet setWithObjects:keys[@"keyEntity"], @"objectEntity", @"class", @"superclass", @"mapped", nil];
+    XCTAssertEqualObjects([NSSet setWithArray:[cache allKeys]], expected);
+
+    /// Batches use the intervals as well.
+    [cache removeAllObjects];
+    NSMutableArray* batchKeys = [NSMutableArray new];
+    NSMutableArray* batchObjects = [NSMutableArray new];
+    for (NSString* name in objects) {
+        [batchKeys addObject:keys[name] ?: name];
+        [batchObjects addObject:objects[name]];
+    }
+    [cache setObjects:batchObjects forKeys:batchKeys tracked:YES expires:nil];
+    [cache processCacheEvictions];
+    XCTAssertEqualObjects([NSSet setWithArray:[cache allKeys]], expected);
+}
+
+
+- (void)testSnapshot
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.evictionInterval = 6000;
+    config.evictionPolicy = VDSFIFOPolicy;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+    NSDate* expires = [NSDate dateWithTimeIntervalSinceNow:3000];
+
+    for (NSUInteger index = 0; index < 10; index++) {
+        [cache setObject:[NSString stringWithFormat:@"object %lu", (unsigned long)index] forKey:@(index) tracked:YES expires:expires cost:index];
+    }
+    /// Updating an object moves it to the head of the recency order.
+    [cache setObject:@"object 0" forKey:@0 tracked:YES expires:expires cost:0];
+    [cache setObject:[@"untracked" dataUsingEncoding:NSUTF8StringEncoding] forKey:@"untracked" tracked:NO expires:nil cost:100];
+    [cache setObject:@"expiring" forKey:@"expiring" tracked:YES expires:[NSDate dateWithTimeIntervalSinceNow:0.2] cost:0];
+
+    NSURL* url = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString]];
+    NSError* error = nil;
+    XCTAssertTrue([cache writeSnapshotToURL:url serializer:nil error:&error]);
+    XCTAssertNil(error);
+
+    /// Entries that expire before the snapshot is loaded are skipped.
+    [NSThread sleepForTimeInterval:0.3];
+    config.preferredMaxObjectCount = 5;
+    VDSDatabaseCache* restored = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+    XCTAssertTrue([restored loadSnapshotFromURL:url serializer:nil error:&error]);
+    XCTAssertNil(error);
+    XCTAssertNil([restored objectForKey:@"expiring"]);
+    XCTAssertEqualObjects([restored objectForKey:@"untracked"], [@"untracked" dataUsingEncoding:NSUTF8StringEncoding]);
+    XCTAssertEqualObjects([restored objectForKey:@9], @"object 9");
+    XCTAssertEqual([[restored trackedKeys] count], 10);
+    XCTAssertEqual(restored.totalCost, 145);
+
+    /// The recency order is restored, so the oldest objects are evicted first.
+    [restored processCacheEvictions];
+    NSSet* expected = [NSSet setWithObjects:@6, @7, @8, @9, @0, nil];
+    XCTAssertEqualObjects([NSSet setWithArray:[restored trackedKeys]], expected);
+
+    /// A snapshot with a corrupt record fails to load and leaves the cache unchanged.
+    XCTAssertTrue([cache writeSnapshotToURL:url serializer:nil error:&error]);
+    NSMutableData* corrupt = [NSMutableData dataWithContentsOfURL:url];
+    ((uint8_t*)corrupt.mutableBytes)[corrupt.length / 2] ^= 0xFF;
+    [corrupt writeToURL:url atomically:YES];
+    XCTAssertFalse([restored loadSnapshotFromURL:url serializer:nil error:&error]);
+    XCTAssertEqual(error.code, VDSCacheSnapshotReadFailed);
+    XCTAssertEqual([[restored allKeys] count], 6);
+
+    /// A file that is not a snapshot fails to load and leaves the cache unchanged.
+    [[@"not a snapshot" dataUsingEncoding:NSUTF8StringEncoding] writeToURL:url atomically:YES];
+    XCTAssertFalse([restored loadSnapshotFromURL:url serializer:nil error:&error]);
+    XCTAssertEqualObjects(error.domain, VDSKitErrorDomain);
+    XCTAssertEqual(error.code, VDSCacheSnapshotReadFailed);
+    XCTAssertEqual([[restored allKeys] count], 6);
+    [[NSFileManager defaultManager] removeItemAtURL:url error:NULL];
+}
+
+
+- (void)testStandardSerializer
+{
+    VDSDatabaseCacheStandardSerializer* serializer = [VDSDatabaseCacheStandardSerializer new];
+    NSArray* values = @[@"string", @"", @"ünïcödé", @42, @(-7), @(UINT64_MAX), @3.25, @YES, @NO,
+                        [@"data" dataUsingEncoding:NSUTF8StringEncoding],
+                        [NSDate dateWithTimeIntervalSinceReferenceDate:1000], @[@1, @"two"]];
+    for (id value in values) {
+        NSData* data = [serializer serializedDataForObject:value];
+        XCTAssertNotNil(data);
+        XCTAssertEqualObjects([serializer objectWithSerializedData:data], value);
+    }
+    XCTAssertNil([serializer serializedDataForObject:[NSObject new]]);
+
+    /// Archived objects are only decoded as instances of the allowed classes.
+    NSURL* url = [NSURL URLWithString:@"https://example.com"];
+    NSData* data = [serializer serializedDataForObject:url];
+    XCTAssertNotNil(data);
+    XCTAssertNil([serializer objectWithSerializedData:data]);
+    VDSDatabaseCacheStandardSerializer* urlSerializer = [[VDSDatabaseCacheStandardSerializer alloc] initWithAllowedClasses:[NSSet setWithObject:[NSURL class]]];
+    XCTAssertEqualObjects([urlSerializer objectWithSerializedData:data], url);
+
+    /// A corrupt archive is converted to nil.
+    NSMutableData* corrupt = [data mutableCopy];
+    [corrupt setLength:corrupt.length / 2];
+    XCTAssertNil([urlSerializer objectWithSerializedData:corrupt]);
+}
+
+
+- (void)testSlicedEvictionCycle
+{
+    for (NSNumber* policy in @[@(VDSFIFOPolicy), @(VDSTinyLFUPolicy), @(VDS2QPolicy)]) {
+        VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+        config.expiresObjects = YES;
+        config.evictionInterval = 6000;
+        config.evictionPolicy = policy.integerValue;
+        config.preferredMaxObjectCount = 10;
+        config.evictionBatchSize = 3;
+        VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+        VDSEvictionCycleTestDelegate* delegate = [VDSEvictionCycleTestDelegate new];
+        cache.delegate = delegate;
+        NSDate* expires = [NSDate dateWithTimeIntervalSinceNow:3000];
+
+        for (NSUInteger index = 0; index < 100; index++) {
+            [cache setObject:@(index) forKey:@(index) tracked:YES expires:expires];
+        }
+        for (NSUInteger index = 0; index < 20; index++) {
+            [cache setObject:@(index) forKey:[NSString stringWithFormat:@"expiring %lu", (unsigned long)index] tracked:YES expires:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+        }
+        [NSThread sleepForTimeInterval:0.2];
+
+        /// The cycle releases the lock every 3 evictions and still completes all of its work.
+        [cache processCacheEvictions];
+        XCTAssertEqual([[cache trackedKeys] count], 10);
+        XCTAssertEqualObjects(delegate.cycleMetrics[VDSCacheExpiredEvictionCountKey], @20);
+        XCTAssertEqualObjects(delegate.cycleMetrics[VDSCacheCountEvictionCountKey], @90);
+        if (policy.integerValue == VDSFIFOPolicy) {
+            XCTAssertEqualObjects([cache objectForKey:@99], @99);
+            XCTAssertNil([cache objectForKey:@89]);
+        }
+    }
+
+    /// A time slice bounds the cycle in the same way.
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.evictionInterval = 6000;
+    config.preferredMaxObjectCount = 1000;
+    config.evictionTimeSlice = 0.000001;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+    NSDate* expires = [NSDate dateWithTimeIntervalSinceNow:3000];
+    for (NSUInteger index = 0; index < 10000; index++) {
+        [cache setObject:@(index) forKey:@(index) tracked:YES expires:expires];
+    }
+    [cache processCacheEvictions];
+    XCTAssertEqual([[cache trackedKeys] count], 1000);
+    XCTAssertEqualObjects([cache objectForKey:@9999], @9999);
+}
+
+
+- (void)testMergeableUpdates
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.evictionInterval = 0;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+    NSDate* expires = [NSDate dateWithTimeIntervalSinceNow:3000];
+
+    /// Only the values the update reports as changed are merged.
+    VDSMergeableTestObject* cached = [VDSMergeableTestObject new];
+    cached.name = @"first";
+    cached.value = @1;
+    [cache setObject:cached forKey:@"merged" tracked:YES expires:expires];
+    VDSMergeableTestObject* update = [VDSMergeableTestObject new];
+    update.name = @"ignored";
+    update.value = @2;
+    update.changedMergeableKeyMask = 1 << 1;
+    [cache setObject:update forKey:@"merged" tracked:YES expires:expires];
+    XCTAssertEqual([cache objectForKey:@"merged"], cached);
+    XCTAssertEqualObjects(cached.name, @"first");
+    XCTAssertEqualObjects(cached.value, @2);
+    XCTAssertEqual(cached.mergedValueCount, 1);
+
+    /// An update with no changes is skipped, leaving the expiration as it was.
+    update.changedMergeableKeyMask = 0;
+    [cache setObject:update forKey:@"merged" tracked:YES expires:[NSDate distantPast]];
+    XCTAssertEqual(cached.mergedValueCount, 1);
+
+    /// Objects that merge in a single call report whether the update changed them.
+    VDSBulkMergeableTestObject* bulk = [VDSBulkMergeableTestObject new];
+    bulk.name = @"bulk";
+    bulk.value = @1;
+    [cache setObject:bulk forKey:@"bulk" tracked:YES expires:expires];
+    VDSMergeableTestObject* bulkUpdate = [VDSMergeableTestObject new];
+    bulkUpdate.name = @"bulk";
+    bulkUpdate.value = @1;
+    [cache setObject:bulkUpdate forKey:@"bulk" tracked:YES expires:[NSDate distantPast]];
+    bulkUpdate.value = @3;
+    [cache setObjects:@[bulkUpdate] forKeys:@[@"bulk"] tracked:YES expires:expires];
+    XCTAssertEqualObjects(bulk.value, @3);
+    XCTAssertEqual(bulk.mergedValueCount, 0);
+
+    [cache processCacheEvictions];
+    XCTAssertEqual([cache objectForKey:@"merged"], cached);
+    XCTAssertEqual([cache objectForKey:@"bulk"], bulk);
+
+    NSDictionary* metrics = [cache metrics];
+    XCTAssertEqualObjects(metrics[VDSCacheMergeCountKey], @2);
+    XCTAssertEqualObjects(metrics[VDSCacheUnchangedMergeCountKey], @2);
+
+    /// A changed update takes the expiration it is stored with.
+    update.changedMergeableKeyMask = 1;
+    [cache setObject:update forKey:@"merged" tracked:YES expires:[NSDate distantPast]];
+    [cache processCacheEvictions];
+    XCTAssertNil([cache objectForKey:@"merged"]);
+}
+
+
+- (void)testLoaderCoalescesConcurrentMisses
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.evictionInterval = 0;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+    cache.defaultExpirationInterval = 3000;
+
+    /// Every concurrent request waits for a single load, which completes after all of them have missed.
+    __block NSInteger loadCount = 0;
+    dispatch_semaphore_t release = dispatch_semaphore_create(0);
+    VDSDatabaseCacheLoader loader = ^(id key, VDSDatabaseCacheLoadCompletion completion) {
+        @synchronized (cache) { loadCount++; }
+        dispatch_async(dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+            dispatch_semaphore_wait(release, DISPATCH_TIME_FOREVER);
+            completion([NSString stringWithFormat:@"loaded %@", key], nil);
+        });
+    };
+    dispatch_group_t requests = dispatch_group_create();
+    NSMutableArray* results = [NSMutableArray new];
+    for (NSUInteger index = 0; index < 16; index++) {
+        dispatch_group_enter(requests);
+        dispatch_async(dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+            [cache objectForKey:@"hot" loader:loader completion:^(id object, NSError* error) {
+                @synchronized (results) { [results addObject:object ?: [NSNull null]]; }
+                dispatch_group_leave(requests);
+            }];
+        });
+    }
+    [NSThread sleepForTimeInterval:0.2];
+    dispatch_semaphore_signal(release);
+    XCTAssertEqual(dispatch_group_wait(requests, dispatch_time(DISPATCH_TIME_NOW, 5 * NSEC_PER_SEC)), 0);
+    XCTAssertEqual(loadCount, 1);
+    XCTAssertEqual(results.count, 16);
+    for (id object in results) { XCTAssertEqualObjects(object, @"loaded hot"); }
+    XCTAssertEqualObjects([cache trackedKeys], @[@"hot"]);
+    XCTAssertEqualObjects([cache metrics][VDSCacheInsertCountKey], @1);
+
+    /// Cached objects are returned without loading.
+    NSError* error = nil;
+    XCTAssertEqualObjects([cache objectForKey:@"hot" loader:loader error:&error], @"loaded hot");
+    XCTAssertEqual(loadCount, 1);
+
+    /// Failures reach the caller and nothing is stored.
+    NSError* failure = [NSError errorWithDomain:VDSKitErrorDomain code:VDSEntryNotFound userInfo:nil];
+    id object = [cache objectForKey:@"missing" loader:^(id key, VDSDatabaseCacheLoadCompletion completion) {
+        completion(nil, failure);
+    } error:&error];
+    XCTAssertNil(object);
+    XCTAssertEqualObjects(error, failure);
+    XCTAssertNil([cache objectForKey:@"missing"]);
+
+    /// Loads may run as operations on a queue, and a cancelled load reports an error.
+    VDSOperationQueue* queue = [VDSOperationQueue new];
+    XCTestExpectation* queued = [self expectationWithDescription:@"queued load"];
+    [cache objectForKey:@"queued" loader:^(id key, VDSDatabaseCacheLoadCompletion completion) {
+        completion(@"from queue", nil);
+    } queue:queue completion:^(id object, NSError* error) {
+        XCTAssertEqualObjects(object, @"from queue");
+        XCTAssertNil(error);
+        [queued fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertEqualObjects([cache objectForKey:@"queued"], @"from queue");
+
+    queue.suspended = YES;
+    XCTestExpectation* cancelled = [self expectationWithDescription:@"cancelled load"];
+    [cache objectForKey:@"cancelled" loader:^(id key, VDSDatabaseCacheLoadCompletion completion) {
+        completion(@"never", nil);
+    } queue:queue completion:^(id object, NSError* error) {
+        XCTAssertNil(object);
+        XCTAssertEqual(error.code, VDSCacheLoadCancelled);
+        [cancelled fulfill];
+    }];
+    [queue cancelAllOperations];
+    queue.suspended = NO;
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertNil([cache objectForKey:@"cancelled"]);
+}
+
+
+- (void)testStaleObjectsRefreshInBackground
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.evictionInterval = 0;
+    config.refreshInterval = 0.2;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+    cache.defaultExpirationInterval = 0.6;
+
+    __block NSInteger refreshCount = 0;
+    dispatch_semaphore_t refreshed = dispatch_semaphore_create(0);
+    cache.refreshLoader = ^(id key, VDSDatabaseCacheLoadCompletion completion) {
+        @synchronized (cache) { refreshCount++; }
+        completion([NSString stringWithFormat:@"refreshed %@", key], nil);
+        dispatch_semaphore_signal(refreshed);
+    };
+    [cache setObject:@"original" forKey:@"key" tracked:YES];
+    [cache setObject:@"untracked" forKey:@"untracked"];
+    XCTAssertEqualObjects([cache objectForKey:@"key"], @"original");
+    XCTAssertEqual(refreshCount, 0);
+
+    /// A stale object is still returned, and only the first stale read starts a refresh.
+    [NSThread sleepForTimeInterval:0.3];
+    XCTAssertEqualObjects([cache objectForKey:@"key"], @"original");
+    XCTAssertEqual(dispatch_semaphore_wait(refreshed, dispatch_time(DISPATCH_TIME_NOW, 5 * NSEC_PER_SEC)), 0);
+    XCTAssertEqualObjects([cache objectForKey:@"key"], @"refreshed key");
+    XCTAssertEqual(refreshCount, 1);
+    XCTAssertEqualObjects([cache metrics][VDSCacheStaleHitCountKey], @1);
+
+    /// Without a refresh, an object is not returned once it reaches its expiration.
+    cache.refreshLoader = nil;
+    [NSThread sleepForTimeInterval:0.7];
+    XCTAssertNil([cache objectForKey:@"key"]);
+    XCTAssertEqualObjects([cache objectsForKeys:@[@"key"] notFoundMarker:[NSNull null]], @[[NSNull null]]);
+    XCTAssertEqualObjects([cache objectForKey:@"untracked"], @"untracked");
+
+    /// A stale object returned to a loader request is refreshed with that loader.
+    [cache setObject:@"original" forKey:@"key" tracked:YES];
+    [NSThread sleepForTimeInterval:0.3];
+    NSError* error = nil;
+    id object = [cache objectForKey:@"key" loader:^(id key, VDSDatabaseCacheLoadCompletion completion) {
+        completion(@"reloaded", nil);
+        dispatch_semaphore_signal(refreshed);
+    } error:&error];
+    XCTAssertEqualObjects(object, @"original");
+    XCTAssertEqual(dispatch_semaphore_wait(refreshed, dispatch_time(DISPATCH_TIME_NOW, 5 * NSEC_PER_SEC)), 0);
+    XCTAssertEqualObjects([cache objectForKey:@"key"], @"reloaded");
+}
+
+- (void)testEvictionDelegateFiltersEvictions
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.evictionInterval = 0;
+    config.evictionPolicy = VDSFIFOPolicy;
+    config.preferredMaxObjectCount = 5;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+    VDSEvictionFilterTestDelegate* delegate = [VDSEvictionFilterTestDelegate new];
+    delegate.keptKeys = [NSSet setWithObjects:@0, @9, nil];
+    cache.delegate = delegate;
+
+    NSDate* future = [NSDate dateWithTimeIntervalSinceNow:3000];
+    for (NSUInteger index = 0; index < 8; index++) {
+        [cache setObject:@(index) forKey:@(index) tracked:YES expires:future];
+    }
+    [cache setObject:@9 forKey:@9 tracked:YES expires:[NSDate distantPast]];
+
+    /// A delegate that declines the cycle leaves the cache as it is.
+    delegate.declinesCycles = YES;
+    [cache processCacheEvictions];
+    XCTAssertNil(delegate.consultedKeys);
+    XCTAssertEqual(cache.trackedKeys.count, 9);
+
+    /// The delegate is consulted about every selected object at once, and the objects it keeps remain tracked.
+    delegate.declinesCycles = NO;
+    [cache processCacheEvictions];
+    XCTAssertEqualObjects([NSSet setWithArray:delegate.consultedKeys], ([NSSet setWithArray:@[@9, @0, @1, @2]]));
+    XCTAssertEqualObjects([NSSet setWithArray:delegate.willEvictKeys], ([NSSet setWithArray:@[@1, @2]]));
+    XCTAssertEqual(dispatch_semaphore_wait(delegate.didEvict, dispatch_time(DISPATCH_TIME_NOW, 5 * NSEC_PER_SEC)), 0);
+    XCTAssertEqualObjects([NSSet setWithArray:delegate.didEvictKeys], ([NSSet setWithArray:@[@1, @2]]));
+    XCTAssertEqual(cache.trackedKeys.count, 7);
+    XCTAssertEqualObjects([cache objectForKey:@0], @0);
+    XCTAssertEqualObjects([cache objectForKey:@9], @9);
+    XCTAssertNil([cache objectForKey:@1]);
+    XCTAssertEqual(cache.untrackedKeys.count, 0);
+    XCTAssertEqualObjects([cache metrics][VDSCacheCountEvictionCountKey], @2);
+    XCTAssertEqualObjects([cache metrics][VDSCacheExpiredEvictionCountKey], @0);
+
+    /// Kept objects are reconsidered by later cycles, and are evicted once the delegate approves.
+    delegate.keptKeys = [NSSet set];
+    [cache processCacheEvictions];
+    XCTAssertEqual(dispatch_semaphore_wait(delegate.didEvict, dispatch_time(DISPATCH_TIME_NOW, 5 * NSEC_PER_SEC)), 0);
+    XCTAssertNil([cache objectForKey:@9]);
+    XCTAssertEqualObjects([cache metrics][VDSCacheExpiredEvictionCountKey], @1);
+}
+
+
+- (void)testPendingEvictionsDuringConsultation
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.tracksObjectUsage = YES;
+    config.evictionInterval = 0;
+    config.evictionPolicy = VDSFIFOPolicy;
+    config.preferredMaxObjectCount = 2;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+    VDSEvictionFilterTestDelegate* delegate = [VDSEvictionFilterTestDelegate new];
+    delegate.keptKeys = [NSSet set];
+    cache.delegate = delegate;
+
+    NSDate* future = [NSDate dateWithTimeIntervalSinceNow:3000];
+    for (NSUInteger index = 0; index < 5; index++) {
+        [cache setObject:@(index) forKey:@(index) tracked:YES expires:future];
+    }
+    [cache setObject:@"plain" forKey:@"plain"];
+
+    /// While the delegate is consulted, the selected objects are neither tracked nor reported as
+    /// untracked, and their usage counts can still change.
+    __block NSArray* untrackedKeys = nil;
+    __block NSUInteger trackedCount = 0;
+    __block BOOL incremented = NO;
+    delegate.whileConsulted = ^(VDSDatabaseCache* consultedCache) {
+        untrackedKeys = consultedCache.untrackedKeys;
+        trackedCount = consultedCache.trackedKeys.count;
+        incremented = [consultedCache incrementUsageCount:@0];
+        [consultedCache setObject:@1 forKey:@1 tracked:NO];
+    };
+    [cache processCacheEvictions];
+    XCTAssertEqualObjects([NSSet setWithArray:delegate.consultedKeys], ([NSSet setWithArray:@[@0, @1, @2]]));
+    XCTAssertEqualObjects(untrackedKeys, @[@"plain"]);
+    XCTAssertEqual(trackedCount, 2);
+    XCTAssertTrue(incremented);
+
+    /// An object put in use is restored with its new usage count, and an object stored again is left
+    /// as it was stored, even though the delegate approved both evictions.
+    XCTAssertEqual(dispatch_semaphore_wait(delegate.didEvict, dispatch_time(DISPATCH_TIME_NOW, 5 * NSEC_PER_SEC)), 0);
+    XCTAssertEqualObjects(delegate.didEvictKeys, @[@2]);
+    XCTAssertEqualObjects([NSSet setWithArray:cache.trackedKeys], ([NSSet setWithArray:@[@0, @3, @4]]));
+    XCTAssertEqualObjects([NSSet setWithArray:cache.untrackedKeys], ([NSSet setWithArray:@[@"plain", @1]]));
+    XCTAssertTrue([cache decrementUsageCount:@0]);
+    XCTAssertTrue([cache decrementUsageCount:@0]);
+    XCTAssertFalse([cache decrementUsageCount:@0]);
+    XCTAssertEqualObjects([cache metrics][VDSCacheCountEvictionCountKey], @1);
+}
+
+
+- (void)testPendingEvictionsAreLeftOutOfCollections
+{
+    VDSMutableDatabaseCacheConfiguration* config = [VDSMutableDatabaseCacheConfiguration new];
+    config.expiresObjects = YES;
+    config.tracksObjectUsage = YES;
+    config.evictionInterval = 0;
+    config.evictionPolicy = VDSFIFOPolicy;
+    config.preferredMaxObjectCount = 2;
+    VDSDatabaseCache* cache = [[VDSDatabaseCache alloc] initWithConfiguration:config];
+    VDSEvictionFilterTestDelegate* delegate = [VDSEvictionFilterTestDelegate new];
+    delegate.keptKeys = [NSSet setWithObject:@0];
+    cache.delegate = delegate;
+
+    NSDate* future = [NSDate dateWithTimeIntervalSinceNow:3000];
+    for (NSUInteger index = 0; index < 5; index++) {
+        [cache setObject:@(index) forKey:@(index) tracked:YES expires:future];
+    }
+    [cache setObject:@"plain" forKey:@"plain"];
+
+    /// Enumerating before the cycle leaves a copy of the keys that the cycle must not reuse.
+    NSMutableSet* enumeratedKeys = [NSMutableSet set];
+    for (id key in cache) { [enumeratedKeys addObject:key]; }
+    XCTAssertEqual(enumeratedKeys.count, 6);
+
+    /// Every collection accessor agrees with the tracked and untracked accessors while the selected
+    /// objects are pending.
+    NSSet* remainingKeys = [NSSet setWithArray:@[@3, @4, @"plain"]];
+    __block NSSet* partitionedKeys = nil;
+    __block NSArray* allKeys = nil;
+    __block NSArray* allObjects = nil;
+    __block NSDictionary* allObjectsAndKeys = nil;
+    [enumeratedKeys removeAllObjects];
+    delegate.whileConsulted = ^(VDSDatabaseCache* consultedCache) {
+        partitionedKeys = [NSSet setWithArray:[consultedCache.trackedKeys arrayByAddingObjectsFromArray:consultedCache.untrackedKeys]];
+        allKeys = consultedCache.allKeys;
+        allObjects = consultedCache.allObjects;
+        allObjectsAndKeys = consultedCache.allObjectsAndKeys;
+        for (id key in consultedCache) { [enumeratedKeys addObject:key]; }
+    };
+    [cache processCacheEvictions];
+    XCTAssertEqualObjects([NSSet setWithArray:delegate.consultedKeys], ([NSSet setWithArray:@[@0, @1, @2]]));
+    XCTAssertEqualObjects(partitionedKeys, remainingKeys);
+    XCTAssertEqual(allKeys.count, 3);
+    XCTAssertEqualObjects([NSSet setWithArray:allKeys], remainingKeys);
+    XCTAssertEqualObjects([NSSet setWithArray:allObjects], ([NSSet setWithArray:@[@3, @4, @"plain"]]));
+    XCTAssertEqualObjects([NSSet setWithArray:allObjectsAndKeys.allKeys], remainingKeys);
+    XCTAssertEqualObjects(enumeratedKeys, remainingKeys);
+
+    /// The kept object is tracked again and reappears in every collection.
+    XCTAssertEqual(dispatch_semaphore_wait(delegate.didEvict, dispatch_time(DISPATCH_TIME_NOW, 5 * NSEC_PER_SEC)), 0);
+    XCTAssertEqualObjects([NSSet setWithArray:cache.allKeys], ([NSSet setWithArray:@[@0, @3, @4, @"plain"]]));
+    [enumeratedKeys removeAllObjects];
+    for (id key in cache) { [enumeratedKeys addObject:key]; }
+    XCTAssertEqualObjects(enumeratedKeys, ([NSSet setWithArray:@[@0, @3, @4, @"plain"]]));
+}
+
 
 @end
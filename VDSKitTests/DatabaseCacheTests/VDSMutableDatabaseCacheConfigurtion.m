@@ -34,6 +34,15 @@
     XCTAssert(config.evictionInterval == 0.0);
     XCTAssertNil(config.expirationTimingMapKey);
     XCTAssertNil(config.expirationTimingMap);
+    XCTAssert(config.shardCount == 0);
+    XCTAssertFalse(config.usesLockFreeReads);
+    XCTAssert(config.preferredMaxTotalCost == 0);
+    XCTAssertFalse(config.evictsOnInsert);
+    XCTAssertNil(config.expirationIntervals);
+    XCTAssertEqual(config.evictionBatchSize, 0);
+    XCTAssertEqual(config.evictionTimeSlice, 0);
+    XCTAssertEqual(config.refreshInterval, 0);
+    XCTAssertEqual(config.evictionConcurrency, 0);
     
     config = nil;
     config = [VDSMutableDatabaseCacheConfiguration new];
@@ -49,6 +58,15 @@
     XCTAssert(config.evictionInterval == 0.0);
     XCTAssertNil(config.expirationTimingMapKey);
     XCTAssertNil(config.expirationTimingMap);
+    XCTAssert(config.shardCount == 0);
+    XCTAssertFalse(config.usesLockFreeReads);
+    XCTAssert(config.preferredMaxTotalCost == 0);
+    XCTAssertFalse(config.evictsOnInsert);
+    XCTAssertNil(config.expirationIntervals);
+    XCTAssertEqual(config.evictionBatchSize, 0);
+    XCTAssertEqual(config.evictionTimeSlice, 0);
+    XCTAssertEqual(config.refreshInterval, 0);
+    XCTAssertEqual(config.evictionConcurrency, 0);
     
 }
 
@@ -67,7 +85,16 @@
                                  VDSCacheEvictionPolicyKey: @(VDSFIFOPolicy),
                                  VDSCacheEvictionIntervalKey: @(300.0),
                                  VDSCacheExpirationTimingMapExpressionKey: expression,
-                                 VDSCacheExpirationTimingMapKey: expressionMap
+                                 VDSCacheExpirationTimingMapKey: expressionMap,
+                                 VDSCacheShardCountKey: @8,
+                                 VDSCacheUsesLockFreeReadsKey: @YES,
+                                 VDSCachePreferredMaxTotalCostKey: @(1 << 20),
+                                 VDSCacheEvictsOnInsertKey: @YES,
+                                 VDSCacheExpirationIntervalsKey: @{@"Person": @60},
+                                 VDSCacheEvictionBatchSizeKey: @500,
+                                 VDSCacheEvictionTimeSliceKey: @0.0005,
+                                 VDSCacheRefreshIntervalKey: @45,
+                                 VDSCacheEvictionConcurrencyKey: @4
     };
     
     VDSMutableDatabaseCacheConfiguration* config = [[VDSMutableDatabaseCacheConfiguration alloc] initWithDictionary:configDict];
@@ -85,6 +112,15 @@
     XCTAssertNotNil(config.expirationTimingMap);
     XCTAssertEqualObjects(expression, config.expirationTimingMapKey);
     XCTAssertEqualObjects(expressionMap, config.expirationTimingMap);
+    XCTAssert(config.shardCount == 8);
+    XCTAssertTrue(config.usesLockFreeReads);
+    XCTAssert(config.preferredMaxTotalCost == 1 << 20);
+    XCTAssertTrue(config.evictsOnInsert);
+    XCTAssertEqualObjects(config.expirationIntervals, @{@"Person": @60});
+    XCTAssertEqual(config.evictionBatchSize, 500);
+    XCTAssertEqual(config.evictionTimeSlice, 0.0005);
+    XCTAssertEqual(config.refreshInterval, 45);
+    XCTAssertEqual(config.evictionConcurrency, 4);
     
     config.expiresObjects = YES;
     XCTAssertTrue(config.expiresObjects);
@@ -118,6 +154,34 @@
     
     config.expirationTimingMap = nil;
     XCTAssertNil(config.expirationTimingMap);
+    
+    config.shardCount = 16;
+    XCTAssertEqual(config.shardCount, 16);
+    
+    config.usesLockFreeReads = NO;
+    XCTAssertFalse(config.usesLockFreeReads);
+    
+    config.preferredMaxTotalCost = 4096;
+    XCTAssertEqual(config.preferredMaxTotalCost, 4096);
+    
+    config.evictsOnInsert = YES;
+    XCTAssertTrue(config.evictsOnInsert);
+    
+    config.expirationIntervals = @{@"NSString": @30};
+    XCTAssertEqualObjects(config.expirationIntervals, @{@"NSString": @30});
+    config.expirationIntervals = nil;
+    XCTAssertNil(config.expirationIntervals);
+    
+    config.evictionBatchSize = 250;
+    XCTAssertEqual(config.evictionBatchSize, 250);
+    
+    config.evictionTimeSlice = 0.001;
+    XCTAssertEqual(config.evictionTimeSlice, 0.001);
+    
+    config.refreshInterval = 20;
+    XCTAssertEqual(config.refreshInterval, 20);
+    config.evictionConcurrency = 2;
+    XCTAssertEqual(config.evictionConcurrency, 2);
 }
 
 @end